@@ -1,14 +1,320 @@
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include <iostream>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <queue>
 #include <cmath>
 #include <chrono>
 #include <thread>
 #include <sstream>
+#include <algorithm>
+#include <random>
+#include <atomic>
+#include <memory>
+#include <cctype>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <charconv>
+#include <new>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <cstdio>
+#include <coroutine>
+#include <bit>
+#include <cstdint>
+#include <utility>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#ifdef USE_PARALLEL_STL
+#include <execution>
+#endif
 #include <SFML/Graphics.hpp>
 
+// Counts every allocation made through the global operator new, so the profiler can
+// report allocations per frame. The replacements are kept out of line: once GCC
+// inlines them it pairs the free() with operator new and warns about a mismatch.
+static std::atomic<unsigned long long> allocationCount{0};
+
+#if defined(__GNUC__) && !defined(__clang__)
+#define ALLOCATOR_NOINLINE __attribute__((noinline))
+#else
+#define ALLOCATOR_NOINLINE
+#endif
+
+ALLOCATOR_NOINLINE void* operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1)) return memory;
+    throw std::bad_alloc();
+}
+
+ALLOCATOR_NOINLINE void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+ALLOCATOR_NOINLINE void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+// Per-frame timings and counters for the F3 overlay. Phases are accumulated with
+// ProfileScope during the frame and pushed into rolling windows by endFrame().
+class FrameProfiler {
+public:
+    enum Phase { Events, Update, Layout, Render, Frame, PHASE_COUNT };
+
+    static constexpr int WINDOW = 240;   // frames kept for percentiles
+
+    static FrameProfiler& shared() {
+        static FrameProfiler profiler;
+        return profiler;
+    }
+
+    void beginFrame() {
+        frameStart = std::chrono::steady_clock::now();
+        allocationsAtStart = allocationCount.load(std::memory_order_relaxed);
+        for (double& time : current) time = 0;
+        drawCalls = 0;
+        vertices = 0;
+    }
+
+    void endFrame() {
+        current[Frame] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+        for (int phase = 0; phase < PHASE_COUNT; ++phase) history[phase][cursor] = static_cast<float>(current[phase]);
+        allocationHistory[cursor] = static_cast<float>(allocationCount.load(std::memory_order_relaxed) - allocationsAtStart);
+        lastDrawCalls = drawCalls;
+        lastVertices = vertices;
+        cursor = (cursor + 1) % WINDOW;
+        frames = std::min(frames + 1, WINDOW);
+    }
+
+    void add(Phase phase, double milliseconds) {
+        current[phase] += milliseconds;
+    }
+
+    void countDraw(size_t vertexCount) {
+        ++drawCalls;
+        vertices += vertexCount;
+    }
+
+    // Percentile of a phase over the rolling window, in milliseconds
+    float percentile(Phase phase, float fraction) const {
+        return percentileOf(history[phase], fraction);
+    }
+
+    float allocationPercentile(float fraction) const {
+        return percentileOf(allocationHistory, fraction);
+    }
+
+    size_t getDrawCalls() const { return lastDrawCalls; }
+    size_t getVertices() const { return lastVertices; }
+
+private:
+    std::chrono::steady_clock::time_point frameStart;
+    unsigned long long allocationsAtStart = 0;
+    double current[PHASE_COUNT] = {};
+    float history[PHASE_COUNT][WINDOW] = {};
+    float allocationHistory[WINDOW] = {};
+    int cursor = 0;
+    int frames = 0;
+    size_t drawCalls = 0, vertices = 0;
+    size_t lastDrawCalls = 0, lastVertices = 0;
+
+    float percentileOf(const float* samples, float fraction) const {
+        if (frames == 0) return 0;
+        float sorted[WINDOW];
+        std::copy(samples, samples + frames, sorted);
+        int rank = std::min(frames - 1, static_cast<int>(fraction * frames));
+        std::nth_element(sorted, sorted + rank, sorted + frames);
+        return sorted[rank];
+    }
+};
+
+// Adds the time spent in the enclosing block to a profiler phase. Scopes nest: an
+// inner scope (Layout inside Update or Render) stops the outer phase's clock until it
+// closes, so no time is counted twice.
+class ProfileScope {
+public:
+    explicit ProfileScope(FrameProfiler::Phase phase) : phase(phase), outer(active), start(std::chrono::steady_clock::now()) {
+        if (outer) outer->charge(start);
+        active = this;
+    }
+
+    ~ProfileScope() {
+        auto end = std::chrono::steady_clock::now();
+        charge(end);
+        active = outer;
+        if (outer) outer->start = end;
+    }
+
+private:
+    static inline thread_local ProfileScope* active = nullptr;
+
+    FrameProfiler::Phase phase;
+    ProfileScope* outer;
+    std::chrono::steady_clock::time_point start;
+
+    void charge(std::chrono::steady_clock::time_point until) {
+        FrameProfiler::shared().add(phase, std::chrono::duration<double, std::milli>(until - start).count());
+    }
+};
+
+// Scoped trace markers exported in the Chrome trace format (chrome://tracing, Perfetto).
+// Each thread appends to its own ring buffer, so recording never takes a lock; only
+// the first event on a new thread registers its buffer. When tracing is off a marker
+// costs one relaxed load. Building with DISABLE_TRACING removes the markers entirely.
+class Tracer {
+public:
+    struct Event {
+        const char* name;
+        long long start;      // nanoseconds since the tracer was created
+        long long duration;
+    };
+
+    static const size_t BUFFER_EVENTS = 1 << 16;   // per thread; oldest events are overwritten
+
+    static Tracer& shared() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    static bool enabled() {
+        return shared().recording.load(std::memory_order_relaxed);
+    }
+
+    void start() {
+        recording.store(true, std::memory_order_relaxed);
+    }
+
+    void stop() {
+        recording.store(false, std::memory_order_relaxed);
+    }
+
+    long long now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    // Each slot is a small seqlock: its sequence is odd while event i is being written
+    // and 2 * (i + 1) once it is complete
+    void record(const char* name, long long start, long long end) {
+        ThreadBuffer& buffer = threadBuffer();
+        size_t head = buffer.head.load(std::memory_order_relaxed);
+        Slot& slot = buffer.slots[head & (BUFFER_EVENTS - 1)];
+        slot.sequence.store(2 * head + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.start.store(start, std::memory_order_relaxed);
+        slot.duration.store(end - start, std::memory_order_relaxed);
+        slot.sequence.store(2 * (head + 1), std::memory_order_release);
+        buffer.head.store(head + 1, std::memory_order_release);
+    }
+
+    // Writes every buffered event as a complete ("X") event. Threads may keep recording
+    // meanwhile; a slot whose sequence changed while it was read has been overwritten
+    // and is dropped.
+    bool writeChromeTrace(const std::string& path) {
+        std::vector<std::pair<int, Event>> events;
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            for (auto& buffer : buffers) {
+                size_t end = buffer->head.load(std::memory_order_acquire);
+                size_t begin = end > BUFFER_EVENTS ? end - BUFFER_EVENTS : 0;
+                for (size_t i = begin; i < end; ++i) {
+                    const Slot& slot = buffer->slots[i & (BUFFER_EVENTS - 1)];
+                    size_t expected = 2 * (i + 1);
+                    if (slot.sequence.load(std::memory_order_acquire) != expected) continue;
+                    Event event = {slot.name.load(std::memory_order_relaxed), slot.start.load(std::memory_order_relaxed),
+                                   slot.duration.load(std::memory_order_relaxed)};
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (slot.sequence.load(std::memory_order_relaxed) == expected) events.emplace_back(buffer->id, event);
+                }
+            }
+        }
+
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Error writing trace to " << path << std::endl;
+            return false;
+        }
+        out << "{\"traceEvents\":[\n";
+        out << std::fixed;
+        out.precision(3);
+        bool first = true;
+        for (auto& entry : events) {
+            out << (first ? "" : ",\n") << "{\"name\":\"" << entry.second.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << entry.first
+                << ",\"ts\":" << entry.second.start / 1000.0 << ",\"dur\":" << entry.second.duration / 1000.0 << "}";
+            first = false;
+        }
+        out << "\n]}\n";
+        std::cout << "Wrote " << events.size() << " trace events to " << path << std::endl;
+        return true;
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence{0};
+        std::atomic<const char*> name{nullptr};
+        std::atomic<long long> start{0};
+        std::atomic<long long> duration{0};
+    };
+
+    struct ThreadBuffer {
+        int id = 0;
+        std::vector<Slot> slots = std::vector<Slot>(BUFFER_EVENTS);
+        std::atomic<size_t> head{0};
+    };
+
+    std::atomic<bool> recording{false};
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    std::mutex registryMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;   // kept until exit so finished threads can be flushed
+
+    ThreadBuffer& threadBuffer() {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer) {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            buffers.emplace_back(new ThreadBuffer());
+            buffer = buffers.back().get();
+            buffer->id = static_cast<int>(buffers.size());
+        }
+        return *buffer;
+    }
+};
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* name) : name(name), start(Tracer::enabled() ? Tracer::shared().now() : -1) {}
+
+    ~TraceScope() {
+        if (start >= 0) Tracer::shared().record(name, start, Tracer::shared().now());
+    }
+
+private:
+    const char* name;   // must be a string literal
+    long long start;
+};
+
+#ifdef DISABLE_TRACING
+#define TRACE_SCOPE(name)
+#else
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#endif
+
 class Button {
 public:
     sf::RectangleShape shape;
@@ -33,7 +339,7 @@ public:
         return shape.getGlobalBounds().contains(mousePos);
     }
 
-    void draw(sf::RenderWindow& window) {
+    void draw(sf::RenderTarget& window) {
         if (isHovered) {
             shape.setFillColor(sf::Color(shape.getFillColor().r, shape.getFillColor().g, shape.getFillColor().b, 200));
             shape.setOutlineThickness(3);
@@ -55,12 +361,611 @@ public:
     }
 };
 
+// Glyph quads of one label, laid out once relative to the label origin and shared by
+// every node that shows the same string.
+struct LabelGeometry {
+    const sf::Texture* page = nullptr;
+    std::vector<sf::Vertex> quads;
+    sf::FloatRect bounds;
+};
+
+// Label geometry keyed by font, size, style and string. Node keys repeat a lot (digits,
+// trie characters, balance factors), so after warm-up no label is ever measured again.
+// Past MAX_ENTRIES a miss reuses a slot CLOCK-style: the hand skips slots drawn since the
+// last batch flush and takes the first older one. When every slot is on screen the cache
+// grows instead, so it ends up sized by the labels visible at once.
+class LabelCache {
+public:
+    // Where a label's geometry lives; stamp changes when the slot is reused
+    struct Handle {
+        const LabelGeometry* geometry;
+        size_t slot;
+        unsigned int stamp;
+    };
+
+    static LabelCache& shared() {
+        static LabelCache cache;
+        return cache;
+    }
+
+    Handle get(const sf::Font& font, unsigned int size, bool bold, const std::string& string) {
+        const sf::Font* fontId = &font;
+        std::string key = string;
+        key.push_back('\0');
+        key.append(reinterpret_cast<const char*>(&fontId), sizeof(fontId));
+        key.push_back(static_cast<char>(bold));
+        key.append(std::to_string(size));
+
+        auto found = index.find(key);
+        if (found != index.end()) {
+            Slot& slot = slots[found->second];
+            slot.lastUsed = frame;
+            return {&slot.geometry, found->second, slot.stamp};
+        }
+
+        size_t id = slots.size() < MAX_ENTRIES ? addSlot() : reclaim();
+        Slot& slot = slots[id];
+        slot.key = key;
+        slot.geometry = build(font, size, bold, string);
+        slot.stamp = ++nextStamp;
+        slot.lastUsed = frame;
+        index.emplace(std::move(key), id);
+        return {&slot.geometry, id, slot.stamp};
+    }
+
+    // False once the slot was given to another label; otherwise marks it as drawn
+    bool touch(size_t id, unsigned int stamp) {
+        if (id >= slots.size() || slots[id].stamp != stamp) return false;
+        slots[id].lastUsed = frame;
+        return true;
+    }
+
+    // Called by every batch flush; slots untouched for a flush may be reused
+    void nextFrame() {
+        ++frame;
+    }
+
+private:
+    static constexpr size_t MAX_ENTRIES = 65536;
+
+    struct Slot {
+        std::string key;
+        LabelGeometry geometry;
+        unsigned int stamp = 0;
+        unsigned long long lastUsed = 0;
+    };
+
+    // A deque keeps slots in place as it grows, so labels may hold pointers into it
+    std::deque<Slot> slots;
+    std::unordered_map<std::string, size_t> index;
+    size_t hand = 0;
+    unsigned int nextStamp = 0;
+    unsigned long long frame = 0;
+    unsigned long long fullFrame = ~0ull;   // frame in which a sweep found every slot in use
+
+    size_t addSlot() {
+        slots.emplace_back();
+        return slots.size() - 1;
+    }
+
+    // Slots drawn in this or the previous flush stay; a sweep that finds nothing else
+    // grows the cache, and the rest of that frame skips the sweep
+    size_t reclaim() {
+        if (fullFrame != frame) {
+            for (size_t swept = 0; swept < slots.size(); ++swept) {
+                size_t id = hand;
+                hand = (hand + 1) % slots.size();
+                if (slots[id].lastUsed + 1 >= frame) continue;
+                index.erase(slots[id].key);
+                return id;
+            }
+            fullFrame = frame;
+        }
+        return addSlot();
+    }
+
+    static LabelGeometry build(const sf::Font& font, unsigned int size, bool bold, const std::string& string) {
+        LabelGeometry geometry;
+        geometry.page = &font.getTexture(size);
+
+        // Same glyph placement as sf::Text, minus the styles nodes never use
+        float x = 0;
+        float y = static_cast<float>(size);
+        float minX = static_cast<float>(size), minY = static_cast<float>(size), maxX = 0, maxY = 0;
+        sf::Uint32 previous = 0;
+        for (char ch : string) {
+            sf::Uint32 current = static_cast<unsigned char>(ch);
+            x += font.getKerning(previous, current, size, bold);
+            previous = current;
+
+            if (current == '\n') {
+                x = 0;
+                y += font.getLineSpacing(size);
+                continue;
+            }
+
+            const sf::Glyph& glyph = font.getGlyph(current, size, bold);
+            if (current != ' ' && current != '\t') {
+                const float padding = 1.0f;
+                float left = x + glyph.bounds.left - padding;
+                float top = y + glyph.bounds.top - padding;
+                float right = x + glyph.bounds.left + glyph.bounds.width + padding;
+                float bottom = y + glyph.bounds.top + glyph.bounds.height + padding;
+
+                float u1 = glyph.textureRect.left - padding;
+                float v1 = glyph.textureRect.top - padding;
+                float u2 = glyph.textureRect.left + glyph.textureRect.width + padding;
+                float v2 = glyph.textureRect.top + glyph.textureRect.height + padding;
+
+                geometry.quads.push_back(sf::Vertex(sf::Vector2f(left, top), sf::Color::White, sf::Vector2f(u1, v1)));
+                geometry.quads.push_back(sf::Vertex(sf::Vector2f(right, top), sf::Color::White, sf::Vector2f(u2, v1)));
+                geometry.quads.push_back(sf::Vertex(sf::Vector2f(left, bottom), sf::Color::White, sf::Vector2f(u1, v2)));
+                geometry.quads.push_back(sf::Vertex(sf::Vector2f(left, bottom), sf::Color::White, sf::Vector2f(u1, v2)));
+                geometry.quads.push_back(sf::Vertex(sf::Vector2f(right, top), sf::Color::White, sf::Vector2f(u2, v1)));
+                geometry.quads.push_back(sf::Vertex(sf::Vector2f(right, bottom), sf::Color::White, sf::Vector2f(u2, v2)));
+
+                minX = std::min(minX, x + glyph.bounds.left);
+                minY = std::min(minY, y + glyph.bounds.top);
+                maxX = std::max(maxX, x + glyph.bounds.left + glyph.bounds.width);
+                maxY = std::max(maxY, y + glyph.bounds.top + glyph.bounds.height);
+            }
+            x += glyph.advance;
+        }
+
+        if (!geometry.quads.empty()) {
+            geometry.bounds = sf::FloatRect(minX, minY, maxX - minX, maxY - minY);
+        }
+        return geometry;
+    }
+};
+
+// Node caption with the parts of the sf::Text interface the nodes use. The glyph
+// geometry and bounds come from the LabelCache and are only looked up again after
+// the font, size, style or string changes.
+class NodeLabel {
+public:
+    NodeLabel() : font(nullptr), characterSize(30), bold(false), color(sf::Color::White), geometry(nullptr) {}
+
+    void setFont(const sf::Font& newFont) {
+        font = &newFont;
+        geometry = nullptr;
+    }
+
+    void setCharacterSize(unsigned int size) {
+        characterSize = size;
+        geometry = nullptr;
+    }
+
+    void setStyle(sf::Uint32 style) {
+        bold = (style & sf::Text::Bold) != 0;
+        geometry = nullptr;
+    }
+
+    void setString(const std::string& newString) {
+        if (newString == string) return;
+        string = newString;
+        geometry = nullptr;
+    }
+
+    void setFillColor(const sf::Color& newColor) { color = newColor; }
+    void setPosition(float x, float y) { position = sf::Vector2f(x, y); }
+    void setPosition(sf::Vector2f pos) { position = pos; }
+
+    const std::string& getString() const { return string; }
+    const sf::Color& getFillColor() const { return color; }
+    const sf::Vector2f& getPosition() const { return position; }
+
+    const LabelGeometry* getGeometry() const {
+        LabelCache& cache = LabelCache::shared();
+        if (geometry && !cache.touch(slot, stamp)) geometry = nullptr;
+        if (!geometry && font) {
+            LabelCache::Handle handle = cache.get(*font, characterSize, bold, string);
+            geometry = handle.geometry;
+            slot = handle.slot;
+            stamp = handle.stamp;
+        }
+        return geometry;
+    }
+
+    sf::FloatRect getLocalBounds() const {
+        const LabelGeometry* cached = getGeometry();
+        return cached ? cached->bounds : sf::FloatRect();
+    }
+
+private:
+    const sf::Font* font;
+    unsigned int characterSize;
+    bool bold;
+    sf::Color color;
+    sf::Vector2f position;
+    std::string string;
+    mutable const LabelGeometry* geometry;
+    mutable size_t slot = 0;
+    mutable unsigned int stamp = 0;
+};
+
+// Collects the edges, node discs and labels of a whole frame and submits them in a
+// handful of draw calls: one for all edges, one for all discs and rectangles (drawn as
+// textured quads from a single circle sprite), and one per glyph page for the cached
+// label quads.
+class BatchRenderer {
+public:
+    static const int CIRCLE_SPRITE_SIZE = 64;
+
+    sf::VertexArray edges;
+    sf::VertexArray discs;
+    std::vector<std::pair<const sf::Texture*, sf::VertexArray>> labels;
+
+    BatchRenderer() : edges(sf::Lines), discs(sf::Triangles) {}
+
+    static const sf::Texture& circleTexture() {
+        static sf::Texture texture = createCircleTexture();
+        return texture;
+    }
+
+    void addEdge(sf::Vector2f start, sf::Vector2f end, sf::Color color = sf::Color::White) {
+        edges.append(sf::Vertex(start, color));
+        edges.append(sf::Vertex(end, color));
+    }
+
+    void addCircle(const sf::CircleShape& circle, sf::Vector2f offset = sf::Vector2f(0, 0)) {
+        float radius = circle.getRadius();
+        sf::Vector2f centre = circle.getPosition() + offset + sf::Vector2f(radius, radius);
+        addDisc(centre, radius, circle.getFillColor(), circle.getOutlineThickness(), circle.getOutlineColor());
+    }
+
+    void addDisc(sf::Vector2f centre, float radius, sf::Color fill, float outline = 0, sf::Color outlineColor = sf::Color::White) {
+        sf::FloatRect sprite(0, 0, CIRCLE_SPRITE_SIZE, CIRCLE_SPRITE_SIZE);
+
+        // The outline is a slightly larger disc drawn underneath, like sf::Shape draws it
+        if (outline > 0) {
+            float outer = radius + outline;
+            addQuad(sf::Vector2f(centre.x - outer, centre.y - outer), sf::Vector2f(2 * outer, 2 * outer), outlineColor, sprite);
+        }
+        addQuad(sf::Vector2f(centre.x - radius, centre.y - radius), sf::Vector2f(2 * radius, 2 * radius), fill, sprite);
+    }
+
+    void addRect(const sf::RectangleShape& rect, sf::Vector2f offset = sf::Vector2f(0, 0)) {
+        sf::Vector2f pos = rect.getPosition() + offset;
+        sf::Vector2f size = rect.getSize();
+        float outline = rect.getOutlineThickness();
+
+        // Sample only the fully opaque centre of the circle sprite to get a solid fill
+        float centre = CIRCLE_SPRITE_SIZE / 2.f;
+        sf::FloatRect solid(centre, centre, 0, 0);
+
+        if (outline > 0) {
+            addQuad(sf::Vector2f(pos.x - outline, pos.y - outline),
+                    sf::Vector2f(size.x + 2 * outline, size.y + 2 * outline),
+                    rect.getOutlineColor(), solid);
+        }
+        addQuad(pos, size, rect.getFillColor(), solid);
+    }
+
+    void addLabel(const NodeLabel& label, sf::Vector2f offset = sf::Vector2f(0, 0)) {
+        const LabelGeometry* geometry = label.getGeometry();
+        if (!geometry || geometry->quads.empty()) return;
+
+        sf::VertexArray& batch = labelBatch(geometry->page);
+        sf::Vector2f origin = label.getPosition() + offset;
+        sf::Color color = label.getFillColor();
+        for (const sf::Vertex& vertex : geometry->quads) {
+            batch.append(sf::Vertex(vertex.position + origin, color, vertex.texCoords));
+        }
+    }
+
+    void flush(sf::RenderTarget& target) {
+        TRACE_SCOPE("batched draw");
+        LabelCache::shared().nextFrame();
+        FrameProfiler& profiler = FrameProfiler::shared();
+        if (edges.getVertexCount() > 0) {
+            target.draw(edges);
+            profiler.countDraw(edges.getVertexCount());
+        }
+        if (discs.getVertexCount() > 0) {
+            target.draw(discs, &circleTexture());
+            profiler.countDraw(discs.getVertexCount());
+        }
+        for (auto& label : labels) {
+            if (label.second.getVertexCount() > 0) {
+                target.draw(label.second, label.first);
+                profiler.countDraw(label.second.getVertexCount());
+            }
+        }
+        clear();
+    }
+
+    void clear() {
+        edges.clear();
+        discs.clear();
+        for (auto& label : labels) label.second.clear();
+    }
+
+private:
+    static sf::Texture createCircleTexture() {
+        sf::Image image;
+        image.create(CIRCLE_SPRITE_SIZE, CIRCLE_SPRITE_SIZE, sf::Color::Transparent);
+        float centre = CIRCLE_SPRITE_SIZE / 2.f;
+        for (int y = 0; y < CIRCLE_SPRITE_SIZE; ++y) {
+            for (int x = 0; x < CIRCLE_SPRITE_SIZE; ++x) {
+                float dx = x + 0.5f - centre;
+                float dy = y + 0.5f - centre;
+                // One pixel of anti-aliasing on the rim
+                float coverage = std::max(0.f, std::min(1.f, centre - std::sqrt(dx * dx + dy * dy)));
+                image.setPixel(x, y, sf::Color(255, 255, 255, static_cast<sf::Uint8>(coverage * 255)));
+            }
+        }
+
+        sf::Texture texture;
+        if (!texture.loadFromImage(image)) {
+            std::cerr << "Error creating circle sprite!" << std::endl;
+        }
+        texture.setSmooth(true);
+        return texture;
+    }
+
+    void addQuad(sf::Vector2f pos, sf::Vector2f size, sf::Color color, sf::FloatRect tex) {
+        sf::Vertex topLeft(pos, color, sf::Vector2f(tex.left, tex.top));
+        sf::Vertex topRight(sf::Vector2f(pos.x + size.x, pos.y), color, sf::Vector2f(tex.left + tex.width, tex.top));
+        sf::Vertex bottomLeft(sf::Vector2f(pos.x, pos.y + size.y), color, sf::Vector2f(tex.left, tex.top + tex.height));
+        sf::Vertex bottomRight(pos + size, color, sf::Vector2f(tex.left + tex.width, tex.top + tex.height));
+        discs.append(topLeft);
+        discs.append(topRight);
+        discs.append(bottomLeft);
+        discs.append(bottomLeft);
+        discs.append(topRight);
+        discs.append(bottomRight);
+    }
+
+    sf::VertexArray& labelBatch(const sf::Texture* page) {
+        for (auto& label : labels) {
+            if (label.first == page) return label.second;
+        }
+        labels.push_back({page, sf::VertexArray(sf::Triangles)});
+        return labels.back().second;
+    }
+};
+
+// Read-only memory map of a whole file
+class MappedFile {
+public:
+    ~MappedFile() {
+        close();
+    }
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            close();
+            return false;
+        }
+        length = static_cast<size_t>(fileSize.QuadPart);
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) bytes = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+        descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) return false;
+        struct stat info;
+        if (fstat(descriptor, &info) != 0 || info.st_size == 0) {
+            close();
+            return false;
+        }
+        length = static_cast<size_t>(info.st_size);
+        void* view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (view != MAP_FAILED) bytes = static_cast<const char*>(view);
+#endif
+        if (!bytes) close();
+        return bytes != nullptr;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (bytes) UnmapViewOfFile(bytes);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (bytes) munmap(const_cast<char*>(bytes), length);
+        if (descriptor >= 0) ::close(descriptor);
+        descriptor = -1;
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int descriptor = -1;
+#endif
+    const char* bytes = nullptr;
+    size_t length = 0;
+};
+
+// Versioned binary snapshot of one structure. A fixed header is followed by flat
+// sections, each padded to 8 bytes, which the loader reads straight out of a memory
+// map. Integers and floats are stored in host (little-endian) order.
+//   trees  i32 keys[count] in pre-order, u64 shape[extra] (left/right bits per node)
+//   trie   PackedTrieNode[count] in breadth-first order
+//   queue, stack  i32 values[count]
+//   graph  i32 values[count], u32 offsets[count + 1], u32 targets[extra] (CSR)
+// With HAS_LAYOUT, node positions (f32 x, y per node) and a layout record follow.
+struct SnapshotHeader {
+    enum Kind : unsigned char { Bst, Avl, Trie, Queue, Stack, Graph };
+    enum Flags : unsigned char { HAS_LAYOUT = 1 };
+
+    char magic[4];
+    unsigned short version;
+    unsigned char kind;
+    unsigned char flags;
+    unsigned int reserved;
+    unsigned long long count;
+    unsigned long long extra;
+
+    static const unsigned short VERSION = 1;
+};
+
+struct PackedTrieNode {
+    unsigned int firstChild;    // index of the first child; children are contiguous
+    unsigned int childCount;
+    char character;
+    unsigned char isEnd;
+    unsigned short padding;
+};
+
+// Layout record stored after the positions
+struct SnapshotLayout {
+    float radius;
+    float padding;
+};
+
+class SnapshotWriter {
+public:
+    bool open(const std::string& path, SnapshotHeader::Kind kind, unsigned long long count, unsigned long long extra, bool hasLayout) {
+        out.open(path, std::ios::binary);
+        if (!out) {
+            std::cerr << "Error writing snapshot " << path << std::endl;
+            return false;
+        }
+        SnapshotHeader header = {{'D', 'S', 'V', 'S'}, SnapshotHeader::VERSION, kind,
+                                 static_cast<unsigned char>(hasLayout ? SnapshotHeader::HAS_LAYOUT : 0), 0, count, extra};
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        return true;
+    }
+
+    template <typename T>
+    void section(const T* data, size_t count) {
+        size_t bytes = count * sizeof(T);
+        out.write(reinterpret_cast<const char*>(data), bytes);
+        static const char zeros[8] = {};
+        out.write(zeros, (8 - bytes % 8) % 8);
+    }
+
+    bool close() {
+        out.close();
+        return !out.fail();
+    }
+
+private:
+    std::ofstream out;
+};
+
+class SnapshotReader {
+public:
+    const SnapshotHeader* header = nullptr;
+
+    bool open(const std::string& path, SnapshotHeader::Kind kind) {
+        if (!file.open(path)) {
+            std::cerr << "Error opening snapshot " << path << std::endl;
+            return false;
+        }
+        header = reinterpret_cast<const SnapshotHeader*>(file.data());
+        if (file.size() < sizeof(SnapshotHeader) || std::string(header->magic, 4) != "DSVS"
+            || header->version != SnapshotHeader::VERSION || header->kind != kind) {
+            std::cerr << "Not a matching snapshot: " << path << std::endl;
+            return false;
+        }
+        // Both fields count elements of at least one byte, so neither can exceed the file
+        // size; this keeps callers' 2 * count and count + 1 from overflowing
+        if (header->count > file.size() || header->extra > file.size()) {
+            std::cerr << "Corrupt snapshot header in " << path << std::endl;
+            return false;
+        }
+        offset = sizeof(SnapshotHeader);
+        return true;
+    }
+
+    bool hasLayout() const {
+        return (header->flags & SnapshotHeader::HAS_LAYOUT) != 0;
+    }
+
+    // Next section, or nullptr when the file is too short for it
+    template <typename T>
+    const T* section(size_t count) {
+        if (count > (file.size() - offset) / sizeof(T)) return nullptr;
+        size_t bytes = count * sizeof(T);
+        const T* data = reinterpret_cast<const T*>(file.data() + offset);
+        offset += bytes + (8 - bytes % 8) % 8;
+        offset = std::min(offset, file.size());
+        return data;
+    }
+
+private:
+    MappedFile file;
+    size_t offset = 0;
+};
+
+// Pre-order keys and two shape bits per node (has left, has right) of a binary tree
+template <typename Node>
+void writeTreeSnapshot(SnapshotWriter& writer, Node* root, size_t count, std::vector<int>* preorderIndex = nullptr) {
+    std::vector<int> keys;
+    std::vector<unsigned long long> shape((2 * count + 63) / 64, 0);
+    keys.reserve(count);
+    std::vector<Node*> stack;
+    if (root) stack.push_back(root);
+    while (!stack.empty()) {
+        Node* node = stack.back();
+        stack.pop_back();
+        size_t bit = 2 * keys.size();
+        if (preorderIndex) (*preorderIndex)[node->index] = static_cast<int>(keys.size());
+        keys.push_back(node->value);
+        if (node->left) shape[bit / 64] |= 1ULL << (bit % 64);
+        if (node->right) shape[(bit + 1) / 64] |= 1ULL << ((bit + 1) % 64);
+        if (node->right) stack.push_back(node->right);
+        if (node->left) stack.push_back(node->left);
+    }
+    writer.section(keys.data(), keys.size());
+    writer.section(shape.data(), shape.size());
+}
+
+// Rebuilds a tree from pre-order keys and shape bits: a node with a left child is
+// followed by it, otherwise the next node is the right child of the latest node still
+// waiting for one. The nodes come back in pre-order. Returns nullptr on corrupt input.
+template <typename Node>
+Node* readTreeSnapshot(const int* keys, const unsigned long long* shape, size_t count, std::vector<Node*>& nodes) {
+    nodes.reserve(count);
+    std::vector<Node*> awaitingRight;
+    Node* root = nullptr;
+    Node* awaitingLeft = nullptr;
+    for (size_t i = 0; i < count; ++i) {
+        Node* node = new Node(keys[i]);
+        node->index = static_cast<int>(i);
+        nodes.push_back(node);
+        if (i == 0) {
+            root = node;
+        } else if (awaitingLeft) {
+            awaitingLeft->left = node;
+        } else if (!awaitingRight.empty()) {
+            awaitingRight.back()->right = node;
+            awaitingRight.pop_back();
+        } else {
+            return nullptr;
+        }
+        bool hasLeft = (shape[(2 * i) / 64] >> ((2 * i) % 64)) & 1;
+        bool hasRight = (shape[(2 * i + 1) / 64] >> ((2 * i + 1) % 64)) & 1;
+        if (hasRight) awaitingRight.push_back(node);
+        awaitingLeft = hasLeft ? node : nullptr;
+    }
+    if (awaitingLeft || !awaitingRight.empty()) return nullptr;
+    return root;
+}
+
 class TrieNode {
 public:
     std::unordered_map<char, TrieNode*> children;
     bool isEnd;
     sf::CircleShape circle;
-    sf::Text charText;
+    NodeLabel charText;
     sf::Vector2f position;
 
     TrieNode(sf::Font& font) : isEnd(false) {
@@ -83,9 +988,9 @@ public:
         );
     }
 
-    void draw(sf::RenderWindow& window) {
-        window.draw(circle);
-        window.draw(charText);
+    void draw(BatchRenderer& batch, sf::Vector2f offset) {
+        batch.addCircle(circle, offset);
+        batch.addLabel(charText, offset);
     }
 };
 
@@ -100,8 +1005,10 @@ public:
     float scrollOffset;
     float maxScrollOffset;
     bool isScrolling;
+    BatchRenderer batch;
 
     TrieVisualizer() : scrollOffset(0), maxScrollOffset(0), isScrolling(false) {
+        TRACE_SCOPE("load font");
         if (!font.loadFromFile("arial.ttf")) {
             std::cerr << "Error loading font!" << std::endl;
         }
@@ -118,6 +1025,7 @@ public:
     }
 
     void insert(const std::string& word) {
+        TRACE_SCOPE("Trie insert");
         TrieNode* current = root;
         for (char ch : word) {
             if (current->children.find(ch) == current->children.end()) {
@@ -132,6 +1040,10 @@ public:
         current->isEnd = true;
     }
 
+    void insertBatch(const std::vector<std::string>& words) {
+        for (const std::string& word : words) insert(word);
+    }
+
     void calculatePositions(TrieNode* node, sf::Vector2f position, float horizontalSpacing, float verticalSpacing) {
         if (!node) return;
         node->setPosition(position);
@@ -144,33 +1056,29 @@ public:
         }
     }
 
-    void draw(sf::RenderWindow& window) {
+    void draw(sf::RenderTarget& window) {
         if (!root) return;
 
-        calculatePositions(root, sf::Vector2f(200, 200), 50, 100);
+        {
+            ProfileScope layout(FrameProfiler::Layout);
+            TRACE_SCOPE("Trie calculatePositions");
+            calculatePositions(root, sf::Vector2f(200, 200), 50, 100);
+        }
 
+        sf::Vector2f offset(0, -scrollOffset);
         for (auto& edge : edges) {
-            sf::Vector2f parentPos = edge.first->circle.getPosition();
-            sf::Vector2f childPos = edge.second->circle.getPosition();
+            sf::Vector2f parentPos = edge.first->circle.getPosition() + offset;
+            sf::Vector2f childPos = edge.second->circle.getPosition() + offset;
             parentPos.x += 20;
             parentPos.y += 40;
             childPos.x += 20;
-            parentPos.y -= scrollOffset;
-            childPos.y -= scrollOffset;
-            sf::Vertex line[] = { sf::Vertex(parentPos), sf::Vertex(childPos) };
-            window.draw(line, 2, sf::Lines);
+            batch.addEdge(parentPos, childPos);
         }
 
         for (auto& node : nodes) {
-            sf::Vector2f pos = node->circle.getPosition();
-            pos.y -= scrollOffset;
-            node->circle.setPosition(pos);
-            node->charText.setPosition(
-                pos.x + (node->circle.getRadius() - node->charText.getLocalBounds().width) / 2,
-                pos.y + (node->circle.getRadius() - node->charText.getLocalBounds().height) / 2 - 5
-            );
-            node->draw(window);
+            node->draw(batch, offset);
         }
+        batch.flush(window);
 
         window.draw(scrollbar);
         window.draw(scrollbarHandle);
@@ -187,6 +1095,61 @@ public:
         maxScrollOffset = 0;
     }
 
+    // Breadth-first, so the children of every node are one contiguous run
+    void saveSnapshot(const std::string& path) {
+        std::vector<TrieNode*> order(1, root);
+        std::vector<PackedTrieNode> packed;
+        packed.reserve(nodes.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            TrieNode* node = order[i];
+            sf::String label = node->charText.getString();
+            PackedTrieNode entry = {static_cast<unsigned int>(order.size()), static_cast<unsigned int>(node->children.size()),
+                                    static_cast<char>(label.isEmpty() ? ' ' : label[0]), static_cast<unsigned char>(node->isEnd), 0};
+            for (auto& child : node->children) order.push_back(child.second);
+            packed.push_back(entry);
+        }
+
+        SnapshotWriter writer;
+        if (!writer.open(path, SnapshotHeader::Trie, packed.size(), 0, false)) return;
+        writer.section(packed.data(), packed.size());
+        if (!writer.close()) std::cerr << "Error writing snapshot " << path << std::endl;
+    }
+
+    void loadSnapshot(const std::string& path) {
+        SnapshotReader reader;
+        if (!reader.open(path, SnapshotHeader::Trie)) return;
+        size_t count = static_cast<size_t>(reader.header->count);
+        const PackedTrieNode* packed = reader.section<PackedTrieNode>(count);
+        if (!packed || count == 0) {
+            std::cerr << "Truncated snapshot " << path << std::endl;
+            return;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (packed[i].childCount && (packed[i].firstChild <= i || packed[i].firstChild + static_cast<size_t>(packed[i].childCount) > count)) {
+                std::cerr << "Corrupt trie node in " << path << std::endl;
+                return;
+            }
+        }
+
+        reset();
+        nodes.reserve(count);
+        root->isEnd = packed[0].isEnd != 0;
+        for (size_t i = 1; i < count; ++i) {
+            TrieNode* node = new TrieNode(font);
+            node->charText.setString(std::string(1, packed[i].character));
+            node->isEnd = packed[i].isEnd != 0;
+            nodes.push_back(node);
+        }
+        edges.reserve(count - 1);
+        for (size_t i = 0; i < count; ++i) {
+            for (unsigned int c = 0; c < packed[i].childCount; ++c) {
+                TrieNode* child = nodes[packed[i].firstChild + c];
+                nodes[i]->children[packed[packed[i].firstChild + c].character] = child;
+                edges.push_back({nodes[i], child});
+            }
+        }
+    }
+
     void handleScrollbar(sf::Vector2f mousePos) {
         if (scrollbar.getGlobalBounds().contains(mousePos)) {
             if (sf::Mouse::isButtonPressed(sf::Mouse::Left)) {
@@ -255,707 +1218,8808 @@ public:
     }
 };
 
+// Finds the first element equal to value, comparing 16 ints (four SSE2 registers) per step
+inline long long findFirstInt(const int* data, size_t count, int value) {
+    size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    __m128i needle = _mm_set1_epi32(value);
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), needle);
+        __m128i b = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 4)), needle);
+        __m128i c = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 8)), needle);
+        __m128i d = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 12)), needle);
+        __m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if (_mm_movemask_epi8(any) != 0) break;
+    }
+#endif
+    for (; i < count; ++i) {
+        if (data[i] == value) return static_cast<long long>(i);
+    }
+    return -1;
+}
+
 class StackVisualizer {
 public:
-    std::vector<sf::RectangleShape> plates;
-    std::vector<sf::Text> plateTexts;
+    std::vector<int> values;
     sf::Font font;
+    BatchRenderer batch;
+
+    // Only the plates inside the view are built each frame
+    size_t scrollPosition = 0;      // index of the lowest visible plate
+    bool followTop = true;
+    long long highlightedIndex = -1;
+    bool isDraggingMinimap = false;
+
+    sf::RectangleShape plate;
+    NodeLabel plateText;
+    NodeLabel indexText;
+    sf::RectangleShape minimap;
+    sf::RectangleShape minimapView;
+
+    const size_t VISIBLE_PLATES = 7;
 
     StackVisualizer() {
+        TRACE_SCOPE("load font");
         if (!font.loadFromFile("arial.ttf")) {
             std::cerr << "Error loading font!" << std::endl;
         }
-    }
-
-    const int MAX_STACK_SIZE = 7;
-
-    void push(int value) {
-        if (plates.size() >= MAX_STACK_SIZE) {
-            std::cout << "Stack is full! Cannot add more plates.\n";
-            return;  // Prevent adding more plates
-        }
 
-        sf::RectangleShape plate(sf::Vector2f(200, 60));
-        plate.setFillColor(sf::Color::Cyan);
+        plate.setSize(sf::Vector2f(200, 60));
         plate.setOutlineThickness(2);
         plate.setOutlineColor(sf::Color::White);
 
-        sf::Text text;
-        text.setFont(font);
-        text.setString(std::to_string(value));
-        text.setCharacterSize(18);
-        text.setFillColor(sf::Color::Black);
+        plateText.setFont(font);
+        plateText.setCharacterSize(18);
+        plateText.setFillColor(sf::Color::Black);
+
+        indexText.setFont(font);
+        indexText.setCharacterSize(14);
+        indexText.setFillColor(sf::Color(200, 200, 200));
+
+        // Overview of the whole stack, bottom of the stack at the bottom of the bar
+        minimap.setSize(sf::Vector2f(20, 540));
+        minimap.setPosition(960, 220);
+        minimap.setFillColor(sf::Color(80, 80, 80));
+        minimap.setOutlineThickness(1);
+        minimap.setOutlineColor(sf::Color::White);
+        minimapView.setFillColor(sf::Color(0, 255, 255, 140));
+    }
 
-        float yPos = 700 - (plates.size() * 80);
-        plate.setPosition(700, yPos);
-        text.setPosition(700 + (200 - text.getLocalBounds().width) / 2, yPos + 15);
+    void push(int value) {
+        values.push_back(value);
+        if (followTop) scrollToTop();
+    }
 
-        plates.push_back(plate);
-        plateTexts.push_back(text);
+    void pushBatch(const std::vector<int>& batch) {
+        values.insert(values.end(), batch.begin(), batch.end());
+        if (followTop) scrollToTop();
     }
 
     void pop() {
-        if (!plates.empty()) {
-            plates.pop_back();
-            plateTexts.pop_back();
-        }
+        if (values.empty()) return;
+        values.pop_back();
+        if (highlightedIndex >= static_cast<long long>(values.size())) highlightedIndex = -1;
+        if (followTop || scrollPosition + VISIBLE_PLATES > values.size()) scrollToTop();
     }
 
-    void draw(sf::RenderWindow& window) {
-        for (size_t i = 0; i < plates.size(); ++i) {
-            window.draw(plates[i]);
-            window.draw(plateTexts[i]);
-        }
+    void scrollToTop() {
+        scrollPosition = values.size() > VISIBLE_PLATES ? values.size() - VISIBLE_PLATES : 0;
+        followTop = true;
+    }
+
+    void scrollTo(size_t bottomIndex) {
+        size_t maxPosition = values.size() > VISIBLE_PLATES ? values.size() - VISIBLE_PLATES : 0;
+        scrollPosition = std::min(bottomIndex, maxPosition);
+        followTop = scrollPosition == maxPosition;
+    }
+
+    // Wheel steps move one plate at a time on small stacks and proportionally more on large ones
+    void scroll(float delta) {
+        long long step = std::max<long long>(1, static_cast<long long>(values.size() / 200));
+        long long target = static_cast<long long>(scrollPosition) + (delta > 0 ? step : -step);
+        scrollTo(static_cast<size_t>(std::max<long long>(0, target)));
+    }
+
+    void handleMinimap(sf::Vector2f mousePos, bool pressed) {
+        if (pressed && minimap.getGlobalBounds().contains(mousePos)) isDraggingMinimap = true;
+        if (!isDraggingMinimap || values.empty()) return;
+
+        float fraction = 1 - (mousePos.y - minimap.getPosition().y) / minimap.getSize().y;
+        fraction = std::max(0.f, std::min(1.f, fraction));
+        size_t centre = static_cast<size_t>(fraction * (values.size() - 1));
+        scrollTo(centre > VISIBLE_PLATES / 2 ? centre - VISIBLE_PLATES / 2 : 0);
+    }
+
+    void stopMinimapDrag() {
+        isDraggingMinimap = false;
+    }
+
+    void draw(sf::RenderTarget& window) {
+        size_t end = std::min(values.size(), scrollPosition + VISIBLE_PLATES);
+        for (size_t i = scrollPosition; i < end; ++i) {
+            float yPos = 700 - ((i - scrollPosition) * 80);
+            plate.setPosition(700, yPos);
+            plate.setFillColor(static_cast<long long>(i) == highlightedIndex ? sf::Color::Yellow : sf::Color::Cyan);
+            batch.addRect(plate);
+
+            plateText.setString(std::to_string(values[i]));
+            plateText.setPosition(700 + (200 - plateText.getLocalBounds().width) / 2, yPos + 15);
+            batch.addLabel(plateText);
+
+            indexText.setString("#" + std::to_string(i));
+            indexText.setPosition(690 - indexText.getLocalBounds().width, yPos + 20);
+            batch.addLabel(indexText);
+        }
+
+        if (values.size() > VISIBLE_PLATES) {
+            batch.addRect(minimap);
+
+            float top = minimap.getPosition().y;
+            float height = minimap.getSize().y;
+            float total = static_cast<float>(values.size());
+            float viewHeight = std::max(4.f, height * VISIBLE_PLATES / total);
+            float viewBottom = top + height - height * scrollPosition / total;
+            minimapView.setSize(sf::Vector2f(minimap.getSize().x, viewHeight));
+            minimapView.setPosition(minimap.getPosition().x, std::max(top, viewBottom - viewHeight));
+            batch.addRect(minimapView);
+
+            if (highlightedIndex >= 0) {
+                sf::RectangleShape marker(sf::Vector2f(minimap.getSize().x + 8, 2));
+                marker.setFillColor(sf::Color::Yellow);
+                marker.setPosition(minimap.getPosition().x - 4, top + height - height * (highlightedIndex + 0.5f) / total);
+                batch.addRect(marker);
+            }
+        }
+        batch.flush(window);
     }
 
     void reset() {
-        plates.clear();
-        plateTexts.clear();
+        std::vector<int>().swap(values);
+        highlightedIndex = -1;
+        scrollPosition = 0;
+        followTop = true;
+        isDraggingMinimap = false;
+    }
+
+    void saveSnapshot(const std::string& path) {
+        SnapshotWriter writer;
+        if (!writer.open(path, SnapshotHeader::Stack, values.size(), 0, false)) return;
+        writer.section(values.data(), values.size());
+        if (!writer.close()) std::cerr << "Error writing snapshot " << path << std::endl;
+    }
+
+    void loadSnapshot(const std::string& path) {
+        SnapshotReader reader;
+        if (!reader.open(path, SnapshotHeader::Stack)) return;
+        size_t count = static_cast<size_t>(reader.header->count);
+        const int* data = reader.section<int>(count);
+        if (!data) {
+            std::cerr << "Truncated snapshot " << path << std::endl;
+            return;
+        }
+        reset();
+        values.assign(data, data + count);
+        scrollToTop();
     }
 
     void search(int value) {
-        for (size_t i = 0; i < plates.size(); ++i) {
-            if (std::stoi(plateTexts[i].getString().toAnsiString()) == value) {
-                plates[i].setFillColor(sf::Color::Yellow); // Highlight the found plate
-                return;
-            }
+        highlightedIndex = findFirstInt(values.data(), values.size(), value);
+        if (highlightedIndex >= 0) {
+            // Bring the found plate into view
+            size_t index = static_cast<size_t>(highlightedIndex);
+            scrollTo(index > VISIBLE_PLATES / 2 ? index - VISIBLE_PLATES / 2 : 0);
+            return;
         }
         std::cout << "Number does not exist." << std::endl;
     }
 };
 
-class QueueNode {
+// Growable circular buffer with O(1) push at the back and pop at the front. The
+// capacity is a power of two so wrapping is a mask; growing unrolls the ring into a
+// new array twice the size.
+template <typename T>
+class RingBuffer {
 public:
-    int value;
-    QueueNode* next;
-    sf::CircleShape circle;
-    sf::Text text;
-    sf::RectangleShape arrow;
+    void push_back(const T& value) {
+        if (count == storage.size()) grow();
+        storage[(head + count) & (storage.size() - 1)] = value;
+        ++count;
+    }
 
+    void pop_front() {
+        head = (head + 1) & (storage.size() - 1);
+        --count;
+    }
 
+    T& operator[](size_t index) { return storage[(head + index) & (storage.size() - 1)]; }
+    const T& operator[](size_t index) const { return storage[(head + index) & (storage.size() - 1)]; }
+    T& front() { return (*this)[0]; }
+    T& back() { return (*this)[count - 1]; }
 
-    QueueNode(int val, const sf::Font& font) : value(val), next(nullptr) {
-        circle.setRadius(30);
-        circle.setFillColor(sf::Color::Magenta);
-        circle.setOutlineThickness(2);
-        circle.setOutlineColor(sf::Color::White);
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    size_t capacity() const { return storage.size(); }
 
-        text.setFont(font);
-        text.setString(std::to_string(val));
-        text.setCharacterSize(15);
-        text.setFillColor(sf::Color::White);
-        text.setStyle(sf::Text::Bold);
+    void clear() {
+        head = 0;
+        count = 0;
     }
 
-    void setPosition(sf::Vector2f position) {
-        circle.setPosition(position);
-        text.setPosition(
-            position.x + (circle.getRadius() - text.getLocalBounds().width) / 2 + 12,
-            position.y + (circle.getRadius() - text.getLocalBounds().height) / 2 + 6
-        );
-        arrow.setPosition(position.x + 70, position.y + 30);
+    void reserve(size_t minimum) {
+        while (storage.size() < minimum) grow();
     }
 
-    void draw(sf::RenderWindow& window) {
-        window.draw(circle);
-        window.draw(text);
-        if (next) window.draw(arrow);
+    void release() {
+        std::vector<T>().swap(storage);
+        clear();
+    }
+
+    // The elements as at most two contiguous runs, for bulk scans
+    std::pair<const T*, size_t> firstRun() const {
+        if (count == 0) return {nullptr, 0};
+        return {storage.data() + head, std::min(count, storage.size() - head)};
+    }
+
+    std::pair<const T*, size_t> secondRun() const {
+        size_t first = firstRun().second;
+        return {storage.data(), count - first};
+    }
+
+private:
+    std::vector<T> storage;
+    size_t head = 0;
+    size_t count = 0;
+
+    void grow() {
+        std::vector<T> bigger(std::max<size_t>(16, storage.size() * 2));
+        for (size_t i = 0; i < count; ++i) bigger[i] = (*this)[i];
+        storage.swap(bigger);
+        head = 0;
     }
 };
 
-class QueueVisualizer {
+// Bounded single-producer/single-consumer ring. Each side owns one index and keeps a
+// cached copy of the other's, so the shared cache lines are only touched when the
+// ring looks full or empty.
+template <typename T>
+class SpscRing {
 public:
-    QueueNode* front;
-    QueueNode* rear;
-    sf::Font font;
-    std::vector<QueueNode*> nodes;
-    std::vector<sf::RectangleShape> arrows;
-    bool isAnimating = false;
-    int animationStep = 50;
+    explicit SpscRing(size_t minimumCapacity) {
+        size_t capacity = 2;
+        while (capacity < minimumCapacity) capacity *= 2;
+        slots.resize(capacity);
+        mask = capacity - 1;
+    }
 
-    QueueVisualizer() : front(nullptr), rear(nullptr) {
-        if (!font.loadFromFile("arial.ttf")) {
-            std::cerr << "Error loading font!" << std::endl;
+    bool tryPush(const T& value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - headCache == slots.size()) {
+            headCache = head.load(std::memory_order_acquire);
+            if (t - headCache == slots.size()) return false;
         }
+        slots[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
     }
 
-    const int MAX_QUEUE_SIZE = 8;
-
-    void enqueue(int value) {
-        if (nodes.size() >= MAX_QUEUE_SIZE) {
-            std::cout << "Queue is full! Cannot add more elements.\n";
-            return;  // Prevent adding more elements
+    bool tryPop(T& value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tailCache) {
+            tailCache = tail.load(std::memory_order_acquire);
+            if (h == tailCache) return false;
         }
+        value = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
 
-        QueueNode* newNode = new QueueNode(value, font);
-        nodes.push_back(newNode);
-
-        if (!rear) {
-            front = rear = newNode;
-        } else {
-            rear->next = newNode;
-            rear = newNode;
-        }
-        updatePositions();
+    // Safe from any thread; may be briefly stale
+    size_t approximateSize() const {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_relaxed);
+        return t > h ? std::min(t - h, slots.size()) : 0;
     }
 
-    void dequeue() {
-        if (!front) return;
+    size_t capacity() const { return slots.size(); }
 
-        QueueNode* temp = front;
-        front = front->next;
-        if (!front) rear = nullptr;
+private:
+    std::vector<T> slots;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> head{0};
+    size_t tailCache = 0;                 // consumer's view of tail
+    alignas(64) std::atomic<size_t> tail{0};
+    size_t headCache = 0;                 // producer's view of head
+};
 
-        nodes.erase(nodes.begin());
-        delete temp;
-        updatePositions();
+// Bounded multi-producer/multi-consumer queue (Vyukov). Every cell carries a sequence
+// number telling producers and consumers whose turn it is; a failed claim is counted
+// as a retry so contention can be reported.
+template <typename T>
+class MpmcQueue {
+public:
+    explicit MpmcQueue(size_t minimumCapacity) {
+        size_t capacity = 2;
+        while (capacity < minimumCapacity) capacity *= 2;
+        cells.reset(new Cell[capacity]);
+        for (size_t i = 0; i < capacity; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+        mask = capacity - 1;
     }
 
-    void updatePositions() {
-        float startX = 220;
-        float y = 450;
-        for (auto& node : nodes) {
-            node->setPosition(sf::Vector2f(startX, y));
-            startX += 150;
-
-            if (node->next) {
-                node->arrow.setSize(sf::Vector2f(30, 2));
-                node->arrow.setFillColor(sf::Color::White);
+    bool tryPush(const T& value, unsigned long long& retries) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            long long diff = static_cast<long long>(sequence) - static_cast<long long>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+                ++retries;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+                ++retries;
             }
         }
     }
 
-    void draw(sf::RenderWindow& window) {
-        for (auto& node : nodes) {
-            node->draw(window);
+    bool tryPop(T& value, unsigned long long& retries) {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            long long diff = static_cast<long long>(sequence) - static_cast<long long>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+                ++retries;
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+                ++retries;
+            }
         }
     }
 
-    void reset() {
-        front = rear = nullptr;
-        for (auto node : nodes) delete node;
-        nodes.clear();
+    size_t approximateSize() const {
+        size_t d = dequeuePos.load(std::memory_order_relaxed);
+        size_t e = enqueuePos.load(std::memory_order_relaxed);
+        return e > d ? std::min(e - d, mask + 1) : 0;
     }
 
-    void search(int value) {
-        for (auto& node : nodes) {
-            if (node->value == value) {
-                node->circle.setFillColor(sf::Color::Yellow); // Highlight the found node
-                return;
-            }
-        }
-        std::cout << "Number does not exist." << std::endl;
-    }
+    size_t capacity() const { return mask + 1; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> enqueuePos{0};
+    alignas(64) std::atomic<size_t> dequeuePos{0};
 };
 
-class BSTNode {
+// Producer/consumer threads pushing timestamps through one of the queues above. Every
+// worker owns its counters and is their only writer; sample() reads them with relaxed
+// loads, so the render thread never takes a lock or stalls a worker.
+class QueueSimulation {
 public:
-    int value;
-    BSTNode* left;
-    BSTNode* right;
-    sf::CircleShape circle;
-    sf::Text text;
+    enum class Mode { Spsc, Mpmc };
 
-    BSTNode(int val, const sf::Font& font) : value(val), left(nullptr), right(nullptr) {
-        circle.setRadius(30);
-        circle.setFillColor(sf::Color::Green);
-        circle.setOutlineThickness(2);
-        circle.setOutlineColor(sf::Color::White);
+    struct Config {
+        Mode mode = Mode::Spsc;
+        int producers = 1;
+        int consumers = 1;
+        size_t capacity = 1024;
+    };
 
-        text.setFont(font);
-        text.setString(std::to_string(val));
-        text.setCharacterSize(20);
-        text.setFillColor(sf::Color::White);
-        text.setPosition(
-            circle.getPosition().x + (circle.getRadius() - text.getLocalBounds().width) / 2 + 10,
-            circle.getPosition().y + (circle.getRadius() - text.getLocalBounds().height) / 2 + 10
-        );
-    }
+    struct Sample {
+        double seconds = 0;
+        size_t occupancy = 0;
+        double opsPerSecond = 0;       // items consumed
+        double p50 = 0, p99 = 0, p999 = 0; // enqueue-to-dequeue latency in microseconds
+        double retriesPerSecond = 0;   // lost CAS races
+        double stallsPerSecond = 0;    // pushes on full plus pops on empty
+    };
 
-    void setPosition(sf::Vector2f position) {
-        circle.setPosition(position);
-        text.setPosition(
-            position.x + (circle.getRadius() - text.getLocalBounds().width) / 2 + 12,
-            position.y + (circle.getRadius() - text.getLocalBounds().height) / 2 + 7
-        );
-    }
+    static const int LATENCY_BUCKETS = 256;
 
-    void draw(sf::RenderWindow& window) {
-        window.draw(circle);
-        window.draw(text);
+    ~QueueSimulation() {
+        stop();
     }
-};
 
-class BSTVisualizer {
-public:
-    BSTNode* root;
-    sf::Font font;
-    std::vector<std::pair<BSTNode*, BSTNode*>> edges;
-    std::vector<BSTNode*> nodes;
-    int currentStep = 50;
-    bool isAnimating = false;
+    void start(Config requested) {
+        stop();
+        config = requested;
+        if (config.mode == Mode::Spsc) {
+            config.producers = 1;
+            config.consumers = 1;
+        }
+        config.producers = std::max(1, std::min(config.producers, 16));
+        config.consumers = std::max(1, std::min(config.consumers, 16));
 
-    BSTVisualizer() : root(nullptr) {
-        if (!font.loadFromFile("arial.ttf")) {
-            std::cerr << "Error loading font!" << std::endl;
+        spsc.reset();
+        mpmc.reset();
+        if (config.mode == Mode::Spsc) spsc.reset(new SpscRing<long long>(config.capacity));
+        else mpmc.reset(new MpmcQueue<long long>(config.capacity));
+
+        counters.reset(new WorkerCounters[config.producers + config.consumers]);
+        previous = Totals();
+        startTime = lastSample = std::chrono::steady_clock::now();
+        running.store(true);
+
+        for (int i = 0; i < config.producers; ++i) {
+            workers.emplace_back([this, i] { produce(counters[i]); });
+        }
+        for (int i = 0; i < config.consumers; ++i) {
+            workers.emplace_back([this, i] { consume(counters[config.producers + i]); });
         }
     }
 
-    void insert(int value) {
-        root = insertRecursive(root, value);
+    void stop() {
+        running.store(false);
+        for (std::thread& worker : workers) worker.join();
+        workers.clear();
+    }
+
+    bool isRunning() const {
+        return !workers.empty();
+    }
+
+    const Config& getConfig() const {
+        return config;
     }
 
-    const int MAX_BST_DEPTH = 4;
+    size_t capacity() const {
+        if (spsc) return spsc->capacity();
+        if (mpmc) return mpmc->capacity();
+        return 0;
+    }
 
-    BSTNode* insertRecursive(BSTNode* node, int value, int depth = 0) {
-        if (node == nullptr) {
-            BSTNode* newNode = new BSTNode(value, font);
-            nodes.push_back(newNode);
-            return newNode;
+    // Rates and percentiles over the interval since the previous call
+    Sample sample() {
+        Sample result;
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastSample).count();
+        result.seconds = std::chrono::duration<double>(now - startTime).count();
+        lastSample = now;
+        if (!counters) return result;
+
+        if (spsc) result.occupancy = spsc->approximateSize();
+        if (mpmc) result.occupancy = mpmc->approximateSize();
+
+        Totals current = totals();
+        if (elapsed > 0) {
+            result.opsPerSecond = (current.consumed - previous.consumed) / elapsed;
+            result.retriesPerSecond = (current.retries - previous.retries) / elapsed;
+            result.stallsPerSecond = (current.stalls - previous.stalls) / elapsed;
         }
 
-        if (value < node->value) {
-            if (depth >= MAX_BST_DEPTH) {
-                std::cout << "Max BST depth reached! Cannot insert more nodes.\n";
-                return node;  // Prevent deeper insertion
-            }
-            node->left = insertRecursive(node->left, value, depth + 1);
-            edges.push_back({node, node->left});
-        } else if (value > node->value) {
-            if (depth >= MAX_BST_DEPTH) {
-                std::cout << "Max BST depth reached! Cannot insert more nodes.\n";
-                return node;  // Prevent deeper insertion
-            }
-            node->right = insertRecursive(node->right, value, depth + 1);
-            edges.push_back({node, node->right});
+        unsigned long long window[LATENCY_BUCKETS];
+        unsigned long long count = 0;
+        for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+            window[b] = current.latency[b] - previous.latency[b];
+            count += window[b];
         }
+        result.p50 = percentile(window, count, 0.5);
+        result.p99 = percentile(window, count, 0.99);
+        result.p999 = percentile(window, count, 0.999);
 
-        return node;
+        previous = current;
+        return result;
     }
 
-    void drawTree(sf::RenderWindow& window, BSTNode* node, float x, float y, float horizontalSpacing = 100) {
-        if (node == nullptr) return;
+private:
+    struct alignas(64) WorkerCounters {
+        std::atomic<unsigned long long> ops{0};
+        std::atomic<unsigned long long> retries{0};
+        std::atomic<unsigned long long> stalls{0};
+        std::atomic<unsigned long long> latency[LATENCY_BUCKETS] = {};
+    };
 
-        node->setPosition(sf::Vector2f(x, y));
+    struct Totals {
+        unsigned long long consumed = 0;
+        unsigned long long retries = 0;
+        unsigned long long stalls = 0;
+        unsigned long long latency[LATENCY_BUCKETS] = {};
+    };
 
-        for (int i = 0; i < currentStep && i < edges.size(); ++i) {
-            auto& edge = edges[i];
-            sf::Vertex line[] = {
-                sf::Vertex(sf::Vector2f(edge.first->circle.getPosition().x + 20, edge.first->circle.getPosition().y + 40)),
-                sf::Vertex(sf::Vector2f(edge.second->circle.getPosition().x + 20, edge.second->circle.getPosition().y))
-            };
-            window.draw(line, 2, sf::Lines);
-        }
+    Config config;
+    std::unique_ptr<SpscRing<long long>> spsc;
+    std::unique_ptr<MpmcQueue<long long>> mpmc;
+    std::unique_ptr<WorkerCounters[]> counters;
+    std::vector<std::thread> workers;
+    std::atomic<bool> running{false};
+    Totals previous;
+    std::chrono::steady_clock::time_point startTime;
+    std::chrono::steady_clock::time_point lastSample;
+
+    // Single writer per counter, so a plain load/store avoids a locked add
+    static void bump(std::atomic<unsigned long long>& counter, unsigned long long amount = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
 
-        for (int i = 0; i < currentStep && i < nodes.size(); ++i) {
-            nodes[i]->draw(window);
-        }
+    static long long nowNanoseconds() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
 
-        if (node->left) {
-            drawTree(window, node->left, x - horizontalSpacing, y + 120, horizontalSpacing / 2);
-        }
+    // Quarter-octave buckets: two mantissa bits after the leading one
+    static int latencyBucket(unsigned long long ns) {
+        if (ns < 4) return static_cast<int>(ns);
+        int msb = 2;
+        while (msb < 63 && (ns >> (msb + 1))) ++msb;
+        return std::min(LATENCY_BUCKETS - 1, msb * 4 + static_cast<int>((ns >> (msb - 2)) & 3));
+    }
 
-        if (node->right) {
-            drawTree(window, node->right, x + horizontalSpacing, y + 120, horizontalSpacing / 2);
-        }
+    static double bucketNanoseconds(int bucket) {
+        if (bucket < 4) return bucket;
+        int msb = bucket / 4;
+        return std::ldexp(4.0 + bucket % 4, msb - 2);
     }
 
-    void updateAnimation() {
-        if (isAnimating && currentStep < nodes.size() + edges.size()) {
-            currentStep++;
+    static double percentile(const unsigned long long* histogram, unsigned long long count, double fraction) {
+        if (count == 0) return 0;
+        unsigned long long rank = static_cast<unsigned long long>(std::ceil(fraction * count));
+        unsigned long long seen = 0;
+        for (int b = 0; b < LATENCY_BUCKETS; ++b) {
+            seen += histogram[b];
+            if (seen >= rank) return bucketNanoseconds(b) / 1000.0;
         }
+        return bucketNanoseconds(LATENCY_BUCKETS - 1) / 1000.0;
     }
 
-    void draw(sf::RenderWindow& window) {
-        drawTree(window, root, 750, 250, 100);
+    Totals totals() const {
+        Totals result;
+        int workerCount = config.producers + config.consumers;
+        for (int i = 0; i < workerCount; ++i) {
+            const WorkerCounters& c = counters[i];
+            if (i >= config.producers) result.consumed += c.ops.load(std::memory_order_relaxed);
+            result.retries += c.retries.load(std::memory_order_relaxed);
+            result.stalls += c.stalls.load(std::memory_order_relaxed);
+            for (int b = 0; b < LATENCY_BUCKETS; ++b) result.latency[b] += c.latency[b].load(std::memory_order_relaxed);
+        }
+        return result;
     }
 
-    void reset() {
-        root = nullptr;
-        edges.clear();
-        nodes.clear();
-        currentStep = 0;
-        isAnimating = false;
+    void produce(WorkerCounters& mine) {
+        while (running.load(std::memory_order_relaxed)) {
+            unsigned long long retries = 0;
+            bool pushed = spsc ? spsc->tryPush(nowNanoseconds()) : mpmc->tryPush(nowNanoseconds(), retries);
+            if (retries) bump(mine.retries, retries);
+            if (pushed) {
+                bump(mine.ops);
+            } else {
+                bump(mine.stalls);
+                std::this_thread::yield();
+            }
+        }
     }
 
-    void search(int value) {
-        BSTNode* current = root;
-        while (current) {
-            if (current->value == value) {
-                current->circle.setFillColor(sf::Color::Yellow); // Highlight the found node
-                return;
-            } else if (value < current->value) {
-                current = current->left;
+    void consume(WorkerCounters& mine) {
+        while (running.load(std::memory_order_relaxed)) {
+            long long stamp = 0;
+            unsigned long long retries = 0;
+            bool popped = spsc ? spsc->tryPop(stamp) : mpmc->tryPop(stamp, retries);
+            if (retries) bump(mine.retries, retries);
+            if (popped) {
+                bump(mine.ops);
+                long long latency = nowNanoseconds() - stamp;
+                bump(mine.latency[latencyBucket(latency > 0 ? latency : 0)]);
             } else {
-                current = current->right;
+                bump(mine.stalls);
+                std::this_thread::yield();
             }
         }
-        std::cout << "Number does not exist." << std::endl;
     }
 };
 
-class AVLNode {
-public:
-    int value;
-    int height;
-    AVLNode* left;
-    AVLNode* right;
-    sf::CircleShape circle;
-    sf::Text valueText;
-    sf::Text balanceFactorText;
-
-    AVLNode(int val, const sf::Font& font) : value(val), height(1), left(nullptr), right(nullptr) {
-        circle.setRadius(30);
-        circle.setFillColor(sf::Color::Blue);
-        circle.setOutlineThickness(2);
-        circle.setOutlineColor(sf::Color::White);
-
-        valueText.setFont(font);
-        valueText.setString(std::to_string(val));
-        valueText.setCharacterSize(20);
-        valueText.setFillColor(sf::Color::White);
-
-        balanceFactorText.setFont(font);
-        balanceFactorText.setString("0");
-        balanceFactorText.setCharacterSize(12);
-        balanceFactorText.setFillColor(sf::Color::Yellow);
+// "spsc", "mpmc" and up to two thread counts (producers, consumers) in any order
+inline QueueSimulation::Config parseSimulationConfig(std::istream& in) {
+    QueueSimulation::Config config;
+    std::string token;
+    int counts = 0;
+    bool explicitMode = false;
+    while (in >> token) {
+        if (token == "spsc" || token == "mpmc") {
+            config.mode = token == "spsc" ? QueueSimulation::Mode::Spsc : QueueSimulation::Mode::Mpmc;
+            explicitMode = true;
+        } else if (std::isdigit(static_cast<unsigned char>(token[0]))) {
+            int value = std::atoi(token.c_str());
+            if (counts == 0) config.producers = value;
+            else if (counts == 1) config.consumers = value;
+            else config.capacity = static_cast<size_t>(std::max(2, value));
+            ++counts;
+        }
     }
+    // More than one thread on a side needs the MPMC queue
+    if (!explicitMode && (config.producers > 1 || config.consumers > 1)) config.mode = QueueSimulation::Mode::Mpmc;
+    return config;
+}
 
-    void setPosition(sf::Vector2f position) {
-        circle.setPosition(position);
-        valueText.setPosition(
-            position.x + (circle.getRadius() - valueText.getLocalBounds().width) / 2 + 12,
-            position.y + (circle.getRadius() - valueText.getLocalBounds().height) / 2 + 7
-        );
-        balanceFactorText.setPosition(
-            position.x + circle.getRadius() - balanceFactorText.getLocalBounds().width / 2,
-            position.y + circle.getRadius() * 2 - 5
-        );
+// Headless run: --queue-bench [spsc|mpmc] [producers] [consumers] [capacity]
+inline int runQueueBenchmark(std::istream& args) {
+    QueueSimulation::Config config = parseSimulationConfig(args);
+    QueueSimulation simulation;
+    simulation.start(config);
+    const QueueSimulation::Config& used = simulation.getConfig();
+    std::cout << (used.mode == QueueSimulation::Mode::Spsc ? "spsc" : "mpmc")
+              << " producers=" << used.producers << " consumers=" << used.consumers
+              << " capacity=" << simulation.capacity() << std::endl;
+    std::cout << "second ops/s p50_us p99_us p99.9_us retries/s stalls/s" << std::endl;
+
+    double totalOps = 0;
+    const int SECONDS = 5;
+    simulation.sample();
+    for (int second = 1; second <= SECONDS; ++second) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        QueueSimulation::Sample s = simulation.sample();
+        totalOps += s.opsPerSecond;
+        std::cout << second << " " << static_cast<long long>(s.opsPerSecond) << " " << s.p50 << " " << s.p99 << " " << s.p999
+                  << " " << static_cast<long long>(s.retriesPerSecond) << " " << static_cast<long long>(s.stallsPerSecond) << std::endl;
     }
+    simulation.stop();
+    std::cout << "mean ops/s " << static_cast<long long>(totalOps / SECONDS) << std::endl;
+    return 0;
+}
 
-    void updateBalanceFactor(int bf) {
-        balanceFactorText.setString(std::to_string(bf));
+// One node of a chain drawn left to right: the disc, its value over it and an arrow
+// towards the next node. The queue and cache pages draw their lists with it.
+inline void addChainNode(BatchRenderer& batch, sf::CircleShape& shape, NodeLabel& text, sf::RectangleShape& arrow,
+                         sf::Vector2f position, bool linkNext) {
+    float radius = shape.getRadius();
+    shape.setPosition(position);
+    batch.addCircle(shape);
+    text.setPosition(
+        position.x + (radius - text.getLocalBounds().width) / 2 + radius * 0.4f,
+        position.y + (radius - text.getLocalBounds().height) / 2 + radius * 0.2f
+    );
+    batch.addLabel(text);
+    if (linkNext) {
+        arrow.setPosition(position.x + 2 * radius + 10, position.y + radius);
+        batch.addRect(arrow);
     }
+}
 
-    void draw(sf::RenderWindow& window) {
-        window.draw(circle);
-        window.draw(valueText);
-        window.draw(balanceFactorText);
+// One series over a sample history of up to capacity samples, scaled to its own
+// maximum unless a fixed peak is given
+template <typename History, typename Metric>
+void addSeriesPlot(BatchRenderer& batch, const History& history, size_t capacity, sf::Vector2f origin, sf::Vector2f size,
+                   Metric metric, sf::Color color, double fixedPeak = 0) {
+    sf::Color frame(120, 120, 120);
+    batch.addEdge(origin, origin + sf::Vector2f(0, size.y), frame);
+    batch.addEdge(origin + sf::Vector2f(0, size.y), origin + size, frame);
+
+    double peak = fixedPeak;
+    if (peak <= 0) {
+        for (size_t i = 0; i < history.size(); ++i) peak = std::max(peak, metric(history[i]) * 1.1);
     }
-};
+    if (peak <= 0 || history.size() < 2) return;
+
+    float step = size.x / (capacity - 1);
+    sf::Vector2f previous;
+    for (size_t i = 0; i < history.size(); ++i) {
+        float height = static_cast<float>(std::min(1.0, metric(history[i]) / peak)) * size.y;
+        sf::Vector2f point(origin.x + i * step, origin.y + size.y - height);
+        if (i > 0) batch.addEdge(previous, point, color);
+        previous = point;
+    }
+}
 
-class AVLVisualizer {
+class QueueVisualizer {
 public:
-    AVLNode* root;
+    RingBuffer<int> values;
     sf::Font font;
-    std::vector<AVLNode*> nodes;
     bool isAnimating = false;
-    std::chrono::duration<double, std::milli> avlInsertionTime;
-    std::chrono::duration<double, std::milli> estimatedBSTTime;
+    int animationStep = 50;
+    BatchRenderer batch;
 
-    AVLVisualizer() : root(nullptr), avlInsertionTime(0), estimatedBSTTime(0) {
+    // Sliding window over the queue: the view only shows elements scrollOffset onwards
+    size_t scrollOffset = 0;
+    unsigned long long dequeued = 0;          // total dequeues, turns positions into stable ids
+    long long highlightedId = -1;
+
+    sf::CircleShape nodeShape;
+    NodeLabel nodeText;
+    NodeLabel indexText;
+    sf::RectangleShape arrow;
+    sf::RectangleShape track;
+    sf::RectangleShape trackView;
+    sf::Text statusText;
+
+    // Live producer/consumer mode; history holds one sample per SAMPLE_SECONDS
+    QueueSimulation simulation;
+    RingBuffer<QueueSimulation::Sample> history;
+    sf::Clock sampleClock;
+    sf::RectangleShape occupancyBar;
+    sf::RectangleShape occupancyFill;
+    sf::Text plotText;
+
+    const size_t VISIBLE_NODES = 8;
+    const size_t HISTORY_SAMPLES = 120;
+    const float SAMPLE_SECONDS = 0.25f;
+
+    QueueVisualizer() {
+        TRACE_SCOPE("load font");
         if (!font.loadFromFile("arial.ttf")) {
             std::cerr << "Error loading font!" << std::endl;
         }
+
+        nodeShape.setRadius(30);
+        nodeShape.setOutlineThickness(2);
+        nodeShape.setOutlineColor(sf::Color::White);
+
+        nodeText.setFont(font);
+        nodeText.setCharacterSize(15);
+        nodeText.setFillColor(sf::Color::White);
+        nodeText.setStyle(sf::Text::Bold);
+
+        indexText.setFont(font);
+        indexText.setCharacterSize(14);
+        indexText.setFillColor(sf::Color(200, 200, 200));
+
+        arrow.setSize(sf::Vector2f(30, 2));
+        arrow.setFillColor(sf::Color::White);
+
+        // Overview of the whole queue, front on the left
+        track.setSize(sf::Vector2f(1110, 10));
+        track.setPosition(220, 580);
+        track.setFillColor(sf::Color(80, 80, 80));
+        trackView.setFillColor(sf::Color(255, 0, 255, 160));
+
+        statusText.setFont(font);
+        statusText.setCharacterSize(18);
+        statusText.setFillColor(sf::Color::White);
+        statusText.setPosition(220, 610);
+
+        occupancyBar.setSize(sf::Vector2f(1110, 30));
+        occupancyBar.setPosition(220, 250);
+        occupancyBar.setFillColor(sf::Color(80, 80, 80));
+        occupancyFill.setFillColor(sf::Color::Magenta);
+
+        plotText.setFont(font);
+        plotText.setCharacterSize(16);
+        plotText.setFillColor(sf::Color::White);
     }
 
-    int getHeight(AVLNode* node) {
-        return node ? node->height : 0;
+    void startSimulation(const std::string& settings) {
+        std::istringstream in(settings);
+        simulation.start(parseSimulationConfig(in));
+        history.clear();
+        sampleClock.restart();
     }
 
-    int getBalance(AVLNode* node) {
-        return node ? getHeight(node->left) - getHeight(node->right) : 0;
+    void stopSimulation() {
+        simulation.stop();
     }
 
-    AVLNode* rightRotate(AVLNode* y) {
-        AVLNode* x = y->left;
-        AVLNode* T2 = x->right;
+    void enqueue(int value) {
+        values.push_back(value);
+    }
 
-        x->right = y;
-        y->left = T2;
+    void enqueueBatch(const std::vector<int>& batch) {
+        values.reserve(values.size() + batch.size());
+        for (int value : batch) values.push_back(value);
+    }
 
-        y->height = std::max(getHeight(y->left), getHeight(y->right)) + 1;
-        x->height = std::max(getHeight(x->left), getHeight(x->right)) + 1;
+    void dequeue() {
+        if (values.empty()) return;
+        values.pop_front();
+        ++dequeued;
+        clampScroll();
+    }
 
-        x->updateBalanceFactor(getBalance(x));
-        y->updateBalanceFactor(getBalance(y));
+    void clampScroll() {
+        size_t maxOffset = values.size() > VISIBLE_NODES ? values.size() - VISIBLE_NODES : 0;
+        scrollOffset = std::min(scrollOffset, maxOffset);
+    }
 
-        return x;
+    void scroll(float delta) {
+        long long step = std::max<long long>(1, static_cast<long long>(values.size() / 200));
+        long long target = static_cast<long long>(scrollOffset) + (delta > 0 ? -step : step);
+        scrollOffset = static_cast<size_t>(std::max<long long>(0, target));
+        clampScroll();
     }
 
-    AVLNode* leftRotate(AVLNode* x) {
-        AVLNode* y = x->right;
-        AVLNode* T2 = y->left;
+    void draw(sf::RenderTarget& window) {
+        if (simulation.isRunning()) {
+            drawSimulation(window);
+            return;
+        }
 
-        y->left = x;
-        x->right = T2;
+        size_t end = std::min(values.size(), scrollOffset + VISIBLE_NODES);
+        float startX = 220;
+        float y = 450;
+        for (size_t i = scrollOffset; i < end; ++i) {
+            float x = startX + (i - scrollOffset) * 150;
+            bool found = static_cast<long long>(dequeued + i) == highlightedId;
+            nodeShape.setFillColor(found ? sf::Color::Yellow : sf::Color::Magenta);
+            nodeText.setString(std::to_string(values[i]));
+            addChainNode(batch, nodeShape, nodeText, arrow, sf::Vector2f(x, y), i + 1 < values.size());
+
+            indexText.setString(i == 0 ? "front" : (i + 1 == values.size() ? "rear" : "+" + std::to_string(i)));
+            indexText.setPosition(x + 30 - indexText.getLocalBounds().width / 2, y + 75);
+            batch.addLabel(indexText);
+        }
 
-        x->height = std::max(getHeight(x->left), getHeight(x->right)) + 1;
-        y->height = std::max(getHeight(y->left), getHeight(y->right)) + 1;
+        if (values.size() > VISIBLE_NODES) {
+            float total = static_cast<float>(values.size());
+            float width = track.getSize().x;
+            trackView.setSize(sf::Vector2f(std::max(4.f, width * VISIBLE_NODES / total), track.getSize().y));
+            trackView.setPosition(track.getPosition().x + width * scrollOffset / total, track.getPosition().y);
+            batch.addRect(track);
+            batch.addRect(trackView);
+        }
+        batch.flush(window);
 
-        x->updateBalanceFactor(getBalance(x));
-        y->updateBalanceFactor(getBalance(y));
+        if (!values.empty()) {
+            statusText.setString("Size: " + std::to_string(values.size()) + "   Capacity: " + std::to_string(values.capacity()));
+        } else {
+            statusText.setString("Type e.g. \"mpmc 4 4\" and press Simulate to run producer and consumer threads.");
+        }
+        window.draw(statusText);
+    }
 
-        return y;
+    void drawSimulation(sf::RenderTarget& window) {
+        if (sampleClock.getElapsedTime().asSeconds() >= SAMPLE_SECONDS) {
+            sampleClock.restart();
+            if (history.size() == HISTORY_SAMPLES) history.pop_front();
+            history.push_back(simulation.sample());
+        }
+        if (history.empty()) return;
+        const QueueSimulation::Sample& latest = history.back();
+
+        // Occupancy as a fill bar over the ring's capacity
+        float fraction = static_cast<float>(latest.occupancy) / std::max<size_t>(1, simulation.capacity());
+        occupancyFill.setSize(sf::Vector2f(occupancyBar.getSize().x * std::min(1.f, fraction), occupancyBar.getSize().y));
+        occupancyFill.setPosition(occupancyBar.getPosition());
+        batch.addRect(occupancyBar);
+        batch.addRect(occupancyFill);
+
+        sf::Vector2f plotSize(350, 220);
+        drawPlot(sf::Vector2f(220, 340), plotSize, [](const QueueSimulation::Sample& s) { return s.opsPerSecond; }, sf::Color::Green);
+        drawPlot(sf::Vector2f(600, 340), plotSize, [](const QueueSimulation::Sample& s) { return s.p999; }, sf::Color::Red);
+        drawPlot(sf::Vector2f(600, 340), plotSize, [](const QueueSimulation::Sample& s) { return s.p99; }, sf::Color::Yellow);
+        drawPlot(sf::Vector2f(600, 340), plotSize, [](const QueueSimulation::Sample& s) { return s.p50; }, sf::Color::Cyan);
+        drawPlot(sf::Vector2f(980, 340), plotSize, [](const QueueSimulation::Sample& s) { return s.stallsPerSecond; }, sf::Color(255, 165, 0));
+        drawPlot(sf::Vector2f(980, 340), plotSize, [](const QueueSimulation::Sample& s) { return s.retriesPerSecond; }, sf::Color::Magenta);
+        batch.flush(window);
+
+        const QueueSimulation::Config& config = simulation.getConfig();
+        drawPlotText(window, sf::Vector2f(220, 215), std::string(config.mode == QueueSimulation::Mode::Spsc ? "SPSC ring" : "MPMC queue")
+            + "   producers " + std::to_string(config.producers) + "   consumers " + std::to_string(config.consumers)
+            + "   occupancy " + std::to_string(latest.occupancy) + " / " + std::to_string(simulation.capacity()));
+        drawPlotText(window, sf::Vector2f(220, 570), "Throughput  " + formatRate(latest.opsPerSecond) + " ops/s");
+        drawPlotText(window, sf::Vector2f(600, 570), "Latency us  p50 " + formatRate(latest.p50)
+            + "  p99 " + formatRate(latest.p99) + "  p99.9 " + formatRate(latest.p999));
+        drawPlotText(window, sf::Vector2f(980, 570), "Stalls " + formatRate(latest.stallsPerSecond)
+            + "/s  CAS retries " + formatRate(latest.retriesPerSecond) + "/s");
+    }
+
+    template <typename Metric>
+    void drawPlot(sf::Vector2f origin, sf::Vector2f size, Metric metric, sf::Color color) {
+        addSeriesPlot(batch, history, HISTORY_SAMPLES, origin, size, metric, color);
+    }
+
+    void drawPlotText(sf::RenderTarget& window, sf::Vector2f position, const std::string& text) {
+        plotText.setString(text);
+        plotText.setPosition(position);
+        window.draw(plotText);
+    }
+
+    static std::string formatRate(double value) {
+        std::ostringstream out;
+        out.precision(3);
+        if (value >= 1e6) out << value / 1e6 << "M";
+        else if (value >= 1e3) out << value / 1e3 << "k";
+        else out << value;
+        return out.str();
+    }
+
+    void reset() {
+        simulation.stop();
+        history.clear();
+        values.release();
+        scrollOffset = 0;
+        dequeued = 0;
+        highlightedId = -1;
     }
 
-    const int MAX_AVL_DEPTH = 4;
+    // Front to back, one run or two depending on where the ring wraps
+    void saveSnapshot(const std::string& path) {
+        SnapshotWriter writer;
+        if (!writer.open(path, SnapshotHeader::Queue, values.size(), 0, false)) return;
+        auto first = values.firstRun();
+        auto second = values.secondRun();
+        std::vector<int> contiguous;
+        if (second.second > 0) {
+            contiguous.reserve(values.size());
+            contiguous.insert(contiguous.end(), first.first, first.first + first.second);
+            contiguous.insert(contiguous.end(), second.first, second.first + second.second);
+            first = std::make_pair(static_cast<const int*>(contiguous.data()), contiguous.size());
+        }
+        writer.section(first.first, first.second);
+        if (!writer.close()) std::cerr << "Error writing snapshot " << path << std::endl;
+    }
 
-    AVLNode* insertRecursive(AVLNode* node, int value, int depth = 0) {
-        if (!node) {
-            AVLNode* newNode = new AVLNode(value, font);
-            nodes.push_back(newNode);
-            return newNode;
+    void loadSnapshot(const std::string& path) {
+        SnapshotReader reader;
+        if (!reader.open(path, SnapshotHeader::Queue)) return;
+        size_t count = static_cast<size_t>(reader.header->count);
+        const int* data = reader.section<int>(count);
+        if (!data) {
+            std::cerr << "Truncated snapshot " << path << std::endl;
+            return;
         }
+        reset();
+        values.reserve(count);
+        for (size_t i = 0; i < count; ++i) values.push_back(data[i]);
+    }
 
-        if (value < node->value) {
-            if (depth >= MAX_AVL_DEPTH) {
-                std::cout << "Max AVL depth reached! Cannot insert " << value << ".\n";
-                return node;  // Return the existing node, not nullptr
-            }
+    void search(int value) {
+        // The ring is at most two contiguous runs, each scanned with SIMD
+        auto first = values.firstRun();
+        auto second = values.secondRun();
+        long long index = findFirstInt(first.first, first.second, value);
+        if (index < 0 && second.second > 0) {
+            index = findFirstInt(second.first, second.second, value);
+            if (index >= 0) index += first.second;
+        }
+
+        if (index >= 0) {
+            highlightedId = static_cast<long long>(dequeued) + index; // Highlight the found node
+            scrollOffset = static_cast<size_t>(index) > VISIBLE_NODES / 2 ? index - VISIBLE_NODES / 2 : 0;
+            clampScroll();
+            return;
+        }
+        std::cout << "Number does not exist." << std::endl;
+    }
+};
+
+// Coroutine frames come from per-thread free lists in 64-byte size classes. A coroutine
+// is started for every insert and search, and once the lists are warm none of them
+// reaches the allocator.
+class FramePool {
+public:
+    static void* allocate(size_t size) {
+        size_t sizeClass = (size + GRANULE - 1) / GRANULE;
+        if (sizeClass >= CLASSES) return ::operator new(size);
+        Block*& head = lists().heads[sizeClass];
+        if (!head) return ::operator new(sizeClass * GRANULE);
+        Block* block = head;
+        head = block->next;
+        return block;
+    }
+
+    static void release(void* frame, size_t size) {
+        size_t sizeClass = (size + GRANULE - 1) / GRANULE;
+        if (sizeClass >= CLASSES) {
+            ::operator delete(frame);
+            return;
+        }
+        Block* block = static_cast<Block*>(frame);
+        block->next = lists().heads[sizeClass];
+        lists().heads[sizeClass] = block;
+    }
+
+private:
+    static constexpr size_t GRANULE = 64;
+    static constexpr size_t CLASSES = 64;    // frames up to 4 KB are pooled
+
+    struct Block {
+        Block* next;
+    };
+
+    struct Lists {
+        Block* heads[CLASSES] = {};
 
-            node->left = insertRecursive(node->left, value, depth + 1);
-        } else if (value > node->value) {
-            if (depth >= MAX_AVL_DEPTH) {
-                std::cout << "Max AVL depth reached! Cannot insert " << value << ".\n";
-                return node;  // Return the existing node, not nullptr
+        ~Lists() {
+            for (Block* head : heads) {
+                while (head) {
+                    Block* next = head->next;
+                    ::operator delete(head);
+                    head = next;
+                }
             }
-            node->right = insertRecursive(node->right, value, depth + 1);
-        } else
-            return node;
+        }
+    };
+
+    static Lists& lists() {
+        thread_local Lists instance;
+        return instance;
+    }
+};
+
+// An algorithm written as a coroutine that co_yields an event at every step. It starts
+// suspended; the animation driver resumes it once per tick, and runToEnd() drives the
+// same code straight through when nobody is watching.
+template <typename Event>
+class StepTask {
+public:
+    struct promise_type {
+        Event current{};
+
+        StepTask get_return_object() {
+            return StepTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(Event event) noexcept {
+            current = event;
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() { throw; }
+
+        static void* operator new(size_t size) { return FramePool::allocate(size); }
+        static void operator delete(void* frame, size_t size) { FramePool::release(frame, size); }
+    };
+
+    StepTask() = default;
+    StepTask(StepTask&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    StepTask& operator=(StepTask&& other) noexcept {
+        if (this != &other) {
+            if (handle) handle.destroy();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    StepTask(const StepTask&) = delete;
+    StepTask& operator=(const StepTask&) = delete;
+
+    ~StepTask() {
+        if (handle) handle.destroy();
+    }
+
+    // Runs to the next event; false once the algorithm has finished
+    bool step() {
+        if (!handle || handle.done()) return false;
+        handle.resume();
+        return !handle.done();
+    }
+
+    const Event& event() const { return handle.promise().current; }
+
+    void runToEnd() {
+        while (step()) {}
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit StepTask(std::coroutine_handle<promise_type> h) : handle(h) {}
+};
+
+// One step of a tree algorithm. node is an index into the visualizer's nodes.
+struct TreeEvent {
+    enum Kind : unsigned char { None, Compare, Insert, Rotate, Found, Missing, Recolor };
+
+    Kind kind = None;
+    int node = -1;
+    int value = 0;      // the key being inserted or searched for
+};
+
+// Runs a tree's step coroutines one after another, one event per tick. Anything that
+// changes the tree outside a coroutine finishes (or cancels) the queue first, so a
+// suspended coroutine never sees the tree move under it.
+class StepDriver {
+public:
+    TreeEvent event;    // the event shown until the next tick
+
+    void queue(StepTask<TreeEvent> task) {
+        pending.push_back(std::move(task));
+    }
+
+    // False when nothing is left to run
+    bool tick() {
+        while (!pending.empty()) {
+            if (pending.front().step()) {
+                event = pending.front().event();
+                return true;
+            }
+            pending.pop_front();
+        }
+        event = TreeEvent();
+        return false;
+    }
+
+    void finish() {
+        while (tick()) {}
+    }
+
+    void cancel() {
+        pending.clear();
+        event = TreeEvent();
+    }
+
+    bool busy() const {
+        return !pending.empty();
+    }
+
+private:
+    std::deque<StepTask<TreeEvent>> pending;
+};
+
+// Work done by the inserts and searches of a balanced tree: the last operation and the
+// running total. The AVL tree keeps heights instead of colours, so a height that changes
+// on the way back up counts as its recolouring.
+struct BalanceCounters {
+    struct Counts {
+        size_t comparisons = 0;
+        size_t rotations = 0;
+        size_t recolorings = 0;
+    };
+
+    Counts last;
+    Counts total;
+    size_t operations = 0;
+
+    void begin() {
+        last = Counts();
+        ++operations;
+    }
+
+    void comparison() {
+        ++last.comparisons;
+        ++total.comparisons;
+    }
+
+    void rotation() {
+        ++last.rotations;
+        ++total.rotations;
+    }
+
+    void recoloring() {
+        ++last.recolorings;
+        ++total.recolorings;
+    }
+};
+
+// Render-side picture of a tree. The worker builds a fresh one after each burst of
+// mutations and never touches it again, so the render thread can draw it without locks.
+struct TreeSnapshot {
+    struct Node {
+        int value;
+        int balance;
+        bool highlighted;
+        sf::Vector2f position;        // top-left of the node's circle
+    };
+
+    std::vector<Node> nodes;                 // in insertion order
+    std::vector<std::pair<int, int>> edges;  // parent, child; ordered by child
+    float radius = 30;
+    double layoutMs = 0;             // time the worker spent building this snapshot
+    double insertionMs = 0;
+    double estimatedBSTMs = 0;
+    int height = 0;
+    BalanceCounters counters;
+
+    // Undo history: the version shown and what all retained versions cost
+    size_t version = 0;
+    size_t versionCount = 1;
+    size_t retainedBytes = 0;
+    size_t fullCopyBytes = 0;
+
+    // Step animation: the event on screen and whether more are queued
+    TreeEvent step;
+    bool stepping = false;
+};
+
+// Runs structural mutations on a background thread. Tasks run in the order they were
+// posted; once the queue drains the worker lays the tree out and publishes one
+// snapshot, so pasting thousands of values costs a single layout. While tasks keep
+// coming it still publishes every PUBLISH_INTERVAL_MS, so the screen never sticks on an
+// old tree. Snapshots are swapped in through an atomic shared_ptr and the render thread
+// only ever loads the latest.
+class TreeWorker {
+public:
+    explicit TreeWorker(std::function<std::shared_ptr<TreeSnapshot>()> buildSnapshot)
+        : build(buildSnapshot), published(std::make_shared<const TreeSnapshot>()), lastPublish(std::chrono::steady_clock::now()) {
+        thread = std::thread([this] { run(); });
+    }
+
+    ~TreeWorker() {
+        stop();
+    }
+
+    // Abandons queued tasks; the owner may touch the tree directly afterwards
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        if (thread.joinable()) thread.join();
+    }
+
+    // Busy from here until the snapshot after this task is out
+    void post(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+            busy.store(true, std::memory_order_relaxed);
+        }
+        wake.notify_one();
+    }
+
+    // Blocks until every posted task has run and its snapshot is out (batch mode)
+    void waitIdle() {
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (tasks.empty() && !busy.load(std::memory_order_relaxed)) return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    std::shared_ptr<const TreeSnapshot> latest() const {
+        return published.load();
+    }
+
+    bool isBusy() const {
+        return busy.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr int PUBLISH_INTERVAL_MS = 100;
+
+    std::function<std::shared_ptr<TreeSnapshot>()> build;
+    std::atomic<std::shared_ptr<const TreeSnapshot>> published;
+    std::chrono::steady_clock::time_point lastPublish;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::atomic<bool> busy{false};
+    bool stopping = false;
+    std::thread thread;
+
+    void run() {
+        for (;;) {
+            std::deque<std::function<void()>> batch;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping) return;
+                batch.swap(tasks);
+                busy.store(true, std::memory_order_relaxed);
+            }
+            for (auto& task : batch) task();
+
+            bool drained;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                drained = tasks.empty();
+            }
+            auto start = std::chrono::steady_clock::now();
+            if (drained || start - lastPublish >= std::chrono::milliseconds(PUBLISH_INTERVAL_MS)) {
+                std::shared_ptr<TreeSnapshot> snapshot;
+                {
+                    TRACE_SCOPE("tree layout");
+                    snapshot = build();
+                }
+                lastPublish = std::chrono::steady_clock::now();
+                snapshot->layoutMs = std::chrono::duration<double, std::milli>(lastPublish - start).count();
+                published.store(std::shared_ptr<const TreeSnapshot>(snapshot));
+            }
+            // Idle only if nothing was posted while the snapshot was built
+            if (drained) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (tasks.empty()) busy.store(false, std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+// In-order layout: x follows the sorted position of each node and y its depth, so the
+// picture stays readable at any size. The spacing shrinks to fit the window once the
+// tree gets wide. Iterative, because an unbalanced BST can be as deep as it is large.
+// With cached positions (from a loaded snapshot) only the edges are collected.
+template <typename Node>
+void layoutTreeSnapshot(Node* root, const std::vector<Node*>& nodes, TreeSnapshot& snapshot, float levelGap,
+                        const std::vector<sf::Vector2f>* cached = nullptr, float cachedRadius = 30) {
+    std::vector<int> inorderIndex(nodes.size(), 0);
+    std::vector<int> depth(nodes.size(), 0);
+    std::vector<int> parent(nodes.size(), -1);
+    int maxDepth = 0;
+    int next = 0;
+    std::vector<std::pair<Node*, int>> stack;
+    Node* current = root;
+    int currentDepth = 0;
+    while (current || !stack.empty()) {
+        while (current) {
+            stack.emplace_back(current, currentDepth);
+            if (current->left) parent[current->left->index] = current->index;
+            current = current->left;
+            ++currentDepth;
+        }
+        Node* node = stack.back().first;
+        int nodeDepth = stack.back().second;
+        stack.pop_back();
+        int id = node->index;
+        inorderIndex[id] = next++;
+        depth[id] = nodeDepth;
+        maxDepth = std::max(maxDepth, nodeDepth);
+        if (node->right) parent[node->right->index] = id;
+        current = node->right;
+        currentDepth = nodeDepth + 1;
+    }
+
+    float spacing = std::min(90.f, 1300.f / std::max(1, next));
+    float gap = std::min(levelGap, 450.f / std::max(1, maxDepth));
+    snapshot.radius = cached ? cachedRadius : std::max(2.f, std::min(30.f, spacing * 0.45f));
+    float left = 750 - spacing * (next - 1) / 2 - snapshot.radius + 30;
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        snapshot.nodes[i].position = cached ? (*cached)[i] : sf::Vector2f(left + inorderIndex[i] * spacing, 250 + depth[i] * gap);
+        if (parent[i] >= 0) snapshot.edges.emplace_back(parent[i], static_cast<int>(i));
+    }
+}
+
+// Tree snapshot file with the layout the worker last built. Nodes are written in
+// pre-order, so their positions are permuted to match.
+template <typename Node>
+void saveTreeSnapshot(const std::string& path, SnapshotHeader::Kind kind, Node* root, const std::vector<Node*>& nodes, const TreeSnapshot& layout) {
+    size_t count = nodes.size();
+    SnapshotWriter writer;
+    if (!writer.open(path, kind, count, (2 * count + 63) / 64, layout.nodes.size() == count)) return;
+    std::vector<int> preorder(count);
+    writeTreeSnapshot(writer, root, count, &preorder);
+    if (layout.nodes.size() == count) {
+        std::vector<float> positions(2 * count);
+        for (size_t i = 0; i < count; ++i) {
+            positions[2 * preorder[i]] = layout.nodes[i].position.x;
+            positions[2 * preorder[i] + 1] = layout.nodes[i].position.y;
+        }
+        writer.section(positions.data(), positions.size());
+        SnapshotLayout record = {layout.radius, 0};
+        writer.section(&record, 1);
+    }
+    if (!writer.close()) std::cerr << "Error writing snapshot " << path << std::endl;
+}
+
+// Returns false and leaves the outputs empty when the file is missing or corrupt
+template <typename Node>
+bool loadTreeSnapshot(const std::string& path, SnapshotHeader::Kind kind, Node*& root, std::vector<Node*>& nodes,
+                      std::vector<sf::Vector2f>& layout, float& radius) {
+    SnapshotReader reader;
+    if (!reader.open(path, kind)) return false;
+    size_t count = static_cast<size_t>(reader.header->count);
+    const int* keys = reader.section<int>(count);
+    const unsigned long long* shape = reader.section<unsigned long long>(static_cast<size_t>(reader.header->extra));
+    if (!keys || !shape || reader.header->extra < (2 * count + 63) / 64) {
+        std::cerr << "Truncated snapshot " << path << std::endl;
+        return false;
+    }
+
+    root = count ? readTreeSnapshot(keys, shape, count, nodes) : nullptr;
+    if (count && !root) {
+        std::cerr << "Corrupt tree shape in " << path << std::endl;
+        for (Node* node : nodes) delete node;
+        nodes.clear();
+        return false;
+    }
+
+    const float* positions = reader.hasLayout() ? reader.section<float>(2 * count) : nullptr;
+    const SnapshotLayout* record = positions ? reader.section<SnapshotLayout>(1) : nullptr;
+    if (record) {
+        layout.resize(count);
+        for (size_t i = 0; i < count; ++i) layout[i] = sf::Vector2f(positions[2 * i], positions[2 * i + 1]);
+        radius = record->radius;
+    }
+    return true;
+}
+
+// Draws a snapshot with one reused circle and label. Labels are skipped once the nodes
+// are too small to hold them. The node of the current step is coloured by its kind. With
+// balanceColors (red-black) a node is filled by its balance field instead of fill.
+inline void drawTreeSnapshot(const TreeSnapshot& snapshot, BatchRenderer& batch, sf::CircleShape& circle,
+                             NodeLabel& valueText, NodeLabel* balanceText, sf::Color fill,
+                             const sf::Color* balanceColors = nullptr) {
+    float radius = snapshot.radius;
+    circle.setRadius(radius);
+    circle.setOutlineThickness(radius >= 10 ? 2 : 0);
+    bool labels = radius >= 14;
+
+    for (size_t i = 0; i < snapshot.edges.size(); ++i) {
+        sf::Vector2f from = snapshot.nodes[snapshot.edges[i].first].position;
+        sf::Vector2f to = snapshot.nodes[snapshot.edges[i].second].position;
+        batch.addEdge(from + sf::Vector2f(radius * 2 / 3, radius * 4 / 3), to + sf::Vector2f(radius * 2 / 3, 0));
+    }
+
+    const sf::Color stepColors[] = {fill, sf::Color(255, 140, 0), sf::Color::Cyan, sf::Color::Magenta, sf::Color::Yellow, fill, sf::Color::Green};
+    for (size_t i = 0; i < snapshot.nodes.size(); ++i) {
+        const TreeSnapshot::Node& node = snapshot.nodes[i];
+        circle.setPosition(node.position);
+        if (static_cast<int>(i) == snapshot.step.node) circle.setFillColor(stepColors[snapshot.step.kind]);
+        else if (node.highlighted) circle.setFillColor(sf::Color::Yellow);
+        else circle.setFillColor(balanceColors ? balanceColors[node.balance] : fill);
+        batch.addCircle(circle);
+        if (!labels) continue;
+
+        valueText.setString(std::to_string(node.value));
+        valueText.setPosition(
+            node.position.x + (radius - valueText.getLocalBounds().width) / 2 + 12,
+            node.position.y + (radius - valueText.getLocalBounds().height) / 2 + 7
+        );
+        batch.addLabel(valueText);
+
+        if (balanceText) {
+            balanceText->setString(std::to_string(node.balance));
+            balanceText->setPosition(
+                node.position.x + radius - balanceText->getLocalBounds().width / 2,
+                node.position.y + radius * 2 - 5
+            );
+            batch.addLabel(*balanceText);
+        }
+    }
+}
+
+// Caption for the step on screen, empty when no algorithm is running
+inline std::string describeStep(const TreeSnapshot& snapshot) {
+    const TreeEvent& step = snapshot.step;
+    bool hasNode = step.node >= 0 && step.node < static_cast<int>(snapshot.nodes.size());
+    int other = hasNode ? snapshot.nodes[step.node].value : 0;
+    std::string value = std::to_string(step.value);
+    switch (step.kind) {
+        case TreeEvent::Compare:
+            if (!hasNode) break;
+            return "Compare " + value + " with " + std::to_string(other)
+                + (step.value < other ? ": go left" : step.value > other ? ": go right" : "");
+        case TreeEvent::Insert: return "Insert " + value;
+        case TreeEvent::Rotate: return hasNode ? "Rotate: " + std::to_string(other) + " moves up" : "Rotate";
+        case TreeEvent::Found: return "Found " + value;
+        case TreeEvent::Missing: return value + " is not in the tree";
+        case TreeEvent::Recolor: return hasNode ? "Recolour around " + std::to_string(other) : "Recolour";
+        default: break;
+    }
+    return "";
+}
+
+// Counters of the last operation and the mean over all of them. fixName is what the
+// tree calls its third counter (recolours, height changes), or nullptr when it has none.
+inline std::string describeCounters(const BalanceCounters& counters, const char* fixName) {
+    if (!counters.operations) return "";
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(2);
+    double operations = static_cast<double>(counters.operations);
+    out << "Last operation: " << counters.last.comparisons << " comparisons, " << counters.last.rotations << " rotations";
+    if (fixName) out << ", " << counters.last.recolorings << " " << fixName;
+    out << "\nMean over " << counters.operations << ": " << counters.total.comparisons / operations << ", "
+        << counters.total.rotations / operations;
+    if (fixName) out << ", " << counters.total.recolorings / operations;
+    return out.str();
+}
+
+// Path-copying history of a binary tree. Nodes are never changed once their version is
+// committed: an insert copies the nodes on its path (AVL rotations copy theirs too), so
+// every committed root stays valid and any version can be shown without a replay. Nodes
+// created or copied since the last commit carry the current stamp and are changed in
+// place, so a batch insert copies each shared node at most once. Node::index keeps the
+// slot in the visualizer's node list; a copy takes over the slot of its original.
+template <typename Node>
+class TreeHistory {
+public:
+    struct Version {
+        Node* root;
+        size_t count;
+        size_t nodeMark;   // allNodes.size() when the version was committed
+    };
+
+    TreeHistory() {
+        clear();
+    }
+
+    ~TreeHistory() {
+        for (Node* node : allNodes) delete node;
+    }
+
+    Node* create(int value, std::vector<Node*>& nodes) {
+        Node* node = new Node(value);
+        node->index = static_cast<int>(nodes.size());
+        node->stamp = stamp;
+        nodes.push_back(node);
+        allNodes.push_back(node);
+        return node;
+    }
+
+    Node* writable(Node* node, std::vector<Node*>& nodes) {
+        if (!node || node->stamp == stamp) return node;
+        Node* copy = new Node(*node);
+        copy->stamp = stamp;
+        allNodes.push_back(copy);
+        nodes[copy->index] = copy;
+        return copy;
+    }
+
+    // Nodes built elsewhere (a loaded snapshot) become part of the next version
+    void adopt(const std::vector<Node*>& nodes) {
+        for (Node* node : nodes) node->stamp = stamp;
+        allNodes.insert(allNodes.end(), nodes.begin(), nodes.end());
+    }
+
+    // Records the tree as a new version unless nothing changed. Versions after the
+    // cursor (undone ones) are dropped and their nodes freed: those were allocated
+    // after the cursor's version was committed, and unlike the edit being committed
+    // they carry an older stamp.
+    void commit(Node* root, size_t count) {
+        if (versions[cursor].root == root && versions[cursor].count == count) return;
+        if (cursor + 1 < versions.size()) {
+            size_t kept = versions[cursor].nodeMark;
+            for (size_t i = kept; i < allNodes.size(); ++i) {
+                if (allNodes[i]->stamp == stamp) allNodes[kept++] = allNodes[i];
+                else delete allNodes[i];
+            }
+            allNodes.resize(kept);
+            versions.resize(cursor + 1);
+        }
+        versions.push_back({root, count, allNodes.size()});
+        cursor = versions.size() - 1;
+        ++stamp;
+    }
+
+    // Root of a version; nodes is refilled with that version's nodes by index
+    Node* select(size_t version, std::vector<Node*>& nodes) {
+        cursor = std::min(version, versions.size() - 1);
+        Node* root = versions[cursor].root;
+        nodes.assign(versions[cursor].count, nullptr);
+        std::vector<Node*> stack;
+        if (root) stack.push_back(root);
+        while (!stack.empty()) {
+            Node* node = stack.back();
+            stack.pop_back();
+            nodes[node->index] = node;
+            if (node->left) stack.push_back(node->left);
+            if (node->right) stack.push_back(node->right);
+        }
+        ++stamp;
+        return root;
+    }
+
+    void clear() {
+        for (Node* node : allNodes) delete node;
+        allNodes.clear();
+        versions.assign(1, {nullptr, 0, 0});
+        cursor = 0;
+        ++stamp;
+    }
+
+    size_t current() const { return cursor; }
+    size_t size() const { return versions.size(); }
+
+    size_t retainedBytes() const {
+        return allNodes.size() * sizeof(Node);
+    }
+
+    // What keeping a full copy of every version would take
+    size_t fullCopyBytes() const {
+        size_t total = 0;
+        for (const Version& version : versions) total += version.count;
+        return total * sizeof(Node);
+    }
+
+    void fillSnapshot(TreeSnapshot& snapshot) const {
+        snapshot.version = cursor;
+        snapshot.versionCount = versions.size();
+        snapshot.retainedBytes = retainedBytes();
+        snapshot.fullCopyBytes = fullCopyBytes();
+    }
+
+private:
+    std::vector<Node*> allNodes;     // every node of every version, owned here
+    std::vector<Version> versions;
+    size_t cursor = 0;
+    unsigned int stamp = 0;
+};
+
+// Slider under the BST and AVL pages that scrubs through the tree's versions
+class TimelineSlider {
+public:
+    sf::RectangleShape track;
+    sf::RectangleShape handle;
+    sf::Text label;
+    bool isDragging = false;
+
+    TimelineSlider() {
+        track.setPosition(500, 800);
+        track.setSize(sf::Vector2f(600, 6));
+        track.setFillColor(sf::Color(120, 120, 120));
+        handle.setSize(sf::Vector2f(12, 22));
+        handle.setFillColor(sf::Color::White);
+        label.setCharacterSize(16);
+        label.setFillColor(sf::Color::White);
+        label.setPosition(500, 818);
+    }
+
+    void setFont(const sf::Font& font) {
+        label.setFont(font);
+    }
+
+    void draw(sf::RenderTarget& target, const TreeSnapshot& snapshot) {
+        if (snapshot.versionCount < 2) return;
+        float t = static_cast<float>(snapshot.version) / (snapshot.versionCount - 1);
+        handle.setPosition(track.getPosition().x + t * track.getSize().x - 6, track.getPosition().y - 8);
+
+        // Only rebuild the text when the numbers change
+        if (snapshot.version != shownVersion || snapshot.versionCount != shownCount || snapshot.retainedBytes != shownBytes) {
+            shownVersion = snapshot.version;
+            shownCount = snapshot.versionCount;
+            shownBytes = snapshot.retainedBytes;
+            label.setString("Version " + std::to_string(snapshot.version) + " / " + std::to_string(snapshot.versionCount - 1)
+                + "   all versions " + formatBytes(snapshot.retainedBytes)
+                + ", a full copy of each would take " + formatBytes(snapshot.fullCopyBytes)
+                + "   (Ctrl+Z / Ctrl+Y)");
+        }
+        target.draw(track);
+        target.draw(handle);
+        target.draw(label);
+    }
+
+    bool contains(sf::Vector2f point) const {
+        sf::FloatRect area = track.getGlobalBounds();
+        return point.x >= area.left - 6 && point.x <= area.left + area.width + 6
+            && point.y >= area.top - 12 && point.y <= area.top + area.height + 12;
+    }
+
+    size_t versionAt(float x, const TreeSnapshot& snapshot) const {
+        float t = (x - track.getPosition().x) / track.getSize().x;
+        t = std::max(0.f, std::min(1.f, t));
+        return static_cast<size_t>(std::lround(t * (snapshot.versionCount - 1)));
+    }
+
+    static std::string formatBytes(size_t bytes) {
+        std::ostringstream out;
+        out.setf(std::ios::fixed);
+        out.precision(1);
+        if (bytes >= (1u << 20)) out << bytes / double(1 << 20) << " MB";
+        else if (bytes >= (1u << 10)) out << bytes / double(1 << 10) << " KB";
+        else out << bytes << " B";
+        return out.str();
+    }
+
+private:
+    size_t shownVersion = static_cast<size_t>(-1);
+    size_t shownCount = 0;
+    size_t shownBytes = 0;
+};
+
+class BSTNode {
+public:
+    int value;
+    int index = 0;              // position in BSTVisualizer::nodes
+    unsigned int stamp = 0;     // TreeHistory version that may still change it
+    BSTNode* left;
+    BSTNode* right;
+
+    BSTNode(int val) : value(val), left(nullptr), right(nullptr) {}
+};
+
+class BSTVisualizer {
+public:
+    // Owned by the worker thread; the render thread only sees snapshots
+    BSTNode* root;
+    std::vector<BSTNode*> nodes;            // nodes of the version shown, by index
+    TreeHistory<BSTNode> history;
+    std::unordered_set<int> foundKeys;      // search hits; nodes are shared between versions
+    std::shared_ptr<TreeSnapshot> lastBuilt;
+    bool layoutCurrent = false;
+    std::vector<sf::Vector2f> cachedLayout; // from a loaded snapshot, dropped on the next insert
+    float cachedRadius = 30;
+    StepDriver driver;
+
+    // Set by the interactive app: inserts of up to ANIMATED_BATCH values and searches
+    // are played one step per tick. Headless runs go at full speed.
+    bool animateSteps = false;
+    static constexpr size_t ANIMATED_BATCH = 16;
+
+    sf::Font font;
+    bool isAnimating = false;
+    BatchRenderer batch;
+    sf::CircleShape circle;
+    NodeLabel valueText;
+    sf::Text stepText;
+    TimelineSlider timeline;
+    TreeWorker worker;
+
+    BSTVisualizer() : root(nullptr), worker([this] { return buildSnapshot(); }) {
+        TRACE_SCOPE("load font");
+        if (!font.loadFromFile("arial.ttf")) {
+            std::cerr << "Error loading font!" << std::endl;
+        }
+
+        circle.setOutlineColor(sf::Color::White);
+        valueText.setFont(font);
+        valueText.setCharacterSize(20);
+        valueText.setFillColor(sf::Color::White);
+        stepText.setFont(font);
+        stepText.setCharacterSize(18);
+        stepText.setFillColor(sf::Color::White);
+        stepText.setPosition(100, 760);
+        timeline.setFont(font);
+    }
+
+    ~BSTVisualizer() {
+        worker.stop();
+        clear();
+    }
+
+    void insert(int value) {
+        insertBatch({value});
+    }
+
+    // Each call is one version in the undo history
+    void insertBatch(std::vector<int> values) {
+        if (animateSteps && values.size() <= ANIMATED_BATCH) {
+            isAnimating = true;
+            worker.post([this, values = std::move(values)] {
+                for (int value : values) driver.queue(animatedInsert(value));
+            });
+            return;
+        }
+        worker.post([this, values = std::move(values)] {
+            driver.finish();
+            for (int value : values) insertValue(value);
+            history.commit(root, nodes.size());
+        });
+    }
+
+    void showVersion(size_t version) {
+        worker.post([this, version] {
+            driver.finish();
+            root = history.select(version, nodes);
+            layoutCurrent = false;
+            cachedLayout.clear();
+        });
+    }
+
+    // Worker thread only. The animation driver resumes this an event at a time;
+    // insertValue runs the same code without looking at the events.
+    StepTask<TreeEvent> insertSteps(int value) {
+        for (BSTNode* current = root; current; current = value < current->value ? current->left : current->right) {
+            co_yield TreeEvent{TreeEvent::Compare, current->index, value};
+            if (value == current->value) {
+                co_yield TreeEvent{TreeEvent::Found, current->index, value};
+                co_return;
+            }
+        }
+
+        // Copy the path down from the root, then hang the new leaf off its end
+        BSTNode* created;
+        if (!root) {
+            root = created = history.create(value, nodes);
+        } else {
+            root = history.writable(root, nodes);
+            BSTNode* parent = root;
+            while (true) {
+                BSTNode*& child = value < parent->value ? parent->left : parent->right;
+                if (!child) {
+                    child = created = history.create(value, nodes);
+                    break;
+                }
+                child = history.writable(child, nodes);
+                parent = child;
+            }
+        }
+        layoutCurrent = false;
+        cachedLayout.clear();
+        co_yield TreeEvent{TreeEvent::Insert, created->index, value};
+    }
+
+    StepTask<TreeEvent> animatedInsert(int value) {
+        StepTask<TreeEvent> steps = insertSteps(value);
+        while (steps.step()) co_yield steps.event();
+        history.commit(root, nodes.size());
+    }
+
+    void insertValue(int value) {
+        TRACE_SCOPE("BST insert");
+        insertSteps(value).runToEnd();
+    }
+
+    StepTask<TreeEvent> searchSteps(int value) {
+        for (BSTNode* current = root; current; current = value < current->value ? current->left : current->right) {
+            co_yield TreeEvent{TreeEvent::Compare, current->index, value};
+            if (current->value == value) {
+                foundKeys.insert(value); // Highlight the found node
+                co_yield TreeEvent{TreeEvent::Found, current->index, value};
+                co_return;
+            }
+        }
+        std::cout << "Number does not exist." << std::endl;
+        co_yield TreeEvent{TreeEvent::Missing, -1, value};
+    }
+
+    // When only the step moved on, the last layout is reused
+    std::shared_ptr<TreeSnapshot> buildSnapshot() {
+        auto snapshot = std::make_shared<TreeSnapshot>();
+        if (layoutCurrent && lastBuilt) {
+            snapshot->nodes = lastBuilt->nodes;
+            snapshot->edges = lastBuilt->edges;
+            snapshot->radius = lastBuilt->radius;
+            for (size_t i = 0; i < nodes.size(); ++i) snapshot->nodes[i].highlighted = foundKeys.count(nodes[i]->value) != 0;
+        } else {
+            snapshot->nodes.reserve(nodes.size());
+            for (BSTNode* node : nodes) snapshot->nodes.push_back({node->value, 0, foundKeys.count(node->value) != 0, sf::Vector2f()});
+            bool cached = cachedLayout.size() == nodes.size();
+            layoutTreeSnapshot(root, nodes, *snapshot, 120, cached ? &cachedLayout : nullptr, cachedRadius);
+        }
+        snapshot->step = driver.event;
+        snapshot->stepping = driver.busy();
+        history.fillSnapshot(*snapshot);
+        lastBuilt = snapshot;
+        layoutCurrent = true;
+        return snapshot;
+    }
+
+    void clear() {
+        driver.cancel();
+        history.clear();
+        foundKeys.clear();
+        nodes.clear();
+        root = nullptr;
+        layoutCurrent = false;
+        cachedLayout.clear();
+    }
+
+    void saveSnapshot(const std::string& path) {
+        worker.post([this, path] {
+            driver.finish();
+            auto layout = layoutCurrent ? lastBuilt : buildSnapshot();
+            saveTreeSnapshot(path, SnapshotHeader::Bst, root, nodes, *layout);
+        });
+    }
+
+    void loadSnapshot(const std::string& path) {
+        worker.post([this, path] {
+            BSTNode* loadedRoot = nullptr;
+            std::vector<BSTNode*> loaded;
+            std::vector<sf::Vector2f> layout;
+            float radius = 30;
+            if (!loadTreeSnapshot(path, SnapshotHeader::Bst, loadedRoot, loaded, layout, radius)) return;
+            clear();
+            root = loadedRoot;
+            nodes.swap(loaded);
+            history.adopt(nodes);
+            history.commit(root, nodes.size());
+            cachedLayout.swap(layout);
+            cachedRadius = radius;
+        });
+    }
+
+    // Animation driver: one step per call while anything is queued
+    void tick() {
+        if (!isAnimating) return;
+        if (!worker.isBusy() && !worker.latest()->stepping) {
+            isAnimating = false;
+            return;
+        }
+        worker.post([this] { driver.tick(); });
+    }
+
+    void draw(sf::RenderTarget& window) {
+        auto snapshot = worker.latest();
+        timeline.draw(window, *snapshot);
+        if (snapshot->nodes.empty()) return;
+        drawTreeSnapshot(*snapshot, batch, circle, valueText, nullptr, sf::Color::Green);
+        batch.flush(window);
+
+        stepText.setString(describeStep(*snapshot));
+        window.draw(stepText);
+    }
+
+    void reset() {
+        worker.post([this] { clear(); });
+        isAnimating = false;
+    }
+
+    void search(int value) {
+        if (animateSteps) {
+            isAnimating = true;
+            worker.post([this, value] { driver.queue(searchSteps(value)); });
+            return;
+        }
+        worker.post([this, value] {
+            driver.finish();
+            searchSteps(value).runToEnd();
+        });
+    }
+};
+
+template <typename Node>
+int treeHeight(const Node* root) {
+    int height = 0;
+    std::vector<std::pair<const Node*, int>> stack;
+    if (root) stack.emplace_back(root, 1);
+    while (!stack.empty()) {
+        auto [node, depth] = stack.back();
+        stack.pop_back();
+        height = std::max(height, depth);
+        if (node->left) stack.emplace_back(node->left, depth + 1);
+        if (node->right) stack.emplace_back(node->right, depth + 1);
+    }
+    return height;
+}
+
+// What the AVL tree, the red-black tree and the treap share. Only the worker thread
+// touches it. Rotations copy the two nodes they change and count themselves.
+template <typename Node>
+class BalancedTree {
+public:
+    Node* root = nullptr;
+    std::vector<Node*> nodes;               // nodes of the version shown, by index
+    TreeHistory<Node> history;
+    std::unordered_set<int> foundKeys;      // search hits; nodes are shared between versions
+    BalanceCounters counters;
+    bool shapeChanged = false;              // a node was added or rotated since the last layout
+
+    Node* rotateRight(Node* y) {
+        counters.rotation();
+        shapeChanged = true;
+        y = history.writable(y, nodes);
+        Node* x = history.writable(y->left, nodes);
+        y->left = x->right;
+        x->right = y;
+        return x;
+    }
+
+    Node* rotateLeft(Node* x) {
+        counters.rotation();
+        shapeChanged = true;
+        x = history.writable(x, nodes);
+        Node* y = history.writable(x->right, nodes);
+        x->right = y->left;
+        y->left = x;
+        return y;
+    }
+
+    // Hangs top where path[i] was. Every node on the path lies on value's search path,
+    // so the side to hang it on follows from value.
+    void relink(Node** path, int i, int value, Node* top) {
+        if (i == 0) root = top;
+        else (value < path[i - 1]->value ? path[i - 1]->left : path[i - 1]->right) = top;
+    }
+
+    // Copies the path found by the search down to value and hangs a new node below it
+    Node* attach(Node** path, int depth, int value) {
+        Node* created = history.create(value, nodes);
+        if (depth == 0) {
+            root = created;
+        } else {
+            root = path[0] = history.writable(root, nodes);
+            for (int i = 1; i < depth; ++i) {
+                Node*& child = value < path[i - 1]->value ? path[i - 1]->left : path[i - 1]->right;
+                path[i] = child = history.writable(child, nodes);
+            }
+            (value < path[depth - 1]->value ? path[depth - 1]->left : path[depth - 1]->right) = created;
+        }
+        shapeChanged = true;
+        return created;
+    }
+
+    StepTask<TreeEvent> searchSteps(int value) {
+        counters.begin();
+        for (Node* current = root; current; current = value < current->value ? current->left : current->right) {
+            counters.comparison();
+            co_yield TreeEvent{TreeEvent::Compare, current->index, value};
+            if (current->value == value) {
+                foundKeys.insert(value);
+                co_yield TreeEvent{TreeEvent::Found, current->index, value};
+                co_return;
+            }
+        }
+        std::cout << "Number does not exist." << std::endl;
+        co_yield TreeEvent{TreeEvent::Missing, -1, value};
+    }
+
+    void clear() {
+        history.clear();
+        foundKeys.clear();
+        nodes.clear();
+        root = nullptr;
+        counters = BalanceCounters();
+        shapeChanged = true;
+    }
+};
+
+class AVLNode {
+public:
+    int value;
+    int height;
+    int index = 0;              // position in AvlTree::nodes
+    unsigned int stamp = 0;     // TreeHistory version that may still change it
+    AVLNode* left;
+    AVLNode* right;
+
+    AVLNode(int val) : value(val), height(1), left(nullptr), right(nullptr) {}
+};
+
+// AVL insert without the drawing, so the AVL page and the tree comparisons measure
+// the same code. Walks down keeping the path in the coroutine frame, copies it, then
+// fixes heights on the way back up and rotates where the balance breaks. Nodes are
+// copied before they change; a duplicate copies nothing. AVL keeps the height
+// logarithmic, so MAX_HEIGHT is never reached.
+class AvlTree : public BalancedTree<AVLNode> {
+public:
+    static constexpr int MAX_HEIGHT = 64;
+    static constexpr const char* NAME = "AVL";
+    static constexpr const char* FIX_NAME = "height changes";
+
+    static int height(const AVLNode* node) {
+        return node ? node->height : 0;
+    }
+
+    // Balance factor, shown under the node
+    static int detail(const AVLNode* node) {
+        return node ? height(node->left) - height(node->right) : 0;
+    }
+
+    AVLNode* rightRotate(AVLNode* y) {
+        TRACE_SCOPE("AVL rightRotate");
+        AVLNode* x = rotateRight(y);
+        updateHeight(x->right);
+        updateHeight(x);
+        return x;
+    }
+
+    AVLNode* leftRotate(AVLNode* x) {
+        TRACE_SCOPE("AVL leftRotate");
+        AVLNode* y = rotateLeft(x);
+        updateHeight(y->left);
+        updateHeight(y);
+        return y;
+    }
+
+    StepTask<TreeEvent> insertSteps(int value) {
+        AVLNode* path[MAX_HEIGHT];
+        int depth = 0;
+        counters.begin();
+        for (AVLNode* current = root; current; current = value < current->value ? current->left : current->right) {
+            counters.comparison();
+            co_yield TreeEvent{TreeEvent::Compare, current->index, value};
+            if (value == current->value) {
+                co_yield TreeEvent{TreeEvent::Found, current->index, value};
+                co_return;
+            }
+            if (depth == MAX_HEIGHT) {
+                std::cerr << "AVL tree too deep to insert into" << std::endl;
+                co_return;
+            }
+            path[depth++] = current;
+        }
+        AVLNode* created = attach(path, depth, value);
+        co_yield TreeEvent{TreeEvent::Insert, created->index, value};
+
+        for (int i = depth - 1; i >= 0; --i) {
+            AVLNode* node = path[i];
+            int before = node->height;
+            updateHeight(node);
+            if (node->height != before) counters.recoloring();
+            int balance = detail(node);
+
+            // Left-right and right-left cases first turn the child around
+            if (balance > 1 && value > node->left->value) {
+                node->left = leftRotate(node->left);
+                co_yield TreeEvent{TreeEvent::Rotate, node->left->index, value};
+            } else if (balance < -1 && value < node->right->value) {
+                node->right = rightRotate(node->right);
+                co_yield TreeEvent{TreeEvent::Rotate, node->right->index, value};
+            }
+
+            AVLNode* top;
+            if (balance > 1) top = rightRotate(node);
+            else if (balance < -1) top = leftRotate(node);
+            else continue;
+
+            relink(path, i, value, top);
+            co_yield TreeEvent{TreeEvent::Rotate, top->index, value};
+        }
+    }
+
+    // Heights are not stored in snapshots; children come after their parent in
+    // pre-order, so one reverse pass restores them
+    void restoreHeights() {
+        for (auto it = nodes.rbegin(); it != nodes.rend(); ++it) updateHeight(*it);
+    }
+
+private:
+    static void updateHeight(AVLNode* node) {
+        node->height = 1 + std::max(height(node->left), height(node->right));
+    }
+};
+
+class AVLVisualizer {
+public:
+    AvlTree tree;                           // owned by the worker thread; the render thread only sees snapshots
+    std::shared_ptr<TreeSnapshot> lastBuilt;
+    std::vector<sf::Vector2f> cachedLayout; // from a loaded snapshot, used for its first layout
+    float cachedRadius = 30;
+    StepDriver driver;
+    std::chrono::duration<double, std::milli> avlInsertionTime;
+    std::chrono::duration<double, std::milli> estimatedBSTTime;
+
+    // Set by the interactive app: inserts of up to ANIMATED_BATCH values and searches
+    // are played one step per tick. Headless runs go at full speed.
+    bool animateSteps = false;
+    static constexpr size_t ANIMATED_BATCH = 16;
+
+    sf::Font font;
+    bool isAnimating = false;
+    BatchRenderer batch;
+    sf::CircleShape circle;
+    NodeLabel valueText;
+    NodeLabel balanceFactorText;
+    sf::Text timeText;
+    sf::Text stepText;
+    TimelineSlider timeline;
+    TreeWorker worker;
+
+    AVLVisualizer() : avlInsertionTime(0), estimatedBSTTime(0), worker([this] { return buildSnapshot(); }) {
+        TRACE_SCOPE("load font");
+        if (!font.loadFromFile("arial.ttf")) {
+            std::cerr << "Error loading font!" << std::endl;
+        }
+
+        circle.setOutlineColor(sf::Color::White);
+        valueText.setFont(font);
+        valueText.setCharacterSize(20);
+        valueText.setFillColor(sf::Color::White);
+        balanceFactorText.setFont(font);
+        balanceFactorText.setCharacterSize(12);
+        balanceFactorText.setFillColor(sf::Color::Yellow);
+
+        timeText.setFont(font);
+        timeText.setCharacterSize(18);
+        timeText.setFillColor(sf::Color::White);
+        timeText.setPosition(100, 800);
+        stepText.setFont(font);
+        stepText.setCharacterSize(18);
+        stepText.setFillColor(sf::Color::White);
+        stepText.setPosition(100, 760);
+        timeline.setFont(font);
+    }
+
+    ~AVLVisualizer() {
+        worker.stop();
+        clear();
+    }
+
+    void insert(int value) {
+        insertBatch({value});
+    }
+
+    // Each call is one version in the undo history
+    void insertBatch(std::vector<int> values) {
+        if (animateSteps && values.size() <= ANIMATED_BATCH) {
+            isAnimating = true;
+            worker.post([this, values = std::move(values)] {
+                for (int value : values) driver.queue(animatedInsert(value));
+            });
+            return;
+        }
+        worker.post([this, values = std::move(values)] {
+            driver.finish();
+            for (int value : values) insertValue(value);
+            tree.history.commit(tree.root, tree.nodes.size());
+        });
+    }
+
+    void showVersion(size_t version) {
+        worker.post([this, version] {
+            driver.finish();
+            tree.root = tree.history.select(version, tree.nodes);
+            tree.shapeChanged = true;
+        });
+    }
+
+    // Worker thread only
+    StepTask<TreeEvent> animatedInsert(int value) {
+        StepTask<TreeEvent> steps = tree.insertSteps(value);
+        while (steps.step()) co_yield steps.event();
+        tree.history.commit(tree.root, tree.nodes.size());
+    }
+
+    void insertValue(int value) {
+        TRACE_SCOPE("AVL insert");
+        auto start = std::chrono::high_resolution_clock::now();
+        tree.insertSteps(value).runToEnd();
+        auto end = std::chrono::high_resolution_clock::now();
+        avlInsertionTime += end - start;
+
+        // Estimate BST time based on AVL time and logarithmic complexity
+        estimatedBSTTime += std::chrono::duration<double, std::milli>(avlInsertionTime.count() * log2(static_cast<double>(tree.nodes.size() + 1)));
+    }
+
+    // When only the step moved on, the last layout is reused
+    std::shared_ptr<TreeSnapshot> buildSnapshot() {
+        auto snapshot = std::make_shared<TreeSnapshot>();
+        if (!tree.shapeChanged && lastBuilt) {
+            snapshot->nodes = lastBuilt->nodes;
+            snapshot->edges = lastBuilt->edges;
+            snapshot->radius = lastBuilt->radius;
+            // Heights change after the Insert step without moving anything, so the
+            // balance factors are refreshed along with the highlight
+            for (size_t i = 0; i < tree.nodes.size(); ++i) {
+                snapshot->nodes[i].balance = AvlTree::detail(tree.nodes[i]);
+                snapshot->nodes[i].highlighted = tree.foundKeys.count(tree.nodes[i]->value) != 0;
+            }
+        } else {
+            snapshot->nodes.reserve(tree.nodes.size());
+            for (AVLNode* node : tree.nodes) {
+                snapshot->nodes.push_back({node->value, AvlTree::detail(node), tree.foundKeys.count(node->value) != 0, sf::Vector2f()});
+            }
+            bool cached = cachedLayout.size() == tree.nodes.size();
+            layoutTreeSnapshot(tree.root, tree.nodes, *snapshot, 190, cached ? &cachedLayout : nullptr, cachedRadius);
+            cachedLayout.clear();
+        }
+        snapshot->step = driver.event;
+        snapshot->stepping = driver.busy();
+        snapshot->insertionMs = avlInsertionTime.count();
+        snapshot->estimatedBSTMs = estimatedBSTTime.count();
+        snapshot->height = AvlTree::height(tree.root);
+        snapshot->counters = tree.counters;
+        tree.history.fillSnapshot(*snapshot);
+        lastBuilt = snapshot;
+        tree.shapeChanged = false;
+        return snapshot;
+    }
+
+    void clear() {
+        driver.cancel();
+        tree.clear();
+        avlInsertionTime = std::chrono::duration<double, std::milli>(0);
+        estimatedBSTTime = std::chrono::duration<double, std::milli>(0);
+        cachedLayout.clear();
+    }
+
+    void saveSnapshot(const std::string& path) {
+        worker.post([this, path] {
+            driver.finish();
+            auto layout = !tree.shapeChanged && lastBuilt ? lastBuilt : buildSnapshot();
+            saveTreeSnapshot(path, SnapshotHeader::Avl, tree.root, tree.nodes, *layout);
+        });
+    }
+
+    void loadSnapshot(const std::string& path) {
+        worker.post([this, path] {
+            AVLNode* loadedRoot = nullptr;
+            std::vector<AVLNode*> loaded;
+            std::vector<sf::Vector2f> layout;
+            float radius = 30;
+            if (!loadTreeSnapshot(path, SnapshotHeader::Avl, loadedRoot, loaded, layout, radius)) return;
+            clear();
+            tree.root = loadedRoot;
+            tree.nodes.swap(loaded);
+            tree.history.adopt(tree.nodes);
+            tree.history.commit(tree.root, tree.nodes.size());
+            tree.restoreHeights();
+            cachedLayout.swap(layout);
+            cachedRadius = radius;
+        });
+    }
+
+    void draw(sf::RenderTarget& window) {
+        auto snapshot = worker.latest();
+        timeline.draw(window, *snapshot);
+        if (snapshot->nodes.empty()) return;
+
+        drawTreeSnapshot(*snapshot, batch, circle, valueText, &balanceFactorText, sf::Color::Blue);
+        batch.flush(window);
+
+        stepText.setString(describeStep(*snapshot));
+        window.draw(stepText);
+
+        // Display time taken
+        timeText.setString("AVL Insertion Time: " + std::to_string(snapshot->insertionMs) + " ms\nEstimated BST Time: " + std::to_string(snapshot->estimatedBSTMs) + " ms\n"
+            + describeCounters(snapshot->counters, AvlTree::FIX_NAME));
+        window.draw(timeText);
+    }
+
+    // Animation driver: one step per call while anything is queued
+    void tick() {
+        if (!isAnimating) return;
+        if (!worker.isBusy() && !worker.latest()->stepping) {
+            isAnimating = false;
+            return;
+        }
+        worker.post([this] { driver.tick(); });
+    }
+
+    void reset() {
+        worker.post([this] { clear(); });
+        isAnimating = false;
+    }
+
+    void search(int value) {
+        if (animateSteps) {
+            isAnimating = true;
+            worker.post([this, value] { driver.queue(tree.searchSteps(value)); });
+            return;
+        }
+        worker.post([this, value] {
+            driver.finish();
+            tree.searchSteps(value).runToEnd();
+        });
+    }
+};
+
+class GraphNode {
+public:
+    int value;
+    int id = 0;
+    std::vector<int> neighbors;
+    sf::CircleShape circle;
+    NodeLabel text;
+    sf::Vector2f position;
+
+    GraphNode(int val, const sf::Font& font) : value(val) {
+        circle.setRadius(30);
+        circle.setFillColor(sf::Color::Red);
+        circle.setOutlineThickness(2);
+        circle.setOutlineColor(sf::Color::White);
+
+        text.setFont(font);
+        text.setString(std::to_string(val));
+        text.setCharacterSize(15);
+        text.setFillColor(sf::Color::Black);
+    }
+
+    void setPosition(sf::Vector2f pos) {
+        position = pos;
+        circle.setPosition(pos);
+        text.setPosition(
+            pos.x + (circle.getRadius() - text.getLocalBounds().width) / 2 + 5,
+            pos.y + (circle.getRadius() - text.getLocalBounds().height) / 2 + 5
+        );
+    }
+
+    void draw(BatchRenderer& batch) {
+        batch.addCircle(circle);
+        batch.addLabel(text);
+    }
+};
+
+// Multilevel coarsening of a graph for level-of-detail drawing. Level 0 is the graph
+// itself; each level above merges pairs of clusters from the one below, preferring the
+// pair joined by the heaviest edge bundle (heavy-edge matching) and pairing leftover
+// clusters with a spatial neighbour so that isolated nodes coarsen as well.
+class GraphHierarchy {
+public:
+    struct Level {
+        std::vector<sf::Vector2f> centres;
+        std::vector<float> radii;            // world radius covering every member
+        std::vector<int> sizes;              // graph nodes inside each cluster
+        std::vector<int> parents;            // cluster one level up, -1 on the top level
+        std::vector<std::pair<int, int>> edges;
+        std::vector<int> weights;            // graph edges bundled into each edge
+        std::vector<int> adjacencyStart;     // edges touching cluster i, as indices into edges
+        std::vector<int> adjacency;
+
+        // Uniform grid over the clusters for viewport culling
+        sf::FloatRect bounds;
+        float cellSize = 1;
+        int columns = 1;
+        int rows = 1;
+        std::vector<int> cellStart;
+        std::vector<int> cellItems;
+    };
+
+    std::vector<Level> levels;
+
+    void clear() {
+        levels.clear();
+    }
+
+    bool empty() const {
+        return levels.empty();
+    }
+
+    void build(const std::vector<sf::Vector2f>& centres, float nodeRadius, const std::vector<std::pair<int, int>>& graphEdges) {
+        levels.clear();
+        if (centres.empty()) return;
+
+        Level base;
+        base.centres = centres;
+        base.radii.assign(centres.size(), nodeRadius);
+        base.sizes.assign(centres.size(), 1);
+        std::vector<int> identity(centres.size());
+        for (size_t i = 0; i < identity.size(); ++i) identity[i] = static_cast<int>(i);
+        bundleEdges(base, graphEdges, std::vector<int>(graphEdges.size(), 1), identity);
+        indexLevel(base);
+        levels.push_back(std::move(base));
+
+        while (levels.back().centres.size() > 1 && levels.size() < MAX_LEVELS) {
+            Level coarser = coarsen(levels.back());
+            // Stop once matching no longer shrinks the graph noticeably
+            if (coarser.centres.size() * 20 > levels.back().centres.size() * 19) {
+                levels.back().parents.assign(levels.back().centres.size(), -1);
+                break;
+            }
+            indexLevel(coarser);
+            levels.push_back(std::move(coarser));
+        }
+    }
+
+    // Finest level whose clusters inside the area are expected to stay within the budget
+    int levelFor(const sf::FloatRect& area, size_t budget) const {
+        for (size_t level = 0; level < levels.size(); ++level) {
+            const Level& current = levels[level];
+            float coverage = 1;
+            float boundsArea = current.bounds.width * current.bounds.height;
+            sf::FloatRect overlap;
+            if (boundsArea > 0 && intersect(current.bounds, area, overlap)) {
+                coverage = overlap.width * overlap.height / boundsArea;
+            }
+            if (current.centres.size() * coverage <= budget) return static_cast<int>(level);
+        }
+        return static_cast<int>(levels.size()) - 1;
+    }
+
+    void query(int level, const sf::FloatRect& area, std::vector<int>& out) const {
+        out.clear();
+        const Level& current = levels[level];
+        int firstColumn = std::max(0, static_cast<int>((area.left - current.bounds.left) / current.cellSize));
+        int lastColumn = std::min(current.columns - 1, static_cast<int>((area.left + area.width - current.bounds.left) / current.cellSize));
+        int firstRow = std::max(0, static_cast<int>((area.top - current.bounds.top) / current.cellSize));
+        int lastRow = std::min(current.rows - 1, static_cast<int>((area.top + area.height - current.bounds.top) / current.cellSize));
+
+        for (int row = firstRow; row <= lastRow; ++row) {
+            for (int column = firstColumn; column <= lastColumn; ++column) {
+                int cell = row * current.columns + column;
+                for (int i = current.cellStart[cell]; i < current.cellStart[cell + 1]; ++i) {
+                    out.push_back(current.cellItems[i]);
+                }
+            }
+        }
+    }
+
+    // Nodes in the finest level; nodes added since the last build are not in it
+    size_t nodeCount() const {
+        return levels.empty() ? 0 : levels.front().centres.size();
+    }
+
+    int ancestor(int node, int level) const {
+        for (int i = 0; i < level && node >= 0; ++i) node = levels[i].parents[node];
+        return node;
+    }
+
+private:
+    static const size_t MAX_LEVELS = 32;
+
+    static bool intersect(const sf::FloatRect& a, const sf::FloatRect& b, sf::FloatRect& overlap) {
+        float left = std::max(a.left, b.left);
+        float top = std::max(a.top, b.top);
+        float right = std::min(a.left + a.width, b.left + b.width);
+        float bottom = std::min(a.top + a.height, b.top + b.height);
+        if (left >= right || top >= bottom) return false;
+        overlap = sf::FloatRect(left, top, right - left, bottom - top);
+        return true;
+    }
+
+    // Maps edges onto clusters, merging parallel edges into one weighted bundle
+    static void bundleEdges(Level& level, const std::vector<std::pair<int, int>>& edges,
+                            const std::vector<int>& weights, const std::vector<int>& clusterOf) {
+        std::unordered_map<unsigned long long, int> bundles;
+        for (size_t i = 0; i < edges.size(); ++i) {
+            int a = clusterOf[edges[i].first];
+            int b = clusterOf[edges[i].second];
+            if (a == b) continue;
+            if (a > b) std::swap(a, b);
+            unsigned long long key = (static_cast<unsigned long long>(a) << 32) | static_cast<unsigned int>(b);
+            auto found = bundles.find(key);
+            if (found == bundles.end()) {
+                bundles.emplace(key, static_cast<int>(level.edges.size()));
+                level.edges.push_back({a, b});
+                level.weights.push_back(weights[i]);
+            } else {
+                level.weights[found->second] += weights[i];
+            }
+        }
+
+        size_t count = level.centres.size();
+        level.adjacencyStart.assign(count + 1, 0);
+        for (auto& edge : level.edges) {
+            level.adjacencyStart[edge.first + 1]++;
+            level.adjacencyStart[edge.second + 1]++;
+        }
+        for (size_t i = 0; i < count; ++i) level.adjacencyStart[i + 1] += level.adjacencyStart[i];
+        level.adjacency.assign(level.adjacencyStart[count], 0);
+        std::vector<int> fill(level.adjacencyStart.begin(), level.adjacencyStart.end() - 1);
+        for (size_t i = 0; i < level.edges.size(); ++i) {
+            level.adjacency[fill[level.edges[i].first]++] = static_cast<int>(i);
+            level.adjacency[fill[level.edges[i].second]++] = static_cast<int>(i);
+        }
+    }
+
+    static void indexLevel(Level& level) {
+        size_t count = level.centres.size();
+        level.parents.assign(count, -1);
+
+        float minX = level.centres[0].x, maxX = minX;
+        float minY = level.centres[0].y, maxY = minY;
+        for (auto& centre : level.centres) {
+            minX = std::min(minX, centre.x);
+            maxX = std::max(maxX, centre.x);
+            minY = std::min(minY, centre.y);
+            maxY = std::max(maxY, centre.y);
+        }
+        level.bounds = sf::FloatRect(minX, minY, std::max(1.f, maxX - minX), std::max(1.f, maxY - minY));
+
+        // Aim for a couple of cluster centres per cell
+        float area = level.bounds.width * level.bounds.height;
+        level.cellSize = std::max(1.f, std::sqrt(area * 2 / count));
+        level.columns = std::max(1, static_cast<int>(std::ceil(level.bounds.width / level.cellSize)));
+        level.rows = std::max(1, static_cast<int>(std::ceil(level.bounds.height / level.cellSize)));
+
+        std::vector<int> cellOf(count);
+        level.cellStart.assign(level.columns * level.rows + 1, 0);
+        for (size_t i = 0; i < count; ++i) {
+            int column = std::min(level.columns - 1, static_cast<int>((level.centres[i].x - level.bounds.left) / level.cellSize));
+            int row = std::min(level.rows - 1, static_cast<int>((level.centres[i].y - level.bounds.top) / level.cellSize));
+            cellOf[i] = row * level.columns + column;
+            level.cellStart[cellOf[i] + 1]++;
+        }
+        for (size_t i = 1; i < level.cellStart.size(); ++i) level.cellStart[i] += level.cellStart[i - 1];
+        level.cellItems.assign(count, 0);
+        std::vector<int> fill(level.cellStart.begin(), level.cellStart.end() - 1);
+        for (size_t i = 0; i < count; ++i) level.cellItems[fill[cellOf[i]]++] = static_cast<int>(i);
+    }
+
+    static Level coarsen(Level& fine) {
+        size_t count = fine.centres.size();
+        std::vector<int> match(count, -1);
+
+        // Heavy-edge matching, visiting clusters in a fixed pseudo-random order
+        std::vector<int> order(count);
+        for (size_t i = 0; i < count; ++i) order[i] = static_cast<int>(i);
+        std::shuffle(order.begin(), order.end(), std::mt19937(12345));
+        for (int u : order) {
+            if (match[u] != -1) continue;
+            int best = -1;
+            int bestWeight = 0;
+            for (int i = fine.adjacencyStart[u]; i < fine.adjacencyStart[u + 1]; ++i) {
+                int edge = fine.adjacency[i];
+                int v = fine.edges[edge].first == u ? fine.edges[edge].second : fine.edges[edge].first;
+                if (match[v] == -1 && fine.weights[edge] > bestWeight) {
+                    best = v;
+                    bestWeight = fine.weights[edge];
+                }
+            }
+            if (best != -1) {
+                match[u] = best;
+                match[best] = u;
+            }
+        }
+
+        // Whatever is left pairs up with an unmatched cluster in the same grid cell
+        std::vector<std::pair<long long, int>> leftovers;
+        for (size_t i = 0; i < count; ++i) {
+            if (match[i] != -1) continue;
+            long long column = static_cast<long long>((fine.centres[i].x - fine.bounds.left) / (fine.cellSize * 2));
+            long long row = static_cast<long long>((fine.centres[i].y - fine.bounds.top) / (fine.cellSize * 2));
+            leftovers.push_back({row * (fine.columns + 1) + column, static_cast<int>(i)});
+        }
+        std::sort(leftovers.begin(), leftovers.end());
+        for (size_t i = 0; i + 1 < leftovers.size(); ++i) {
+            if (leftovers[i].first == leftovers[i + 1].first) {
+                match[leftovers[i].second] = leftovers[i + 1].second;
+                match[leftovers[i + 1].second] = leftovers[i].second;
+                ++i;
+            }
+        }
+
+        Level coarse;
+        std::vector<int> clusterOf(count, -1);
+        for (size_t i = 0; i < count; ++i) {
+            if (clusterOf[i] != -1) continue;
+            int id = static_cast<int>(coarse.centres.size());
+            int partner = match[i];
+            clusterOf[i] = id;
+            float size = static_cast<float>(fine.sizes[i]);
+            sf::Vector2f centre = fine.centres[i] * size;
+            float total = size;
+            if (partner != -1) {
+                clusterOf[partner] = id;
+                float partnerSize = static_cast<float>(fine.sizes[partner]);
+                centre += fine.centres[partner] * partnerSize;
+                total += partnerSize;
+            }
+            centre /= total;
+
+            auto cover = [&](int member) {
+                sf::Vector2f d = fine.centres[member] - centre;
+                return std::sqrt(d.x * d.x + d.y * d.y) + fine.radii[member];
+            };
+            float radius = cover(static_cast<int>(i));
+            if (partner != -1) radius = std::max(radius, cover(partner));
+
+            coarse.centres.push_back(centre);
+            coarse.radii.push_back(radius);
+            coarse.sizes.push_back(static_cast<int>(total));
+        }
+
+        fine.parents = clusterOf;
+        bundleEdges(coarse, fine.edges, fine.weights, clusterOf);
+        return coarse;
+    }
+};
+
+class GraphVisualizer {
+public:
+    std::vector<GraphNode*> nodes;
+    std::vector<std::pair<GraphNode*, GraphNode*>> edges;
+    sf::Font font;
+    sf::RectangleShape boundary;
+    BatchRenderer batch;
+
+    // Camera over the graph area; at zoom 1 world and screen coordinates coincide
+    float zoom = 1;
+    sf::Vector2f camera;
+    bool isPanning = false;
+    sf::Vector2f panStart;
+
+    GraphHierarchy hierarchy;
+    bool hierarchyDirty = true;
+    sf::Clock hierarchyClock;
+
+    // Incremental layout: nodes keep their place once set, new ones are seeded next to
+    // their neighbours and only the neighbourhood of a new edge is relaxed
+    std::unordered_map<int, GraphNode*> nodesByValue;
+    std::unordered_map<long long, std::vector<int>> layoutGrid;
+    int nextSpiralSlot = 0;
+    std::vector<int> visible;
+    std::vector<char> visibleMark;
+    int highlightedNode = -1;
+
+    // Fewest screen pixels a drawn node or cluster may claim
+    const float MIN_NODE_PIXELS = 24;
+    const float NODE_RADIUS = 30;
+    const float EDGE_LENGTH = 120;
+    const int RELAX_ITERATIONS = 30;
+    const size_t MAX_RELAX_NODES = 64;
+    const float HIERARCHY_REBUILD_SECONDS = 1;
+
+    GraphVisualizer() {
+        TRACE_SCOPE("load font");
+        if (!font.loadFromFile("arial.ttf")) {
+            std::cerr << "Error loading font!" << std::endl;
+        }
+
+        // Define the boundary for the graph visualization area
+        boundary.setSize(sf::Vector2f(1200, 620));
+        boundary.setPosition(sf::Vector2f(200, 150));
+        boundary.setFillColor(sf::Color::Transparent);
+        boundary.setOutlineThickness(2);
+        boundary.setOutlineColor(sf::Color::White);
+
+        camera = areaCentre();
+    }
+
+    void addNode(int value) {
+        GraphNode* newNode = new GraphNode(value, font);
+        newNode->id = static_cast<int>(nodes.size());
+        nodes.push_back(newNode);
+        nodesByValue[value] = newNode;
+        placeOnSpiral(newNode);
+        hierarchyDirty = true;
+    }
+
+    void addNodes(const std::vector<int>& values) {
+        nodes.reserve(nodes.size() + values.size());
+        nodesByValue.reserve(nodesByValue.size() + values.size());
+        for (int value : values) addNode(value);
+    }
+
+    // Consecutive pairs of values are the start and end of each edge
+    void addEdges(const std::vector<int>& endpoints) {
+        edges.reserve(edges.size() + endpoints.size() / 2);
+        for (size_t i = 0; i + 1 < endpoints.size(); i += 2) addEdge(endpoints[i], endpoints[i + 1]);
+    }
+
+    void addEdge(int start, int end) {
+        auto startFound = nodesByValue.find(start);
+        auto endFound = nodesByValue.find(end);
+        if (startFound == nodesByValue.end() || endFound == nodesByValue.end()) return;
+
+        GraphNode* startNode = startFound->second;
+        GraphNode* endNode = endFound->second;
+        edges.push_back({startNode, endNode});
+        hierarchyDirty = true;
+        if (startNode == endNode) return;
+
+        // A node seeing its first edge moves next to the node it was connected to
+        if (endNode->neighbors.empty()) {
+            seedNear(endNode, startNode);
+        } else if (startNode->neighbors.empty()) {
+            seedNear(startNode, endNode);
+        }
+        startNode->neighbors.push_back(endNode->id);
+        endNode->neighbors.push_back(startNode->id);
+
+        relaxAround(startNode, endNode);
+    }
+
+    long long gridKey(sf::Vector2f centre) const {
+        long long column = static_cast<long long>(std::floor(centre.x / EDGE_LENGTH));
+        long long row = static_cast<long long>(std::floor(centre.y / EDGE_LENGTH));
+        return static_cast<long long>((static_cast<unsigned long long>(row) << 32) ^ static_cast<unsigned long long>(column & 0xffffffffLL));
+    }
+
+    void moveNode(GraphNode* node, sf::Vector2f centre) {
+        long long oldKey = gridKey(nodeCentre(node));
+        long long newKey = gridKey(centre);
+        if (oldKey != newKey) {
+            auto& cell = layoutGrid[oldKey];
+            cell.erase(std::find(cell.begin(), cell.end(), node->id));
+            if (cell.empty()) layoutGrid.erase(oldKey);
+            layoutGrid[newKey].push_back(node->id);
+        }
+        node->setPosition(centre - sf::Vector2f(NODE_RADIUS, NODE_RADIUS));
+    }
+
+    // Nodes whose centre lies within EDGE_LENGTH of the point
+    void nodesNear(sf::Vector2f centre, std::vector<int>& out) const {
+        out.clear();
+        for (float dy = -EDGE_LENGTH; dy <= EDGE_LENGTH; dy += EDGE_LENGTH) {
+            for (float dx = -EDGE_LENGTH; dx <= EDGE_LENGTH; dx += EDGE_LENGTH) {
+                auto found = layoutGrid.find(gridKey(centre + sf::Vector2f(dx, dy)));
+                if (found == layoutGrid.end()) continue;
+                for (int id : found->second) {
+                    sf::Vector2f d = nodeCentre(nodes[id]) - centre;
+                    if (d.x * d.x + d.y * d.y < EDGE_LENGTH * EDGE_LENGTH) out.push_back(id);
+                }
+            }
+        }
+    }
+
+    // Unconnected nodes take the next free slot of a golden-angle spiral around the
+    // centre of the area, so they fill it evenly without disturbing anything placed
+    void placeOnSpiral(GraphNode* node) {
+        const float goldenAngle = 2.39996323f;
+        std::vector<int> crowd;
+        sf::Vector2f centre;
+        do {
+            float radius = EDGE_LENGTH * 0.6f * std::sqrt(static_cast<float>(nextSpiralSlot));
+            float angle = goldenAngle * nextSpiralSlot;
+            centre = areaCentre() + sf::Vector2f(radius * std::cos(angle), radius * std::sin(angle));
+            ++nextSpiralSlot;
+            nodesNear(centre, crowd);
+        } while (!crowd.empty());
+
+        node->setPosition(centre - sf::Vector2f(NODE_RADIUS, NODE_RADIUS));
+        layoutGrid[gridKey(centre)].push_back(node->id);
+    }
+
+    void seedNear(GraphNode* node, GraphNode* anchor) {
+        // Of eight spots around the anchor, take the least crowded one
+        std::vector<int> crowd;
+        sf::Vector2f best = nodeCentre(node);
+        size_t bestCrowd = static_cast<size_t>(-1);
+        for (int i = 0; i < 8; ++i) {
+            float angle = i * static_cast<float>(M_PI) / 4 + 0.3f * anchor->neighbors.size();
+            sf::Vector2f spot = nodeCentre(anchor) + sf::Vector2f(std::cos(angle), std::sin(angle)) * EDGE_LENGTH;
+            nodesNear(spot, crowd);
+            if (crowd.size() < bestCrowd) {
+                bestCrowd = crowd.size();
+                best = spot;
+            }
+        }
+        moveNode(node, best);
+    }
+
+    // A few force-directed steps over the new edge's endpoints and their neighbours;
+    // every other node stays where it is
+    void relaxAround(GraphNode* a, GraphNode* b) {
+        ProfileScope layout(FrameProfiler::Layout);
+        TRACE_SCOPE("Graph relaxAround");
+        std::vector<GraphNode*> affected = {a, b};
+        for (GraphNode* endpoint : {a, b}) {
+            for (int id : endpoint->neighbors) {
+                if (affected.size() >= MAX_RELAX_NODES) break;
+                if (std::find(affected.begin(), affected.end(), nodes[id]) == affected.end()) affected.push_back(nodes[id]);
+            }
+        }
+
+        std::vector<int> crowd;
+        float step = EDGE_LENGTH * 0.25f;
+        for (int iteration = 0; iteration < RELAX_ITERATIONS; ++iteration) {
+            for (GraphNode* node : affected) {
+                sf::Vector2f centre = nodeCentre(node);
+                sf::Vector2f force(0, 0);
+
+                // Springs pull neighbours towards the ideal edge length
+                for (int id : node->neighbors) {
+                    sf::Vector2f d = nodeCentre(nodes[id]) - centre;
+                    float length = std::sqrt(d.x * d.x + d.y * d.y);
+                    if (length > 0.01f) force += d * ((length - EDGE_LENGTH) / (length * EDGE_LENGTH));
+                }
+
+                // Anything closer than an edge length pushes back
+                nodesNear(centre, crowd);
+                for (int id : crowd) {
+                    if (id == node->id) continue;
+                    sf::Vector2f d = centre - nodeCentre(nodes[id]);
+                    float length = std::sqrt(d.x * d.x + d.y * d.y);
+                    if (length < 0.01f) {
+                        // Coincident nodes: split them in an arbitrary but fixed direction
+                        d = sf::Vector2f(static_cast<float>(id % 7) - 3, static_cast<float>(node->id % 5) - 2.5f);
+                        length = std::sqrt(d.x * d.x + d.y * d.y);
+                    }
+                    force += d * ((EDGE_LENGTH - length) / (length * EDGE_LENGTH));
+                }
+
+                float magnitude = std::sqrt(force.x * force.x + force.y * force.y);
+                if (magnitude > 0.001f) moveNode(node, centre + force * (step / std::max(1.f, magnitude)));
+            }
+            step *= 0.9f;
+        }
+    }
+
+    // Coarsening hierarchy over the current layout, rebuilt only after the graph changed
+    void buildHierarchy() {
+        ProfileScope layout(FrameProfiler::Layout);
+        TRACE_SCOPE("Graph buildHierarchy");
+        std::vector<sf::Vector2f> centres(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) centres[i] = nodeCentre(nodes[i]);
+
+        std::vector<std::pair<int, int>> indexEdges;
+        indexEdges.reserve(edges.size());
+        for (auto& edge : edges) indexEdges.push_back({edge.first->id, edge.second->id});
+
+        hierarchy.build(centres, NODE_RADIUS, indexEdges);
+        hierarchyDirty = false;
+    }
+
+    sf::Vector2f areaCentre() const {
+        return boundary.getPosition() + boundary.getSize() / 2.f;
+    }
+
+    sf::Vector2f nodeCentre(const GraphNode* node) const {
+        return node->position + sf::Vector2f(NODE_RADIUS, NODE_RADIUS);
+    }
+
+    sf::Vector2f toScreen(sf::Vector2f world) const {
+        return areaCentre() + (world - camera) * zoom;
+    }
+
+    sf::Vector2f toWorld(sf::Vector2f screen) const {
+        return camera + (screen - areaCentre()) / zoom;
+    }
+
+    sf::FloatRect visibleWorldArea() const {
+        sf::Vector2f size = boundary.getSize() / zoom;
+        return sf::FloatRect(camera - size / 2.f, size);
+    }
+
+    // How many nodes or clusters fit on screen without piling up
+    size_t nodeBudget() const {
+        return static_cast<size_t>(boundary.getSize().x * boundary.getSize().y / (MIN_NODE_PIXELS * MIN_NODE_PIXELS));
+    }
+
+    void zoomAt(sf::Vector2f mousePos, float factor) {
+        if (!boundary.getGlobalBounds().contains(mousePos)) return;
+        // Keep the world point under the cursor fixed
+        sf::Vector2f anchor = toWorld(mousePos);
+        zoom = std::max(0.0005f, std::min(4.f, zoom * factor));
+        camera = anchor - (mousePos - areaCentre()) / zoom;
+    }
+
+    void startPan(sf::Vector2f mousePos) {
+        if (!boundary.getGlobalBounds().contains(mousePos)) return;
+        isPanning = true;
+        panStart = mousePos;
+    }
+
+    void pan(sf::Vector2f mousePos) {
+        if (!isPanning) return;
+        camera -= (mousePos - panStart) / zoom;
+        panStart = mousePos;
+    }
+
+    void stopPan() {
+        isPanning = false;
+    }
+
+    void draw(sf::RenderTarget& window) {
+        TRACE_SCOPE("Graph draw");
+        // Draw the boundary
+        window.draw(boundary);
+
+        if (nodes.size() <= nodeBudget()) {
+            drawAllNodes();
+        } else {
+            drawLevelOfDetail();
+        }
+        batch.flush(window);
+    }
+
+    void drawNode(GraphNode* node) {
+        sf::Vector2f centre = toScreen(nodeCentre(node));
+        batch.addDisc(centre, NODE_RADIUS * zoom, node->circle.getFillColor(),
+                      node->circle.getOutlineThickness(), node->circle.getOutlineColor());
+
+        // Labels keep their size, so they only show once nodes are large enough to hold them
+        if (zoom >= 0.6f) {
+            sf::FloatRect bounds = node->text.getLocalBounds();
+            sf::Vector2f labelPos = centre - sf::Vector2f(bounds.left + bounds.width / 2, bounds.top + bounds.height / 2);
+            batch.addLabel(node->text, labelPos - node->text.getPosition());
+        }
+    }
+
+    void drawAllNodes() {
+        for (auto& edge : edges) {
+            batch.addEdge(toScreen(nodeCentre(edge.first)), toScreen(nodeCentre(edge.second)));
+        }
+
+        for (auto& node : nodes) {
+            drawNode(node);
+        }
+    }
+
+    // Draws only what is inside the view, at the finest hierarchy level whose clusters
+    // still fit the screen budget, so the cost follows the screen, not the graph
+    void drawLevelOfDetail() {
+        TRACE_SCOPE("Graph drawLevelOfDetail");
+        // While edges keep streaming in, rebuild at most once a second
+        if (hierarchy.empty() || (hierarchyDirty && hierarchyClock.getElapsedTime().asSeconds() >= HIERARCHY_REBUILD_SECONDS)) {
+            buildHierarchy();
+            hierarchyClock.restart();
+        }
+        if (hierarchy.empty()) return;
+
+        // Clusters are culled by centre, so look a little past the edges of the view
+        sf::FloatRect area = visibleWorldArea();
+        float margin = 2 * MIN_NODE_PIXELS / zoom;
+        area = sf::FloatRect(area.left - margin, area.top - margin, area.width + 2 * margin, area.height + 2 * margin);
+        size_t budget = nodeBudget();
+        int level = hierarchy.levelFor(area, budget);
+        hierarchy.query(level, area, visible);
+        while (visible.size() > 2 * budget && level + 1 < static_cast<int>(hierarchy.levels.size())) {
+            hierarchy.query(++level, area, visible);
+        }
+
+        const GraphHierarchy::Level& current = hierarchy.levels[level];
+        visibleMark.assign(current.centres.size(), 0);
+        for (int cluster : visible) visibleMark[cluster] = 1;
+
+        // Bundled edges: each one stands for every graph edge between the two clusters
+        size_t edgeBudget = 4 * budget;
+        size_t drawnEdges = 0;
+        for (int cluster : visible) {
+            for (int i = current.adjacencyStart[cluster]; i < current.adjacencyStart[cluster + 1] && drawnEdges < edgeBudget; ++i) {
+                int edge = current.adjacency[i];
+                int other = current.edges[edge].first == cluster ? current.edges[edge].second : current.edges[edge].first;
+                if (visibleMark[other] && other < cluster) continue; // drawn from the other end
+                int alpha = std::min(255, 60 + 25 * current.weights[edge]);
+                batch.addEdge(toScreen(current.centres[cluster]), toScreen(current.centres[other]), sf::Color(255, 255, 255, alpha));
+                ++drawnEdges;
+            }
+        }
+
+        if (level == 0) {
+            for (int node : visible) drawNode(nodes[node]);
+            return;
+        }
+
+        for (int cluster : visible) {
+            float radius = std::min(current.radii[cluster], NODE_RADIUS * std::sqrt(static_cast<float>(current.sizes[cluster])));
+            batch.addDisc(toScreen(current.centres[cluster]), std::max(3.f, radius * zoom), sf::Color(180, 30, 30), 2, sf::Color::White);
+        }
+
+        // A found node lights up whichever cluster currently stands in for it, once the
+        // hierarchy has been rebuilt with it
+        if (highlightedNode >= 0 && static_cast<size_t>(highlightedNode) < hierarchy.nodeCount()) {
+            int cluster = hierarchy.ancestor(highlightedNode, level);
+            if (cluster >= 0 && visibleMark[cluster]) {
+                float radius = std::min(current.radii[cluster], NODE_RADIUS * std::sqrt(static_cast<float>(current.sizes[cluster])));
+                batch.addDisc(toScreen(current.centres[cluster]), std::max(3.f, radius * zoom), sf::Color::Yellow);
+            }
+        }
+    }
+
+    void reset() {
+        for (auto node : nodes) delete node;
+        nodes.clear();
+        edges.clear();
+        nodesByValue.clear();
+        layoutGrid.clear();
+        nextSpiralSlot = 0;
+        hierarchy.clear();
+        hierarchyDirty = true;
+        highlightedNode = -1;
+        zoom = 1;
+        camera = areaCentre();
+        isPanning = false;
+    }
+
+    // Adjacency as CSR over node ids, with each edge under its start node
+    void saveSnapshot(const std::string& path) {
+        size_t count = nodes.size();
+        std::vector<int> values(count);
+        std::vector<unsigned int> offsets(count + 1, 0);
+        std::vector<unsigned int> targets(edges.size());
+        std::vector<float> positions(2 * count);
+        for (size_t i = 0; i < count; ++i) {
+            values[i] = nodes[i]->value;
+            positions[2 * i] = nodes[i]->position.x;
+            positions[2 * i + 1] = nodes[i]->position.y;
+        }
+        for (auto& edge : edges) ++offsets[edge.first->id + 1];
+        for (size_t i = 0; i < count; ++i) offsets[i + 1] += offsets[i];
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (auto& edge : edges) targets[fill[edge.first->id]++] = static_cast<unsigned int>(edge.second->id);
+
+        SnapshotWriter writer;
+        if (!writer.open(path, SnapshotHeader::Graph, count, targets.size(), true)) return;
+        writer.section(values.data(), values.size());
+        writer.section(offsets.data(), offsets.size());
+        writer.section(targets.data(), targets.size());
+        writer.section(positions.data(), positions.size());
+        SnapshotLayout record = {NODE_RADIUS, 0};
+        writer.section(&record, 1);
+        if (!writer.close()) std::cerr << "Error writing snapshot " << path << std::endl;
+    }
+
+    // Nodes go straight to their saved positions; without a layout they fill the spiral
+    void loadSnapshot(const std::string& path) {
+        SnapshotReader reader;
+        if (!reader.open(path, SnapshotHeader::Graph)) return;
+        size_t count = static_cast<size_t>(reader.header->count);
+        size_t edgeCount = static_cast<size_t>(reader.header->extra);
+        const int* values = reader.section<int>(count);
+        const unsigned int* offsets = reader.section<unsigned int>(count + 1);
+        const unsigned int* targets = reader.section<unsigned int>(edgeCount);
+        if (!values || !offsets || !targets) {
+            std::cerr << "Truncated snapshot " << path << std::endl;
+            return;
+        }
+        if (offsets[0] != 0 || offsets[count] != edgeCount) {
+            std::cerr << "Corrupt adjacency in " << path << std::endl;
+            return;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (offsets[i] > offsets[i + 1]) {
+                std::cerr << "Corrupt adjacency in " << path << std::endl;
+                return;
+            }
+        }
+        for (size_t e = 0; e < edgeCount; ++e) {
+            if (targets[e] >= count) {
+                std::cerr << "Corrupt adjacency in " << path << std::endl;
+                return;
+            }
+        }
+        const float* positions = reader.hasLayout() ? reader.section<float>(2 * count) : nullptr;
+
+        reset();
+        nodes.reserve(count);
+        nodesByValue.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            GraphNode* node = new GraphNode(values[i], font);
+            node->id = static_cast<int>(i);
+            nodes.push_back(node);
+            nodesByValue[values[i]] = node;
+            if (positions) {
+                node->setPosition(sf::Vector2f(positions[2 * i], positions[2 * i + 1]));
+                layoutGrid[gridKey(nodeCentre(node))].push_back(node->id);
+            } else {
+                placeOnSpiral(node);
+            }
+        }
+        edges.reserve(edgeCount);
+        for (size_t i = 0; i < count; ++i) {
+            for (unsigned int e = offsets[i]; e < offsets[i + 1]; ++e) {
+                GraphNode* start = nodes[i];
+                GraphNode* end = nodes[targets[e]];
+                edges.push_back({start, end});
+                if (start == end) continue;
+                start->neighbors.push_back(end->id);
+                end->neighbors.push_back(start->id);
+            }
+        }
+    }
+
+    void search(int value) {
+        for (auto& node : nodes) {
+            if (node->value == value) {
+                node->circle.setFillColor(sf::Color::Yellow); // Highlight the found node
+                highlightedNode = node->id;
+                return;
+            }
+        }
+        std::cout << "Number does not exist." << std::endl;
+    }
+};
+
+// One recorded step of a sort in eight bytes: the kind in the top two bits of op with
+// the first index below it, then the second index or the value written
+struct SortStep {
+    enum Kind : unsigned int { Compare, Swap, Write };
+
+    unsigned int op;
+    int operand;
+
+    static const unsigned int INDEX_MASK = (1u << 30) - 1;
+
+    Kind kind() const { return static_cast<Kind>(op >> 30); }
+    size_t index() const { return op & INDEX_MASK; }
+};
+
+// Step sinks for the sort kernels. NoSteps hooks are empty and inline away, so the
+// benchmark runs the same kernels the page animates; StepTrace records every step.
+struct NoSteps {
+    static const bool RECORDS = false;
+    void compare(size_t, size_t) {}
+    void swap(size_t, size_t) {}
+    void write(size_t, int) {}
+};
+
+struct StepTrace {
+    static const bool RECORDS = true;
+    std::vector<SortStep> steps;
+
+    void compare(size_t a, size_t b) { add(SortStep::Compare, a, static_cast<int>(b)); }
+    void swap(size_t a, size_t b) { add(SortStep::Swap, a, static_cast<int>(b)); }
+    void write(size_t index, int value) { add(SortStep::Write, index, value); }
+
+private:
+    void add(SortStep::Kind kind, size_t index, int operand) {
+        steps.push_back({(static_cast<unsigned int>(kind) << 30) | static_cast<unsigned int>(index), operand});
+    }
+};
+
+template <typename Steps>
+void insertionSortRange(int* data, size_t lo, size_t hi, Steps& steps) {
+    for (size_t i = lo + 1; i < hi; ++i) {
+        for (size_t j = i; j > lo; --j) {
+            steps.compare(j - 1, j);
+            if (data[j - 1] <= data[j]) break;
+            steps.swap(j - 1, j);
+            std::swap(data[j - 1], data[j]);
+        }
+    }
+}
+
+// Median-of-three Hoare partitioning. The larger side waits on the stack while the
+// smaller one is split further, so the stack stays logarithmic; short ranges finish with
+// insertion sort.
+template <typename Steps>
+void quickSort(int* data, size_t n, Steps& steps) {
+    std::vector<std::pair<size_t, size_t>> ranges;
+    if (n > 1) ranges.emplace_back(0, n);
+    while (!ranges.empty()) {
+        size_t lo = ranges.back().first;
+        size_t hi = ranges.back().second;
+        ranges.pop_back();
+        while (hi - lo > 16) {
+            size_t mid = lo + (hi - lo) / 2;
+            auto order = [&](size_t a, size_t b) {
+                steps.compare(a, b);
+                if (data[b] < data[a]) {
+                    steps.swap(a, b);
+                    std::swap(data[a], data[b]);
+                }
+            };
+            order(lo, mid);
+            order(mid, hi - 1);
+            order(lo, mid);
+
+            int pivot = data[mid];
+            std::ptrdiff_t i = static_cast<std::ptrdiff_t>(lo) - 1;
+            std::ptrdiff_t j = static_cast<std::ptrdiff_t>(hi);
+            while (true) {
+                do {
+                    ++i;
+                    steps.compare(i, mid);
+                } while (data[i] < pivot);
+                do {
+                    --j;
+                    steps.compare(j, mid);
+                } while (pivot < data[j]);
+                if (i >= j) break;
+                steps.swap(i, j);
+                std::swap(data[i], data[j]);
+            }
+
+            size_t split = static_cast<size_t>(j) + 1;
+            if (split - lo < hi - split) {
+                ranges.emplace_back(split, hi);
+                hi = split;
+            } else {
+                ranges.emplace_back(lo, split);
+                lo = split;
+            }
+        }
+        insertionSortRange(data, lo, hi, steps);
+    }
+}
+
+// Bottom-up: insertion-sorted runs of 16, then merges of doubling width through a buffer.
+// A merge copies back only the part that moved, and runs already in order are skipped.
+template <typename Steps>
+void mergeSort(int* data, size_t n, Steps& steps) {
+    const size_t RUN = 16;
+    for (size_t lo = 0; lo < n; lo += RUN) insertionSortRange(data, lo, std::min(n, lo + RUN), steps);
+
+    std::vector<int> buffer(n);
+    for (size_t width = RUN; width < n; width *= 2) {
+        for (size_t lo = 0; lo + width < n; lo += 2 * width) {
+            size_t mid = lo + width;
+            size_t hi = std::min(n, lo + 2 * width);
+            steps.compare(mid - 1, mid);
+            if (data[mid - 1] <= data[mid]) continue;
+
+            size_t i = lo, j = mid, k = lo;
+            while (i < mid && j < hi) {
+                steps.compare(i, j);
+                buffer[k++] = data[j] < data[i] ? data[j++] : data[i++];
+            }
+            while (i < mid) buffer[k++] = data[i++];
+            for (size_t w = lo; w < k; ++w) {
+                steps.write(w, buffer[w]);
+                data[w] = buffer[w];
+            }
+        }
+    }
+}
+
+template <typename Steps>
+void heapSortSiftDown(int* data, size_t root, size_t n, Steps& steps) {
+    while (true) {
+        size_t child = 2 * root + 1;
+        if (child >= n) return;
+        if (child + 1 < n) {
+            steps.compare(child, child + 1);
+            if (data[child] < data[child + 1]) ++child;
+        }
+        steps.compare(root, child);
+        if (!(data[root] < data[child])) return;
+        steps.swap(root, child);
+        std::swap(data[root], data[child]);
+        root = child;
+    }
+}
+
+template <typename Steps>
+void heapSort(int* data, size_t n, Steps& steps) {
+    for (size_t i = n / 2; i-- > 0;) heapSortSiftDown(data, i, n, steps);
+    for (size_t end = n; end-- > 1;) {
+        steps.swap(0, end);
+        std::swap(data[0], data[end]);
+        heapSortSiftDown(data, 0, end, steps);
+    }
+}
+
+// LSD radix sort on bytes. The sign bit is flipped so negative keys come first, and a
+// pass is skipped when every key has the same byte there. Each pass scatters into the
+// other buffer; the trace shows that as writes over the array.
+template <typename Steps>
+void radixSort(int* data, size_t n, Steps& steps) {
+    if (n < 2) return;
+    std::vector<int> buffer(n);
+    int* from = data;
+    int* to = buffer.data();
+    for (int shift = 0; shift < 32; shift += 8) {
+        auto digit = [shift](int value) { return ((static_cast<unsigned int>(value) ^ 0x80000000u) >> shift) & 0xff; };
+        size_t counts[256] = {};
+        for (size_t i = 0; i < n; ++i) ++counts[digit(from[i])];
+        if (counts[digit(from[0])] == n) continue;
+
+        size_t offset = 0;
+        for (size_t& count : counts) {
+            size_t bucket = count;
+            count = offset;
+            offset += bucket;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            size_t position = counts[digit(from[i])]++;
+            steps.write(position, from[i]);
+            to[position] = from[i];
+        }
+        std::swap(from, to);
+    }
+    if (from != data) std::copy(from, from + n, data);
+}
+
+// Compare-exchange of data[i] and data[i + distance] for count consecutive i. The pairs
+// are independent, so without a trace four of them go through SSE2 at once.
+template <typename Steps>
+void bitonicCompareRun(int* data, size_t lo, size_t count, size_t distance, bool ascending, Steps& steps) {
+    size_t i = lo;
+    size_t end = lo + count;
+#if defined(__SSE2__) || defined(_M_X64)
+    if (!Steps::RECORDS) {
+        for (; i + 4 <= end; i += 4) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + distance));
+            __m128i greater = _mm_cmpgt_epi32(a, b);
+            __m128i low = _mm_or_si128(_mm_and_si128(greater, b), _mm_andnot_si128(greater, a));
+            __m128i high = _mm_or_si128(_mm_and_si128(greater, a), _mm_andnot_si128(greater, b));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), ascending ? low : high);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i + distance), ascending ? high : low);
+        }
+    }
+#endif
+    for (; i < end; ++i) {
+        steps.compare(i, i + distance);
+        if (ascending ? data[i + distance] < data[i] : data[i] < data[i + distance]) {
+            steps.swap(i, i + distance);
+            std::swap(data[i], data[i + distance]);
+        }
+    }
+}
+
+// Bitonic merge for any length: the first n - m elements are compared with those m
+// further on, where m is the largest power of two below n
+template <typename Steps>
+void bitonicMerge(int* data, size_t lo, size_t n, bool ascending, Steps& steps) {
+    if (n < 2) return;
+    size_t m = 1;
+    while (m * 2 < n) m *= 2;
+    bitonicCompareRun(data, lo, n - m, m, ascending, steps);
+    bitonicMerge(data, lo, m, ascending, steps);
+    bitonicMerge(data, lo + m, n - m, ascending, steps);
+}
+
+template <typename Steps>
+void bitonicSortRange(int* data, size_t lo, size_t n, bool ascending, Steps& steps) {
+    if (n < 2) return;
+    size_t half = n / 2;
+    bitonicSortRange(data, lo, half, !ascending, steps);
+    bitonicSortRange(data, lo + half, n - half, ascending, steps);
+    bitonicMerge(data, lo, n, ascending, steps);
+}
+
+// Sorting network: the same O(n log^2 n) compare-exchanges whatever the data
+template <typename Steps>
+void bitonicSort(int* data, size_t n, Steps& steps) {
+    bitonicSortRange(data, 0, n, true, steps);
+}
+
+enum SortAlgorithm { QuickSort, MergeSort, HeapSort, RadixSort, BitonicSort, SORT_ALGORITHM_COUNT };
+
+inline const char* sortAlgorithmName(int algorithm) {
+    static const char* names[] = {"Quick", "Merge", "Heap", "Radix", "Bitonic"};
+    return names[algorithm];
+}
+
+// Index of a name such as "quick" or "Radix", or -1
+inline int sortAlgorithmIndex(const std::string& name) {
+    for (int algorithm = 0; algorithm < SORT_ALGORITHM_COUNT; ++algorithm) {
+        std::string candidate = sortAlgorithmName(algorithm);
+        if (candidate.size() == name.size() && std::equal(name.begin(), name.end(), candidate.begin(),
+                [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b)); })) {
+            return algorithm;
+        }
+    }
+    return -1;
+}
+
+template <typename Steps>
+void runSort(int algorithm, int* data, size_t n, Steps& steps) {
+    switch (algorithm) {
+    case QuickSort: quickSort(data, n, steps); break;
+    case MergeSort: mergeSort(data, n, steps); break;
+    case HeapSort: heapSort(data, n, steps); break;
+    case RadixSort: radixSort(data, n, steps); break;
+    default: bitonicSort(data, n, steps); break;
+    }
+}
+
+// std::sort on one chunk per hardware thread, then rounds of merging neighbouring
+// chunks, each round in parallel
+inline void threadedChunkSort(int* data, size_t n) {
+    size_t chunks = std::max(1u, std::thread::hardware_concurrency());
+    chunks = std::min(chunks, std::max<size_t>(1, n / 4096));
+    std::vector<size_t> bounds(chunks + 1);
+    for (size_t c = 0; c <= chunks; ++c) bounds[c] = n * c / chunks;
+
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < chunks; ++c) {
+        threads.emplace_back([data, &bounds, c] { std::sort(data + bounds[c], data + bounds[c + 1]); });
+    }
+    for (auto& thread : threads) thread.join();
+
+    for (size_t width = 1; width < chunks; width *= 2) {
+        threads.clear();
+        for (size_t c = 0; c + width < chunks; c += 2 * width) {
+            size_t last = std::min(chunks, c + 2 * width);
+            threads.emplace_back([data, &bounds, c, width, last] {
+                std::inplace_merge(data + bounds[c], data + bounds[c + width], data + bounds[last]);
+            });
+        }
+        for (auto& thread : threads) thread.join();
+    }
+}
+
+// --sort-bench [count ...]: every kernel, std::sort and the parallel sorts on the same
+// random ints, each result checked. Counts may be written as 1e7.
+inline int runSortBenchmark(std::istream& args) {
+    std::vector<size_t> counts;
+    double count;
+    while (args >> count) counts.push_back(static_cast<size_t>(count));
+    if (counts.empty()) counts = {1000000, 10000000};
+
+    std::vector<std::pair<std::string, std::function<void(int*, size_t)>>> kernels;
+    for (int algorithm = 0; algorithm < SORT_ALGORITHM_COUNT; ++algorithm) {
+        kernels.emplace_back(sortAlgorithmName(algorithm), [algorithm](int* data, size_t n) {
+            NoSteps none;
+            runSort(algorithm, data, n, none);
+        });
+    }
+    kernels.emplace_back("std::sort", [](int* data, size_t n) { std::sort(data, data + n); });
+    kernels.emplace_back("threads", threadedChunkSort);
+#ifdef USE_PARALLEL_STL
+    kernels.emplace_back("std::sort par", [](int* data, size_t n) { std::sort(std::execution::par, data, data + n); });
+#endif
+
+    std::cout << std::fixed;
+    std::cout.precision(1);
+    std::cout << "kernel              count         ms    Melem/s" << std::endl;
+    for (size_t n : counts) {
+        std::vector<int> input(n);
+        std::mt19937 rng(42);
+        for (int& value : input) value = static_cast<int>(rng());
+        std::vector<int> work;
+        for (auto& kernel : kernels) {
+            work = input;
+            auto start = std::chrono::steady_clock::now();
+            kernel.second(work.data(), n);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            bool sorted = std::is_sorted(work.begin(), work.end());
+            std::cout << std::left << std::setw(14) << kernel.first << std::right << std::setw(11) << n
+                      << std::setw(11) << ms << std::setw(11) << n / (ms * 1e3) << (sorted ? "" : "   NOT SORTED") << std::endl;
+            if (!sorted) return 1;
+        }
+    }
+    return 0;
+}
+
+// Bar view of a sort. The sort runs once up front on a copy of the bars while its steps
+// are recorded, and playback applies a slice of them every frame.
+class SortVisualizer {
+public:
+    std::vector<int> values;            // what the bars show
+    std::vector<SortStep> steps;
+    size_t nextStep = 0;
+    int algorithm = -1;
+    size_t compares = 0, swaps = 0, writes = 0;
+    size_t lastFirst = 0, lastSecond = 0;
+    SortStep::Kind lastKind = SortStep::Compare;
+    double sortMs = 0;
+    int minValue = 0, maxValue = 0;
+
+    sf::Font font;
+    BatchRenderer batch;
+    sf::RectangleShape bar;
+    sf::Text statusText;
+    size_t shownStep = static_cast<size_t>(-1);
+
+    // A sort runs on a background thread so the page keeps drawing during a large one
+    struct SortResult {
+        double ms = 0;
+        bool traced = false;
+        std::vector<int> sorted;            // only when the input is too large to trace
+        std::vector<SortStep> steps;
+    };
+    std::future<SortResult> pending;
+    std::chrono::steady_clock::time_point pendingStart;
+
+    const size_t MAX_TRACED = 100000;       // larger inputs are sorted without playback
+    const size_t MAX_COLUMNS = 1300;
+    const size_t PLAYBACK_FRAMES = 600;
+    const sf::Vector2f AREA_POSITION = sf::Vector2f(150, 280);
+    const sf::Vector2f AREA_SIZE = sf::Vector2f(1300, 400);
+
+    SortVisualizer() {
+        TRACE_SCOPE("load font");
+        if (!font.loadFromFile("arial.ttf")) {
+            std::cerr << "Error loading font!" << std::endl;
+        }
+        statusText.setFont(font);
+        statusText.setCharacterSize(18);
+        statusText.setFillColor(sf::Color::White);
+        statusText.setPosition(150, 225);
+    }
+
+    void insertBatch(const std::vector<int>& batch) {
+        finishSort();
+        finishPlayback();
+        values.insert(values.end(), batch.begin(), batch.end());
+        updateRange();
+        shownStep = static_cast<size_t>(-1);
+    }
+
+    void reset() {
+        finishSort();
+        std::vector<int>().swap(values);
+        std::vector<SortStep>().swap(steps);
+        nextStep = 0;
+        algorithm = -1;
+        compares = swaps = writes = 0;
+        sortMs = 0;
+        minValue = maxValue = 0;
+        shownStep = static_cast<size_t>(-1);
+    }
+
+    // Times the kernel without a trace, then records one for playback when the input is
+    // small enough to watch. Both run in the background; update() picks up the result.
+    // A second sort first waits for the running one, so a replay sorts what the live
+    // session sorted.
+    void sort(int which) {
+        if (which < 0 || which >= SORT_ALGORITHM_COUNT) return;
+        finishSort();
+        finishPlayback();
+        algorithm = which;
+        compares = swaps = writes = 0;
+        steps.clear();
+        nextStep = 0;
+
+        bool traced = values.size() <= MAX_TRACED;
+        pendingStart = std::chrono::steady_clock::now();
+        pending = std::async(std::launch::async, [which, traced, work = values]() mutable {
+            SortResult result;
+            result.traced = traced;
+            std::vector<int> input = traced ? work : std::vector<int>();
+            auto start = std::chrono::steady_clock::now();
+            NoSteps none;
+            runSort(which, work.data(), work.size(), none);
+            result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            if (traced) {
+                StepTrace trace;
+                trace.steps.reserve(input.size() * 16);
+                runSort(which, input.data(), input.size(), trace);
+                result.steps.swap(trace.steps);
+            } else {
+                result.sorted.swap(work);
+            }
+            return result;
+        });
+        shownStep = static_cast<size_t>(-1);
+    }
+
+    bool isSorting() const {
+        return pending.valid();
+    }
+
+    bool isPlaying() const {
+        return nextStep < steps.size();
+    }
+
+    void update() {
+        if (pending.valid()) {
+            if (pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                shownStep = static_cast<size_t>(-1);   // the status shows the time so far
+                return;
+            }
+            finishSort();
+        }
+        size_t perFrame = std::max<size_t>(1, steps.size() / PLAYBACK_FRAMES);
+        for (size_t i = 0; i < perFrame && nextStep < steps.size(); ++i) applyStep(steps[nextStep++]);
+    }
+
+    void finishPlayback() {
+        while (nextStep < steps.size()) applyStep(steps[nextStep++]);
+    }
+
+    // Waits for a running sort and takes its result
+    void finishSort() {
+        if (!pending.valid()) return;
+        SortResult result = pending.get();
+        sortMs = result.ms;
+        if (result.traced) steps.swap(result.steps);
+        else values.swap(result.sorted);
+        shownStep = static_cast<size_t>(-1);
+    }
+
+    void draw(sf::RenderTarget& target) {
+        if (!values.empty()) {
+            // One bar per column; with more values than columns each column samples one
+            size_t n = values.size();
+            size_t columns = std::min(n, MAX_COLUMNS);
+            float width = AREA_SIZE.x / columns;
+            float range = std::max(1.f, static_cast<float>(maxValue) - static_cast<float>(minValue));
+            bool playing = isPlaying();
+            size_t firstColumn = lastFirst * columns / n;
+            size_t secondColumn = lastSecond * columns / n;
+            sf::Color active = lastKind == SortStep::Compare ? sf::Color::Yellow
+                             : lastKind == SortStep::Swap ? sf::Color::Red : sf::Color::Green;
+            for (size_t column = 0; column < columns; ++column) {
+                int value = values[column * n / columns];
+                float height = 5 + (static_cast<float>(value) - minValue) / range * (AREA_SIZE.y - 5);
+                bar.setSize(sf::Vector2f(std::max(1.f, width - (width > 3 ? 1 : 0)), height));
+                bar.setPosition(AREA_POSITION.x + column * width, AREA_POSITION.y + AREA_SIZE.y - height);
+                bool touched = playing && (column == firstColumn || (lastKind != SortStep::Write && column == secondColumn));
+                bar.setFillColor(touched ? active : sf::Color(100, 180, 255));
+                batch.addRect(bar);
+            }
+            batch.flush(target);
+        }
+
+        if (nextStep != shownStep) {
+            shownStep = nextStep;
+            statusText.setString(status());
+        }
+        target.draw(statusText);
+    }
+
+private:
+    void applyStep(const SortStep& step) {
+        size_t first = step.index();
+        lastFirst = first;
+        lastKind = step.kind();
+        switch (step.kind()) {
+        case SortStep::Compare:
+            ++compares;
+            lastSecond = static_cast<size_t>(step.operand);
+            break;
+        case SortStep::Swap:
+            ++swaps;
+            lastSecond = static_cast<size_t>(step.operand);
+            std::swap(values[first], values[lastSecond]);
+            break;
+        default:
+            ++writes;
+            lastSecond = first;
+            values[first] = step.operand;
+            break;
+        }
+    }
+
+    void updateRange() {
+        if (values.empty()) return;
+        auto range = std::minmax_element(values.begin(), values.end());
+        minValue = *range.first;
+        maxValue = *range.second;
+    }
+
+    std::string status() const {
+        std::ostringstream out;
+        out.setf(std::ios::fixed);
+        out.precision(2);
+        if (values.empty()) {
+            return "Enter numbers, or 'random 2000', then pick an algorithm below.";
+        }
+        out << values.size() << " values";
+        if (algorithm < 0) return out.str();
+        if (pending.valid()) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - pendingStart).count();
+            out << "   " << sortAlgorithmName(algorithm) << " sort running for " << seconds << " s";
+            return out.str();
+        }
+        out << "   " << sortAlgorithmName(algorithm) << " sort took " << sortMs << " ms";
+        if (steps.empty()) {
+            out << "   (more than " << MAX_TRACED << " values, shown without playback)";
+        } else {
+            out << "   step " << nextStep << " / " << steps.size()
+                << "   compares " << compares << "   swaps " << swaps << "   writes " << writes;
+        }
+        return out.str();
+    }
+};
+
+// Min-heap kernels for a heap of arity D. heap points D-1 slots into its array, so the
+// children of index i (D*i+1 .. D*i+D) start at array slot D*(i+1): every group of
+// children starts on a multiple of D. std::vector storage is 16-byte aligned, so a
+// 4-ary group sits in one 16-byte block and is never split across cache lines.
+template <int D>
+struct DaryHeap {
+    static const size_t PADDING = D - 1;
+
+    // Each returns the index where the moved key came to rest
+    static size_t siftUp(int* heap, size_t i) {
+        int key = heap[i];
+        while (i > 0) {
+            size_t parent = (i - 1) / D;
+            if (heap[parent] <= key) break;
+            heap[i] = heap[parent];
+            i = parent;
+        }
+        heap[i] = key;
+        return i;
+    }
+
+    // levels counts the child groups read: one cache line each
+    static size_t siftDown(int* heap, size_t n, size_t i, size_t& levels) {
+        int key = heap[i];
+        while (true) {
+            size_t first = D * i + 1;
+            if (first >= n) break;
+            size_t last = std::min(first + D, n);
+            size_t best = first;
+            for (size_t child = first + 1; child < last; ++child) {
+                if (heap[child] < heap[best]) best = child;
+            }
+            ++levels;
+            if (heap[best] >= key) break;
+            heap[i] = heap[best];
+            i = best;
+        }
+        heap[i] = key;
+        return i;
+    }
+
+    // Floyd's bottom-up build, O(n)
+    static void heapify(int* heap, size_t n) {
+        size_t levels = 0;
+        if (n < 2) return;
+        for (size_t i = (n - 2) / D + 1; i-- > 0;) siftDown(heap, n, i, levels);
+    }
+};
+
+// Array-backed priority queue, binary or 4-ary, drawn as its top levels and as the
+// array underneath
+class HeapVisualizer {
+public:
+    std::vector<int> keys;          // the first arity-1 slots are padding
+    size_t count = 0;
+    int arity = 2;
+    long long highlighted = -1;     // index of the key the last operation moved or found
+    std::string lastAction;
+    size_t lastLevels = 0;
+    double lastMs = 0;
+
+    sf::Font font;
+    BatchRenderer batch;
+    sf::CircleShape circle;
+    NodeLabel valueText;
+    NodeLabel indexText;
+    sf::RectangleShape cell;
+    sf::Text statusText;
+    TreeSnapshot shown;
+    bool shownCurrent = false;
+
+    const size_t MAX_LEVEL_NODES = 32;     // deeper levels only appear in the array row
+    const size_t MAX_CELLS = 32;
+    const sf::Vector2f AREA_POSITION = sf::Vector2f(150, 240);
+    const float AREA_WIDTH = 1300;
+
+    HeapVisualizer() {
+        TRACE_SCOPE("load font");
+        if (!font.loadFromFile("arial.ttf")) {
+            std::cerr << "Error loading font!" << std::endl;
+        }
+        circle.setOutlineColor(sf::Color::White);
+        valueText.setFont(font);
+        valueText.setCharacterSize(18);
+        valueText.setFillColor(sf::Color::White);
+        indexText.setFont(font);
+        indexText.setCharacterSize(12);
+        indexText.setFillColor(sf::Color(200, 200, 200));
+        cell.setOutlineThickness(1);
+        cell.setOutlineColor(sf::Color::White);
+        statusText.setFont(font);
+        statusText.setCharacterSize(18);
+        statusText.setFillColor(sf::Color::White);
+        statusText.setPosition(150, 560);
+        keys.resize(arity - 1);
+    }
+
+    int* heap() {
+        return keys.data() + arity - 1;
+    }
+
+    const int* heap() const {
+        return keys.data() + arity - 1;
+    }
+
+    // Pushes one by one when the batch is small next to the heap, otherwise appends and
+    // rebuilds in O(n)
+    void pushBatch(const std::vector<int>& values) {
+        if (values.empty()) return;
+        auto start = std::chrono::steady_clock::now();
+        keys.insert(keys.end(), values.begin(), values.end());
+        size_t total = count + values.size();
+        if (values.size() * std::log2(static_cast<double>(total) + 1) > total) {
+            if (arity == 2) DaryHeap<2>::heapify(heap(), total);
+            else DaryHeap<4>::heapify(heap(), total);
+            count = total;
+            highlighted = -1;
+            lastAction = "heapify " + std::to_string(values.size()) + " keys";
+        } else {
+            while (count < total) highlighted = static_cast<long long>(siftUp(count++));
+            lastAction = "push " + std::to_string(values.size()) + (values.size() == 1 ? " key" : " keys");
+        }
+        lastLevels = 0;
+        finish(start);
+    }
+
+    void popMin() {
+        if (count == 0) {
+            std::cout << "Heap is empty." << std::endl;
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        int minimum = heap()[0];
+        heap()[0] = heap()[--count];
+        keys.pop_back();
+        lastLevels = 0;
+        highlighted = count > 0 ? static_cast<long long>(siftDown(0)) : -1;
+        lastAction = "pop-min " + std::to_string(minimum);
+        finish(start);
+    }
+
+    void decreaseKey(size_t index, int value) {
+        if (index >= count) {
+            std::cout << "No key at index " << index << "." << std::endl;
+            return;
+        }
+        if (value > heap()[index]) {
+            std::cout << "Decrease-key needs a key no larger than " << heap()[index] << "." << std::endl;
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        heap()[index] = value;
+        highlighted = static_cast<long long>(siftUp(index));
+        lastLevels = 0;
+        lastAction = "decrease-key at " + std::to_string(index);
+        finish(start);
+    }
+
+    // Rebuilds the same keys with the new arity
+    void setArity(int newArity) {
+        if (newArity != 2 && newArity != 4) return;
+        std::vector<int> live(heap(), heap() + count);
+        arity = newArity;
+        keys.assign(arity - 1, 0);
+        count = 0;
+        pushBatch(live);
+        lastAction = std::to_string(arity) + "-ary rebuild";
+    }
+
+    void search(int value) {
+        long long index = findFirstInt(heap(), count, value);
+        if (index < 0) {
+            std::cout << "Number does not exist." << std::endl;
+            return;
+        }
+        highlighted = index;
+        shownCurrent = false;
+    }
+
+    void reset() {
+        std::vector<int>().swap(keys);
+        keys.resize(arity - 1);
+        count = 0;
+        highlighted = -1;
+        lastAction.clear();
+        lastLevels = 0;
+        lastMs = 0;
+        shownCurrent = false;
+    }
+
+    size_t height() const {
+        size_t levels = 0;
+        for (size_t width = 1, total = 0; total < count; width *= arity, ++levels) total += width;
+        return levels;
+    }
+
+    void draw(sf::RenderTarget& target) {
+        if (!shownCurrent) rebuildView();
+        if (!shown.nodes.empty()) drawTreeSnapshot(shown, batch, circle, valueText, nullptr, sf::Color(0, 140, 160));
+
+        // Array row: cells coloured by depth so each level can be matched with the tree
+        const sf::Color levelColors[] = {sf::Color(0, 140, 160), sf::Color(60, 100, 180), sf::Color(110, 80, 170), sf::Color(150, 70, 120)};
+        size_t cells = std::min(count, MAX_CELLS);
+        float width = AREA_WIDTH / MAX_CELLS;
+        size_t depth = 0, levelEnd = 1, levelWidth = 1;
+        for (size_t i = 0; i < cells; ++i) {
+            if (i == levelEnd) {
+                ++depth;
+                levelWidth *= arity;
+                levelEnd += levelWidth;
+            }
+            cell.setSize(sf::Vector2f(width - 2, 36));
+            cell.setPosition(AREA_POSITION.x + i * width, 610);
+            cell.setFillColor(static_cast<long long>(i) == highlighted ? sf::Color(200, 160, 0) : levelColors[depth % 4]);
+            batch.addRect(cell);
+            valueText.setString(std::to_string(heap()[i]));
+            valueText.setPosition(AREA_POSITION.x + i * width + (width - valueText.getLocalBounds().width) / 2, 617);
+            batch.addLabel(valueText);
+            indexText.setString(std::to_string(i));
+            indexText.setPosition(AREA_POSITION.x + i * width + (width - indexText.getLocalBounds().width) / 2, 650);
+            batch.addLabel(indexText);
+        }
+        batch.flush(target);
+
+        statusText.setString(status());
+        target.draw(statusText);
+    }
+
+private:
+    size_t siftUp(size_t i) {
+        return arity == 2 ? DaryHeap<2>::siftUp(heap(), i) : DaryHeap<4>::siftUp(heap(), i);
+    }
+
+    size_t siftDown(size_t i) {
+        return arity == 2 ? DaryHeap<2>::siftDown(heap(), count, i, lastLevels) : DaryHeap<4>::siftDown(heap(), count, i, lastLevels);
+    }
+
+    void finish(std::chrono::steady_clock::time_point start) {
+        lastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        shownCurrent = false;
+    }
+
+    // Top levels as a tree snapshot, laid out by position within each level
+    void rebuildView() {
+        shownCurrent = true;
+        shown = TreeSnapshot();
+        size_t levelStart = 0;
+        for (size_t level = 0, levelWidth = 1; levelStart < count && levelWidth <= MAX_LEVEL_NODES; ++level, levelStart += levelWidth, levelWidth *= arity) {
+            float slot = AREA_WIDTH / levelWidth;
+            float y = AREA_POSITION.y + 55 * level;
+            for (size_t i = levelStart; i < std::min(count, levelStart + levelWidth); ++i) {
+                float x = AREA_POSITION.x + (i - levelStart + 0.5f) * slot;
+                shown.nodes.push_back({heap()[i], 0, false, sf::Vector2f(x - 16, y)});
+                if (i > 0) shown.edges.push_back({static_cast<int>((i - 1) / arity), static_cast<int>(i)});
+            }
+        }
+        shown.radius = 16;
+        if (highlighted >= 0 && highlighted < static_cast<long long>(shown.nodes.size())) {
+            shown.step = {TreeEvent::Found, static_cast<int>(highlighted), 0};
+        }
+    }
+
+    std::string status() const {
+        if (count == 0) return "Enter keys to push; a long paste is heapified in O(n). Decrease takes an index and a smaller key.";
+        std::ostringstream out;
+        out.setf(std::ios::fixed);
+        out.precision(3);
+        out << count << " keys   " << (arity == 2 ? "binary" : "4-ary") << "   height " << height()
+            << "   min " << heap()[0];
+        if (!lastAction.empty()) {
+            out << "   last: " << lastAction << " in " << lastMs << " ms";
+            if (lastLevels > 0) out << ", " << lastLevels << " levels sifted";
+        }
+        return out.str();
+    }
+};
+
+// --heap-bench [count]: binary and 4-ary heaps built, drained and refilled on the same
+// random keys (default 1e7). A pop reads one child group per level; the 4-ary heap
+// reads half as many groups but compares twice as many keys in each.
+inline int runHeapBenchmark(std::istream& args) {
+    double requested = 1e7;
+    args >> requested;
+    size_t n = static_cast<size_t>(requested);
+    std::vector<int> input(n);
+    std::mt19937 rng(42);
+    for (int& value : input) value = static_cast<int>(rng());
+
+    auto elapsed = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    std::cout << std::fixed;
+    std::cout.precision(1);
+    std::cout << "heap          count   build_ms   pop_ns   levels/pop   push_ns" << std::endl;
+
+    auto run = [&](const char* name, auto kernel, size_t padding) {
+        std::vector<int> keys(padding);
+        keys.insert(keys.end(), input.begin(), input.end());
+        int* heap = keys.data() + padding;
+
+        auto start = std::chrono::steady_clock::now();
+        kernel.heapify(heap, n);
+        double buildMs = elapsed(start);
+
+        size_t levels = 0;
+        bool ordered = true;
+        int previous = std::numeric_limits<int>::min();
+        start = std::chrono::steady_clock::now();
+        for (size_t size = n; size > 0; --size) {
+            int minimum = heap[0];
+            ordered &= minimum >= previous;
+            previous = minimum;
+            heap[0] = heap[size - 1];
+            if (size > 1) kernel.siftDown(heap, size - 1, 0, levels);
+        }
+        double popMs = elapsed(start);
+
+        start = std::chrono::steady_clock::now();
+        for (size_t size = 0; size < n; ++size) {
+            heap[size] = input[size];
+            kernel.siftUp(heap, size);
+        }
+        double pushMs = elapsed(start);
+
+        std::cout << std::left << std::setw(8) << name << std::right << std::setw(11) << n << std::setw(11) << buildMs
+                  << std::setw(9) << popMs * 1e6 / n << std::setw(13) << static_cast<double>(levels) / n
+                  << std::setw(10) << pushMs * 1e6 / n << (ordered ? "" : "   NOT ORDERED") << std::endl;
+        return ordered;
+    };
+
+    bool ok = run("binary", DaryHeap<2>(), DaryHeap<2>::PADDING);
+    ok = run("4-ary", DaryHeap<4>(), DaryHeap<4>::PADDING) && ok;
+
+    // std::make_heap/pop_heap as a baseline (a max-heap, so on the comparator flipped)
+    std::vector<int> keys = input;
+    auto start = std::chrono::steady_clock::now();
+    std::make_heap(keys.begin(), keys.end(), std::greater<int>());
+    double buildMs = elapsed(start);
+    start = std::chrono::steady_clock::now();
+    for (auto end = keys.end(); end != keys.begin(); --end) std::pop_heap(keys.begin(), end, std::greater<int>());
+    double popMs = elapsed(start);
+    std::cout << std::left << std::setw(8) << "std" << std::right << std::setw(11) << n << std::setw(11) << buildMs
+              << std::setw(9) << popMs * 1e6 / n << std::endl;
+    return ok ? 0 : 1;
+}
+
+// Multiplicative mix for int keys. std::hash<int> is the identity, which would leave the
+// low bits (the bucket) and the top bits (the Swiss tag) as patterned as the keys.
+inline uint64_t hashInt(int key) {
+    uint64_t h = static_cast<uint32_t>(key) * 0x9E3779B97F4A7C15ull;
+    return h ^ (h >> 32);
+}
+
+// Separate chaining: a power-of-two bucket array of entry indices and one pool of
+// entries linked through next. New keys go to the head of their chain; the buckets
+// double once there are more keys than buckets.
+class ChainedHashTable {
+public:
+    struct Entry {
+        int key;
+        int value;
+        int next;       // next entry in the chain, or in the free list
+    };
+
+    std::vector<int> buckets;           // first entry of each chain, or -1
+    std::vector<Entry> entries;
+    int freeEntries = -1;
+    size_t count = 0;
+    size_t rehashes = 0;
+    std::vector<int>* rehashTrace = nullptr;    // entries in the order a rehash relinks them
+
+    ChainedHashTable() {
+        reset();
+    }
+
+    void reset() {
+        buckets.assign(16, -1);
+        entries.clear();
+        freeEntries = -1;
+        count = 0;
+        rehashes = 0;
+    }
+
+    size_t bucketOf(int key) const {
+        return hashInt(key) & (buckets.size() - 1);
+    }
+
+    // Entry holding the key, or -1
+    long long find(int key) const {
+        for (int e = buckets[bucketOf(key)]; e >= 0; e = entries[e].next) {
+            if (entries[e].key == key) return e;
+        }
+        return -1;
+    }
+
+    // False when the key was already there; its value is replaced
+    bool insert(int key, int value) {
+        size_t bucket = bucketOf(key);
+        for (int e = buckets[bucket]; e >= 0; e = entries[e].next) {
+            if (entries[e].key == key) {
+                entries[e].value = value;
+                return false;
+            }
+        }
+        if (count + 1 > buckets.size()) {
+            rehash(buckets.size() * 2);
+            bucket = bucketOf(key);
+        }
+        int e;
+        if (freeEntries >= 0) {
+            e = freeEntries;
+            freeEntries = entries[e].next;
+            entries[e] = {key, value, buckets[bucket]};
+        } else {
+            e = static_cast<int>(entries.size());
+            entries.push_back({key, value, buckets[bucket]});
+        }
+        buckets[bucket] = e;
+        ++count;
+        return true;
+    }
+
+    bool erase(int key) {
+        for (int* link = &buckets[bucketOf(key)]; *link >= 0; link = &entries[*link].next) {
+            int e = *link;
+            if (entries[e].key != key) continue;
+            *link = entries[e].next;
+            entries[e].next = freeEntries;
+            freeEntries = e;
+            --count;
+            return true;
+        }
+        return false;
+    }
+
+    // Histogram of chain positions: how many keys a lookup passes before each key
+    void probeHistogram(std::vector<size_t>& histogram) const {
+        std::fill(histogram.begin(), histogram.end(), 0);
+        for (int head : buckets) {
+            size_t position = 0;
+            for (int e = head; e >= 0; e = entries[e].next) ++histogram[std::min(position++, histogram.size() - 1)];
+        }
+    }
+
+    size_t bytes() const {
+        return buckets.size() * sizeof(int) + entries.size() * sizeof(Entry);
+    }
+
+private:
+    void rehash(size_t bucketCount) {
+        TRACE_SCOPE("chained rehash");
+        std::vector<int> old(bucketCount, -1);
+        old.swap(buckets);
+        if (rehashTrace) rehashTrace->clear();
+        for (int head : old) {
+            for (int e = head; e >= 0;) {
+                int next = entries[e].next;
+                size_t bucket = bucketOf(entries[e].key);
+                entries[e].next = buckets[bucket];
+                buckets[bucket] = e;
+                if (rehashTrace) rehashTrace->push_back(e);
+                e = next;
+            }
+        }
+        ++rehashes;
+    }
+};
+
+// Open addressing in the style of Swiss tables. One control byte per slot holds seven
+// bits of the hash, or EMPTY or DELETED. A lookup compares a group of 16 control bytes
+// at once with SSE2 and only reads the keys whose tag matched. Groups are probed
+// triangularly, which visits every group of a power-of-two table.
+class SwissHashTable {
+public:
+    static const size_t GROUP = 16;
+    static constexpr signed char EMPTY = -128;
+    static constexpr signed char DELETED = -2;
+
+    std::vector<signed char> control;
+    std::vector<int> keys;
+    std::vector<int> values;
+    size_t count = 0;
+    size_t tombstones = 0;
+    size_t rehashes = 0;
+    std::vector<int>* rehashTrace = nullptr;    // new slots in the order a rehash fills them
+
+    SwissHashTable() {
+        reset();
+    }
+
+    void reset() {
+        allocate(GROUP);
+        count = 0;
+        rehashes = 0;
+    }
+
+    size_t capacity() const {
+        return control.size();
+    }
+
+    // Slot holding the key, or -1
+    long long find(int key) const {
+        uint64_t hash = hashInt(key);
+        signed char tag = tagOf(hash);
+        size_t groupMask = control.size() / GROUP - 1;
+        size_t group = hash & groupMask;
+        for (size_t step = 1;; group = (group + step++) & groupMask) {
+            for (uint32_t match = matchMask(group, tag); match; match &= match - 1) {
+                size_t slot = group * GROUP + std::countr_zero(match);
+                if (keys[slot] == key) return static_cast<long long>(slot);
+            }
+            if (matchMask(group, EMPTY)) return -1;
+        }
+    }
+
+    // False when the key was already there; its value is replaced. The table grows
+    // before more than 7/8 of it would be full or deleted, and a table that is mostly
+    // tombstones is rebuilt at the same size instead.
+    bool insert(int key, int value) {
+        long long found = find(key);
+        if (found >= 0) {
+            values[found] = value;
+            return false;
+        }
+        if ((count + tombstones + 1) * 8 > capacity() * 7) {
+            rehash((count + 1) * 16 > capacity() * 7 ? capacity() * 2 : capacity());
+        }
+        uint64_t hash = hashInt(key);
+        size_t slot = freeSlot(hash);
+        if (control[slot] == DELETED) --tombstones;
+        control[slot] = tagOf(hash);
+        keys[slot] = key;
+        values[slot] = value;
+        ++count;
+        return true;
+    }
+
+    // A group that still has an empty slot was never full, so no probe went past it and
+    // the slot can become empty again; otherwise it is left as a tombstone
+    bool erase(int key) {
+        long long slot = find(key);
+        if (slot < 0) return false;
+        if (matchMask(static_cast<size_t>(slot) / GROUP, EMPTY)) {
+            control[slot] = EMPTY;
+        } else {
+            control[slot] = DELETED;
+            ++tombstones;
+        }
+        --count;
+        return true;
+    }
+
+    // Groups a lookup probes past its home group before it reaches the slot
+    size_t extraGroups(size_t slot) const {
+        uint64_t hash = hashInt(keys[slot]);
+        size_t groupMask = control.size() / GROUP - 1;
+        size_t group = hash & groupMask;
+        size_t extra = 0;
+        for (size_t step = 1; group != slot / GROUP; group = (group + step++) & groupMask) ++extra;
+        return extra;
+    }
+
+    void probeHistogram(std::vector<size_t>& histogram) const {
+        std::fill(histogram.begin(), histogram.end(), 0);
+        for (size_t slot = 0; slot < control.size(); ++slot) {
+            if (control[slot] >= 0) ++histogram[std::min(extraGroups(slot), histogram.size() - 1)];
+        }
+    }
+
+    size_t bytes() const {
+        return control.size() * (1 + 2 * sizeof(int));
+    }
+
+private:
+    static signed char tagOf(uint64_t hash) {
+        return static_cast<signed char>(hash >> 57);
+    }
+
+    void allocate(size_t slots) {
+        control.assign(slots, EMPTY);
+        keys.assign(slots, 0);
+        values.assign(slots, 0);
+        tombstones = 0;
+    }
+
+    // Bit i is set where control byte i of the group equals tag
+    uint32_t matchMask(size_t group, signed char tag) const {
+#if defined(__SSE2__) || defined(_M_X64)
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(control.data() + group * GROUP));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(tag))));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP; ++i) mask |= static_cast<uint32_t>(control[group * GROUP + i] == tag) << i;
+        return mask;
+#endif
+    }
+
+    // EMPTY and DELETED are the control bytes with the top bit set
+    uint32_t freeMask(size_t group) const {
+#if defined(__SSE2__) || defined(_M_X64)
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(control.data() + group * GROUP));
+        return static_cast<uint32_t>(_mm_movemask_epi8(bytes));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP; ++i) mask |= static_cast<uint32_t>(control[group * GROUP + i] < 0) << i;
+        return mask;
+#endif
+    }
+
+    size_t freeSlot(uint64_t hash) const {
+        size_t groupMask = control.size() / GROUP - 1;
+        size_t group = hash & groupMask;
+        for (size_t step = 1;; group = (group + step++) & groupMask) {
+            uint32_t free = freeMask(group);
+            if (free) return group * GROUP + std::countr_zero(free);
+        }
+    }
+
+    void rehash(size_t slots) {
+        TRACE_SCOPE("swiss rehash");
+        std::vector<signed char> oldControl;
+        std::vector<int> oldKeys, oldValues;
+        oldControl.swap(control);
+        oldKeys.swap(keys);
+        oldValues.swap(values);
+        allocate(slots);
+        if (rehashTrace) rehashTrace->clear();
+        for (size_t i = 0; i < oldControl.size(); ++i) {
+            if (oldControl[i] < 0) continue;
+            size_t slot = freeSlot(hashInt(oldKeys[i]));
+            control[slot] = oldControl[i];
+            keys[slot] = oldKeys[i];
+            values[slot] = oldValues[i];
+            if (rehashTrace) rehashTrace->push_back(static_cast<int>(slot));
+        }
+        ++rehashes;
+    }
+};
+
+// Both tables side by side on the same keys: the first buckets and groups, probe-length
+// histograms, and the last rehash played back as keys arriving in their new places
+class HashTableVisualizer {
+public:
+    ChainedHashTable chained;
+    SwissHashTable swiss;
+    double chainedMs = 0, swissMs = 0;      // the last batch on each table
+    long long chainedFound = -1, swissFound = -1;
+
+    // Rehash playback: entries and slots ranked by when the rehash moved them
+    std::vector<int> chainedTrace, swissTrace;
+    std::vector<int> chainedOrder, swissOrder;
+    size_t rehashShown = 0, rehashLength = 0;
+
+    std::vector<size_t> chainedHistogram, swissHistogram;
+    bool statsCurrent = false;
+
+    sf::Font font;
+    BatchRenderer batch;
+    sf::RectangleShape cell;
+    NodeLabel keyText;
+    NodeLabel smallText;
+    sf::Text chainedText;
+    sf::Text swissText;
+
+    static constexpr size_t VISIBLE_ROWS = 16;
+    static constexpr size_t VISIBLE_CHAIN = 14;
+    static constexpr size_t HISTOGRAM_BINS = 10;
+    static constexpr size_t MAX_ANIMATED = 4096;    // larger rehashes are not played back
+    static constexpr int MAX_RANDOM = 1000000;      // "random N" is inserted on the UI thread
+    static constexpr size_t PLAYBACK_FRAMES = 60;
+    static constexpr float CHAINED_X = 100, SWISS_X = 820, TOP = 270;
+
+    HashTableVisualizer() : chainedHistogram(HISTOGRAM_BINS), swissHistogram(HISTOGRAM_BINS) {
+        TRACE_SCOPE("load font");
+        if (!font.loadFromFile("arial.ttf")) {
+            std::cerr << "Error loading font!" << std::endl;
+        }
+        keyText.setFont(font);
+        keyText.setCharacterSize(11);
+        keyText.setFillColor(sf::Color::White);
+        smallText.setFont(font);
+        smallText.setCharacterSize(12);
+        smallText.setFillColor(sf::Color(200, 200, 200));
+        for (sf::Text* text : {&chainedText, &swissText}) {
+            text->setFont(font);
+            text->setCharacterSize(16);
+            text->setFillColor(sf::Color::White);
+        }
+        chainedText.setPosition(CHAINED_X, 220);
+        swissText.setPosition(SWISS_X, 220);
+        chained.rehashTrace = &chainedTrace;
+        swiss.rehashTrace = &swissTrace;
+    }
+
+    void insertBatch(const std::vector<int>& values) {
+        size_t chainedBefore = chained.rehashes, swissBefore = swiss.rehashes;
+        auto start = std::chrono::steady_clock::now();
+        for (int value : values) chained.insert(value, value);
+        chainedMs = elapsedMs(start);
+        start = std::chrono::steady_clock::now();
+        for (int value : values) swiss.insert(value, value);
+        swissMs = elapsedMs(start);
+        if (chained.rehashes != chainedBefore || swiss.rehashes != swissBefore) {
+            startPlayback(chained.rehashes != chainedBefore, swiss.rehashes != swissBefore);
+        }
+        changed();
+    }
+
+    void eraseBatch(const std::vector<int>& values) {
+        auto start = std::chrono::steady_clock::now();
+        for (int value : values) chained.erase(value);
+        chainedMs = elapsedMs(start);
+        start = std::chrono::steady_clock::now();
+        for (int value : values) swiss.erase(value);
+        swissMs = elapsedMs(start);
+        changed();
+    }
+
+    void search(int value) {
+        chainedFound = chained.find(value);
+        swissFound = swiss.find(value);
+        if (swissFound < 0) std::cout << "Number does not exist." << std::endl;
+    }
+
+    void reset() {
+        chained.reset();
+        swiss.reset();
+        chainedMs = swissMs = 0;
+        rehashShown = rehashLength = 0;
+        changed();
+    }
+
+    void update() {
+        if (rehashShown < rehashLength) {
+            rehashShown = std::min(rehashLength, rehashShown + std::max<size_t>(1, rehashLength / PLAYBACK_FRAMES));
+        }
+    }
+
+    void draw(sf::RenderTarget& target) {
+        if (!statsCurrent) {
+            chained.probeHistogram(chainedHistogram);
+            swiss.probeHistogram(swissHistogram);
+            statsCurrent = true;
+        }
+        drawChained();
+        drawSwiss();
+        drawHistogram(chainedHistogram, CHAINED_X, "chain position");
+        drawHistogram(swissHistogram, SWISS_X, "groups probed past home");
+        batch.flush(target);
+
+        chainedText.setString(header("Separate chaining", chained.count, chained.buckets.size(), "buckets", chained.rehashes,
+                                     chained.bytes(), chainedMs, chainedHistogram));
+        swissText.setString(header("Swiss table (SSE2 groups)", swiss.count, swiss.capacity(), "slots", swiss.rehashes,
+                                   swiss.bytes(), swissMs, swissHistogram)
+                            + (swiss.tombstones ? "   " + std::to_string(swiss.tombstones) + " tombstones" : ""));
+        target.draw(chainedText);
+        target.draw(swissText);
+    }
+
+private:
+    static double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void changed() {
+        statsCurrent = false;
+        chainedFound = swissFound = -1;
+    }
+
+    // Ranks come from the last rehash; keys inserted after it wait for the playback end.
+    // Only the tables that rehashed in this batch are played back; an empty order shows
+    // the other one as it is.
+    void startPlayback(bool chainedRehashed, bool swissRehashed) {
+        if (chained.count > MAX_ANIMATED) {
+            rehashShown = rehashLength = 0;
+            return;
+        }
+        const int LATER = std::numeric_limits<int>::max() - 1;
+        chainedOrder.clear();
+        swissOrder.clear();
+        rehashLength = 0;
+        if (chainedRehashed) {
+            chainedOrder.assign(chained.entries.size(), LATER);
+            for (size_t i = 0; i < chainedTrace.size(); ++i) chainedOrder[chainedTrace[i]] = static_cast<int>(i);
+            rehashLength = chainedTrace.size();
+        }
+        if (swissRehashed) {
+            swissOrder.assign(swiss.capacity(), LATER);
+            for (size_t i = 0; i < swissTrace.size(); ++i) swissOrder[swissTrace[i]] = static_cast<int>(i);
+            rehashLength = std::max(rehashLength, swissTrace.size());
+        }
+        ++rehashLength;
+        rehashShown = 0;
+    }
+
+    bool arrived(const std::vector<int>& order, size_t index) const {
+        if (rehashShown >= rehashLength || index >= order.size()) return true;
+        return static_cast<size_t>(order[index]) < rehashShown;
+    }
+
+    void drawCell(float x, float y, float width, sf::Color fill, const int* key) {
+        cell.setSize(sf::Vector2f(width - 2, 16));
+        cell.setPosition(x, y);
+        cell.setFillColor(fill);
+        batch.addRect(cell);
+        if (!key) return;
+        keyText.setString(std::to_string(*key));
+        keyText.setPosition(x + (width - 2 - keyText.getLocalBounds().width) / 2, y + 1);
+        batch.addLabel(keyText);
+    }
+
+    // One row per bucket: its index, then the chain as linked boxes
+    void drawChained() {
+        size_t rows = std::min(VISIBLE_ROWS, chained.buckets.size());
+        for (size_t b = 0; b < rows; ++b) {
+            float y = TOP + b * 18;
+            smallText.setString(std::to_string(b));
+            smallText.setPosition(CHAINED_X, y);
+            batch.addLabel(smallText);
+            size_t position = 0;
+            for (int e = chained.buckets[b]; e >= 0; e = chained.entries[e].next) {
+                if (!arrived(chainedOrder, e)) continue;
+                if (position == VISIBLE_CHAIN) {
+                    size_t rest = 0;
+                    for (; e >= 0; e = chained.entries[e].next) ++rest;
+                    smallText.setString("+" + std::to_string(rest));
+                    smallText.setPosition(CHAINED_X + 40 + position * 46, y);
+                    batch.addLabel(smallText);
+                    break;
+                }
+                float x = CHAINED_X + 40 + position * 46;
+                if (position > 0) batch.addEdge(sf::Vector2f(x - 6, y + 8), sf::Vector2f(x, y + 8));
+                sf::Color fill = e == chainedFound ? sf::Color(200, 160, 0) : sf::Color(60, 100, 180);
+                drawCell(x, y, 42, fill, &chained.entries[e].key);
+                ++position;
+            }
+        }
+    }
+
+    // One row per group of 16 slots, coloured by how far each key sits from its home group
+    void drawSwiss() {
+        size_t rows = std::min(VISIBLE_ROWS, swiss.capacity() / SwissHashTable::GROUP);
+        const float width = 44;
+        for (size_t g = 0; g < rows; ++g) {
+            for (size_t i = 0; i < SwissHashTable::GROUP; ++i) {
+                size_t slot = g * SwissHashTable::GROUP + i;
+                float x = SWISS_X + i * width, y = TOP + g * 18;
+                signed char byte = swiss.control[slot];
+                if (byte == SwissHashTable::EMPTY || (byte >= 0 && !arrived(swissOrder, slot))) {
+                    drawCell(x, y, width, sf::Color(60, 60, 60), nullptr);
+                } else if (byte == SwissHashTable::DELETED) {
+                    drawCell(x, y, width, sf::Color(110, 40, 40), nullptr);
+                } else {
+                    size_t extra = swiss.extraGroups(slot);
+                    sf::Color fill = static_cast<long long>(slot) == swissFound ? sf::Color(200, 160, 0)
+                                   : extra == 0 ? sf::Color(0, 140, 160) : extra == 1 ? sf::Color(170, 120, 0) : sf::Color(190, 60, 40);
+                    drawCell(x, y, width, fill, &swiss.keys[slot]);
+                }
+            }
+        }
+    }
+
+    void drawHistogram(const std::vector<size_t>& histogram, float left, const std::string& caption) {
+        size_t largest = std::max<size_t>(1, *std::max_element(histogram.begin(), histogram.end()));
+        const float base = 660, height = 70, barWidth = 56;
+        for (size_t bin = 0; bin < histogram.size(); ++bin) {
+            float barHeight = histogram[bin] ? std::max(1.f, height * histogram[bin] / largest) : 0.f;
+            cell.setSize(sf::Vector2f(barWidth - 6, barHeight));
+            cell.setPosition(left + bin * barWidth, base - barHeight);
+            cell.setFillColor(sf::Color(100, 180, 255));
+            batch.addRect(cell);
+            smallText.setString(bin + 1 == histogram.size() ? std::to_string(bin) + "+" : std::to_string(bin));
+            smallText.setPosition(left + bin * barWidth + 18, base + 2);
+            batch.addLabel(smallText);
+        }
+        smallText.setString("Probe lengths: " + caption);
+        smallText.setPosition(left, base - height - 20);
+        batch.addLabel(smallText);
+    }
+
+    std::string header(const char* name, size_t count, size_t capacity, const char* unit, size_t rehashes, size_t bytes,
+                       double ms, const std::vector<size_t>& histogram) const {
+        double total = 0, weighted = 0;
+        for (size_t bin = 0; bin < histogram.size(); ++bin) {
+            total += histogram[bin];
+            weighted += bin * static_cast<double>(histogram[bin]);
+        }
+        std::ostringstream out;
+        out.setf(std::ios::fixed);
+        out.precision(2);
+        out << name << "\n" << count << " keys   " << capacity << " " << unit << "   load " << count / static_cast<double>(capacity)
+            << "   mean probe " << (total > 0 ? weighted / total : 0.0) << "   " << TimelineSlider::formatBytes(bytes)
+            << "   " << rehashes << " rehashes   last batch " << ms << " ms";
+        if (rehashShown < rehashLength) out << "   rehashing " << rehashShown << "/" << rehashLength - 1;
+        return out.str();
+    }
+};
+
+// --hash-bench [count ...]: insert, hit and miss lookups and erase of the same distinct
+// random keys on both tables and on std::unordered_map (what TrieNode::children uses)
+inline int runHashBenchmark(std::istream& args) {
+    std::vector<size_t> counts;
+    double count;
+    while (args >> count) counts.push_back(static_cast<size_t>(count));
+    if (counts.empty()) counts = {1000000, 4000000};
+
+    std::cout << std::fixed;
+    std::cout.precision(1);
+    std::cout << std::left << std::setw(14) << "table" << std::right << std::setw(10) << "count" << std::setw(9) << "insert"
+              << std::setw(7) << "hit" << std::setw(7) << "miss" << std::setw(7) << "erase" << "   (million ops/s)" << std::endl;
+    bool ok = true;
+    for (size_t n : counts) {
+        // Odd multipliers are bijections on 32 bits: the keys are distinct, the misses disjoint
+        std::vector<int> keys(n), misses(n);
+        for (size_t i = 0; i < n; ++i) {
+            keys[i] = static_cast<int>(static_cast<uint32_t>(i) * 2654435761u);
+            misses[i] = static_cast<int>(static_cast<uint32_t>(i + n) * 2654435761u);
+        }
+        std::vector<int> lookups = keys;
+        std::shuffle(lookups.begin(), lookups.end(), std::mt19937(42));
+
+        auto measure = [&](const char* name, auto& table, auto insert, auto find, auto erase) {
+            auto rate = [n](std::chrono::steady_clock::time_point start) {
+                return n / std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            };
+            auto start = std::chrono::steady_clock::now();
+            for (int key : keys) insert(table, key);
+            double insertRate = rate(start);
+            size_t hits = 0;
+            start = std::chrono::steady_clock::now();
+            for (int key : lookups) hits += find(table, key);
+            double hitRate = rate(start);
+            size_t falseHits = 0;
+            start = std::chrono::steady_clock::now();
+            for (int key : misses) falseHits += find(table, key);
+            double missRate = rate(start);
+            size_t erased = 0;
+            start = std::chrono::steady_clock::now();
+            for (int key : lookups) erased += erase(table, key);
+            double eraseRate = rate(start);
+            bool correct = hits == n && falseHits == 0 && erased == n;
+            std::cout << std::left << std::setw(14) << name << std::right << std::setw(10) << n << std::setw(9) << insertRate
+                      << std::setw(7) << hitRate << std::setw(7) << missRate << std::setw(7) << eraseRate
+                      << (correct ? "" : "   WRONG RESULTS") << std::endl;
+            ok = ok && correct;
+        };
+
+        ChainedHashTable chained;
+        measure("chaining", chained, [](ChainedHashTable& t, int k) { t.insert(k, k); },
+                [](const ChainedHashTable& t, int k) { return t.find(k) >= 0; }, [](ChainedHashTable& t, int k) { return t.erase(k); });
+        SwissHashTable swiss;
+        measure("swiss", swiss, [](SwissHashTable& t, int k) { t.insert(k, k); },
+                [](const SwissHashTable& t, int k) { return t.find(k) >= 0; }, [](SwissHashTable& t, int k) { return t.erase(k); });
+        std::unordered_map<int, int> standard;
+        measure("unordered_map", standard, [](std::unordered_map<int, int>& t, int k) { t.emplace(k, k); },
+                [](const std::unordered_map<int, int>& t, int k) { return t.find(k) != t.end(); },
+                [](std::unordered_map<int, int>& t, int k) { return t.erase(k) == 1; });
+    }
+    return ok ? 0 : 1;
+}
+
+// Keys of a sorted node below x, or at most x when INCLUSIVE. Large nodes are narrowed
+// by binary search to a window of 64 keys, which is then counted four at a time.
+template <bool INCLUSIVE>
+inline int countBelow(const int* keys, int count, int x) {
+    int low = 0, high = count;
+    while (high - low > 64) {
+        int mid = (low + high) / 2;
+        if (INCLUSIVE ? keys[mid] <= x : keys[mid] < x) low = mid + 1;
+        else high = mid;
+    }
+    int below = low;
+    int i = low;
+#if defined(__SSE2__) || defined(_M_X64)
+    __m128i value = _mm_set1_epi32(x);
+    for (; i + 4 <= high; i += 4) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        if (INCLUSIVE) {
+            below += 4 - std::popcount(static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(block, value)))));
+        } else {
+            below += std::popcount(static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(block, value)))));
+        }
+    }
+#endif
+    for (; i < high; ++i) below += INCLUSIVE ? keys[i] <= x : keys[i] < x;
+    return below;
+}
+
+// B+tree of ints with the key array of every node exactly nodeBytes long, so a node is
+// one cache line (64) or a page (4096). Leaves and inner nodes live in separate pools
+// addressed by index; leaves are linked left to right for range scans. height counts
+// the inner levels, so the root is a leaf while height is 0.
+class BPlusTree {
+public:
+    struct alignas(64) CacheLine {
+        int keys[16];
+    };
+
+    static constexpr int MAX_HEIGHT = 32;
+
+    int nodeBytes = 64;
+    int order = 16;                 // keys per node
+    int height = 0;
+    int root = 0;
+    size_t count = 0;
+
+    std::vector<CacheLine> leafLines;
+    std::vector<int> leafCounts;
+    std::vector<int> leafNext;      // next leaf to the right, or -1
+    std::vector<CacheLine> innerLines;
+    std::vector<int> innerCounts;
+    std::vector<int> children;      // order + 1 per inner node
+
+    BPlusTree() {
+        reset(64);
+    }
+
+    void reset(int bytes) {
+        nodeBytes = bytes;
+        order = bytes / static_cast<int>(sizeof(int));
+        height = 0;
+        count = 0;
+        leafLines.clear();
+        leafCounts.clear();
+        leafNext.clear();
+        innerLines.clear();
+        innerCounts.clear();
+        children.clear();
+        root = newLeaf();
+    }
+
+    int* leafKeys(int leaf) { return leafLines[static_cast<size_t>(leaf) * linesPerNode()].keys; }
+    const int* leafKeys(int leaf) const { return leafLines[static_cast<size_t>(leaf) * linesPerNode()].keys; }
+    int* innerKeys(int node) { return innerLines[static_cast<size_t>(node) * linesPerNode()].keys; }
+    const int* innerKeys(int node) const { return innerLines[static_cast<size_t>(node) * linesPerNode()].keys; }
+    int* childrenOf(int node) { return &children[static_cast<size_t>(node) * (order + 1)]; }
+    const int* childrenOf(int node) const { return &children[static_cast<size_t>(node) * (order + 1)]; }
+
+    size_t leafCount() const { return leafCounts.size(); }
+    size_t innerCount() const { return innerCounts.size(); }
+
+    // Leaf that would hold key; path, when given, receives the inner nodes from the root
+    int findLeaf(int key, std::vector<int>* path = nullptr) const {
+        int node = root;
+        for (int level = height; level > 0; --level) {
+            if (path) path->push_back(node);
+            node = childrenOf(node)[countBelow<true>(innerKeys(node), innerCounts[node], key)];
+        }
+        return node;
+    }
+
+    bool contains(int key) const {
+        return leafContains(findLeaf(key), key);
+    }
+
+    bool leafContains(int leaf, int key) const {
+        const int* keys = leafKeys(leaf);
+        int position = countBelow<false>(keys, leafCounts[leaf], key);
+        return position < leafCounts[leaf] && keys[position] == key;
+    }
+
+    // Splits a full leaf in half before inserting and carries the separator up, splitting
+    // full inner nodes on the way; a root split adds a level
+    bool insert(int key) {
+        int path[MAX_HEIGHT + 1], slots[MAX_HEIGHT + 1];
+        int node = root;
+        for (int level = height; level > 0; --level) {
+            int slot = countBelow<true>(innerKeys(node), innerCounts[node], key);
+            path[level] = node;
+            slots[level] = slot;
+            node = childrenOf(node)[slot];
+        }
+        int filled = leafCounts[node];
+        int position = countBelow<false>(leafKeys(node), filled, key);
+        if (position < filled && leafKeys(node)[position] == key) return false;
+        ++count;
+        if (filled < order) {
+            insertAt(leafKeys(node), filled, position, key);
+            ++leafCounts[node];
+            return true;
+        }
+
+        int right = newLeaf();
+        int half = order / 2;
+        std::copy(leafKeys(node) + half, leafKeys(node) + order, leafKeys(right));
+        leafCounts[node] = half;
+        leafCounts[right] = order - half;
+        leafNext[right] = leafNext[node];
+        leafNext[node] = right;
+        if (position <= half) insertAt(leafKeys(node), leafCounts[node]++, position, key);
+        else insertAt(leafKeys(right), leafCounts[right]++, position - half, key);
+
+        int separator = leafKeys(right)[0];
+        int child = right;
+        for (int level = 1; level <= height; ++level) {
+            int parent = path[level], slot = slots[level];
+            if (innerCounts[parent] < order) {
+                insertInner(parent, slot, separator, child);
+                return true;
+            }
+            int sibling = newInner();
+            int middle = order / 2;
+            int up = innerKeys(parent)[middle];
+            std::copy(innerKeys(parent) + middle + 1, innerKeys(parent) + order, innerKeys(sibling));
+            std::copy(childrenOf(parent) + middle + 1, childrenOf(parent) + order + 1, childrenOf(sibling));
+            innerCounts[parent] = middle;
+            innerCounts[sibling] = order - middle - 1;
+            if (slot <= middle) insertInner(parent, slot, separator, child);
+            else insertInner(sibling, slot - middle - 1, separator, child);
+            separator = up;
+            child = sibling;
+        }
+
+        int top = newInner();
+        innerKeys(top)[0] = separator;
+        childrenOf(top)[0] = root;
+        childrenOf(top)[1] = child;
+        innerCounts[top] = 1;
+        root = top;
+        ++height;
+        return true;
+    }
+
+    // Packs sorted, distinct keys into full leaves, then builds each inner level from
+    // the one below; nodes of a level share the keys evenly
+    void bulkLoad(const std::vector<int>& sorted) {
+        TRACE_SCOPE("B+tree bulk load");
+        reset(nodeBytes);
+        if (sorted.empty()) return;
+        leafLines.clear();
+        leafCounts.clear();
+        leafNext.clear();
+        size_t leaves = (sorted.size() + order - 1) / order;
+        std::vector<int> level(leaves), lowest(leaves);
+        for (size_t i = 0; i < leaves; ++i) {
+            size_t begin = i * sorted.size() / leaves, end = (i + 1) * sorted.size() / leaves;
+            int leaf = newLeaf();
+            std::copy(sorted.begin() + begin, sorted.begin() + end, leafKeys(leaf));
+            leafCounts[leaf] = static_cast<int>(end - begin);
+            if (i > 0) leafNext[leaf - 1] = leaf;
+            level[i] = leaf;
+            lowest[i] = sorted[begin];
+        }
+        count = sorted.size();
+
+        while (level.size() > 1) {
+            size_t parents = (level.size() + order) / (order + 1);
+            std::vector<int> above(parents), aboveLowest(parents);
+            for (size_t p = 0; p < parents; ++p) {
+                size_t begin = p * level.size() / parents, end = (p + 1) * level.size() / parents;
+                int node = newInner();
+                for (size_t c = begin; c < end; ++c) {
+                    childrenOf(node)[c - begin] = level[c];
+                    if (c > begin) innerKeys(node)[c - begin - 1] = lowest[c];
+                }
+                innerCounts[node] = static_cast<int>(end - begin - 1);
+                above[p] = node;
+                aboveLowest[p] = lowest[begin];
+            }
+            level.swap(above);
+            lowest.swap(aboveLowest);
+            ++height;
+        }
+        root = level[0];
+    }
+
+    // Calls visit on each key in [low, high] in order; returns the leaves read
+    template <typename Visit>
+    size_t scan(int low, int high, Visit visit) const {
+        size_t leavesRead = 0;
+        int leaf = findLeaf(low);
+        int position = countBelow<false>(leafKeys(leaf), leafCounts[leaf], low);
+        while (leaf >= 0) {
+            ++leavesRead;
+            const int* keys = leafKeys(leaf);
+            for (; position < leafCounts[leaf]; ++position) {
+                if (keys[position] > high) return leavesRead;
+                visit(keys[position]);
+            }
+            leaf = leafNext[leaf];
+            position = 0;
+        }
+        return leavesRead;
+    }
+
+    // Leaf 0 is always leftmost: splits only add leaves to the right of the one split
+    void keysInOrder(std::vector<int>& out) const {
+        out.clear();
+        out.reserve(count);
+        for (int leaf = 0; leaf >= 0; leaf = leafNext[leaf]) out.insert(out.end(), leafKeys(leaf), leafKeys(leaf) + leafCounts[leaf]);
+    }
+
+    size_t bytes() const {
+        return (leafLines.size() + innerLines.size()) * sizeof(CacheLine)
+             + (leafCounts.size() + leafNext.size() + innerCounts.size() + children.size()) * sizeof(int);
+    }
+
+private:
+    size_t linesPerNode() const {
+        return static_cast<size_t>(nodeBytes) / sizeof(CacheLine);
+    }
+
+    static void insertAt(int* keys, int filled, int position, int key) {
+        std::copy_backward(keys + position, keys + filled, keys + filled + 1);
+        keys[position] = key;
+    }
+
+    void insertInner(int node, int slot, int key, int child) {
+        int filled = innerCounts[node]++;
+        insertAt(innerKeys(node), filled, slot, key);
+        int* links = childrenOf(node);
+        std::copy_backward(links + slot + 1, links + filled + 1, links + filled + 2);
+        links[slot + 1] = child;
+    }
+
+    int newLeaf() {
+        leafLines.resize(leafLines.size() + linesPerNode());
+        leafCounts.push_back(0);
+        leafNext.push_back(-1);
+        return static_cast<int>(leafCounts.size() - 1);
+    }
+
+    int newInner() {
+        innerLines.resize(innerLines.size() + linesPerNode());
+        innerCounts.push_back(0);
+        children.resize(children.size() + order + 1, -1);
+        return static_cast<int>(innerCounts.size() - 1);
+    }
+};
+
+// The app's AVL tree built from the same keys, for the B+tree page and benchmark.
+// Inserts run the AVL page's insert straight through; lookups walk the finished tree.
+struct AvlComparison {
+    int height = 0;
+    double insertMs = 0;
+    double lookupsPerSecond = 0;
+};
+
+inline AvlComparison measureAvl(const std::vector<int>& keys, const std::vector<int>& lookups) {
+    AvlComparison result;
+    AvlTree avl;
+    auto start = std::chrono::steady_clock::now();
+    for (int key : keys) avl.insertSteps(key).runToEnd();
+    result.insertMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    result.height = AvlTree::height(avl.root);
+    size_t found = 0;
+    start = std::chrono::steady_clock::now();
+    for (int key : lookups) {
+        AVLNode* node = avl.root;
+        while (node && node->value != key) node = key < node->value ? node->left : node->right;
+        found += node != nullptr;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.lookupsPerSecond = found / std::max(seconds, 1e-9);
+    return result;
+}
+
+// Lookups per second of every key in lookups that the tree holds
+inline double measureBPlusLookups(const BPlusTree& tree, const std::vector<int>& lookups) {
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int key : lookups) found += tree.contains(key);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return found / std::max(seconds, 1e-9);
+}
+
+// Levels of nodes drawn as boxes (key range and a fill bar), the leaves linked along
+// the bottom. The last search path and range scan are highlighted.
+class BPlusTreeVisualizer {
+public:
+    BPlusTree tree;
+    std::string lastAction;
+    std::vector<int> searchPath;        // inner nodes, then the leaf
+    std::vector<int> scannedLeaves;
+    AvlComparison avl;
+    double bplusLookupsPerSecond = 0;
+    size_t comparedKeys = 0;            // keys the comparison ran on, 0 when stale
+
+    // The comparison builds a whole AVL tree, so it runs in the background on a copy of
+    // the B+tree; a result for keys that changed meanwhile is dropped
+    struct Comparison {
+        AvlComparison avl;
+        double bplusLookupsPerSecond = 0;
+        size_t keys = 0;
+    };
+    std::future<Comparison> pendingComparison;
+    size_t generation = 0;              // bumped on every change to the keys
+    size_t pendingGeneration = 0;
+    std::vector<size_t> levelTotals;    // nodes per level, root first; empty when stale
+
+    sf::Font font;
+    BatchRenderer batch;
+    sf::RectangleShape box;
+    NodeLabel keyText;
+    sf::Text statusText;
+
+    static constexpr size_t MAX_LEVEL_NODES = 16;
+    static constexpr size_t BULK_LOAD_BATCH = 64;   // larger pastes into a small tree are bulk loaded
+    static constexpr int NODE_SIZES[] = {64, 256, 1024, 4096};
+
+    BPlusTreeVisualizer() {
+        TRACE_SCOPE("load font");
+        if (!font.loadFromFile("arial.ttf")) {
+            std::cerr << "Error loading font!" << std::endl;
+        }
+        keyText.setFont(font);
+        keyText.setCharacterSize(12);
+        keyText.setFillColor(sf::Color::White);
+        statusText.setFont(font);
+        statusText.setCharacterSize(18);
+        statusText.setFillColor(sf::Color::White);
+        statusText.setPosition(150, 560);
+    }
+
+    // A batch larger than the tree is merged with its keys and bulk loaded; smaller
+    // ones go in one insert at a time, splitting nodes as they fill
+    void insertBatch(const std::vector<int>& values) {
+        auto start = std::chrono::steady_clock::now();
+        std::ostringstream out;
+        if (values.size() >= BULK_LOAD_BATCH && values.size() > tree.count) {
+            std::vector<int> keys;
+            tree.keysInOrder(keys);
+            keys.insert(keys.end(), values.begin(), values.end());
+            std::sort(keys.begin(), keys.end());
+            keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+            tree.bulkLoad(keys);
+            out << "Bulk loaded " << keys.size() << " keys";
+        } else {
+            TRACE_SCOPE("B+tree insert");
+            size_t added = 0;
+            for (int value : values) added += tree.insert(value);
+            out << "Inserted " << added << " of " << values.size() << " keys";
+        }
+        out << " in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms";
+        lastAction = out.str();
+        changed();
+    }
+
+    void search(int value) {
+        clearHighlight();
+        int leaf = tree.findLeaf(value, &searchPath);
+        searchPath.push_back(leaf);
+        bool found = tree.leafContains(leaf, value);
+        if (!found) std::cout << "Number does not exist." << std::endl;
+        lastAction = "Search " + std::to_string(value) + ": " + (found ? "found" : "not found") + ", "
+                   + std::to_string(searchPath.size()) + " nodes read";
+    }
+
+    void rangeScan(int low, int high) {
+        clearHighlight();
+        if (low > high) std::swap(low, high);
+        size_t keys = 0;
+        long long sum = 0;
+        size_t leavesRead = tree.scan(low, high, [&](int key) { ++keys; sum += key; });
+        for (int leaf = tree.findLeaf(low); leaf >= 0 && scannedLeaves.size() < MAX_LEVEL_NODES * 4; leaf = tree.leafNext[leaf]) {
+            scannedLeaves.push_back(leaf);
+            if (tree.leafCounts[leaf] && tree.leafKeys(leaf)[tree.leafCounts[leaf] - 1] >= high) break;
+        }
+        lastAction = "Range [" + std::to_string(low) + ", " + std::to_string(high) + "]: " + std::to_string(keys)
+                   + " keys from " + std::to_string(leavesRead) + " leaves, sum " + std::to_string(sum);
+    }
+
+    // Rebuilds the same keys with the next node size
+    void setNodeBytes(int bytes) {
+        if (std::find(std::begin(NODE_SIZES), std::end(NODE_SIZES), bytes) == std::end(NODE_SIZES)) {
+            std::cout << "Node size must be 64, 256, 1024 or 4096 bytes." << std::endl;
+            return;
+        }
+        std::vector<int> keys;
+        tree.keysInOrder(keys);
+        tree.reset(bytes);
+        tree.bulkLoad(keys);
+        lastAction = "Rebuilt with " + std::to_string(bytes) + " byte nodes";
+        changed();
+    }
+
+    int nextNodeBytes() const {
+        for (size_t i = 0; i + 1 < std::size(NODE_SIZES); ++i) {
+            if (NODE_SIZES[i] == tree.nodeBytes) return NODE_SIZES[i + 1];
+        }
+        return NODE_SIZES[0];
+    }
+
+    // Builds an AVL tree from the same keys and looks every key up in both. Ignored
+    // while a comparison is still running.
+    void compareWithAvl() {
+        if (pendingComparison.valid()) return;
+        pendingGeneration = generation;
+        pendingComparison = std::async(std::launch::async, [copy = tree] {
+            Comparison result;
+            std::vector<int> keys;
+            copy.keysInOrder(keys);
+            std::vector<int> lookups = keys;
+            std::shuffle(lookups.begin(), lookups.end(), std::mt19937(7));
+            result.avl = measureAvl(keys, lookups);
+            result.bplusLookupsPerSecond = measureBPlusLookups(copy, lookups);
+            result.keys = keys.size();
+            return result;
+        });
+    }
+
+    void reset() {
+        tree.reset(tree.nodeBytes);
+        lastAction.clear();
+        changed();
+    }
+
+    void draw(sf::RenderTarget& target) {
+        if (pendingComparison.valid() && pendingComparison.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            Comparison result = pendingComparison.get();
+            if (pendingGeneration == generation) {
+                avl = result.avl;
+                bplusLookupsPerSecond = result.bplusLookupsPerSecond;
+                comparedKeys = result.keys;
+            }
+        }
+        drawLevels();
+        batch.flush(target);
+
+        std::ostringstream out;
+        out.setf(std::ios::fixed);
+        out.precision(1);
+        size_t levels = static_cast<size_t>(tree.height) + 1;
+        out << tree.count << " keys   " << tree.nodeBytes << " byte nodes (" << tree.order << " keys)   height " << levels
+            << "   " << tree.innerCount() << " inner + " << tree.leafCount() << " leaves, "
+            << 100.0 * tree.count / (static_cast<double>(tree.leafCount()) * tree.order) << "% full   "
+            << TimelineSlider::formatBytes(tree.bytes()) << "\n" << lastAction;
+        if (comparedKeys) {
+            out.precision(2);
+            out << "\nOn " << comparedKeys << " keys: B+tree height " << levels << ", " << bplusLookupsPerSecond / 1e6
+                << " M lookups/s   AVL height " << avl.height << ", " << avl.lookupsPerSecond / 1e6
+                << " M lookups/s, built in " << avl.insertMs << " ms";
+        } else if (pendingComparison.valid()) {
+            out << "\nComparing with an AVL tree on the same keys...";
+        }
+        statusText.setString(out.str());
+        target.draw(statusText);
+    }
+
+private:
+    void changed() {
+        clearHighlight();
+        comparedKeys = 0;
+        ++generation;
+        levelTotals.clear();
+    }
+
+    void clearHighlight() {
+        searchPath.clear();
+        scannedLeaves.clear();
+    }
+
+    // The first MAX_LEVEL_NODES nodes of each level; the children of a prefix of one
+    // level are a prefix of the next, so every drawn child has its parent drawn
+    void drawLevels() {
+        int levels = tree.height + 1;
+        float gap = std::min(70.f, 300.f / levels);
+        std::vector<int> level = {tree.root};
+        std::vector<sf::Vector2f> above;    // bottom centres of the level above
+        std::vector<int> aboveFirstChild;
+        if (levelTotals.empty()) countLevels();
+        for (int depth = 0; depth < levels; ++depth) {
+            bool leaves = depth == tree.height;
+            size_t shown = std::min(level.size(), MAX_LEVEL_NODES);
+            float width = std::min(140.f, 1300.f / shown - 12);
+            float left = 800 - (shown * (width + 12) - 12) / 2;
+            float y = 230 + depth * gap;
+            std::vector<sf::Vector2f> bottoms;
+            std::vector<int> firstChild;
+            std::vector<int> next;
+            size_t parent = 0;
+            for (size_t i = 0; i < shown; ++i) {
+                int node = level[i];
+                int filled = leaves ? tree.leafCounts[node] : tree.innerCounts[node];
+                const int* keys = leaves ? tree.leafKeys(node) : tree.innerKeys(node);
+                float x = left + i * (width + 12);
+
+                bool onPath = static_cast<size_t>(depth) < searchPath.size() && searchPath[depth] == node;
+                bool scanned = leaves && std::find(scannedLeaves.begin(), scannedLeaves.end(), node) != scannedLeaves.end();
+                box.setSize(sf::Vector2f(width, 26));
+                box.setPosition(x, y);
+                box.setFillColor(onPath ? sf::Color(200, 120, 0) : scanned ? sf::Color(0, 140, 160) : sf::Color(70, 70, 100));
+                batch.addRect(box);
+                box.setSize(sf::Vector2f(width * filled / tree.order, 4));
+                box.setPosition(x, y + 22);
+                box.setFillColor(sf::Color(100, 200, 100));
+                batch.addRect(box);
+                if (filled && width >= 50) {
+                    keyText.setString(filled == 1 ? std::to_string(keys[0]) : std::to_string(keys[0]) + ".." + std::to_string(keys[filled - 1]));
+                    keyText.setPosition(x + (width - keyText.getLocalBounds().width) / 2, y + 4);
+                    batch.addLabel(keyText);
+                }
+
+                while (parent + 1 < aboveFirstChild.size() && aboveFirstChild[parent + 1] <= static_cast<int>(i)) ++parent;
+                if (!above.empty()) batch.addEdge(above[parent], sf::Vector2f(x + width / 2, y));
+                if (leaves && i + 1 < shown) batch.addEdge(sf::Vector2f(x + width, y + 13), sf::Vector2f(x + width + 12, y + 13));
+
+                bottoms.push_back(sf::Vector2f(x + width / 2, y + 26));
+                if (!leaves) {
+                    firstChild.push_back(static_cast<int>(next.size()));
+                    next.insert(next.end(), tree.childrenOf(node), tree.childrenOf(node) + filled + 1);
+                }
+            }
+            if (levelTotals[depth] > shown) {
+                keyText.setString("+" + std::to_string(levelTotals[depth] - shown));
+                keyText.setPosition(left + shown * (width + 12), y + 6);
+                batch.addLabel(keyText);
+            }
+            above.swap(bottoms);
+            aboveFirstChild.swap(firstChild);
+            level.swap(next);
+        }
+    }
+
+    // Inner levels are walked; inner nodes are few next to the leaves
+    void countLevels() {
+        std::vector<int> level = {tree.root};
+        for (int depth = 0; depth < tree.height; ++depth) {
+            levelTotals.push_back(level.size());
+            std::vector<int> next;
+            for (int node : level) next.insert(next.end(), tree.childrenOf(node), tree.childrenOf(node) + tree.innerCounts[node] + 1);
+            level.swap(next);
+        }
+        levelTotals.push_back(tree.leafCount());
+    }
+};
+
+// --bptree-bench [count]: random inserts, bulk load, lookups and range scans at each node
+// size (default 1e6 distinct keys), then the AVL page's tree on the same keys
+inline int runBPlusTreeBenchmark(std::istream& args) {
+    double requested = 1e6;
+    args >> requested;
+    size_t n = static_cast<size_t>(requested);
+    std::vector<int> keys(n);
+    for (size_t i = 0; i < n; ++i) keys[i] = static_cast<int>(static_cast<uint32_t>(i) * 2654435761u);
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(42));
+    std::vector<int> sorted = keys;
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<int> lookups = keys;
+    std::shuffle(lookups.begin(), lookups.end(), std::mt19937(43));
+
+    auto elapsedMs = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    std::cout << std::fixed;
+    std::cout.precision(1);
+    std::cout << "tree        height  insert_ms  bulk_ms  lookups/s(M)  scan_keys/s(M)  memory" << std::endl;
+    bool ok = true;
+    for (int bytes : BPlusTreeVisualizer::NODE_SIZES) {
+        BPlusTree tree;
+        tree.reset(bytes);
+        auto start = std::chrono::steady_clock::now();
+        for (int key : keys) tree.insert(key);
+        double insertMs = elapsedMs(start);
+        int insertedHeight = tree.height + 1;
+        start = std::chrono::steady_clock::now();
+        tree.bulkLoad(sorted);
+        double bulkMs = elapsedMs(start);
+        double lookupRate = measureBPlusLookups(tree, lookups);
+
+        // 1000 scans of up to 1000 keys each, from spread-out starting keys
+        size_t scanned = 0, expected = 0;
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < 1000 && n > 0; ++i) {
+            size_t first = i * 7919 % n, last = std::min(n - 1, first + 999);
+            tree.scan(sorted[first], sorted[last], [&scanned](int) { ++scanned; });
+            expected += last - first + 1;
+        }
+        double scanRate = scanned / std::max(elapsedMs(start), 1e-6) / 1e3;
+        std::vector<int> check;
+        tree.keysInOrder(check);
+        bool correct = check == sorted && scanned == expected;
+        ok = ok && correct;
+        std::cout << "B+ " << std::left << std::setw(6) << bytes << std::right << std::setw(8) << insertedHeight
+                  << std::setw(11) << insertMs << std::setw(9) << bulkMs << std::setw(14) << lookupRate / 1e6
+                  << std::setw(16) << scanRate << "  " << TimelineSlider::formatBytes(tree.bytes())
+                  << (correct ? "" : "   WRONG RESULTS") << std::endl;
+    }
+    AvlComparison avl = measureAvl(keys, lookups);
+    std::cout << "AVL       " << std::setw(8) << avl.height << std::setw(11) << avl.insertMs << std::setw(9) << "-"
+              << std::setw(14) << avl.lookupsPerSecond / 1e6 << std::setw(16) << "-" << std::endl;
+    return ok ? 0 : 1;
+}
+
+// Epoch-based reclamation for the lock-free structures. A participant announces the
+// global epoch while it holds node pointers. A retired node waits in its participant's
+// limbo list until the epoch has moved on twice; by then no thread can still see it.
+class EpochDomain {
+public:
+    static constexpr int MAX_PARTICIPANTS = 64;
+    static constexpr unsigned long long QUIESCENT = ~0ull;
+    static constexpr size_t COLLECT_EVERY = 64;
+
+    struct Retired {
+        void* pointer;
+        void (*destroy)(void*);
+        unsigned long long epoch;
+    };
+
+    // One per thread; not shared
+    class Participant {
+    public:
+        explicit Participant(EpochDomain& owner) : domain(owner) {
+            for (slot = 0; slot < MAX_PARTICIPANTS; ++slot) {
+                bool expected = false;
+                if (domain.slots[slot].used.compare_exchange_strong(expected, true)) return;
+            }
+            std::cerr << "Too many threads in one epoch domain" << std::endl;
+            std::abort();
+        }
+
+        // Whatever is still waiting is handed to the domain
+        ~Participant() {
+            domain.countRetired(sinceCollect);
+            {
+                std::lock_guard<std::mutex> lock(domain.orphanMutex);
+                domain.orphans.insert(domain.orphans.end(), limbo.begin(), limbo.end());
+            }
+            domain.slots[slot].announced.store(QUIESCENT, std::memory_order_release);
+            domain.slots[slot].used.store(false, std::memory_order_release);
+        }
+
+        Participant(const Participant&) = delete;
+        Participant& operator=(const Participant&) = delete;
+
+        // The fence keeps the list loads that follow from being ordered before the
+        // announcement, where tryAdvance could miss it and free what they read
+        void enter() {
+            domain.slots[slot].announced.store(domain.epoch.load(std::memory_order_acquire), std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+        void exit() {
+            domain.slots[slot].announced.store(QUIESCENT, std::memory_order_release);
+        }
+
+        void retire(void* pointer, void (*destroy)(void*)) {
+            limbo.push_back({pointer, destroy, domain.epoch.load(std::memory_order_acquire)});
+            if (++sinceCollect < COLLECT_EVERY) return;
+            domain.countRetired(sinceCollect);
+            sinceCollect = 0;
+            domain.tryAdvance();
+            collect();
+        }
+
+        // Frees everything waiting; only when no other thread is inside the domain
+        void freeAll() {
+            domain.countRetired(sinceCollect);
+            sinceCollect = 0;
+            for (Retired& retired : limbo) retired.destroy(retired.pointer);
+            domain.countFreed(limbo.size());
+            limbo.clear();
+        }
+
+    private:
+        EpochDomain& domain;
+        int slot = 0;
+        std::deque<Retired> limbo;      // oldest first
+        size_t sinceCollect = 0;
+
+        void collect() {
+            unsigned long long safe = domain.epoch.load(std::memory_order_acquire);
+            size_t freed = 0;
+            while (!limbo.empty() && limbo.front().epoch + 2 <= safe) {
+                limbo.front().destroy(limbo.front().pointer);
+                limbo.pop_front();
+                ++freed;
+            }
+            domain.countFreed(freed);
+        }
+    };
+
+    ~EpochDomain() {
+        freeOrphans();
+    }
+
+    unsigned long long currentEpoch() const {
+        return epoch.load(std::memory_order_relaxed);
+    }
+
+    // Counted in batches by the participants, so both lag a little
+    size_t retiredCount() const { return retired.load(std::memory_order_relaxed); }
+    size_t freedCount() const { return freed.load(std::memory_order_relaxed); }
+
+    // Nodes left by participants that have gone; only when no thread is inside
+    void freeOrphans() {
+        std::lock_guard<std::mutex> lock(orphanMutex);
+        for (Retired& orphan : orphans) orphan.destroy(orphan.pointer);
+        countFreed(orphans.size());
+        orphans.clear();
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<unsigned long long> announced{QUIESCENT};
+        std::atomic<bool> used{false};
+    };
+
+    Slot slots[MAX_PARTICIPANTS];
+    alignas(64) std::atomic<unsigned long long> epoch{2};
+    std::atomic<size_t> retired{0};
+    std::atomic<size_t> freed{0};
+    std::mutex orphanMutex;
+    std::vector<Retired> orphans;
+
+    // The epoch moves on once every participant inside has seen the current one
+    void tryAdvance() {
+        unsigned long long current = epoch.load(std::memory_order_acquire);
+        for (const Slot& s : slots) {
+            if (!s.used.load(std::memory_order_acquire)) continue;
+            unsigned long long announced = s.announced.load(std::memory_order_seq_cst);
+            if (announced != QUIESCENT && announced != current) return;
+        }
+        epoch.compare_exchange_strong(current, current + 1, std::memory_order_acq_rel);
+    }
+
+    void countRetired(size_t count) {
+        if (count) retired.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void countFreed(size_t count) {
+        if (count) freed.fetch_add(count, std::memory_order_relaxed);
+    }
+};
+
+// Holds a participant inside the domain for one operation
+class EpochGuard {
+public:
+    explicit EpochGuard(EpochDomain::Participant& participant) : participant(participant) {
+        participant.enter();
+    }
+
+    ~EpochGuard() {
+        participant.exit();
+    }
+
+private:
+    EpochDomain::Participant& participant;
+};
+
+// Lock-free skip list set of ints after Herlihy and Shavit. The low bit of a node's next
+// pointer at a level marks the node deleted at that level; a search that meets a marked
+// node unlinks it. A node is retired once both the thread that inserted it and the one
+// that removed it are done with it, which is when it is unlinked from every level.
+class ConcurrentSkipList {
+public:
+    static constexpr int MAX_LEVEL = 24;
+
+    struct Node {
+        int key = 0;
+        int height = 0;
+        std::atomic<int> owners{2};             // inserter and remover
+        std::atomic<uintptr_t>* next = nullptr; // height entries, stored right after the node
+    };
+
+    // Per-thread state: the epoch participant, level coin flips and counters only its
+    // thread writes (others may read them)
+    struct Context {
+        ConcurrentSkipList& list;
+        EpochDomain::Participant participant;
+        std::mt19937 rng;
+        std::atomic<unsigned long long> ops{0};
+        std::atomic<unsigned long long> retries{0};
+        long long pendingSize = 0;              // flushed into the shared count now and then
+
+        Context(ConcurrentSkipList& owner, unsigned seed) : list(owner), participant(owner.domain), rng(seed) {}
+
+        ~Context() {
+            flush();
+        }
+
+        void flush() {
+            if (pendingSize) list.count.fetch_add(pendingSize, std::memory_order_relaxed);
+            pendingSize = 0;
+        }
+    };
+
+    EpochDomain domain;
+
+    ConcurrentSkipList() : head(createNode(0, MAX_LEVEL)) {}
+
+    ~ConcurrentSkipList() {
+        freeNodes();
+        destroyNode(head);
+    }
+
+    std::unique_ptr<Context> makeContext(unsigned seed) {
+        return std::make_unique<Context>(*this, seed);
+    }
+
+    bool insert(int key, Context& context) {
+        EpochGuard guard(context.participant);
+        bump(context.ops);
+        Node* preds[MAX_LEVEL];
+        Node* succs[MAX_LEVEL];
+        int height = randomHeight(context.rng);
+        Node* node = nullptr;
+        for (;;) {
+            if (find(key, preds, succs, context)) {
+                if (node) destroyNode(node);    // never published
+                return false;
+            }
+            if (!node) node = createNode(key, height);
+            for (int level = 0; level < height; ++level) node->next[level].store(pack(succs[level]), std::memory_order_relaxed);
+            uintptr_t expected = pack(succs[0]);
+            if (preds[0]->next[0].compare_exchange_strong(expected, pack(node), std::memory_order_release, std::memory_order_relaxed)) break;
+            bump(context.retries);
+        }
+        addSize(context, 1);
+
+        // Upper levels are linked one at a time; a remove that marks them stops this
+        for (int level = 1; level < height; ++level) {
+            for (;;) {
+                uintptr_t mine = node->next[level].load(std::memory_order_acquire);
+                if (isMarked(mine)) goto linked;
+                if (unpack(mine) != succs[level]
+                    && !node->next[level].compare_exchange_strong(mine, pack(succs[level]), std::memory_order_acq_rel)) {
+                    goto linked;                // only a remove changes it under us
+                }
+                uintptr_t expected = pack(succs[level]);
+                if (preds[level]->next[level].compare_exchange_strong(expected, pack(node), std::memory_order_release, std::memory_order_relaxed)) break;
+                bump(context.retries);
+                find(key, preds, succs, context);
+                if (succs[0] != node) goto linked;  // removed and already unlinked below
+            }
+        }
+    linked:
+        // Pairs with the fence in remove: either this load sees the mark, or the remover's
+        // find sees the upper links, so one of the two unlinks them
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (isMarked(node->next[0].load(std::memory_order_acquire))) find(key, preds, succs, context);
+        release(node, context);
+        return true;
+    }
+
+    bool remove(int key, Context& context) {
+        EpochGuard guard(context.participant);
+        bump(context.ops);
+        Node* preds[MAX_LEVEL];
+        Node* succs[MAX_LEVEL];
+        if (!find(key, preds, succs, context)) return false;
+        Node* victim = succs[0];
+        for (int level = victim->height - 1; level >= 1; --level) {
+            uintptr_t word = victim->next[level].load(std::memory_order_acquire);
+            while (!isMarked(word) && !victim->next[level].compare_exchange_weak(word, word | 1, std::memory_order_acq_rel)) {}
+        }
+        // Whoever marks the bottom level removed the key
+        uintptr_t word = victim->next[0].load(std::memory_order_acquire);
+        for (;;) {
+            if (isMarked(word)) return false;
+            if (victim->next[0].compare_exchange_strong(word, word | 1, std::memory_order_acq_rel)) break;
+            bump(context.retries);
+        }
+        addSize(context, -1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);    // see insert
+        find(key, preds, succs, context);
+        release(victim, context);
+        return true;
+    }
+
+    // Wait-free: skips marked nodes instead of unlinking them
+    bool contains(int key, Context& context) {
+        EpochGuard guard(context.participant);
+        bump(context.ops);
+        Node* pred = head;
+        Node* curr = nullptr;
+        for (int level = MAX_LEVEL - 1; level >= 0; --level) {
+            curr = unpack(pred->next[level].load(std::memory_order_acquire));
+            while (curr) {
+                uintptr_t succ = curr->next[level].load(std::memory_order_acquire);
+                if (isMarked(succ)) {
+                    curr = unpack(succ);
+                } else if (curr->key < key) {
+                    pred = curr;
+                    curr = unpack(succ);
+                } else {
+                    break;
+                }
+            }
+        }
+        return curr && curr->key == key && !isMarked(curr->next[0].load(std::memory_order_acquire));
+    }
+
+    // Calls visit(key, height) on live nodes from the first key at or above start, in
+    // order, until it returns false. Everything reached stays allocated for the walk.
+    template <typename Visit>
+    void walk(int start, Context& context, Visit visit) {
+        EpochGuard guard(context.participant);
+        Node* pred = head;
+        for (int level = MAX_LEVEL - 1; level >= 0; --level) {
+            for (Node* curr = unpack(pred->next[level].load(std::memory_order_acquire)); curr && curr->key < start;
+                 curr = unpack(curr->next[level].load(std::memory_order_acquire))) {
+                pred = curr;
+            }
+        }
+        for (Node* node = unpack(pred->next[0].load(std::memory_order_acquire)); node;) {
+            uintptr_t succ = node->next[0].load(std::memory_order_acquire);
+            if (!isMarked(succ) && node->key >= start && !visit(node->key, node->height)) return;
+            node = unpack(succ);
+        }
+    }
+
+    // Approximate while writers run: each thread flushes its count every few operations
+    long long size() const {
+        return count.load(std::memory_order_relaxed);
+    }
+
+    // Only with no other thread using the list
+    void clear() {
+        freeNodes();
+        domain.freeOrphans();
+        for (int level = 0; level < MAX_LEVEL; ++level) head->next[level].store(0, std::memory_order_relaxed);
+        count.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    Node* head;
+    std::atomic<long long> count{0};
+
+    static constexpr long long SIZE_FLUSH = 256;
+
+    static uintptr_t pack(Node* node) { return reinterpret_cast<uintptr_t>(node); }
+    static Node* unpack(uintptr_t word) { return reinterpret_cast<Node*>(word & ~uintptr_t(1)); }
+    static bool isMarked(uintptr_t word) { return word & 1; }
+
+    // Single writer per counter, so a plain load/store avoids a locked add
+    static void bump(std::atomic<unsigned long long>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void addSize(Context& context, long long delta) {
+        context.pendingSize += delta;
+        if (context.pendingSize >= SIZE_FLUSH || context.pendingSize <= -SIZE_FLUSH) context.flush();
+    }
+
+    static Node* createNode(int key, int height) {
+        void* memory = ::operator new(sizeof(Node) + height * sizeof(std::atomic<uintptr_t>));
+        Node* node = new (memory) Node;
+        node->key = key;
+        node->height = height;
+        node->next = reinterpret_cast<std::atomic<uintptr_t>*>(node + 1);
+        for (int level = 0; level < height; ++level) new (&node->next[level]) std::atomic<uintptr_t>(0);
+        return node;
+    }
+
+    static void destroyNode(void* pointer) {
+        Node* node = static_cast<Node*>(pointer);
+        node->~Node();
+        ::operator delete(pointer);
+    }
+
+    static int randomHeight(std::mt19937& rng) {
+        uint32_t bits = rng() | (1u << (MAX_LEVEL - 1));
+        return std::countr_zero(bits) + 1;
+    }
+
+    void release(Node* node, Context& context) {
+        if (node->owners.fetch_sub(1, std::memory_order_acq_rel) == 1) context.participant.retire(node, destroyNode);
+    }
+
+    // Fills the nodes either side of key at every level, unlinking marked nodes on the
+    // way; starts over when an unlink loses a race
+    bool find(int key, Node** preds, Node** succs, Context& context) {
+    retry:
+        Node* pred = head;
+        for (int level = MAX_LEVEL - 1; level >= 0; --level) {
+            Node* curr = unpack(pred->next[level].load(std::memory_order_acquire));
+            while (curr) {
+                uintptr_t succ = curr->next[level].load(std::memory_order_acquire);
+                if (isMarked(succ)) {
+                    uintptr_t expected = pack(curr);
+                    if (!pred->next[level].compare_exchange_strong(expected, succ & ~uintptr_t(1), std::memory_order_acq_rel)) {
+                        bump(context.retries);
+                        goto retry;
+                    }
+                    curr = unpack(succ);
+                } else if (curr->key < key) {
+                    pred = curr;
+                    curr = unpack(succ);
+                } else {
+                    break;
+                }
+            }
+            preds[level] = pred;
+            succs[level] = curr;
+        }
+        return succs[0] && succs[0]->key == key;
+    }
+
+    // Reachable nodes at rest are exactly the live ones; retired ones are unlinked
+    void freeNodes() {
+        Node* node = unpack(head->next[0].load(std::memory_order_relaxed));
+        while (node) {
+            Node* next = unpack(node->next[0].load(std::memory_order_relaxed));
+            destroyNode(node);
+            node = next;
+        }
+    }
+};
+
+// Worker threads hammering one skip list with a mix of inserts, removes and lookups on
+// random keys; the page and the benchmark sample their counters
+class SkipListSimulation {
+public:
+    struct Config {
+        int threads = 4;
+        int keyRange = 1000000;
+        int insertPercent = 50;     // then removes, then lookups
+        int removePercent = 25;
+    };
+
+    struct ThreadRate {
+        double opsPerSecond = 0;
+        double retriesPerSecond = 0;
+    };
+
+    static constexpr int MAX_THREADS = 16;
+
+    explicit SkipListSimulation(ConcurrentSkipList& list) : list(list) {}
+
+    ~SkipListSimulation() {
+        stop();
+    }
+
+    void start(Config requested) {
+        stop();
+        config = requested;
+        config.threads = std::max(1, std::min(config.threads, MAX_THREADS));
+        config.keyRange = std::max(1, config.keyRange);
+        contexts.clear();
+        for (int i = 0; i < config.threads; ++i) contexts.push_back(list.makeContext(1000 + i));
+        previous.assign(config.threads, {0, 0});
+        lastSample = std::chrono::steady_clock::now();
+        running.store(true);
+        for (int i = 0; i < config.threads; ++i) {
+            workers.emplace_back([this, i] { work(*contexts[i]); });
+        }
+    }
+
+    // Contexts go with their threads, handing leftover retired nodes to the domain
+    void stop() {
+        running.store(false);
+        for (std::thread& worker : workers) worker.join();
+        workers.clear();
+        contexts.clear();
+    }
+
+    bool isRunning() const {
+        return !workers.empty();
+    }
+
+    const Config& getConfig() const {
+        return config;
+    }
+
+    // Per-thread rates since the previous call
+    std::vector<ThreadRate> sample() {
+        std::vector<ThreadRate> rates(contexts.size());
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - lastSample).count();
+        lastSample = now;
+        for (size_t i = 0; i < contexts.size(); ++i) {
+            unsigned long long ops = contexts[i]->ops.load(std::memory_order_relaxed);
+            unsigned long long retries = contexts[i]->retries.load(std::memory_order_relaxed);
+            if (elapsed > 0) {
+                rates[i].opsPerSecond = (ops - previous[i].first) / elapsed;
+                rates[i].retriesPerSecond = (retries - previous[i].second) / elapsed;
+            }
+            previous[i] = {ops, retries};
+        }
+        return rates;
+    }
+
+private:
+    ConcurrentSkipList& list;
+    Config config;
+    std::vector<std::unique_ptr<ConcurrentSkipList::Context>> contexts;
+    std::vector<std::pair<unsigned long long, unsigned long long>> previous;
+    std::vector<std::thread> workers;
+    std::atomic<bool> running{false};
+    std::chrono::steady_clock::time_point lastSample;
+
+    void work(ConcurrentSkipList::Context& context) {
+        std::uniform_int_distribution<int> keys(0, config.keyRange - 1);
+        std::uniform_int_distribution<int> percent(0, 99);
+        while (running.load(std::memory_order_relaxed)) {
+            int key = keys(context.rng);
+            int roll = percent(context.rng);
+            if (roll < config.insertPercent) list.insert(key, context);
+            else if (roll < config.insertPercent + config.removePercent) list.remove(key, context);
+            else list.contains(key, context);
+        }
+    }
+};
+
+// "threads [keyRange]", as typed on the page or given to --skiplist-bench
+inline SkipListSimulation::Config parseSkipListConfig(std::istream& in) {
+    SkipListSimulation::Config config;
+    unsigned hardware = std::thread::hardware_concurrency();
+    config.threads = static_cast<int>(std::max(2u, std::min(hardware, 8u)));
+    double threads, range;
+    if (in >> threads) config.threads = static_cast<int>(threads);
+    if (in >> range) config.keyRange = static_cast<int>(std::min(range, 2e9));
+    return config;
+}
+
+// The skip list's levels as lanes over a window of keys, next to per-thread rates while
+// worker threads run. The lanes come from one walk of the bottom list, so the drawing
+// never shows a node on an upper lane that its own column is missing.
+class SkipListVisualizer {
+public:
+    ConcurrentSkipList list;
+    std::unique_ptr<ConcurrentSkipList::Context> context;   // the UI thread's
+    SkipListSimulation simulation;
+    std::vector<SkipListSimulation::ThreadRate> rates;
+    int viewStart = std::numeric_limits<int>::min();
+    int highlighted = std::numeric_limits<int>::min();
+    bool hasHighlight = false;
+
+    sf::Font font;
+    BatchRenderer batch;
+    sf::RectangleShape box;
+    NodeLabel keyText;
+    sf::Text statusText;
+    sf::Clock sampleClock;
+    std::vector<std::pair<int, int>> window;    // key and height of the nodes on screen
+
+    static constexpr size_t VISIBLE_NODES = 40;
+    static constexpr int VISIBLE_LANES = 12;
+
+    SkipListVisualizer() : context(list.makeContext(1)), simulation(list) {
+        TRACE_SCOPE("load font");
+        if (!font.loadFromFile("arial.ttf")) {
+            std::cerr << "Error loading font!" << std::endl;
+        }
+        keyText.setFont(font);
+        keyText.setCharacterSize(10);
+        keyText.setFillColor(sf::Color::White);
+        statusText.setFont(font);
+        statusText.setCharacterSize(16);
+        statusText.setFillColor(sf::Color::White);
+        statusText.setPosition(150, 560);
+    }
+
+    ~SkipListVisualizer() {
+        simulation.stop();
+        context.reset();
+    }
+
+    void insertBatch(const std::vector<int>& values) {
+        for (int value : values) list.insert(value, *context);
+        context->flush();
+    }
+
+    void removeBatch(const std::vector<int>& values) {
+        for (int value : values) list.remove(value, *context);
+        context->flush();
+    }
+
+    // Scrolls the lanes so they start at the key, or where it would be
+    void search(int value) {
+        hasHighlight = list.contains(value, *context);
+        highlighted = value;
+        viewStart = value;
+        if (!hasHighlight) std::cout << "Number does not exist." << std::endl;
+    }
+
+    void startSimulation(const std::string& settings) {
+        std::istringstream in(settings);
+        simulation.start(parseSkipListConfig(in));
+        rates.clear();
+        sampleClock.restart();
+    }
+
+    void stopSimulation() {
+        simulation.stop();
+        rates.clear();
+    }
+
+    void reset() {
+        simulation.stop();
+        rates.clear();
+        context.reset();
+        list.clear();
+        context = list.makeContext(1);
+        viewStart = std::numeric_limits<int>::min();
+        hasHighlight = false;
+    }
+
+    void update() {
+        if (simulation.isRunning() && sampleClock.getElapsedTime() >= sf::milliseconds(500)) {
+            sampleClock.restart();
+            rates = simulation.sample();
+        }
+    }
+
+    void draw(sf::RenderTarget& target) {
+        window.clear();
+        list.walk(viewStart, *context, [this](int key, int height) {
+            window.emplace_back(key, height);
+            return window.size() < VISIBLE_NODES;
+        });
+        int lanes = 1;
+        for (const auto& node : window) lanes = std::max(lanes, node.second);
+        lanes = std::min(lanes, VISIBLE_LANES);
+        drawLanes(lanes);
+        drawRates();
+        batch.flush(target);
+
+        std::ostringstream out;
+        out.setf(std::ios::fixed);
+        out.precision(2);
+        const EpochDomain& domain = list.domain;
+        out << "about " << list.size() << " keys   epoch " << domain.currentEpoch() << "   retired " << domain.retiredCount()
+            << ", freed " << domain.freedCount();
+        if (simulation.isRunning()) {
+            const SkipListSimulation::Config& config = simulation.getConfig();
+            double ops = 0, retries = 0;
+            for (const auto& rate : rates) {
+                ops += rate.opsPerSecond;
+                retries += rate.retriesPerSecond;
+            }
+            out << "\n" << config.threads << " threads on keys 0.." << config.keyRange - 1 << " (" << config.insertPercent
+                << "% insert, " << config.removePercent << "% remove, the rest lookups)\n" << ops / 1e6
+                << " M ops/s in total, " << retries / 1e3 << " K CAS retries/s";
+        } else {
+            out << "\nSimulate starts worker threads: type '<threads> [key range]' first";
+        }
+        statusText.setString(out.str());
+        target.draw(statusText);
+    }
+
+private:
+    // Column 0 is the head; a node's boxes stack up to its height
+    void drawLanes(int lanes) {
+        float spacing = 1300.f / (VISIBLE_NODES + 1);
+        float laneGap = std::min(26.f, 280.f / lanes);
+        auto columnX = [&](size_t column) { return 150 + column * spacing; };
+        auto laneY = [&](int lane) { return 510 - lane * laneGap; };
+
+        std::vector<size_t> lastColumn(lanes, 0);
+        for (int lane = 0; lane < lanes; ++lane) drawBox(columnX(0), laneY(lane), spacing, laneGap, sf::Color(90, 90, 90), nullptr);
+        for (size_t i = 0; i < window.size(); ++i) {
+            int key = window[i].first;
+            int height = std::min(window[i].second, lanes);
+            sf::Color fill = hasHighlight && key == highlighted ? sf::Color(200, 120, 0) : sf::Color(60, 100, 180);
+            for (int lane = 0; lane < height; ++lane) {
+                float x = columnX(i + 1), y = laneY(lane);
+                drawBox(x, y, spacing, laneGap, fill, lane == 0 ? &key : nullptr);
+                float previousX = columnX(lastColumn[lane]);
+                batch.addEdge(sf::Vector2f(previousX + spacing - 4, y + laneGap / 2 - 2), sf::Vector2f(x, y + laneGap / 2 - 2));
+                lastColumn[lane] = i + 1;
+            }
+        }
+    }
+
+    void drawBox(float x, float y, float spacing, float laneGap, sf::Color fill, const int* key) {
+        box.setSize(sf::Vector2f(spacing - 4, laneGap - 4));
+        box.setPosition(x, y);
+        box.setFillColor(fill);
+        batch.addRect(box);
+        if (!key) return;
+        keyText.setString(std::to_string(*key));
+        keyText.setPosition(x + (spacing - 4 - keyText.getLocalBounds().width) / 2, y + 2);
+        batch.addLabel(keyText);
+    }
+
+    // One pair of bars per worker: operations (green) and CAS retries (red), each
+    // scaled to the largest of its kind
+    void drawRates() {
+        if (rates.empty()) return;
+        double maxOps = 1, maxRetries = 1;
+        for (const auto& rate : rates) {
+            maxOps = std::max(maxOps, rate.opsPerSecond);
+            maxRetries = std::max(maxRetries, rate.retriesPerSecond);
+        }
+        const float base = 680, height = 100, left = 1000;
+        for (size_t i = 0; i < rates.size(); ++i) {
+            float x = left + i * 30;
+            float opsHeight = static_cast<float>(height * rates[i].opsPerSecond / maxOps);
+            float retryHeight = static_cast<float>(height * rates[i].retriesPerSecond / maxRetries);
+            box.setSize(sf::Vector2f(12, opsHeight));
+            box.setPosition(x, base - opsHeight);
+            box.setFillColor(sf::Color(100, 200, 100));
+            batch.addRect(box);
+            box.setSize(sf::Vector2f(12, retryHeight));
+            box.setPosition(x + 13, base - retryHeight);
+            box.setFillColor(sf::Color(200, 80, 80));
+            batch.addRect(box);
+            keyText.setString(std::to_string(i));
+            keyText.setPosition(x + 8, base + 2);
+            batch.addLabel(keyText);
+        }
+    }
+};
+
+// --skiplist-bench [threads] [keyRange] [seconds]: each thread count from 1 up to
+// threads, doubling, runs the insert/remove/lookup mix for the given time (default 2 s)
+inline int runSkipListBenchmark(std::istream& args) {
+    SkipListSimulation::Config config = parseSkipListConfig(args);
+    config.threads = std::max(1, std::min(config.threads, SkipListSimulation::MAX_THREADS));
+    double seconds = 2;
+    args >> seconds;
+    std::cout << std::fixed;
+    std::cout.precision(2);
+    std::cout << "threads  Mops/s  Mops/s/thread  Kretries/s  keys  retired  freed" << std::endl;
+    bool ok = true;
+    for (int threads = 1;; threads = std::min(threads * 2, config.threads)) {
+        ConcurrentSkipList list;
+        {
+            SkipListSimulation simulation(list);
+            SkipListSimulation::Config run = config;
+            run.threads = threads;
+            simulation.start(run);
+            simulation.sample();
+            std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+            double ops = 0, retries = 0;
+            for (const auto& rate : simulation.sample()) {
+                ops += rate.opsPerSecond;
+                retries += rate.retriesPerSecond;
+            }
+            simulation.stop();
+            std::cout << std::setw(7) << threads << std::setw(8) << ops / 1e6 << std::setw(15) << ops / 1e6 / threads
+                      << std::setw(12) << retries / 1e3;
+        }
+        // At rest the bottom list must be sorted without duplicates and match the count
+        auto checker = list.makeContext(0);
+        long long walked = 0;
+        long long last = std::numeric_limits<long long>::min();
+        bool sorted = true;
+        list.walk(std::numeric_limits<int>::min(), *checker, [&](int key, int) {
+            sorted = sorted && key > last;
+            last = key;
+            ++walked;
+            return true;
+        });
+        bool correct = sorted && walked == list.size();
+        ok = ok && correct;
+        std::cout << std::setw(6) << walked << std::setw(9) << list.domain.retiredCount() << std::setw(7) << list.domain.freedCount()
+                  << (correct ? "" : "   WRONG RESULTS") << std::endl;
+        if (threads == config.threads) break;
+    }
+    return ok ? 0 : 1;
+}
+
+// Segment tree over a power-of-two padded array with range add, range sum and range
+// minimum. A pending add stays on the node it covers and is already counted in that
+// node's sum and minimum, so nothing is pushed down and queries never write; many
+// threads may query at once.
+class LazySegmentTree {
+public:
+    struct Result {
+        long long sum = 0;
+        long long min = 0;
+    };
+
+    static constexpr long long NO_MIN = std::numeric_limits<long long>::max() / 4;   // padding
+
+    size_t count = 0;
+    size_t leaves = 1;
+    std::vector<long long> sums;
+    std::vector<long long> mins;
+    std::vector<long long> adds;    // added to the node's whole range, not yet in its children
+
+    // O(n): leaves first, then each parent from its two children
+    void build(const std::vector<long long>& values) {
+        TRACE_SCOPE("segment tree build");
+        count = values.size();
+        leaves = std::bit_ceil(std::max<size_t>(1, count));
+        sums.assign(2 * leaves, 0);
+        mins.assign(2 * leaves, NO_MIN);
+        adds.assign(2 * leaves, 0);
+        for (size_t i = 0; i < count; ++i) sums[leaves + i] = mins[leaves + i] = values[i];
+        for (size_t node = leaves - 1; node >= 1; --node) pull(node);
+    }
+
+    // Inclusive, 0-based; the caller keeps l <= r < count
+    void rangeAdd(size_t l, size_t r, long long delta) {
+        add(1, 0, leaves - 1, l, r, delta);
+    }
+
+    Result query(size_t l, size_t r) const {
+        return query(1, 0, leaves - 1, l, r, 0);
+    }
+
+    // The nodes a query or add on [l, r] stops at, left to right
+    void cover(size_t l, size_t r, std::vector<size_t>& nodes) const {
+        cover(1, 0, leaves - 1, l, r, nodes);
+    }
+
+    // Current value i: its leaf plus the adds pending above it, O(log n)
+    long long value(size_t i) const {
+        size_t node = leaves + i;
+        long long total = sums[node];
+        while (node > 1) total += adds[node /= 2];
+        return total;
+    }
+
+    // Current values, with every pending add carried down to the leaves
+    void values(std::vector<long long>& out) const {
+        std::vector<long long> carried(2 * leaves, 0);
+        for (size_t node = 1; node < leaves; ++node) carried[2 * node] = carried[2 * node + 1] = carried[node] + adds[node];
+        out.resize(count);
+        for (size_t i = 0; i < count; ++i) out[i] = sums[leaves + i] + carried[leaves + i];
+    }
+
+    // Number of array slots under a node
+    long long width(size_t node) const {
+        return static_cast<long long>(leaves >> (std::bit_width(node) - 1));
+    }
+
+    size_t bytes() const {
+        return (sums.size() + mins.size() + adds.size()) * sizeof(long long);
+    }
+
+private:
+    void pull(size_t node) {
+        sums[node] = sums[2 * node] + sums[2 * node + 1] + adds[node] * width(node);
+        mins[node] = std::min(mins[2 * node], mins[2 * node + 1]) + adds[node];
+    }
+
+    void add(size_t node, size_t low, size_t high, size_t l, size_t r, long long delta) {
+        if (r < low || high < l) return;
+        if (l <= low && high <= r) {
+            adds[node] += delta;
+            sums[node] += delta * width(node);
+            mins[node] += delta;
+            return;
+        }
+        size_t mid = (low + high) / 2;
+        add(2 * node, low, mid, l, r, delta);
+        add(2 * node + 1, mid + 1, high, l, r, delta);
+        pull(node);
+    }
+
+    // carry is the adds of the ancestors, which this node's own numbers leave out
+    Result query(size_t node, size_t low, size_t high, size_t l, size_t r, long long carry) const {
+        if (l <= low && high <= r) return {sums[node] + carry * width(node), mins[node] + carry};
+        size_t mid = (low + high) / 2;
+        carry += adds[node];
+        if (r <= mid) return query(2 * node, low, mid, l, r, carry);
+        if (l > mid) return query(2 * node + 1, mid + 1, high, l, r, carry);
+        Result left = query(2 * node, low, mid, l, r, carry);
+        Result right = query(2 * node + 1, mid + 1, high, l, r, carry);
+        return {left.sum + right.sum, std::min(left.min, right.min)};
+    }
+
+    void cover(size_t node, size_t low, size_t high, size_t l, size_t r, std::vector<size_t>& nodes) const {
+        if (r < low || high < l) return;
+        if (l <= low && high <= r) {
+            nodes.push_back(node);
+            return;
+        }
+        size_t mid = (low + high) / 2;
+        cover(2 * node, low, mid, l, r, nodes);
+        cover(2 * node + 1, mid + 1, high, l, r, nodes);
+    }
+};
+
+// Fenwick tree with range add and range sum (no minimum). Two trees of partial sums
+// give prefix(p) = p * S1(p) - S2(p); the values start in S2, built in O(n) by adding
+// each node into the next one that covers it.
+class FenwickTree {
+public:
+    size_t count = 0;
+    std::vector<long long> scale;   // S1, 1-based
+    std::vector<long long> offset;  // S2, 1-based
+
+    void build(const std::vector<long long>& values) {
+        TRACE_SCOPE("Fenwick build");
+        count = values.size();
+        scale.assign(count + 1, 0);
+        offset.assign(count + 1, 0);
+        for (size_t i = 1; i <= count; ++i) {
+            offset[i] -= values[i - 1];
+            size_t parent = i + lowBit(i);
+            if (parent <= count) offset[parent] += offset[i];
+        }
+    }
+
+    void rangeAdd(size_t l, size_t r, long long delta) {
+        size_t first = l + 1, last = r + 1;
+        addAt(scale, first, delta);
+        addAt(scale, last + 1, -delta);
+        addAt(offset, first, delta * static_cast<long long>(first - 1));
+        addAt(offset, last + 1, -delta * static_cast<long long>(last));
+    }
+
+    long long rangeSum(size_t l, size_t r) const {
+        return prefix(r + 1) - prefix(l);
+    }
+
+    static size_t lowBit(size_t i) {
+        return i & (~i + 1);
+    }
+
+    size_t bytes() const {
+        return (scale.size() + offset.size()) * sizeof(long long);
+    }
+
+private:
+    void addAt(std::vector<long long>& tree, size_t i, long long delta) {
+        for (; i <= count; i += lowBit(i)) tree[i] += delta;
+    }
+
+    static long long sumTo(const std::vector<long long>& tree, size_t i) {
+        long long total = 0;
+        for (; i > 0; i -= lowBit(i)) total += tree[i];
+        return total;
+    }
+
+    long long prefix(size_t p) const {
+        return static_cast<long long>(p) * sumTo(scale, p) - sumTo(offset, p);
+    }
+};
+
+// Random ranges answered by both trees, the queries split into one contiguous share
+// per thread. The checksums of the two trees' sums must agree.
+struct RangeBatchResult {
+    size_t queries = 0;
+    int threads = 1;
+    double segmentPerSecond = 0;
+    double fenwickPerSecond = 0;
+    bool agree = true;
+};
+
+inline RangeBatchResult runRangeQueries(const LazySegmentTree& segment, const FenwickTree& fenwick, size_t queries, int threads) {
+    RangeBatchResult result;
+    result.queries = queries;
+    result.threads = std::max(1, std::min(threads, 64));
+    if (segment.count == 0 || queries == 0) return result;
+    std::vector<std::pair<uint32_t, uint32_t>> ranges(queries);
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<uint32_t> index(0, static_cast<uint32_t>(segment.count - 1));
+    for (auto& range : ranges) {
+        uint32_t a = index(rng), b = index(rng);
+        range = {std::min(a, b), std::max(a, b)};
+    }
+
+    auto timed = [&](auto answer) {
+        std::vector<long long> checksums(result.threads, 0);
+        std::vector<std::thread> workers;
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < result.threads; ++t) {
+            workers.emplace_back([&, t] {
+                long long checksum = 0;
+                size_t begin = queries * t / result.threads, end = queries * (t + 1) / result.threads;
+                for (size_t q = begin; q < end; ++q) checksum += answer(ranges[q].first, ranges[q].second);
+                checksums[t] = checksum;
+            });
+        }
+        for (std::thread& worker : workers) worker.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        long long total = 0;
+        for (long long checksum : checksums) total += checksum;
+        return std::make_pair(queries / std::max(seconds, 1e-9), total);
+    };
+    auto segmentRun = timed([&segment](size_t l, size_t r) { return segment.query(l, r).sum; });
+    auto fenwickRun = timed([&fenwick](size_t l, size_t r) { return fenwick.rangeSum(l, r); });
+    result.segmentPerSecond = segmentRun.first;
+    result.fenwickPerSecond = fenwickRun.first;
+    result.agree = segmentRun.second == fenwickRun.second;
+    return result;
+}
+
+// Both trees over the first cells of the array: the segment tree's nodes above the
+// cells, each Fenwick node below them as a bar across the range it sums
+class RangeTreeVisualizer {
+public:
+    LazySegmentTree segment;
+    FenwickTree fenwick;
+    std::vector<size_t> covered;        // segment nodes of the last query or add
+    size_t rangeLow = 0, rangeHigh = 0;
+    bool hasRange = false;
+    std::string lastAction;
+    RangeBatchResult lastBatch;
+    double buildMs = 0;
+
+    // Batches run in the background on a copy of both trees; a result for an array that
+    // was rebuilt meanwhile is dropped
+    std::future<RangeBatchResult> pendingBatch;
+    size_t generation = 0;              // bumped on every rebuild
+    size_t pendingGeneration = 0;
+    static constexpr size_t MAX_QUERIES = 100000000;
+
+    sf::Font font;
+    BatchRenderer batch;
+    sf::RectangleShape box;
+    NodeLabel valueText;
+    sf::Text statusText;
+
+    static constexpr size_t VISIBLE_CELLS = 32;
+    static constexpr float LEFT = 150, CELL_WIDTH = 40, ARRAY_Y = 440;
+
+    RangeTreeVisualizer() {
+        TRACE_SCOPE("load font");
+        if (!font.loadFromFile("arial.ttf")) {
+            std::cerr << "Error loading font!" << std::endl;
+        }
+        valueText.setFont(font);
+        valueText.setCharacterSize(11);
+        valueText.setFillColor(sf::Color::White);
+        statusText.setFont(font);
+        statusText.setCharacterSize(16);
+        statusText.setFillColor(sf::Color::White);
+        statusText.setPosition(150, 600);
+        rebuild({});
+    }
+
+    // Appends and rebuilds both trees in O(n) with the adds so far folded in
+    void insertBatch(const std::vector<int>& values) {
+        std::vector<long long> all;
+        segment.values(all);
+        all.insert(all.end(), values.begin(), values.end());
+        rebuild(all);
+        lastAction = "Built both trees over " + std::to_string(all.size()) + " values in " + std::to_string(buildMs) + " ms";
+    }
+
+    void query(size_t l, size_t r) {
+        if (!clampRange(l, r)) return;
+        LazySegmentTree::Result result = segment.query(l, r);
+        lastAction = "Range [" + std::to_string(l) + ", " + std::to_string(r) + "]: sum " + std::to_string(result.sum)
+                   + " (Fenwick " + std::to_string(fenwick.rangeSum(l, r)) + "), min " + std::to_string(result.min)
+                   + ", " + std::to_string(covered.size()) + " segment nodes";
+    }
+
+    void rangeAdd(size_t l, size_t r, long long delta) {
+        if (!clampRange(l, r)) return;
+        segment.rangeAdd(l, r, delta);
+        fenwick.rangeAdd(l, r, delta);
+        lastAction = "Added " + std::to_string(delta) + " to [" + std::to_string(l) + ", " + std::to_string(r) + "] through "
+                   + std::to_string(covered.size()) + " segment nodes";
+    }
+
+    // Ignored while a batch is still running
+    void runBatch(size_t queries, int threads) {
+        if (queries > MAX_QUERIES) {
+            std::cout << "The page runs at most " << MAX_QUERIES << " queries; use --range-bench for more." << std::endl;
+            return;
+        }
+        if (pendingBatch.valid()) return;
+        pendingGeneration = generation;
+        pendingBatch = std::async(std::launch::async, [segment = segment, fenwick = fenwick, queries, threads] {
+            return runRangeQueries(segment, fenwick, queries, threads);
+        });
+    }
+
+    void reset() {
+        rebuild({});
+        lastAction.clear();
+        lastBatch = RangeBatchResult();
+    }
+
+    void draw(sf::RenderTarget& target) {
+        if (pendingBatch.valid() && pendingBatch.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            RangeBatchResult result = pendingBatch.get();
+            if (pendingGeneration == generation) {
+                lastBatch = result;
+                if (!lastBatch.agree) std::cerr << "Segment and Fenwick sums disagree" << std::endl;
+            }
+        }
+        size_t shown = std::min(segment.count, VISIBLE_CELLS);
+        if (shown > 0) {
+            drawSegmentTree(shown);
+            drawArray(shown);
+            drawFenwick(shown);
+            batch.flush(target);
+        }
+
+        std::ostringstream out;
+        out.setf(std::ios::fixed);
+        out.precision(2);
+        out << segment.count << " values   segment tree " << 2 * segment.leaves - 1 << " nodes, "
+            << TimelineSlider::formatBytes(segment.bytes()) << "   Fenwick " << TimelineSlider::formatBytes(fenwick.bytes())
+            << "\n" << lastAction;
+        if (lastBatch.queries) {
+            out << "\n" << lastBatch.queries << " random range sums on " << lastBatch.threads << " threads: segment tree "
+                << lastBatch.segmentPerSecond / 1e6 << " M/s, Fenwick " << lastBatch.fenwickPerSecond / 1e6 << " M/s"
+                << (lastBatch.agree ? ", results agree" : ", RESULTS DIFFER");
+        }
+        if (pendingBatch.valid()) out << "\nRunning random range sums...";
+        statusText.setString(out.str());
+        target.draw(statusText);
+    }
+
+private:
+    void rebuild(const std::vector<long long>& values) {
+        auto start = std::chrono::steady_clock::now();
+        segment.build(values);
+        fenwick.build(values);
+        buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        covered.clear();
+        hasRange = false;
+        ++generation;
+    }
+
+    bool clampRange(size_t& l, size_t& r) {
+        if (segment.count == 0) {
+            std::cout << "The array is empty." << std::endl;
+            return false;
+        }
+        if (l > r) std::swap(l, r);
+        if (l >= segment.count) {
+            std::cout << "Range starts past the end of the array." << std::endl;
+            return false;
+        }
+        r = std::min(r, segment.count - 1);
+        covered.clear();
+        segment.cover(l, r, covered);
+        rangeLow = l;
+        rangeHigh = r;
+        hasRange = true;
+        return true;
+    }
+
+    // The subtree over the first shown leaves (rounded up to a power of two)
+    void drawSegmentTree(size_t shown) {
+        size_t span = std::bit_ceil(shown);
+        size_t top = segment.leaves / span;     // node covering leaves [0, span)
+        int levels = std::bit_width(span);
+        float gap = std::min(36.f, 190.f / levels);
+        for (int level = 0; level < levels; ++level) {
+            size_t first = top << level, nodes = size_t(1) << level;
+            float width = CELL_WIDTH * span / nodes;
+            float y = ARRAY_Y - (levels - level) * gap - 6;
+            for (size_t i = 0; i < nodes; ++i) {
+                size_t node = first + i;
+                float x = LEFT + i * width;
+                if (x >= LEFT + shown * CELL_WIDTH) break;
+                bool hit = std::find(covered.begin(), covered.end(), node) != covered.end();
+                box.setSize(sf::Vector2f(width - 3, gap - 6));
+                box.setPosition(x, y);
+                box.setFillColor(hit ? sf::Color(200, 120, 0) : segment.adds[node] ? sf::Color(120, 80, 160) : sf::Color(60, 100, 180));
+                batch.addRect(box);
+                if (level > 0) {
+                    size_t parent = node / 2;
+                    float parentWidth = width * 2;
+                    float parentX = LEFT + (parent - (top << (level - 1))) * parentWidth;
+                    batch.addEdge(sf::Vector2f(parentX + parentWidth / 2, y - 6), sf::Vector2f(x + width / 2, y));
+                }
+                if (segment.mins[node] < LazySegmentTree::NO_MIN / 2) {
+                    valueText.setString(std::to_string(segment.sums[node]));
+                    if (valueText.getLocalBounds().width < width - 6) {
+                        valueText.setPosition(x + (width - 3 - valueText.getLocalBounds().width) / 2, y + 1);
+                        batch.addLabel(valueText);
+                    }
+                }
+            }
+        }
+    }
+
+    void drawArray(size_t shown) {
+        for (size_t i = 0; i < shown; ++i) {
+            float x = LEFT + i * CELL_WIDTH;
+            bool inRange = hasRange && i >= rangeLow && i <= rangeHigh;
+            box.setSize(sf::Vector2f(CELL_WIDTH - 3, 24));
+            box.setPosition(x, ARRAY_Y);
+            box.setFillColor(inRange ? sf::Color(0, 140, 160) : sf::Color(80, 80, 80));
+            batch.addRect(box);
+            valueText.setString(std::to_string(segment.value(i)));
+            valueText.setPosition(x + (CELL_WIDTH - 3 - valueText.getLocalBounds().width) / 2, ARRAY_Y + 5);
+            batch.addLabel(valueText);
+        }
+    }
+
+    // Whether prefix(p) reads node i
+    static bool onPrefixPath(size_t i, size_t p) {
+        for (; p > 0; p -= FenwickTree::lowBit(p)) {
+            if (p == i) return true;
+        }
+        return false;
+    }
+
+    // Node i sums the lowBit(i) values ending at i, so it sits on row log2(lowBit(i))
+    void drawFenwick(size_t shown) {
+        for (size_t i = 1; i <= shown; ++i) {
+            size_t low = FenwickTree::lowBit(i);
+            float row = static_cast<float>(std::bit_width(low) - 1);
+            float x = LEFT + (i - low) * CELL_WIDTH;
+            float y = ARRAY_Y + 32 + row * 14;
+            bool used = hasRange && (onPrefixPath(i, rangeHigh + 1) || onPrefixPath(i, rangeLow));
+            box.setSize(sf::Vector2f(low * CELL_WIDTH - 3, 10));
+            box.setPosition(x, y);
+            box.setFillColor(used ? sf::Color(200, 120, 0) : sf::Color(100, 160, 100));
+            batch.addRect(box);
+        }
+    }
+};
+
+// --range-bench [count] [queries] [threads]: builds both trees over random values
+// (default 1e6), checks a sample of range adds against a plain array, then answers
+// random range sums on 1 thread and on the given number (default all cores)
+inline int runRangeBenchmark(std::istream& args) {
+    double count = 1e6, queries = 4e6, threads = std::max(1u, std::thread::hardware_concurrency());
+    args >> count >> queries >> threads;
+    size_t n = std::max<size_t>(1, static_cast<size_t>(count));
+    std::vector<long long> values(n);
+    std::mt19937 rng(5);
+    for (long long& value : values) value = static_cast<long long>(rng() % 10000);
+
+    auto elapsedMs = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+    LazySegmentTree segment;
+    FenwickTree fenwick;
+    auto start = std::chrono::steady_clock::now();
+    segment.build(values);
+    double segmentMs = elapsedMs(start);
+    start = std::chrono::steady_clock::now();
+    fenwick.build(values);
+    double fenwickMs = elapsedMs(start);
+
+    // Range adds on all three, then queries compared with the plain array
+    bool ok = true;
+    std::uniform_int_distribution<size_t> index(0, n - 1);
+    for (int round = 0; round < 200; ++round) {
+        size_t l = index(rng), r = index(rng);
+        if (l > r) std::swap(l, r);
+        if (round % 2 == 0) {
+            long long delta = static_cast<long long>(rng() % 201) - 100;
+            segment.rangeAdd(l, r, delta);
+            fenwick.rangeAdd(l, r, delta);
+            for (size_t i = l; i <= r; ++i) values[i] += delta;
+        } else {
+            long long sum = 0, low = LazySegmentTree::NO_MIN;
+            for (size_t i = l; i <= r; ++i) {
+                sum += values[i];
+                low = std::min(low, values[i]);
+            }
+            LazySegmentTree::Result result = segment.query(l, r);
+            ok = ok && result.sum == sum && result.min == low && fenwick.rangeSum(l, r) == sum;
+        }
+    }
+
+    std::cout << std::fixed;
+    std::cout.precision(1);
+    std::cout << "n=" << n << " build segment " << segmentMs << " ms, Fenwick " << fenwickMs << " ms"
+              << (ok ? "" : "   WRONG RESULTS") << std::endl;
+    std::cout << "threads  segment_Mq/s  fenwick_Mq/s" << std::endl;
+    std::vector<int> counts = {1};
+    if (static_cast<int>(threads) > 1) counts.push_back(static_cast<int>(threads));
+    for (int t : counts) {
+        RangeBatchResult result = runRangeQueries(segment, fenwick, static_cast<size_t>(queries), t);
+        ok = ok && result.agree;
+        std::cout << std::setw(7) << result.threads << std::setw(14) << result.segmentPerSecond / 1e6 << std::setw(14)
+                  << result.fenwickPerSecond / 1e6 << (result.agree ? "" : "   RESULTS DIFFER") << std::endl;
+    }
+    return ok ? 0 : 1;
+}
+
+// Integers anywhere in the text, parsed in place with std::from_chars. Anything that is
+// not part of a number separates tokens; numbers that overflow an int are skipped.
+inline void parseInts(const std::string& text, std::vector<int>& out) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        if (!(*p >= '0' && *p <= '9') && !(*p == '-' && p + 1 < end && p[1] >= '0' && p[1] <= '9')) {
+            ++p;
+            continue;
+        }
+        int value;
+        auto result = std::from_chars(p, end, value);
+        if (result.ec == std::errc()) out.push_back(value);
+        p = result.ptr;
+        while (p < end && *p >= '0' && *p <= '9') ++p; // rest of an out-of-range number
+    }
+}
+
+// Runs of letters and digits, for the trie
+inline void parseWords(const std::string& text, std::vector<std::string>& out) {
+    size_t i = 0;
+    while (i < text.size()) {
+        while (i < text.size() && !std::isalnum(static_cast<unsigned char>(text[i]))) ++i;
+        size_t start = i;
+        while (i < text.size() && std::isalnum(static_cast<unsigned char>(text[i]))) ++i;
+        if (i > start) out.emplace_back(text, start, i - start);
+    }
+}
+
+// First integer in the text, for search
+inline bool parseFirstInt(const std::string& text, int& value) {
+    std::vector<int> values;
+    parseInts(text, values);
+    if (values.empty()) return false;
+    value = values.front();
+    return true;
+}
+
+// Zipf-distributed ranks 1..n with exponent s, drawn in O(1) by rejection-inversion
+// (Hörmann and Derflinger) instead of a table of n probabilities
+class ZipfGenerator {
+public:
+    ZipfGenerator(size_t n, double s) : count(std::max<size_t>(1, n)), exponent(std::max(1e-6, s)) {
+        integralFirst = hIntegral(1.5) - 1;
+        integralLast = hIntegral(count + 0.5);
+        threshold = 2 - hIntegralInverse(hIntegral(2.5) - h(2));
+    }
+
+    template <typename Rng>
+    size_t operator()(Rng& rng) {
+        std::uniform_real_distribution<double> uniform(0, 1);
+        while (true) {
+            double u = integralLast + uniform(rng) * (integralFirst - integralLast);
+            double x = hIntegralInverse(u);
+            double k = std::clamp(std::floor(x + 0.5), 1.0, static_cast<double>(count));
+            if (k - x <= threshold || u >= hIntegral(k + 0.5) - h(k)) return static_cast<size_t>(k);
+        }
+    }
+
+private:
+    size_t count;
+    double exponent;
+    double integralFirst, integralLast, threshold;
+
+    double h(double x) const {
+        return std::exp(-exponent * std::log(x));
+    }
+
+    double hIntegral(double x) const {
+        double logX = std::log(x);
+        return expm1OverX((1 - exponent) * logX) * logX;
+    }
+
+    double hIntegralInverse(double x) const {
+        double t = std::max(-1.0, x * (1 - exponent));
+        return std::exp(log1pOverX(t) * x);
+    }
+
+    static double expm1OverX(double x) {
+        return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1 + x / 2;
+    }
+
+    static double log1pOverX(double x) {
+        return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1 - x / 2;
+    }
+};
+
+// Doubly linked lists threaded through one pool of nodes by index. A node knows which
+// list it is on, so moving it between lists is O(1) and never allocates.
+class CacheListPool {
+public:
+    struct Node {
+        int key = 0;
+        int prev = -1;
+        int next = -1;
+        int list = -1;
+    };
+
+    struct List {
+        int head = -1;      // most recently used
+        int tail = -1;      // least recently used
+        size_t size = 0;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<List> lists;
+    std::vector<int> freeNodes;
+
+    void reset(size_t listCount) {
+        nodes.clear();
+        freeNodes.clear();
+        lists.assign(listCount, List());
+    }
+
+    int allocate(int key) {
+        int node;
+        if (!freeNodes.empty()) {
+            node = freeNodes.back();
+            freeNodes.pop_back();
+        } else {
+            node = static_cast<int>(nodes.size());
+            nodes.emplace_back();
+        }
+        nodes[node] = Node();
+        nodes[node].key = key;
+        return node;
+    }
+
+    void release(int node) {
+        unlink(node);
+        freeNodes.push_back(node);
+    }
+
+    void moveToFront(int list, int node) {
+        unlink(node);
+        Node& n = nodes[node];
+        List& l = lists[list];
+        n.list = list;
+        n.next = l.head;
+        if (l.head >= 0) nodes[l.head].prev = node;
+        l.head = node;
+        if (l.tail < 0) l.tail = node;
+        ++l.size;
+    }
+
+    void unlink(int node) {
+        Node& n = nodes[node];
+        if (n.list < 0) return;
+        List& l = lists[n.list];
+        if (n.prev >= 0) nodes[n.prev].next = n.next;
+        else l.head = n.next;
+        if (n.next >= 0) nodes[n.next].prev = n.prev;
+        else l.tail = n.prev;
+        --l.size;
+        n.prev = n.next = n.list = -1;
+    }
+
+    // Keys of a list from the most recently used, at most limit
+    void keys(int list, size_t limit, std::vector<int>& out) const {
+        out.clear();
+        for (int node = lists[list].head; node >= 0 && out.size() < limit; node = nodes[node].next) out.push_back(nodes[node].key);
+    }
+};
+
+struct CacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+};
+
+// Least recently used: a Swiss table from key to list node, and one list in use order
+class LruCache {
+public:
+    size_t capacity = 1;
+    SwissHashTable index;
+    CacheListPool pool;
+    CacheStats stats;
+
+    void reset(size_t newCapacity) {
+        capacity = std::max<size_t>(1, newCapacity);
+        index.reset();
+        pool.reset(1);
+        stats = CacheStats();
+    }
+
+    bool access(int key) {
+        long long slot = index.find(key);
+        if (slot >= 0) {
+            pool.moveToFront(0, index.values[slot]);
+            ++stats.hits;
+            return true;
+        }
+        ++stats.misses;
+        if (pool.lists[0].size == capacity) {
+            int victim = pool.lists[0].tail;
+            index.erase(pool.nodes[victim].key);
+            pool.release(victim);
+            ++stats.evictions;
+        }
+        int node = pool.allocate(key);
+        pool.moveToFront(0, node);
+        index.insert(key, node);
+        return false;
+    }
+
+    bool contains(int key) const {
+        return index.find(key) >= 0;
+    }
+};
+
+// CLOCK: frames in a ring with a referenced bit each. A hit only sets the bit; on a miss
+// the hand clears bits until it finds a frame that was not referenced since its last pass.
+class ClockCache {
+public:
+    size_t capacity = 1;
+    SwissHashTable index;                  // key to frame
+    std::vector<int> frames;
+    std::vector<unsigned char> referenced;
+    size_t hand = 0;
+    CacheStats stats;
+
+    void reset(size_t newCapacity) {
+        capacity = std::max<size_t>(1, newCapacity);
+        index.reset();
+        frames.clear();
+        referenced.clear();
+        hand = 0;
+        stats = CacheStats();
+    }
+
+    bool access(int key) {
+        long long slot = index.find(key);
+        if (slot >= 0) {
+            referenced[index.values[slot]] = 1;
+            ++stats.hits;
+            return true;
+        }
+        ++stats.misses;
+        size_t frame;
+        if (frames.size() < capacity) {
+            frame = frames.size();
+            frames.push_back(key);
+            referenced.push_back(0);
+        } else {
+            while (referenced[hand]) {
+                referenced[hand] = 0;
+                hand = (hand + 1) % capacity;
+            }
+            frame = hand;
+            hand = (hand + 1) % capacity;
+            index.erase(frames[frame]);
+            frames[frame] = key;
+            ++stats.evictions;
+        }
+        referenced[frame] = 1;
+        index.insert(key, static_cast<int>(frame));
+        return false;
+    }
+
+    bool contains(int key) const {
+        return index.find(key) >= 0;
+    }
+};
+
+// ARC (Megiddo and Modha): T1 holds pages seen once recently, T2 pages seen at least
+// twice, and the ghost lists B1 and B2 remember the keys just evicted from each. A hit
+// on a ghost moves the target size of T1 towards whichever side it came from, so the
+// cache adapts between recency and frequency without a tuning parameter.
+class ArcCache {
+public:
+    enum ListId { T1, T2, B1, B2, LIST_COUNT };
+
+    size_t capacity = 1;
+    size_t target = 0;          // p, the size T1 is steered towards
+    SwissHashTable index;       // key to node, ghosts included
+    CacheListPool pool;
+    CacheStats stats;
+
+    void reset(size_t newCapacity) {
+        capacity = std::max<size_t>(1, newCapacity);
+        target = 0;
+        index.reset();
+        pool.reset(LIST_COUNT);
+        stats = CacheStats();
+    }
+
+    bool access(int key) {
+        long long slot = index.find(key);
+        int node = slot >= 0 ? index.values[slot] : -1;
+        int list = node >= 0 ? pool.nodes[node].list : -1;
+        if (list == T1 || list == T2) {
+            pool.moveToFront(T2, node);
+            ++stats.hits;
+            return true;
+        }
+
+        ++stats.misses;
+        size_t t1 = size(T1), t2 = size(T2), b1 = size(B1), b2 = size(B2);
+        if (list == B1) {
+            target = std::min(capacity, target + std::max<size_t>(1, b2 / b1));
+            replace(false);
+            pool.moveToFront(T2, node);
+            return false;
+        }
+        if (list == B2) {
+            size_t delta = std::max<size_t>(1, b1 / b2);
+            target = target > delta ? target - delta : 0;
+            replace(true);
+            pool.moveToFront(T2, node);
+            return false;
+        }
+
+        if (t1 + b1 == capacity) {
+            if (t1 < capacity) {
+                drop(B1);
+                replace(false);
+            } else {
+                drop(T1);
+                ++stats.evictions;
+            }
+        } else if (t1 + t2 + b1 + b2 >= capacity) {
+            if (t1 + t2 + b1 + b2 == 2 * capacity) drop(B2);
+            replace(false);
+        }
+        int fresh = pool.allocate(key);
+        pool.moveToFront(T1, fresh);
+        index.insert(key, fresh);
+        return false;
+    }
+
+    bool contains(int key) const {
+        long long slot = index.find(key);
+        if (slot < 0) return false;
+        int list = pool.nodes[index.values[slot]].list;
+        return list == T1 || list == T2;
+    }
+
+    size_t size(int list) const {
+        return pool.lists[list].size;
+    }
+
+private:
+    // Evicts the least recently used page of T1 or T2 into its ghost list
+    void replace(bool hitInB2) {
+        size_t t1 = size(T1);
+        bool fromT1 = t1 > 0 && (t1 > target || (hitInB2 && t1 == target) || size(T2) == 0);
+        if (fromT1) pool.moveToFront(B1, pool.lists[T1].tail);
+        else pool.moveToFront(B2, pool.lists[T2].tail);
+        ++stats.evictions;
+    }
+
+    void drop(int list) {
+        int node = pool.lists[list].tail;
+        index.erase(pool.nodes[node].key);
+        pool.release(node);
+    }
+};
+
+// Replays one access trace through all three policies. Each policy runs the same slice
+// of the trace in turn, so each slice is timed on its own. Every `window` accesses the
+// window's hit ratios, the evictions so far and the mean time per access are sampled.
+class CacheSimulator {
+public:
+    static constexpr int POLICY_COUNT = 3;
+    static constexpr size_t HISTORY_SAMPLES = 200;
+
+    struct Sample {
+        double hitRatio[POLICY_COUNT];
+        double evictions[POLICY_COUNT];
+        double nsPerAccess[POLICY_COUNT];
+    };
+
+    LruCache lru;
+    ClockCache clock;
+    ArcCache arc;
+    std::vector<int> trace;
+    size_t position = 0;
+    size_t capacity = 16;
+    RingBuffer<Sample> history;
+
+    static const char* policyName(int policy) {
+        static const char* names[] = {"LRU", "CLOCK", "ARC"};
+        return names[policy];
+    }
+
+    const CacheStats& stats(int policy) const {
+        return policy == 0 ? lru.stats : policy == 1 ? clock.stats : arc.stats;
+    }
+
+    // Empties the caches and starts the trace over
+    void restart() {
+        lru.reset(capacity);
+        clock.reset(capacity);
+        arc.reset(capacity);
+        position = 0;
+        history.clear();
+        windowCount = 0;
+        std::fill(std::begin(windowHits), std::end(windowHits), 0);
+        std::fill(std::begin(windowNs), std::end(windowNs), 0);
+        updateWindow();
+    }
+
+    void setCapacity(size_t newCapacity) {
+        capacity = std::max<size_t>(1, newCapacity);
+        restart();
+    }
+
+    void append(const std::vector<int>& keys) {
+        trace.insert(trace.end(), keys.begin(), keys.end());
+        updateWindow();
+    }
+
+    // count accesses over keys 0..keys-1, rank r having weight 1 / r^skew
+    void generateZipf(size_t count, size_t keys, double skew, unsigned int seed = 1) {
+        TRACE_SCOPE("zipf trace");
+        ZipfGenerator zipf(std::min<size_t>(keys, std::numeric_limits<int>::max()), skew);
+        std::mt19937_64 rng(seed);
+        trace.resize(count);
+        for (int& key : trace) key = static_cast<int>(zipf(rng) - 1);
+        restart();
+    }
+
+    bool finished() const {
+        return position >= trace.size();
+    }
+
+    void replay(size_t count) {
+        TRACE_SCOPE("cache replay");
+        count = std::min(count, trace.size() - position);
+        while (count > 0) {
+            size_t chunk = std::min(count, window - windowCount);
+            const int* keys = trace.data() + position;
+            timeSlice(lru, 0, keys, chunk);
+            timeSlice(clock, 1, keys, chunk);
+            timeSlice(arc, 2, keys, chunk);
+            position += chunk;
+            count -= chunk;
+            windowCount += chunk;
+            if (windowCount == window || position == trace.size()) closeWindow();
+        }
+    }
+
+    size_t bytes(int policy) const {
+        if (policy == 0) return lru.index.bytes() + lru.pool.nodes.capacity() * sizeof(CacheListPool::Node);
+        if (policy == 1) return clock.index.bytes() + clock.frames.capacity() * (sizeof(int) + 1);
+        return arc.index.bytes() + arc.pool.nodes.capacity() * sizeof(CacheListPool::Node);
+    }
+
+private:
+    size_t window = 1;
+    size_t windowCount = 0;
+    size_t windowHits[POLICY_COUNT] = {};
+    double windowNs[POLICY_COUNT] = {};
+
+    // Enough accesses per sample that the whole trace fits in the history
+    void updateWindow() {
+        window = std::max<size_t>(1, (trace.size() + HISTORY_SAMPLES - 1) / HISTORY_SAMPLES);
+        if (windowCount >= window) closeWindow();
+    }
+
+    template <typename Cache>
+    void timeSlice(Cache& cache, int policy, const int* keys, size_t count) {
+        auto start = std::chrono::steady_clock::now();
+        size_t hits = 0;
+        for (size_t i = 0; i < count; ++i) hits += cache.access(keys[i]);
+        windowNs[policy] += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        windowHits[policy] += hits;
+    }
+
+    void closeWindow() {
+        if (windowCount == 0) return;
+        Sample sample;
+        for (int policy = 0; policy < POLICY_COUNT; ++policy) {
+            sample.hitRatio[policy] = static_cast<double>(windowHits[policy]) / windowCount;
+            sample.evictions[policy] = static_cast<double>(stats(policy).evictions);
+            sample.nsPerAccess[policy] = windowNs[policy] / windowCount;
+            windowHits[policy] = 0;
+            windowNs[policy] = 0;
+        }
+        if (history.size() == HISTORY_SAMPLES) history.pop_front();
+        history.push_back(sample);
+        windowCount = 0;
+    }
+};
+
+// The three caches as lists drawn the way the queue page draws its nodes (LRU and ARC's
+// lists from the most recently used, CLOCK's frames in ring order with the hand), and
+// plots of hit ratio per window, evictions and time per access as the trace replays
+class CacheVisualizer {
+public:
+    CacheSimulator simulator;
+    bool playing = false;
+    long long highlighted = std::numeric_limits<long long>::min();
+    std::string lastAction;
+
+    sf::Font font;
+    BatchRenderer batch;
+    sf::CircleShape nodeShape;
+    NodeLabel nodeText;
+    NodeLabel rowText;
+    sf::RectangleShape arrow;
+    sf::RectangleShape handMarker;
+    sf::Text statusText;
+    sf::Text plotText;
+    std::vector<int> rowKeys;
+
+    static constexpr size_t VISIBLE_NODES = 20;
+    static constexpr float ROW_X = 290, NODE_SPACING = 54;
+    static constexpr int DEFAULT_ZIPF = 100000;         // accesses when the Zipf input is empty
+    static constexpr size_t MAX_ZIPF = 100000000;
+    const sf::Color policyColors[CacheSimulator::POLICY_COUNT] = {sf::Color::Cyan, sf::Color::Yellow, sf::Color::Magenta};
+    const sf::Color nodeColors[CacheSimulator::POLICY_COUNT] = {sf::Color(0, 140, 160), sf::Color(160, 140, 0), sf::Color(150, 0, 150)};
+
+    CacheVisualizer() {
+        TRACE_SCOPE("load font");
+        if (!font.loadFromFile("arial.ttf")) {
+            std::cerr << "Error loading font!" << std::endl;
+        }
+        nodeShape.setRadius(16);
+        nodeShape.setOutlineThickness(2);
+        nodeShape.setOutlineColor(sf::Color::White);
+        nodeText.setFont(font);
+        nodeText.setCharacterSize(11);
+        nodeText.setFillColor(sf::Color::White);
+        nodeText.setStyle(sf::Text::Bold);
+        rowText.setFont(font);
+        rowText.setCharacterSize(15);
+        rowText.setFillColor(sf::Color::White);
+        arrow.setSize(sf::Vector2f(12, 2));
+        arrow.setFillColor(sf::Color::White);
+        handMarker.setSize(sf::Vector2f(32, 4));
+        handMarker.setFillColor(sf::Color(255, 140, 0));
+        statusText.setFont(font);
+        statusText.setCharacterSize(16);
+        statusText.setFillColor(sf::Color::White);
+        statusText.setPosition(150, 212);
+        plotText.setFont(font);
+        plotText.setCharacterSize(15);
+        plotText.setFillColor(sf::Color::White);
+        simulator.restart();
+    }
+
+    // Pasted keys are appended to the trace and played
+    void insertBatch(const std::vector<int>& keys) {
+        simulator.append(keys);
+        playing = !keys.empty();
+    }
+
+    // "count keys [skew percent]"
+    void generateZipf(const std::vector<int>& values) {
+        size_t count = values.size() > 0 && values[0] > 0 ? static_cast<size_t>(values[0]) : DEFAULT_ZIPF;
+        if (count > MAX_ZIPF) {
+            std::cout << "Zipf traces on this page hold at most " << MAX_ZIPF << " accesses." << std::endl;
+            return;
+        }
+        size_t keys = values.size() > 1 && values[1] > 0 ? static_cast<size_t>(values[1]) : std::max<size_t>(1, count / 10);
+        double skew = values.size() > 2 && values[2] > 0 ? values[2] / 100.0 : 0.9;
+        simulator.generateZipf(count, keys, skew);
+        lastAction = "Zipf trace: " + std::to_string(count) + " accesses over " + std::to_string(keys) + " keys, skew "
+                   + std::to_string(skew).substr(0, 4);
+        playing = true;
+    }
+
+    // The rest of the trace at full speed
+    void finish() {
+        simulator.replay(simulator.trace.size() - simulator.position);
+        playing = false;
+    }
+
+    void setCapacity(int capacity) {
+        if (capacity <= 0) {
+            std::cout << "Capacity must be positive." << std::endl;
+            return;
+        }
+        simulator.setCapacity(static_cast<size_t>(capacity));
+        lastAction = "Capacity " + std::to_string(capacity) + ", trace restarted";
+    }
+
+    void search(int key) {
+        highlighted = key;
+        lastAction = "Key " + std::to_string(key) + ":";
+        lastAction += simulator.lru.contains(key) ? " in LRU" : " not in LRU";
+        lastAction += simulator.clock.contains(key) ? ", in CLOCK" : ", not in CLOCK";
+        lastAction += simulator.arc.contains(key) ? ", in ARC" : ", not in ARC";
+    }
+
+    void reset() {
+        simulator.trace.clear();
+        simulator.restart();
+        playing = false;
+        highlighted = std::numeric_limits<long long>::min();
+        lastAction.clear();
+    }
+
+    // Whitespace-separated integer keys, one access each
+    void loadTrace(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            std::cerr << "Cannot open trace " << path << std::endl;
+            return;
+        }
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::vector<int> keys;
+        parseInts(text, keys);
+        simulator.trace.swap(keys);
+        simulator.restart();
+        lastAction = "Loaded " + std::to_string(simulator.trace.size()) + " accesses from " + path;
+        playing = true;
+    }
+
+    void saveTrace(const std::string& path) {
+        std::ofstream out(path);
+        for (int key : simulator.trace) out << key << '\n';
+        if (!out) std::cerr << "Error writing trace " << path << std::endl;
+    }
+
+    void togglePlaying() {
+        playing = !playing && !simulator.finished();
+    }
+
+    // About ten seconds for the whole trace, one access per frame at the least
+    void update() {
+        if (!playing) return;
+        simulator.replay(std::max<size_t>(1, simulator.trace.size() / 600));
+        if (simulator.finished()) playing = false;
+    }
+
+    void draw(sf::RenderTarget& target) {
+        float y = 250;
+        simulator.lru.pool.keys(0, VISIBLE_NODES, rowKeys);
+        drawList(target, "LRU", y, rowKeys, simulator.lru.pool.lists[0].size, nodeColors[0]);
+        drawClock(target, y + 55);
+        simulator.arc.pool.keys(ArcCache::T1, VISIBLE_NODES, rowKeys);
+        drawList(target, "ARC T1", y + 110, rowKeys, simulator.arc.size(ArcCache::T1), nodeColors[2]);
+        simulator.arc.pool.keys(ArcCache::T2, VISIBLE_NODES, rowKeys);
+        drawList(target, "ARC T2", y + 165, rowKeys, simulator.arc.size(ArcCache::T2), nodeColors[2]);
+
+        sf::Vector2f plotSize(380, 130);
+        const RingBuffer<CacheSimulator::Sample>& history = simulator.history;
+        for (int policy = 0; policy < CacheSimulator::POLICY_COUNT; ++policy) {
+            sf::Color color = policyColors[policy];
+            addSeriesPlot(batch, history, CacheSimulator::HISTORY_SAMPLES, sf::Vector2f(150, 480), plotSize,
+                          [policy](const CacheSimulator::Sample& s) { return s.hitRatio[policy]; }, color, 1.0);
+            addSeriesPlot(batch, history, CacheSimulator::HISTORY_SAMPLES, sf::Vector2f(610, 480), plotSize,
+                          [policy](const CacheSimulator::Sample& s) { return s.evictions[policy]; }, color,
+                          history.empty() ? 0 : maxEvictions() * 1.1);
+            addSeriesPlot(batch, history, CacheSimulator::HISTORY_SAMPLES, sf::Vector2f(1070, 480), plotSize,
+                          [policy](const CacheSimulator::Sample& s) { return s.nsPerAccess[policy]; }, color,
+                          history.empty() ? 0 : maxNs() * 1.1);
+        }
+        batch.flush(target);
+
+        std::ostringstream out;
+        out.setf(std::ios::fixed);
+        out.precision(1);
+        out << "Trace " << simulator.position << " / " << simulator.trace.size() << "   capacity " << simulator.capacity
+            << "   ARC target T1 " << simulator.arc.target << "   " << lastAction;
+        statusText.setString(out.str());
+        target.draw(statusText);
+
+        std::string hits = "Hit ratio", evictions = "Evictions", latency = "ns per access";
+        for (int policy = 0; policy < CacheSimulator::POLICY_COUNT; ++policy) {
+            const CacheStats& stats = simulator.stats(policy);
+            size_t accesses = stats.hits + stats.misses;
+            std::ostringstream ratio;
+            ratio.setf(std::ios::fixed);
+            ratio.precision(1);
+            ratio << (accesses ? 100.0 * stats.hits / accesses : 0.0);
+            hits += std::string("  ") + CacheSimulator::policyName(policy) + " " + ratio.str() + "%";
+            evictions += std::string("  ") + CacheSimulator::policyName(policy) + " " + QueueVisualizer::formatRate(static_cast<double>(stats.evictions));
+            latency += std::string("  ") + CacheSimulator::policyName(policy) + " "
+                     + (history.empty() ? std::string("-") : QueueVisualizer::formatRate(history[history.size() - 1].nsPerAccess[policy]));
+        }
+        drawPlotText(target, sf::Vector2f(150, 615), hits);
+        drawPlotText(target, sf::Vector2f(610, 615), evictions);
+        drawPlotText(target, sf::Vector2f(1070, 615), latency);
+    }
+
+private:
+    double maxEvictions() const {
+        double peak = 0;
+        for (int policy = 0; policy < CacheSimulator::POLICY_COUNT; ++policy) peak = std::max(peak, simulator.history[simulator.history.size() - 1].evictions[policy]);
+        return peak;
+    }
+
+    double maxNs() const {
+        double peak = 0;
+        for (size_t i = 0; i < simulator.history.size(); ++i) {
+            for (int policy = 0; policy < CacheSimulator::POLICY_COUNT; ++policy) peak = std::max(peak, simulator.history[i].nsPerAccess[policy]);
+        }
+        return peak;
+    }
+
+    void drawRowTitle(const std::string& title, float y, size_t size) {
+        rowText.setString(title);
+        rowText.setPosition(150, y + 6);
+        batch.addLabel(rowText);
+        if (size > VISIBLE_NODES) {
+            rowText.setString("+" + std::to_string(size - VISIBLE_NODES));
+            rowText.setPosition(ROW_X + VISIBLE_NODES * NODE_SPACING, y + 6);
+            batch.addLabel(rowText);
+        }
+    }
+
+    void drawList(sf::RenderTarget& target, const std::string& title, float y, const std::vector<int>& keys, size_t size, sf::Color color) {
+        drawRowTitle(title, y, size);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            nodeShape.setFillColor(keys[i] == highlighted ? sf::Color(255, 140, 0) : color);
+            nodeText.setString(std::to_string(keys[i]));
+            addChainNode(batch, nodeShape, nodeText, arrow, sf::Vector2f(ROW_X + i * NODE_SPACING, y), i + 1 < keys.size());
+        }
+        batch.flush(target);
+    }
+
+    // Frames in ring order; referenced frames are bright, the hand is underlined
+    void drawClock(sf::RenderTarget& target, float y) {
+        const ClockCache& clock = simulator.clock;
+        drawRowTitle("CLOCK", y, clock.frames.size());
+        size_t first = clock.frames.size() > VISIBLE_NODES && clock.hand >= VISIBLE_NODES / 2
+                     ? std::min(clock.hand - VISIBLE_NODES / 2, clock.frames.size() - VISIBLE_NODES) : 0;
+        size_t end = std::min(clock.frames.size(), first + VISIBLE_NODES);
+        for (size_t frame = first; frame < end; ++frame) {
+            float x = ROW_X + (frame - first) * NODE_SPACING;
+            sf::Color color = clock.referenced[frame] ? nodeColors[1] : sf::Color(90, 90, 90);
+            nodeShape.setFillColor(clock.frames[frame] == highlighted ? sf::Color(255, 140, 0) : color);
+            nodeText.setString(std::to_string(clock.frames[frame]));
+            addChainNode(batch, nodeShape, nodeText, arrow, sf::Vector2f(x, y), frame + 1 < end);
+            if (frame == clock.hand) {
+                handMarker.setPosition(x, y + 38);
+                batch.addRect(handMarker);
+            }
+        }
+        batch.flush(target);
+    }
+
+    void drawPlotText(sf::RenderTarget& target, sf::Vector2f position, const std::string& text) {
+        plotText.setString(text);
+        plotText.setPosition(position);
+        target.draw(plotText);
+    }
+};
+
+// --cache-bench [trace file] [capacity ...]: replays a trace of integer keys, or a Zipf
+// trace of 1e7 accesses over 1e6 keys (skew 0.9), through LRU, CLOCK and ARC at each
+// capacity (default 1e3, 1e4 and 1e5) and reports hit ratio, evictions and time per access
+inline int runCacheBenchmark(std::istream& args) {
+    std::vector<std::string> words;
+    std::string word;
+    while (args >> word) words.push_back(word);
+
+    CacheSimulator simulator;
+    size_t first = 0;
+    if (!words.empty() && !std::isdigit(static_cast<unsigned char>(words[0][0]))) {
+        std::ifstream in(words[0], std::ios::binary);
+        if (!in) {
+            std::cerr << "Cannot open trace " << words[0] << std::endl;
+            return 1;
+        }
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        parseInts(text, simulator.trace);
+        first = 1;
+        std::cout << words[0] << ": " << simulator.trace.size() << " accesses" << std::endl;
+    } else {
+        simulator.generateZipf(10000000, 1000000, 0.9);
+        std::cout << "Zipf trace: 10000000 accesses over 1000000 keys, skew 0.9" << std::endl;
+    }
+    std::vector<size_t> capacities;
+    for (size_t i = first; i < words.size(); ++i) capacities.push_back(static_cast<size_t>(std::max(1.0, std::atof(words[i].c_str()))));
+    if (capacities.empty()) capacities = {1000, 10000, 100000};
+
+    std::cout << std::fixed;
+    std::cout.precision(2);
+    std::cout << "capacity  policy    hit%    evictions  ns/access      memory" << std::endl;
+    for (size_t capacity : capacities) {
+        simulator.setCapacity(capacity);
+        double ns[CacheSimulator::POLICY_COUNT] = {};
+        while (!simulator.finished()) {
+            simulator.replay(simulator.trace.size());
+        }
+        // Time per access over the whole trace, from the sampled windows
+        for (size_t i = 0; i < simulator.history.size(); ++i) {
+            for (int policy = 0; policy < CacheSimulator::POLICY_COUNT; ++policy) ns[policy] += simulator.history[i].nsPerAccess[policy];
+        }
+        for (int policy = 0; policy < CacheSimulator::POLICY_COUNT; ++policy) {
+            const CacheStats& stats = simulator.stats(policy);
+            size_t accesses = std::max<size_t>(1, stats.hits + stats.misses);
+            std::cout << std::setw(8) << capacity << "  " << std::left << std::setw(6) << CacheSimulator::policyName(policy) << std::right
+                      << std::setw(8) << 100.0 * stats.hits / accesses << std::setw(13) << stats.evictions
+                      << std::setw(11) << ns[policy] / std::max<size_t>(1, simulator.history.size())
+                      << std::setw(12) << TimelineSlider::formatBytes(simulator.bytes(policy)) << std::endl;
+        }
+    }
+    return 0;
+}
+
+// 64-bit finalizer (splitmix64): every input bit reaches every output bit
+inline uint64_t mixKey(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ULL;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBULL;
+    return key ^ (key >> 31);
+}
+
+inline void prefetchLine(const void* address) {
+#if defined(__SSE2__) || defined(_M_X64)
+    _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+    (void)address;
+#endif
+}
+
+// Split-block Bloom filter: a key picks one 32-byte block, so one cache line, and sets
+// one bit in each of the block's eight 32-bit words, chosen by multiplying the hash by a
+// different odd constant per word. A lookup builds the eight masks and tests the whole
+// block with two SSE2 compares.
+class BlockedBloomFilter {
+public:
+    struct alignas(32) Block {
+        uint32_t words[8];
+    };
+
+    std::vector<Block> blocks;
+    size_t count = 0;
+
+    void reset(size_t expected, double bitsPerKey) {
+        size_t bits = static_cast<size_t>(std::max<double>(256, expected * bitsPerKey));
+        blocks.assign((bits + 255) / 256, Block{});
+        count = 0;
+    }
+
+    void insert(uint64_t key) {
+        uint64_t hash = mixKey(key);
+        Block& block = blocks[blockOf(hash)];
+        uint32_t masks[8];
+        makeMasks(static_cast<uint32_t>(hash), masks);
+        for (int i = 0; i < 8; ++i) block.words[i] |= masks[i];
+        ++count;
+    }
+
+    bool contains(uint64_t key) const {
+        uint64_t hash = mixKey(key);
+        return test(blocks[blockOf(hash)], static_cast<uint32_t>(hash));
+    }
+
+    // Hashes a run of keys first and prefetches each block a few keys ahead of its test
+    size_t containsMany(const uint64_t* keys, size_t n) const {
+        const size_t AHEAD = 8;
+        uint64_t hashes[AHEAD];
+        size_t found = 0;
+        for (size_t i = 0; i < n + AHEAD; ++i) {
+            if (i >= AHEAD) {
+                uint64_t hash = hashes[i % AHEAD];
+                found += test(blocks[blockOf(hash)], static_cast<uint32_t>(hash));
+            }
+            if (i < n) {
+                hashes[i % AHEAD] = mixKey(keys[i]);
+                prefetchLine(&blocks[blockOf(hashes[i % AHEAD])]);
+            }
+        }
+        return found;
+    }
+
+    void insertMany(const uint64_t* keys, size_t n) {
+        const size_t AHEAD = 8;
+        uint64_t hashes[AHEAD];
+        for (size_t i = 0; i < n + AHEAD; ++i) {
+            if (i >= AHEAD) {
+                uint64_t hash = hashes[i % AHEAD];
+                Block& block = blocks[blockOf(hash)];
+                uint32_t masks[8];
+                makeMasks(static_cast<uint32_t>(hash), masks);
+                for (int j = 0; j < 8; ++j) block.words[j] |= masks[j];
+            }
+            if (i < n) {
+                hashes[i % AHEAD] = mixKey(keys[i]);
+                prefetchLine(&blocks[blockOf(hashes[i % AHEAD])]);
+            }
+        }
+        count += n;
+    }
+
+    size_t blockOf(uint64_t hash) const {
+        return static_cast<size_t>(((hash >> 32) * blocks.size()) >> 32);
+    }
+
+    static void makeMasks(uint32_t hash, uint32_t masks[8]) {
+        static const uint32_t SALTS[8] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                          0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+        for (int i = 0; i < 8; ++i) masks[i] = 1u << ((hash * SALTS[i]) >> 27);
+    }
+
+    static bool test(const Block& block, uint32_t hash) {
+        alignas(16) uint32_t masks[8];
+        makeMasks(hash, masks);
+#if defined(__SSE2__) || defined(_M_X64)
+        __m128i low = _mm_load_si128(reinterpret_cast<const __m128i*>(masks));
+        __m128i high = _mm_load_si128(reinterpret_cast<const __m128i*>(masks + 4));
+        __m128i blockLow = _mm_load_si128(reinterpret_cast<const __m128i*>(block.words));
+        __m128i blockHigh = _mm_load_si128(reinterpret_cast<const __m128i*>(block.words + 4));
+        __m128i hits = _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(blockLow, low), low),
+                                     _mm_cmpeq_epi32(_mm_and_si128(blockHigh, high), high));
+        return _mm_movemask_epi8(hits) == 0xFFFF;
+#else
+        for (int i = 0; i < 8; ++i) {
+            if ((block.words[i] & masks[i]) != masks[i]) return false;
+        }
+        return true;
+#endif
+    }
+
+    // Blocks get a Poisson number of keys; a block with i keys has each word's chosen
+    // bit set with probability 1 - (31/32)^i
+    double theoreticalRate() const {
+        if (blocks.empty()) return 0;
+        double lambda = static_cast<double>(count) / blocks.size();
+        double rate = 0;
+        double poisson = std::exp(-lambda);
+        int last = static_cast<int>(lambda + 10 * std::sqrt(lambda) + 20);
+        for (int i = 0; i <= last; ++i) {
+            if (i > 0) poisson *= lambda / i;
+            rate += poisson * std::pow(1 - std::pow(31.0 / 32, i), 8);
+        }
+        return rate;
+    }
+
+    size_t bytes() const {
+        return blocks.size() * sizeof(Block);
+    }
+};
+
+// Cuckoo filter (Fan et al.): buckets of four 16-bit fingerprints. A key may live in
+// bucket i or in (hash(fingerprint) - i) mod n, so either bucket can be found from the
+// other when a fingerprint is kicked out. Unlike i ^ hash this works for any bucket
+// count, so the table is sized to the keys instead of the next power of two. A lookup
+// compares both buckets at once with SSE2. Unlike the Bloom filter it can delete.
+class CuckooFilter {
+public:
+    static const int SLOTS = 4;
+    static const int MAX_KICKS = 500;
+
+    std::vector<uint16_t> slots;     // 0 is empty
+    size_t bucketCount = 1;
+    size_t count = 0;
+    size_t failures = 0;             // inserts dropped because the filter was full
+    uint16_t victim = 0;             // a fingerprint that lost its place, with its bucket
+    size_t victimBucket = 0;
+    std::mt19937 rng{7};
+
+    // Enough buckets for the expected keys at 95% full
+    void reset(size_t expected) {
+        bucketCount = std::max<size_t>(2, static_cast<size_t>(std::ceil(expected / (SLOTS * 0.95))));
+        slots.assign(bucketCount * SLOTS, 0);
+        count = failures = 0;
+        victim = 0;
+    }
+
+    bool insert(uint64_t key) {
+        if (victim) {
+            ++failures;
+            return false;
+        }
+        uint64_t hash = mixKey(key);
+        uint16_t fingerprint = fingerprintOf(hash);
+        size_t bucket = bucketOfHash(hash);
+        if (place(bucket, fingerprint) || place(alternate(bucket, fingerprint), fingerprint)) {
+            ++count;
+            return true;
+        }
+        // Both full: evict random entries along the chain of alternate buckets
+        if (rng() & 1) bucket = alternate(bucket, fingerprint);
+        for (int kick = 0; kick < MAX_KICKS; ++kick) {
+            std::swap(fingerprint, slots[bucket * SLOTS + rng() % SLOTS]);
+            bucket = alternate(bucket, fingerprint);
+            if (place(bucket, fingerprint)) {
+                ++count;
+                return true;
+            }
+        }
+        victim = fingerprint;
+        victimBucket = bucket;
+        ++count;
+        return true;
+    }
+
+    bool contains(uint64_t key) const {
+        uint64_t hash = mixKey(key);
+        uint16_t fingerprint = fingerprintOf(hash);
+        size_t first = bucketOfHash(hash);
+        size_t second = alternate(first, fingerprint);
+        if (victim == fingerprint && (victimBucket == first || victimBucket == second)) return true;
+        return matchBuckets(first, second, fingerprint);
+    }
+
+    bool erase(uint64_t key) {
+        uint64_t hash = mixKey(key);
+        uint16_t fingerprint = fingerprintOf(hash);
+        size_t first = bucketOfHash(hash);
+        size_t second = alternate(first, fingerprint);
+        for (size_t bucket : {first, second}) {
+            for (int i = 0; i < SLOTS; ++i) {
+                if (slots[bucket * SLOTS + i] == fingerprint) {
+                    slots[bucket * SLOTS + i] = 0;
+                    --count;
+                    // The victim may fit now that a slot is free
+                    if (victim) {
+                        uint16_t lost = victim;
+                        victim = 0;
+                        --count;
+                        insertFingerprint(victimBucket, lost);
+                    }
+                    return true;
+                }
+            }
+        }
+        if (victim == fingerprint && (victimBucket == first || victimBucket == second)) {
+            victim = 0;
+            --count;
+            return true;
+        }
+        return false;
+    }
+
+    size_t buckets() const {
+        return bucketCount;
+    }
+
+    double load() const {
+        return slots.empty() ? 0 : static_cast<double>(count) / slots.size();
+    }
+
+    // Each of the 2 * 4 slots a lookup reads matches a random fingerprint with
+    // probability 1 / 65535 when occupied
+    double theoreticalRate() const {
+        return 1 - std::pow(1 - 1.0 / 65535, 2 * SLOTS * load());
+    }
+
+    size_t bytes() const {
+        return slots.size() * sizeof(uint16_t);
+    }
+
+    size_t bucketOf(uint64_t key) const {
+        return bucketOfHash(mixKey(key));
+    }
+
+    // The low 32 bits scaled to [0, n); the fingerprint comes from the top 16
+    size_t bucketOfHash(uint64_t hash) const {
+        return static_cast<size_t>(((hash & 0xffffffffULL) * bucketCount) >> 32);
+    }
+
+    // Its own inverse: alternate(alternate(i, f), f) == i
+    size_t alternate(size_t bucket, uint16_t fingerprint) const {
+        size_t offset = static_cast<size_t>((fingerprint * 0x5bd1e995ULL) % bucketCount);
+        return offset >= bucket ? offset - bucket : offset + bucketCount - bucket;
+    }
+
+    static uint16_t fingerprintOf(uint64_t hash) {
+        uint16_t fingerprint = static_cast<uint16_t>(hash >> 48);
+        return fingerprint ? fingerprint : 1;
+    }
+
+private:
+    bool place(size_t bucket, uint16_t fingerprint) {
+        for (int i = 0; i < SLOTS; ++i) {
+            if (slots[bucket * SLOTS + i] == 0) {
+                slots[bucket * SLOTS + i] = fingerprint;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void insertFingerprint(size_t bucket, uint16_t fingerprint) {
+        if (place(bucket, fingerprint) || place(alternate(bucket, fingerprint), fingerprint)) {
+            ++count;
+            return;
+        }
+        victim = fingerprint;
+        victimBucket = bucket;
+        ++count;
+    }
+
+    bool matchBuckets(size_t first, size_t second, uint16_t fingerprint) const {
+#if defined(__SSE2__) || defined(_M_X64)
+        __m128i a = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(slots.data() + first * SLOTS));
+        __m128i b = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(slots.data() + second * SLOTS));
+        __m128i both = _mm_unpacklo_epi64(a, b);
+        return _mm_movemask_epi8(_mm_cmpeq_epi16(both, _mm_set1_epi16(static_cast<short>(fingerprint)))) != 0;
+#else
+        for (int i = 0; i < SLOTS; ++i) {
+            if (slots[first * SLOTS + i] == fingerprint || slots[second * SLOTS + i] == fingerprint) return true;
+        }
+        return false;
+#endif
+    }
+};
+
+// Keys inserted by a fill have the top bit clear and the keys probed for false positives
+// have it set, so a probe can never be a key that was really inserted
+inline uint64_t filterMemberKey(uint64_t i) {
+    return mixKey(i) & ~(1ULL << 63);
+}
+
+inline uint64_t filterProbeKey(uint64_t i) {
+    return mixKey(i ^ 0x5DEECE66DULL) | (1ULL << 63);
+}
+
+// Both filters sized for the same number of keys and filled step by step; after each
+// step a fixed set of keys that were never inserted measures each false-positive rate
+// next to its theoretical value
+class FilterVisualizer {
+public:
+    struct Sample {
+        double fill;                      // keys inserted / expected
+        double bloomRate, bloomTheory;
+        double cuckooRate, cuckooTheory;
+    };
+
+    BlockedBloomFilter bloom;
+    CuckooFilter cuckoo;
+    size_t expected = 100000;
+    double bitsPerKey = 10;
+    size_t filled = 0;                    // keys a fill has inserted so far
+    size_t fillTarget = 0;
+    bool filling = false;
+    RingBuffer<Sample> history;
+    long long lastKey = -1;               // highlighted block and buckets
+    std::string lastAction;
+
+    sf::Font font;
+    BatchRenderer batch;
+    sf::RectangleShape cell;
+    sf::Text statusText;
+    sf::Text plotText;
+
+    static constexpr size_t HISTORY_SAMPLES = 200;
+    static constexpr size_t PROBES = 20000;
+    static constexpr size_t MAX_EXPECTED = 10000000;
+    static constexpr size_t BLOOM_ROWS = 24, CUCKOO_BUCKETS = 64;
+
+    FilterVisualizer() {
+        TRACE_SCOPE("load font");
+        if (!font.loadFromFile("arial.ttf")) {
+            std::cerr << "Error loading font!" << std::endl;
+        }
+        statusText.setFont(font);
+        statusText.setCharacterSize(16);
+        statusText.setFillColor(sf::Color::White);
+        statusText.setPosition(150, 212);
+        plotText.setFont(font);
+        plotText.setCharacterSize(15);
+        plotText.setFillColor(sf::Color::White);
+        resize();
+    }
+
+    // "count [bits per key]": sizes both filters for count keys and fills them to it.
+    // Larger counts are left to --filter-bench, which does not keep a plot.
+    void startFill(const std::vector<int>& values) {
+        if (values.size() > 1 && !validBitsPerKey(values[1])) return;
+        if (!values.empty() && values[0] > 0) {
+            if (static_cast<size_t>(values[0]) > MAX_EXPECTED) {
+                std::cout << "The page fills at most " << MAX_EXPECTED << " keys; use --filter-bench for more." << std::endl;
+            }
+            expected = std::min(static_cast<size_t>(values[0]), MAX_EXPECTED);
+        }
+        if (values.size() > 1) bitsPerKey = values[1];
+        resize();
+        fillTarget = expected;
+        filling = true;
+        sample();
+    }
+
+    // Bits per key of the Bloom filter; the filters start over empty
+    void setBitsPerKey(int bits) {
+        if (!validBitsPerKey(bits)) return;
+        bitsPerKey = bits;
+        resize();
+        lastAction = "Bloom filter at " + std::to_string(bits) + " bits per key";
+    }
+
+    void insertBatch(const std::vector<int>& values) {
+        for (int value : values) {
+            uint64_t key = static_cast<uint32_t>(value);
+            bloom.insert(key);
+            cuckoo.insert(key);
+        }
+        if (!values.empty()) {
+            lastKey = static_cast<uint32_t>(values.back());
+            sample();
+        }
+    }
+
+    // Only the cuckoo filter can delete
+    void eraseBatch(const std::vector<int>& values) {
+        size_t erased = 0;
+        for (int value : values) erased += cuckoo.erase(static_cast<uint32_t>(value));
+        lastAction = "Erased " + std::to_string(erased) + " of " + std::to_string(values.size()) + " keys from the cuckoo filter"
+                   + " (a Bloom filter cannot delete)";
+        if (!values.empty()) sample();
+    }
+
+    void search(int value) {
+        uint64_t key = static_cast<uint32_t>(value);
+        lastKey = key;
+        lastAction = "Key " + std::to_string(value) + ": Bloom " + (bloom.contains(key) ? "maybe present" : "absent")
+                   + ", cuckoo " + (cuckoo.contains(key) ? "maybe present" : "absent");
+    }
+
+    void reset() {
+        expected = 100000;
+        bitsPerKey = 10;
+        resize();
+        lastAction.clear();
+    }
+
+    void update() {
+        if (!filling) return;
+        size_t step = std::min(fillTarget - filled, std::max<size_t>(1, fillTarget / HISTORY_SAMPLES));
+        for (size_t i = 0; i < step; ++i) {
+            uint64_t key = filterMemberKey(filled + i);
+            bloom.insert(key);
+            cuckoo.insert(key);
+        }
+        filled += step;
+        sample();
+        if (filled >= fillTarget) filling = false;
+    }
+
+    void draw(sf::RenderTarget& target) {
+        drawBloom();
+        drawCuckoo();
+
+        // Measured rates solid, theory dimmer, both plots on the same scale
+        double peak = 1e-4;
+        for (size_t i = 0; i < history.size(); ++i) {
+            peak = std::max({peak, history[i].bloomRate, history[i].bloomTheory, history[i].cuckooRate, history[i].cuckooTheory});
+        }
+        peak *= 1.1;
+        sf::Vector2f plotSize(560, 130);
+        addSeriesPlot(batch, history, HISTORY_SAMPLES, sf::Vector2f(150, 470), plotSize, [](const Sample& s) { return s.bloomTheory; }, sf::Color(0, 120, 120), peak);
+        addSeriesPlot(batch, history, HISTORY_SAMPLES, sf::Vector2f(150, 470), plotSize, [](const Sample& s) { return s.bloomRate; }, sf::Color::Cyan, peak);
+        addSeriesPlot(batch, history, HISTORY_SAMPLES, sf::Vector2f(800, 470), plotSize, [](const Sample& s) { return s.cuckooTheory; }, sf::Color(140, 0, 140), peak);
+        addSeriesPlot(batch, history, HISTORY_SAMPLES, sf::Vector2f(800, 470), plotSize, [](const Sample& s) { return s.cuckooRate; }, sf::Color::Magenta, peak);
+        batch.flush(target);
+
+        std::ostringstream status;
+        status.setf(std::ios::fixed);
+        status.precision(2);
+        status << "Sized for " << expected << " keys   Bloom " << bloom.count << " keys, " << TimelineSlider::formatBytes(bloom.bytes())
+               << " (" << bitsPerKey << " bits/key)   cuckoo " << cuckoo.count << " keys, " << TimelineSlider::formatBytes(cuckoo.bytes())
+               << ", " << 100 * cuckoo.load() << "% full";
+        if (cuckoo.failures) status << ", " << cuckoo.failures << " inserts failed";
+        status << "\n" << lastAction;
+        statusText.setString(status.str());
+        target.draw(statusText);
+
+        if (!history.empty()) {
+            const Sample& latest = history[history.size() - 1];
+            drawPlotText(target, sf::Vector2f(150, 610), "Blocked Bloom  false positives " + percent(latest.bloomRate) + "  theory "
+                         + percent(latest.bloomTheory) + "  " + bitsPerKeyText(bloom.bytes(), bloom.count));
+            drawPlotText(target, sf::Vector2f(800, 610), "Cuckoo  false positives " + percent(latest.cuckooRate) + "  theory "
+                         + percent(latest.cuckooTheory) + "  " + bitsPerKeyText(cuckoo.bytes(), cuckoo.count));
+        }
+    }
+
+private:
+    static bool validBitsPerKey(int bits) {
+        if (bits > 0 && bits <= 64) return true;
+        std::cout << "Bits per key must be between 1 and 64." << std::endl;
+        return false;
+    }
+
+    void resize() {
+        bloom.reset(expected, bitsPerKey);
+        cuckoo.reset(expected);
+        filled = fillTarget = 0;
+        filling = false;
+        history.clear();
+        lastKey = -1;
+    }
+
+    void sample() {
+        size_t bloomHits = 0, cuckooHits = 0;
+        uint64_t probes[256];
+        for (size_t i = 0; i < PROBES; i += 256) {
+            size_t n = std::min<size_t>(256, PROBES - i);
+            for (size_t j = 0; j < n; ++j) probes[j] = filterProbeKey(i + j);
+            bloomHits += bloom.containsMany(probes, n);
+            for (size_t j = 0; j < n; ++j) cuckooHits += cuckoo.contains(probes[j]);
+        }
+        Sample s;
+        s.fill = static_cast<double>(bloom.count) / std::max<size_t>(1, expected);
+        s.bloomRate = static_cast<double>(bloomHits) / PROBES;
+        s.bloomTheory = bloom.theoreticalRate();
+        s.cuckooRate = static_cast<double>(cuckooHits) / PROBES;
+        s.cuckooTheory = cuckoo.theoreticalRate();
+        if (history.size() == HISTORY_SAMPLES) history.pop_front();
+        history.push_back(s);
+    }
+
+    // The first blocks as rows of 256 bits; the block of the last key is outlined
+    void drawBloom() {
+        size_t rows = std::min(BLOOM_ROWS, bloom.blocks.size());
+        size_t highlightedBlock = lastKey >= 0 ? bloom.blockOf(mixKey(static_cast<uint64_t>(lastKey))) : SIZE_MAX;
+        cell.setSize(sf::Vector2f(4, 4));
+        for (size_t row = 0; row < rows; ++row) {
+            const BlockedBloomFilter::Block& block = bloom.blocks[row];
+            sf::Color color = row == highlightedBlock ? sf::Color(255, 140, 0) : sf::Color::Cyan;
+            for (int bit = 0; bit < 256; ++bit) {
+                if (!(block.words[bit / 32] >> (bit % 32) & 1)) continue;
+                cell.setPosition(150 + bit * 4.5f, 250 + row * 5.f);
+                cell.setFillColor(color);
+                batch.addRect(cell);
+            }
+        }
+    }
+
+    // The first buckets, four slots each, shaded by fingerprint
+    void drawCuckoo() {
+        size_t shown = std::min(CUCKOO_BUCKETS, cuckoo.buckets());
+        size_t first = SIZE_MAX, second = SIZE_MAX;
+        if (lastKey >= 0) {
+            uint64_t hash = mixKey(static_cast<uint64_t>(lastKey));
+            first = cuckoo.bucketOfHash(hash);
+            second = cuckoo.alternate(first, CuckooFilter::fingerprintOf(hash));
+        }
+        cell.setSize(sf::Vector2f(4, 12));
+        for (size_t bucket = 0; bucket < shown; ++bucket) {
+            float x = 150 + (bucket % 32) * 40.f;
+            float y = 390 + (bucket / 32) * 30.f;
+            bool onPath = bucket == first || bucket == second;
+            for (int i = 0; i < CuckooFilter::SLOTS; ++i) {
+                uint16_t fingerprint = cuckoo.slots[bucket * CuckooFilter::SLOTS + i];
+                cell.setPosition(x + i * 8, y);
+                if (fingerprint == 0) cell.setFillColor(onPath ? sf::Color(120, 70, 0) : sf::Color(70, 70, 70));
+                else if (onPath) cell.setFillColor(sf::Color(255, 140, 0));
+                else cell.setFillColor(sf::Color(120 + fingerprint % 136, 0, 120 + (fingerprint >> 8) % 136));
+                batch.addRect(cell);
+            }
+        }
+    }
+
+    void drawPlotText(sf::RenderTarget& target, sf::Vector2f position, const std::string& text) {
+        plotText.setString(text);
+        plotText.setPosition(position);
+        target.draw(plotText);
+    }
+
+    static std::string percent(double rate) {
+        std::ostringstream out;
+        out.precision(3);
+        out << 100 * rate << "%";
+        return out.str();
+    }
+
+    static std::string bitsPerKeyText(size_t bytes, size_t keys) {
+        if (keys == 0) return "";
+        std::ostringstream out;
+        out.setf(std::ios::fixed);
+        out.precision(1);
+        out << 8.0 * bytes / keys << " bits per key";
+        return out.str();
+    }
+};
+
+// --filter-bench [count] [bits per key]: inserts count keys (default 1e8) into a blocked
+// Bloom filter (default 10 bits per key) and a cuckoo filter, then queries as many keys
+// that were never inserted, reporting millions of keys per second, the false-positive
+// rate against theory and memory per key
+inline int runFilterBenchmark(std::istream& args) {
+    double count = 1e8, bits = 10;
+    args >> count >> bits;
+    size_t n = std::max<size_t>(1, static_cast<size_t>(count));
+
+    auto elapsed = [](std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+    // Keys are made in batches so 1e8 of them never sit in memory at once
+    const size_t BATCH = 4096;
+    std::vector<uint64_t> keys(BATCH);
+    auto fillBatch = [&keys](size_t first, size_t size, bool members) {
+        for (size_t i = 0; i < size; ++i) keys[i] = members ? filterMemberKey(first + i) : filterProbeKey(first + i);
+    };
+
+    std::cout << std::fixed;
+    std::cout.precision(2);
+    std::cout << "filter   keys=" << n << "   insert_M/s   query_M/s   false_pos%   theory%   bits/key" << std::endl;
+
+    BlockedBloomFilter bloom;
+    bloom.reset(n, bits);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i += BATCH) {
+        size_t size = std::min(BATCH, n - i);
+        fillBatch(i, size, true);
+        bloom.insertMany(keys.data(), size);
+    }
+    double insertSeconds = elapsed(start);
+    size_t positives = 0, missed = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i += BATCH) {
+        size_t size = std::min(BATCH, n - i);
+        fillBatch(i, size, false);
+        positives += bloom.containsMany(keys.data(), size);
+    }
+    double querySeconds = elapsed(start);
+    for (size_t i = 0; i < std::min<size_t>(n, 100000); ++i) missed += !bloom.contains(filterMemberKey(i));
+    std::cout << "bloom    " << std::setw(18) << n / insertSeconds / 1e6 << std::setw(12) << n / querySeconds / 1e6
+              << std::setw(13) << 100.0 * positives / n << std::setw(10) << 100 * bloom.theoreticalRate()
+              << std::setw(11) << 8.0 * bloom.bytes() / n << (missed ? "   MISSED INSERTED KEYS" : "") << std::endl;
+    bool ok = missed == 0;
+    std::vector<BlockedBloomFilter::Block>().swap(bloom.blocks);
+
+    CuckooFilter cuckoo;
+    cuckoo.reset(n);
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i += BATCH) {
+        size_t size = std::min(BATCH, n - i);
+        fillBatch(i, size, true);
+        for (size_t j = 0; j < size; ++j) cuckoo.insert(keys[j]);
+    }
+    insertSeconds = elapsed(start);
+    positives = missed = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < n; i += BATCH) {
+        size_t size = std::min(BATCH, n - i);
+        fillBatch(i, size, false);
+        for (size_t j = 0; j < size; ++j) positives += cuckoo.contains(keys[j]);
+    }
+    querySeconds = elapsed(start);
+    for (size_t i = 0; i < std::min<size_t>(n, 100000); ++i) missed += !cuckoo.contains(filterMemberKey(i));
+    std::cout << "cuckoo   " << std::setw(18) << n / insertSeconds / 1e6 << std::setw(12) << n / querySeconds / 1e6
+              << std::setw(13) << 100.0 * positives / n << std::setw(10) << 100 * cuckoo.theoreticalRate()
+              << std::setw(11) << 8.0 * cuckoo.bytes() / n;
+    if (cuckoo.failures) std::cout << "   " << cuckoo.failures << " inserts failed";
+    std::cout << "   " << 100 * cuckoo.load() << "% full" << (missed ? "   MISSED INSERTED KEYS" : "") << std::endl;
+    return ok && missed == 0 ? 0 : 1;
+}
+
+// Red-black tree and treap pages. Both use the AVL page's model: nodes without parent
+// pointers in a path-copying TreeHistory, inserts and searches as step coroutines that
+// keep the path in their frame, and worker-built snapshots drawn by drawTreeSnapshot.
+class RedBlackNode {
+public:
+    int value;
+    bool red = true;            // new nodes start red
+    int index = 0;              // position in the tree's nodes
+    unsigned int stamp = 0;     // TreeHistory version that may still change it
+    RedBlackNode* left;
+    RedBlackNode* right;
+
+    RedBlackNode(int val) : value(val), left(nullptr), right(nullptr) {}
+};
+
+// A hash of the key stands in for a random priority, so the same keys always build the
+// same treap and a replayed journal draws the same tree
+inline unsigned int treapPriority(int value) {
+    return static_cast<unsigned int>(mixKey(static_cast<uint32_t>(value)) >> 32);
+}
+
+class TreapNode {
+public:
+    int value;
+    unsigned int priority;      // max-heap ordered: no child outranks its parent
+    int index = 0;
+    unsigned int stamp = 0;
+    TreapNode* left;
+    TreapNode* right;
+
+    TreapNode(int val) : value(val), priority(treapPriority(val)), left(nullptr), right(nullptr) {}
+};
+
+// Red-black insert bottom-up from the copied path: a red uncle means recolouring and
+// moving the problem two levels up, a black one at most two rotations and it is over.
+// The height stays within 2 log2(n + 1), so MAX_HEIGHT is never reached.
+class RedBlackTree : public BalancedTree<RedBlackNode> {
+public:
+    static constexpr int MAX_HEIGHT = 64;
+    static constexpr const char* NAME = "Red-Black";
+    static constexpr const char* FIX_NAME = "recolours";
+
+    static int detail(const RedBlackNode* node) {
+        return node->red ? 1 : 0;
+    }
+
+    // The node must already be a copy of this version
+    void recolor(RedBlackNode* node, bool red) {
+        if (node->red == red) return;
+        node->red = red;
+        counters.recoloring();
+    }
+
+    StepTask<TreeEvent> insertSteps(int value) {
+        RedBlackNode* path[MAX_HEIGHT + 1];
+        int depth = 0;
+        counters.begin();
+        for (RedBlackNode* current = root; current; current = value < current->value ? current->left : current->right) {
+            counters.comparison();
+            co_yield TreeEvent{TreeEvent::Compare, current->index, value};
+            if (value == current->value) {
+                co_yield TreeEvent{TreeEvent::Found, current->index, value};
+                co_return;
+            }
+            if (depth == MAX_HEIGHT) {
+                std::cerr << "Red-black tree too deep to insert into" << std::endl;
+                co_return;
+            }
+            path[depth++] = current;
+        }
+        path[depth] = attach(path, depth, value);
+        co_yield TreeEvent{TreeEvent::Insert, path[depth]->index, value};
+
+        // A red parent is never the root, so the grandparent exists
+        int i = depth;
+        while (i >= 2 && path[i - 1]->red) {
+            RedBlackNode* parent = path[i - 1];
+            RedBlackNode* grand = path[i - 2];
+            bool parentLeft = grand->left == parent;
+            RedBlackNode*& uncle = parentLeft ? grand->right : grand->left;
+            if (uncle && uncle->red) {
+                uncle = history.writable(uncle, nodes);
+                recolor(parent, false);
+                recolor(uncle, false);
+                recolor(grand, true);
+                co_yield TreeEvent{TreeEvent::Recolor, grand->index, value};
+                i -= 2;
+                continue;
+            }
+
+            // An inner grandchild is first turned above its parent
+            if ((parent->left == path[i]) != parentLeft) {
+                (parentLeft ? grand->left : grand->right) = parentLeft ? rotateLeft(parent) : rotateRight(parent);
+                std::swap(path[i - 1], path[i]);
+                co_yield TreeEvent{TreeEvent::Rotate, path[i - 1]->index, value};
+            }
+            RedBlackNode* top = parentLeft ? rotateRight(grand) : rotateLeft(grand);
+            relink(path, i - 2, value, top);
+            recolor(top, false);
+            recolor(grand, true);
+            co_yield TreeEvent{TreeEvent::Rotate, top->index, value};
+            break;
+        }
+        if (root->red) {
+            root = history.writable(root, nodes);
+            recolor(root, false);
+            co_yield TreeEvent{TreeEvent::Recolor, root->index, value};
+        }
+    }
+};
+
+// Treap insert: a plain BST insert, then the new node rotates up while it outranks its
+// parent. Nothing bounds the height, it is only logarithmic in expectation, so the path
+// gets more room than the red-black tree's.
+class Treap : public BalancedTree<TreapNode> {
+public:
+    static constexpr int MAX_HEIGHT = 128;
+    static constexpr const char* NAME = "Treap";
+    static constexpr const char* FIX_NAME = nullptr;
+
+    // Priority scaled to 0-99 for the label under the node
+    static int detail(const TreapNode* node) {
+        return static_cast<int>((static_cast<uint64_t>(node->priority) * 100) >> 32);
+    }
+
+    StepTask<TreeEvent> insertSteps(int value) {
+        TreapNode* path[MAX_HEIGHT];
+        int depth = 0;
+        counters.begin();
+        for (TreapNode* current = root; current; current = value < current->value ? current->left : current->right) {
+            counters.comparison();
+            co_yield TreeEvent{TreeEvent::Compare, current->index, value};
+            if (value == current->value) {
+                co_yield TreeEvent{TreeEvent::Found, current->index, value};
+                co_return;
+            }
+            if (depth == MAX_HEIGHT) {
+                std::cerr << "Treap too deep to insert into" << std::endl;
+                co_return;
+            }
+            path[depth++] = current;
+        }
+        TreapNode* created = attach(path, depth, value);
+        co_yield TreeEvent{TreeEvent::Insert, created->index, value};
+
+        for (int i = depth - 1; i >= 0 && created->priority > path[i]->priority; --i) {
+            TreapNode* top = path[i]->left == created ? rotateRight(path[i]) : rotateLeft(path[i]);
+            relink(path, i, value, top);
+            co_yield TreeEvent{TreeEvent::Rotate, top->index, value};
+        }
+    }
+};
+
+// One tree's numbers on a comparison workload. Counters are per insert and per lookup.
+struct TreeComparison {
+    const char* name = "";
+    int height = 0;
+    double comparisons = 0;
+    double rotations = 0;
+    double recolorings = 0;         // height changes for the AVL tree
+    double lookupComparisons = 0;
+    double insertsPerSecond = 0;
+    double lookupsPerSecond = 0;
+};
+
+// Inserts every key through the tree's own insert coroutine, run straight through as
+// scripts do, then looks every key up with a plain loop
+template <typename Tree>
+TreeComparison measureBalancedTree(const char* name, Tree& tree, const std::vector<int>& keys, const std::vector<int>& lookups) {
+    TreeComparison result;
+    result.name = name;
+    auto start = std::chrono::steady_clock::now();
+    for (int key : keys) tree.insertSteps(key).runToEnd();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double inserts = static_cast<double>(std::max<size_t>(1, keys.size()));
+    result.insertsPerSecond = keys.size() / std::max(seconds, 1e-9);
+    result.comparisons = tree.counters.total.comparisons / inserts;
+    result.rotations = tree.counters.total.rotations / inserts;
+    result.recolorings = tree.counters.total.recolorings / inserts;
+    result.height = treeHeight(tree.root);
+
+    size_t found = 0;
+    size_t comparisons = 0;
+    start = std::chrono::steady_clock::now();
+    for (int key : lookups) {
+        auto node = tree.root;
+        while (node) {
+            ++comparisons;
+            if (node->value == key) break;
+            node = key < node->value ? node->left : node->right;
+        }
+        found += node != nullptr;
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.lookupsPerSecond = found / std::max(seconds, 1e-9);
+    result.lookupComparisons = comparisons / static_cast<double>(std::max<size_t>(1, lookups.size()));
+    return result;
+}
+
+// count distinct keys, shuffled or in ascending order
+inline std::vector<int> balancedTreeWorkload(size_t count, bool ascending) {
+    std::vector<int> keys(count);
+    std::iota(keys.begin(), keys.end(), 0);
+    if (!ascending) std::shuffle(keys.begin(), keys.end(), std::mt19937(11));
+    return keys;
+}
+
+// AVL, red-black and treap on the same keys, each looked up in a shuffled order
+inline std::vector<TreeComparison> compareBalancedTrees(const std::vector<int>& keys) {
+    std::vector<int> lookups = keys;
+    std::shuffle(lookups.begin(), lookups.end(), std::mt19937(7));
+    std::vector<TreeComparison> rows;
+    {
+        AvlTree avl;
+        rows.push_back(measureBalancedTree("AVL", avl, keys, lookups));
+    }
+    {
+        RedBlackTree redBlack;
+        rows.push_back(measureBalancedTree("Red-black", redBlack, keys, lookups));
+    }
+    {
+        Treap treap;
+        rows.push_back(measureBalancedTree("Treap", treap, keys, lookups));
+    }
+    return rows;
+}
+
+// Table of compareBalancedTrees rows and what they say about the red-black tree
+inline std::string describeComparison(const std::string& workload, const std::vector<TreeComparison>& rows) {
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out << workload << "\n";
+    out << std::left << std::setw(11) << "tree" << std::right << std::setw(7) << "height" << std::setw(8) << "cmp/ins"
+        << std::setw(8) << "rot/ins" << std::setw(8) << "fix/ins" << std::setw(9) << "M ins/s" << std::setw(9) << "cmp/get"
+        << std::setw(9) << "M get/s" << "\n";
+    for (const TreeComparison& row : rows) {
+        out.precision(2);
+        out << std::left << std::setw(11) << row.name << std::right << std::setw(7) << row.height << std::setw(8) << row.comparisons
+            << std::setw(8) << row.rotations << std::setw(8) << row.recolorings << std::setw(9) << row.insertsPerSecond / 1e6
+            << std::setw(9) << row.lookupComparisons << std::setw(9) << row.lookupsPerSecond / 1e6 << "\n";
+    }
+    if (rows.size() == 3) {
+        const TreeComparison& avl = rows[0];
+        const TreeComparison& redBlack = rows[1];
+        out.precision(2);
+        out << "Red-black against AVL: " << redBlack.rotations << " rotations per insert to " << avl.rotations;
+        out.precision(0);
+        out << ", inserts at " << 100 * redBlack.insertsPerSecond / std::max(1e-9, avl.insertsPerSecond)
+            << "% of AVL's rate, lookups " << 100 * (redBlack.lookupComparisons / std::max(1e-9, avl.lookupComparisons) - 1)
+            << "% longer. The treap has no height bound.";
+    }
+    return out.str();
+}
 
-        node->height = 1 + std::max(getHeight(node->left), getHeight(node->right));
-        int balance = getBalance(node);
-        node->updateBalanceFactor(balance);
+// Page for a BalancedTree. The worker, the step driver, the timeline and the snapshots
+// work as on the AVL page. Red-black nodes are filled with their colour, treap nodes
+// carry their priority under them.
+template <typename Tree>
+class BalancedTreeVisualizer {
+public:
+    Tree tree;                              // owned by the worker thread
+    std::shared_ptr<TreeSnapshot> lastBuilt;
+    StepDriver driver;
+    double insertionMs = 0;
+
+    // Set by the interactive app, as on the AVL page
+    bool animateSteps = false;
+    static constexpr size_t ANIMATED_BATCH = 16;
+
+    // UI thread only. The comparison runs in the background; draw() picks it up, unless
+    // the page was reset meanwhile.
+    std::string comparison;
+    std::future<std::string> pendingComparison;
+    size_t pendingCount = 0;
+    size_t generation = 0, pendingGeneration = 0;
+    static constexpr size_t MAX_COMPARED = 10000000;
 
-        if (balance > 1 && value < node->left->value)
-            return rightRotate(node);
-        if (balance < -1 && value > node->right->value)
-            return leftRotate(node);
-        if (balance > 1 && value > node->left->value) {
-            node->left = leftRotate(node->left);
-            return rightRotate(node);
-        }
-        if (balance < -1 && value < node->right->value) {
-            node->right = rightRotate(node->right);
-            return leftRotate(node);
+    sf::Font font;
+    bool isAnimating = false;
+    BatchRenderer batch;
+    sf::CircleShape circle;
+    NodeLabel valueText;
+    NodeLabel detailText;
+    sf::Text infoText;
+    sf::Text stepText;
+    sf::Text comparisonText;
+    TimelineSlider timeline;
+    TreeWorker worker;
+
+    BalancedTreeVisualizer() : worker([this] { return buildSnapshot(); }) {
+        TRACE_SCOPE("load font");
+        if (!font.loadFromFile("arial.ttf")) {
+            std::cerr << "Error loading font!" << std::endl;
         }
 
-        return node;
+        circle.setOutlineColor(sf::Color::White);
+        valueText.setFont(font);
+        valueText.setCharacterSize(20);
+        valueText.setFillColor(sf::Color::White);
+        detailText.setFont(font);
+        detailText.setCharacterSize(12);
+        detailText.setFillColor(sf::Color::Yellow);
+
+        infoText.setFont(font);
+        infoText.setCharacterSize(18);
+        infoText.setFillColor(sf::Color::White);
+        infoText.setPosition(100, 800);
+        stepText.setFont(font);
+        stepText.setCharacterSize(18);
+        stepText.setFillColor(sf::Color::White);
+        stepText.setPosition(100, 760);
+        comparisonText.setFont(font);
+        comparisonText.setCharacterSize(13);
+        comparisonText.setFillColor(sf::Color::White);
+        comparisonText.setPosition(15, 90);
+        timeline.setFont(font);
     }
 
-    void insert(int value) {
-        auto start = std::chrono::high_resolution_clock::now();
-        root = insertRecursive(root, value);
-        auto end = std::chrono::high_resolution_clock::now();
-        avlInsertionTime += end - start;
-
-        // Estimate BST time based on AVL time and logarithmic complexity
-        estimatedBSTTime += std::chrono::duration<double, std::milli>(avlInsertionTime.count() * log2(static_cast<double>(nodes.size() + 1)));
+    ~BalancedTreeVisualizer() {
+        worker.stop();
     }
 
-    void calculatePositions(AVLNode* node, float x, float y, float hSpacing, std::unordered_map<AVLNode*, sf::Vector2f>& positions) {
-        if (!node) return;
-        positions[node] = sf::Vector2f(x, y);
-        calculatePositions(node->left, x - hSpacing, y + 190, hSpacing / 2, positions);
-        calculatePositions(node->right, x + hSpacing, y + 190, hSpacing / 2, positions);
+    // Each call is one version in the undo history
+    void insertBatch(std::vector<int> values) {
+        if (animateSteps && values.size() <= ANIMATED_BATCH) {
+            isAnimating = true;
+            worker.post([this, values = std::move(values)] {
+                for (int value : values) driver.queue(animatedInsert(value));
+            });
+            return;
+        }
+        worker.post([this, values = std::move(values)] {
+            driver.finish();
+            auto start = std::chrono::steady_clock::now();
+            for (int value : values) tree.insertSteps(value).runToEnd();
+            insertionMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            tree.history.commit(tree.root, tree.nodes.size());
+        });
     }
 
-    void draw(sf::RenderWindow& window) {
-        if (!root) return;
+    StepTask<TreeEvent> animatedInsert(int value) {
+        StepTask<TreeEvent> steps = tree.insertSteps(value);
+        while (steps.step()) co_yield steps.event();
+        tree.history.commit(tree.root, tree.nodes.size());
+    }
 
-        std::unordered_map<AVLNode*, sf::Vector2f> positions;
-        calculatePositions(root, 750, 250, 100, positions);
+    void showVersion(size_t version) {
+        worker.post([this, version] {
+            driver.finish();
+            tree.root = tree.history.select(version, tree.nodes);
+            tree.shapeChanged = true;
+        });
+    }
 
-        std::vector<std::pair<AVLNode*, AVLNode*>> edges;
-        std::queue<AVLNode*> q;
-        q.push(root);
-        while (!q.empty()) {
-            AVLNode* current = q.front();
-            q.pop();
-            if (current->left) {
-                edges.emplace_back(current, current->left);
-                q.push(current->left);
+    // When only colours or the step changed, the last layout is reused
+    std::shared_ptr<TreeSnapshot> buildSnapshot() {
+        auto snapshot = std::make_shared<TreeSnapshot>();
+        if (!tree.shapeChanged && lastBuilt) {
+            snapshot->nodes = lastBuilt->nodes;
+            snapshot->edges = lastBuilt->edges;
+            snapshot->radius = lastBuilt->radius;
+            for (size_t i = 0; i < tree.nodes.size(); ++i) {
+                snapshot->nodes[i].balance = Tree::detail(tree.nodes[i]);
+                snapshot->nodes[i].highlighted = tree.foundKeys.count(tree.nodes[i]->value) != 0;
             }
-            if (current->right) {
-                edges.emplace_back(current, current->right);
-                q.push(current->right);
+        } else {
+            snapshot->nodes.reserve(tree.nodes.size());
+            for (auto node : tree.nodes) {
+                snapshot->nodes.push_back({node->value, Tree::detail(node), tree.foundKeys.count(node->value) != 0, sf::Vector2f()});
             }
+            layoutTreeSnapshot(tree.root, tree.nodes, *snapshot, 190);
         }
+        snapshot->step = driver.event;
+        snapshot->stepping = driver.busy();
+        snapshot->insertionMs = insertionMs;
+        snapshot->height = treeHeight(tree.root);
+        snapshot->counters = tree.counters;
+        tree.history.fillSnapshot(*snapshot);
+        lastBuilt = snapshot;
+        tree.shapeChanged = false;
+        return snapshot;
+    }
 
-        for (auto& edge : edges) {
-            sf::Vector2f parentPos = positions[edge.first];
-            sf::Vector2f childPos = positions[edge.second];
-            parentPos.x += 20;
-            parentPos.y += 40;
-            childPos.x += 20;
-            sf::Vertex line[] = { sf::Vertex(parentPos), sf::Vertex(childPos) };
-            window.draw(line, 2, sf::Lines);
+    void clear() {
+        driver.cancel();
+        tree.clear();
+        insertionMs = 0;
+    }
+
+    // AVL, red-black and treap on count shuffled keys and on count ascending keys. Ignored
+    // while a comparison is still running.
+    void compare(size_t count) {
+        if (count > MAX_COMPARED) {
+            std::cout << "Compare takes at most " << MAX_COMPARED << " keys; use --tree-bench for more." << std::endl;
+            return;
         }
+        if (pendingComparison.valid()) return;
+        pendingCount = count;
+        pendingGeneration = generation;
+        pendingComparison = std::async(std::launch::async, [count] {
+            return describeComparison(std::to_string(count) + " random keys", compareBalancedTrees(balancedTreeWorkload(count, false)))
+                + "\n\n" + describeComparison(std::to_string(count) + " ascending keys", compareBalancedTrees(balancedTreeWorkload(count, true)));
+        });
+    }
 
-        for (auto& node : nodes) {
-            if (positions.find(node) != positions.end()) {
-                node->setPosition(positions[node]);
-                node->draw(window);
+    void draw(sf::RenderTarget& window) {
+        auto snapshot = worker.latest();
+        if (pendingComparison.valid() && pendingComparison.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            std::string result;
+            try {
+                result = pendingComparison.get();
+            } catch (const std::exception& e) {
+                result = std::string("Comparison failed: ") + e.what();
             }
+            if (pendingGeneration == generation) comparison = result;
+        }
+        if (pendingComparison.valid()) {
+            comparisonText.setString("Comparing AVL, red-black and treap on " + std::to_string(pendingCount) + " keys...");
+            window.draw(comparisonText);
+        } else if (!comparison.empty()) {
+            comparisonText.setString(comparison);
+            window.draw(comparisonText);
         }
+        timeline.draw(window, *snapshot);
+        if (snapshot->nodes.empty()) return;
 
-        // Display time taken
-        sf::Text timeText;
-        timeText.setFont(font);
-        timeText.setCharacterSize(18);
-        timeText.setFillColor(sf::Color::White);
-        timeText.setPosition(100, 800);
-        timeText.setString("AVL Insertion Time: " + std::to_string(avlInsertionTime.count()) + " ms\nEstimated BST Time: " + std::to_string(estimatedBSTTime.count()) + " ms");
-        window.draw(timeText);
+        // Red-black nodes by colour (balance 1 is red), treap nodes with their priority
+        static const sf::Color redBlackColors[] = {sf::Color(30, 30, 30), sf::Color(200, 30, 30)};
+        if constexpr (std::is_same_v<Tree, RedBlackTree>) drawTreeSnapshot(*snapshot, batch, circle, valueText, nullptr, sf::Color::Blue, redBlackColors);
+        else drawTreeSnapshot(*snapshot, batch, circle, valueText, &detailText, sf::Color(0, 120, 90));
+        batch.flush(window);
+
+        stepText.setString(describeStep(*snapshot));
+        window.draw(stepText);
+
+        infoText.setString(std::string(Tree::NAME) + " height " + std::to_string(snapshot->height) + ", insertion time "
+            + std::to_string(snapshot->insertionMs) + " ms\n" + describeCounters(snapshot->counters, Tree::FIX_NAME));
+        window.draw(infoText);
+    }
+
+    // Animation driver: one step per call while anything is queued
+    void tick() {
+        if (!isAnimating) return;
+        if (!worker.isBusy() && !worker.latest()->stepping) {
+            isAnimating = false;
+            return;
+        }
+        worker.post([this] { driver.tick(); });
     }
 
     void reset() {
-        for (auto node : nodes) delete node;
-        nodes.clear();
-        root = nullptr;
-        avlInsertionTime = std::chrono::duration<double, std::milli>(0);
-        estimatedBSTTime = std::chrono::duration<double, std::milli>(0);
+        worker.post([this] { clear(); });
+        isAnimating = false;
+        comparison.clear();
+        ++generation;
     }
 
     void search(int value) {
-        AVLNode* current = root;
-        while (current) {
-            if (current->value == value) {
-                current->circle.setFillColor(sf::Color::Yellow); // Highlight the found node
-                return;
-            } else if (value < current->value) {
-                current = current->left;
-            } else {
-                current = current->right;
-            }
+        if (animateSteps) {
+            isAnimating = true;
+            worker.post([this, value] { driver.queue(tree.searchSteps(value)); });
+            return;
         }
-        std::cout << "Number does not exist." << std::endl;
+        worker.post([this, value] {
+            driver.finish();
+            tree.searchSteps(value).runToEnd();
+        });
     }
 };
 
-class GraphNode {
-public:
-    int value;
-    sf::CircleShape circle;
-    sf::Text text;
-    sf::Vector2f position;
+// --tree-bench [count ...]: the three balanced trees on shuffled and ascending keys
+inline int runTreeBenchmark(std::istream& args) {
+    std::vector<size_t> counts;
+    double count;
+    while (args >> count) {
+        if (count > 0 && count < 1e9) counts.push_back(static_cast<size_t>(count));
+    }
+    if (counts.empty()) counts = {100000, 1000000};
+    for (size_t n : counts) {
+        std::cout << describeComparison(std::to_string(n) + " random keys", compareBalancedTrees(balancedTreeWorkload(n, false))) << "\n\n";
+        std::cout << describeComparison(std::to_string(n) + " ascending keys", compareBalancedTrees(balancedTreeWorkload(n, true))) << "\n\n";
+    }
+    return 0;
+}
 
-    GraphNode(int val, const sf::Font& font) : value(val) {
-        circle.setRadius(30);
-        circle.setFillColor(sf::Color::Red);
-        circle.setOutlineThickness(2);
-        circle.setOutlineColor(sf::Color::White);
+// One user operation. The UI, the script runner and journal replay all go through
+// applyOperation, so a recorded session replays exactly what the user did.
+struct Operation {
+    enum Structure : unsigned char { Bst, Avl, Trie, Queue, Stack, Graph, Sort, Heap, Hash, BPlus, SkipList, Range, Cache, Filter, RedBlack, Treap, STRUCTURE_COUNT };
+    enum Type : unsigned char { Insert, Search, Reset, Remove, Edge, Save, Load, Version, Run, Update, Mode, TYPE_COUNT };
 
-        text.setFont(font);
-        text.setString(std::to_string(val));
-        text.setCharacterSize(15);
-        text.setFillColor(sf::Color::Black);
+    Structure structure = Bst;
+    Type type = Insert;
+    std::vector<int> values;
+    std::vector<std::string> words;   // trie words, or the snapshot file for save and load
+
+    bool usesWords() const {
+        return structure == Trie || type == Save || type == Load;
     }
 
-    void setPosition(sf::Vector2f pos) {
-        position = pos;
-        circle.setPosition(pos);
-        text.setPosition(
-            pos.x + (circle.getRadius() - text.getLocalBounds().width) / 2 + 5,
-            pos.y + (circle.getRadius() - text.getLocalBounds().height) / 2 + 5
-        );
+    static const char* structureName(Structure structure) {
+        static const char* names[] = {"bst", "avl", "trie", "queue", "stack", "graph", "sort", "heap", "hash", "bplus", "skiplist", "range", "cache", "filter", "redblack", "treap"};
+        return names[structure];
     }
 
-    void draw(sf::RenderWindow& window) {
-        window.draw(circle);
-        window.draw(text);
+    static const char* typeName(Type type) {
+        static const char* names[] = {"insert", "search", "reset", "remove", "edge", "save", "load", "version", "run", "update", "mode"};
+        return names[type];
     }
 };
 
-class GraphVisualizer {
-public:
-    std::vector<GraphNode*> nodes;
-    std::vector<std::pair<GraphNode*, GraphNode*>> edges;
-    sf::Font font;
-    sf::RectangleShape boundary;
-
-    GraphVisualizer() {
-        if (!font.loadFromFile("arial.ttf")) {
-            std::cerr << "Error loading font!" << std::endl;
+// Workspace is anything holding the visualizers under their usual member names.
+// Returns false for operations a structure does not have.
+template <typename Workspace>
+bool applyOperation(Workspace& w, const Operation& op) {
+    switch (op.type) {
+    case Operation::Reset:
+        switch (op.structure) {
+        case Operation::Bst: w.bstVisualizer.reset(); break;
+        case Operation::Avl: w.avlVisualizer.reset(); break;
+        case Operation::Trie: w.trieVisualizer.reset(); break;
+        case Operation::Queue: w.queueVisualizer.reset(); break;
+        case Operation::Stack: w.stackVisualizer.reset(); break;
+        case Operation::Graph: w.graphVisualizer.reset(); break;
+        case Operation::Sort: w.sortVisualizer.reset(); break;
+        case Operation::Heap: w.heapVisualizer.reset(); break;
+        case Operation::Hash: w.hashVisualizer.reset(); break;
+        case Operation::BPlus: w.bplusVisualizer.reset(); break;
+        case Operation::SkipList: w.skipListVisualizer.reset(); break;
+        case Operation::Range: w.rangeVisualizer.reset(); break;
+        case Operation::Cache: w.cacheVisualizer.reset(); break;
+        case Operation::Filter: w.filterVisualizer.reset(); break;
+        case Operation::RedBlack: w.redBlackVisualizer.reset(); break;
+        case Operation::Treap: w.treapVisualizer.reset(); break;
+        default: return false;
         }
-
-        // Define the boundary for the graph visualization area
-        boundary.setSize(sf::Vector2f(1200, 620));
-        boundary.setPosition(sf::Vector2f(200, 150));
-        boundary.setFillColor(sf::Color::Transparent);
-        boundary.setOutlineThickness(2);
-        boundary.setOutlineColor(sf::Color::White);
+        return true;
+    case Operation::Insert:
+        switch (op.structure) {
+        case Operation::Bst: w.bstVisualizer.insertBatch(op.values); break;
+        case Operation::Avl: w.avlVisualizer.insertBatch(op.values); break;
+        case Operation::Trie: w.trieVisualizer.insertBatch(op.words); break;
+        case Operation::Queue: w.queueVisualizer.enqueueBatch(op.values); break;
+        case Operation::Stack: w.stackVisualizer.pushBatch(op.values); break;
+        case Operation::Graph: w.graphVisualizer.addNodes(op.values); break;
+        case Operation::Sort: w.sortVisualizer.insertBatch(op.values); break;
+        case Operation::Heap: w.heapVisualizer.pushBatch(op.values); break;
+        case Operation::Hash: w.hashVisualizer.insertBatch(op.values); break;
+        case Operation::BPlus: w.bplusVisualizer.insertBatch(op.values); break;
+        case Operation::SkipList: w.skipListVisualizer.insertBatch(op.values); break;
+        case Operation::Range: w.rangeVisualizer.insertBatch(op.values); break;
+        case Operation::Cache: w.cacheVisualizer.insertBatch(op.values); break;
+        case Operation::Filter: w.filterVisualizer.insertBatch(op.values); break;
+        case Operation::RedBlack: w.redBlackVisualizer.insertBatch(op.values); break;
+        case Operation::Treap: w.treapVisualizer.insertBatch(op.values); break;
+        default: return false;
+        }
+        return true;
+    case Operation::Search:
+        if (op.structure == Operation::Trie) {
+            if (!op.words.empty()) w.trieVisualizer.search(op.words.front());
+            return true;
+        }
+        if (op.values.empty()) return true;
+        if (op.structure == Operation::BPlus && op.values.size() >= 2) {
+            w.bplusVisualizer.rangeScan(op.values[0], op.values[1]);
+            return true;
+        }
+        // Range page: sum and minimum over [l, r], or one index
+        if (op.structure == Operation::Range) {
+            if (op.values.front() < 0 || op.values.back() < 0) return false;
+            w.rangeVisualizer.query(static_cast<size_t>(op.values.front()), static_cast<size_t>(op.values.size() >= 2 ? op.values[1] : op.values.front()));
+            return true;
+        }
+        switch (op.structure) {
+        case Operation::Bst: w.bstVisualizer.search(op.values.front()); break;
+        case Operation::Avl: w.avlVisualizer.search(op.values.front()); break;
+        case Operation::Queue: w.queueVisualizer.search(op.values.front()); break;
+        case Operation::Stack: w.stackVisualizer.search(op.values.front()); break;
+        case Operation::Graph: w.graphVisualizer.search(op.values.front()); break;
+        case Operation::Heap: w.heapVisualizer.search(op.values.front()); break;
+        case Operation::Hash: w.hashVisualizer.search(op.values.front()); break;
+        case Operation::BPlus: w.bplusVisualizer.search(op.values.front()); break;
+        case Operation::SkipList: w.skipListVisualizer.search(op.values.front()); break;
+        case Operation::Cache: w.cacheVisualizer.search(op.values.front()); break;
+        case Operation::Filter: w.filterVisualizer.search(op.values.front()); break;
+        case Operation::RedBlack: w.redBlackVisualizer.search(op.values.front()); break;
+        case Operation::Treap: w.treapVisualizer.search(op.values.front()); break;
+        default: return false;
+        }
+        return true;
+    case Operation::Remove:
+        if (op.structure == Operation::Queue) w.queueVisualizer.dequeue();
+        else if (op.structure == Operation::Stack) w.stackVisualizer.pop();
+        else if (op.structure == Operation::Heap) w.heapVisualizer.popMin();
+        else if (op.structure == Operation::Hash) w.hashVisualizer.eraseBatch(op.values);
+        else if (op.structure == Operation::SkipList) w.skipListVisualizer.removeBatch(op.values);
+        else if (op.structure == Operation::Filter) w.filterVisualizer.eraseBatch(op.values);
+        else return false;
+        return true;
+    case Operation::Edge:
+        if (op.structure != Operation::Graph) return false;
+        w.graphVisualizer.addEdges(op.values);
+        return true;
+    case Operation::Version:
+        if (op.values.empty() || op.values.front() < 0) return false;
+        if (op.structure == Operation::Bst) w.bstVisualizer.showVersion(op.values.front());
+        else if (op.structure == Operation::Avl) w.avlVisualizer.showVersion(op.values.front());
+        else if (op.structure == Operation::RedBlack) w.redBlackVisualizer.showVersion(op.values.front());
+        else if (op.structure == Operation::Treap) w.treapVisualizer.showVersion(op.values.front());
+        else return false;
+        return true;
+    case Operation::Run:
+        // B+tree: compare with an AVL tree on the same keys
+        if (op.structure == Operation::BPlus) {
+            w.bplusVisualizer.compareWithAvl();
+            return true;
+        }
+        // Range page: query count and threads
+        if (op.structure == Operation::Range) {
+            if (op.values.empty() || op.values.front() <= 0) return false;
+            w.rangeVisualizer.runBatch(static_cast<size_t>(op.values.front()), op.values.size() >= 2 ? op.values[1] : 1);
+            return true;
+        }
+        // Cache page: a Zipf trace from "count keys [skew percent]", or the rest of the trace
+        if (op.structure == Operation::Cache) {
+            if (op.values.empty()) w.cacheVisualizer.finish();
+            else w.cacheVisualizer.generateZipf(op.values);
+            return true;
+        }
+        // Filter page: size both filters for "count [bits per key]" and fill them
+        if (op.structure == Operation::Filter) {
+            w.filterVisualizer.startFill(op.values);
+            return true;
+        }
+        // Red-black and treap pages: AVL, red-black and treap on that many keys
+        if (op.structure == Operation::RedBlack || op.structure == Operation::Treap) {
+            int count = op.values.empty() ? 100000 : op.values.front();
+            if (count <= 0) return false;
+            if (op.structure == Operation::RedBlack) w.redBlackVisualizer.compare(static_cast<size_t>(count));
+            else w.treapVisualizer.compare(static_cast<size_t>(count));
+            return true;
+        }
+        if (op.structure != Operation::Sort || op.values.empty()) return false;
+        w.sortVisualizer.sort(op.values.front());
+        return true;
+    case Operation::Update:
+        // Range page: l, r and the amount added to each value
+        if (op.structure == Operation::Range) {
+            if (op.values.size() < 3 || op.values[0] < 0 || op.values[1] < 0) return false;
+            w.rangeVisualizer.rangeAdd(static_cast<size_t>(op.values[0]), static_cast<size_t>(op.values[1]), op.values[2]);
+            return true;
+        }
+        // Heap: index and the smaller key
+        if (op.structure != Operation::Heap || op.values.size() < 2 || op.values[0] < 0) return false;
+        w.heapVisualizer.decreaseKey(static_cast<size_t>(op.values[0]), op.values[1]);
+        return true;
+    case Operation::Mode:
+        // Heap: arity 2 or 4. B+tree: node size in bytes. Cache: capacity. Filter: Bloom bits per key.
+        if (op.values.empty()) return false;
+        if (op.structure == Operation::Heap) w.heapVisualizer.setArity(op.values.front());
+        else if (op.structure == Operation::BPlus) w.bplusVisualizer.setNodeBytes(op.values.front());
+        else if (op.structure == Operation::Cache) w.cacheVisualizer.setCapacity(op.values.front());
+        else if (op.structure == Operation::Filter) w.filterVisualizer.setBitsPerKey(op.values.front());
+        else return false;
+        return true;
+    case Operation::Save:
+        if (op.words.empty()) return false;
+        switch (op.structure) {
+        case Operation::Bst: w.bstVisualizer.saveSnapshot(op.words.front()); break;
+        case Operation::Avl: w.avlVisualizer.saveSnapshot(op.words.front()); break;
+        case Operation::Trie: w.trieVisualizer.saveSnapshot(op.words.front()); break;
+        case Operation::Queue: w.queueVisualizer.saveSnapshot(op.words.front()); break;
+        case Operation::Stack: w.stackVisualizer.saveSnapshot(op.words.front()); break;
+        case Operation::Graph: w.graphVisualizer.saveSnapshot(op.words.front()); break;
+        case Operation::Cache: w.cacheVisualizer.saveTrace(op.words.front()); break;
+        default: return false;
+        }
+        return true;
+    case Operation::Load:
+        if (op.words.empty()) return false;
+        switch (op.structure) {
+        case Operation::Bst: w.bstVisualizer.loadSnapshot(op.words.front()); break;
+        case Operation::Avl: w.avlVisualizer.loadSnapshot(op.words.front()); break;
+        case Operation::Trie: w.trieVisualizer.loadSnapshot(op.words.front()); break;
+        case Operation::Queue: w.queueVisualizer.loadSnapshot(op.words.front()); break;
+        case Operation::Stack: w.stackVisualizer.loadSnapshot(op.words.front()); break;
+        case Operation::Graph: w.graphVisualizer.loadSnapshot(op.words.front()); break;
+        case Operation::Cache: w.cacheVisualizer.loadTrace(op.words.front()); break;
+        default: return false;
+        }
+        return true;
+    default:
+        return false;
     }
+}
 
-    void addNode(int value) {
-        GraphNode* newNode = new GraphNode(value, font);
-        nodes.push_back(newNode);
-    }
+// Binary journal of operations with timestamps. Layout, little-endian:
+//   header  "DSVJ", u16 version
+//   entry   u64 microseconds since recording started, u8 structure, u8 type, u32 count,
+//           then count i32 values, or count words as u16 length + bytes for the trie and
+//           for save and load, whose word is the snapshot file
+class OperationJournal {
+public:
+    struct Entry {
+        unsigned long long time;   // microseconds
+        Operation op;
+    };
 
-    void addEdge(int start, int end) {
-        GraphNode* startNode = nullptr;
-        GraphNode* endNode = nullptr;
+    static const unsigned short VERSION = 1;
 
-        for (auto& node : nodes) {
-            if (node->value == start) startNode = node;
-            if (node->value == end) endNode = node;
-        }
+    ~OperationJournal() {
+        stopRecording();
+    }
 
-        if (startNode && endNode) {
-            edges.push_back({startNode, endNode});
+    bool startRecording(const std::string& path) {
+        stopRecording();
+        out.open(path, std::ios::binary);
+        if (!out) {
+            std::cerr << "Error opening journal " << path << std::endl;
+            return false;
         }
+        out.write("DSVJ", 4);
+        writeValue(VERSION);
+        started = std::chrono::steady_clock::now();
+        return true;
     }
 
-    void calculatePositions() {
-        float angle = 2 * M_PI / nodes.size();
-        float radius = 250; // Reduced radius to fit within the boundary
-        sf::Vector2f center(boundary.getPosition().x + boundary.getSize().x / 2,
-                             boundary.getPosition().y + boundary.getSize().y / 2);
-
-        for (size_t i = 0; i < nodes.size(); ++i) {
-            float x = center.x + radius * cos(angle * i);
-            float y = center.y + radius * sin(angle * i);
-            nodes[i]->setPosition(sf::Vector2f(x, y));
-        }
+    void stopRecording() {
+        if (out.is_open()) out.close();
     }
 
-    void draw(sf::RenderWindow& window) {
-        calculatePositions();
+    bool isRecording() const {
+        return out.is_open();
+    }
 
-        // Draw the boundary
-        window.draw(boundary);
+    void record(const Operation& op) {
+        unsigned long long time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+        writeValue(time);
+        writeValue(static_cast<unsigned char>(op.structure));
+        writeValue(static_cast<unsigned char>(op.type));
+        if (op.usesWords()) {
+            writeValue(static_cast<unsigned int>(op.words.size()));
+            for (const std::string& word : op.words) {
+                unsigned short length = static_cast<unsigned short>(std::min<size_t>(word.size(), 65535));
+                writeValue(length);
+                out.write(word.data(), length);
+            }
+        } else {
+            writeValue(static_cast<unsigned int>(op.values.size()));
+            out.write(reinterpret_cast<const char*>(op.values.data()), op.values.size() * sizeof(int));
+        }
+    }
 
-        for (auto& edge : edges) {
-            sf::Vector2f startPos = edge.first->circle.getPosition();
-            sf::Vector2f endPos = edge.second->circle.getPosition();
-            startPos.x += 20;
-            startPos.y += 20;
-            endPos.x += 20;
-            endPos.y += 20;
-            sf::Vertex line[] = { sf::Vertex(startPos), sf::Vertex(endPos) };
-            window.draw(line, 2, sf::Lines);
+    // Counts come from the file, so each one is checked against the bytes left before
+    // anything is allocated. A file that ends inside an entry is reported as truncated.
+    static bool load(const std::string& path, std::vector<Entry>& entries) {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        unsigned long long size = in ? static_cast<unsigned long long>(in.tellg()) : 0;
+        in.seekg(0);
+        char magic[4];
+        unsigned short version = 0;
+        if (!in.read(magic, 4) || std::string(magic, 4) != "DSVJ" || !readValue(in, version) || version != VERSION) {
+            std::cerr << "Error reading journal " << path << std::endl;
+            return false;
         }
 
-        for (auto& node : nodes) {
-            node->draw(window);
+        Entry entry;
+        unsigned char structure, type;
+        unsigned int count;
+        while (in.peek() != std::char_traits<char>::eof()) {
+            if (!readValue(in, entry.time) || !readValue(in, structure) || !readValue(in, type) || !readValue(in, count)) {
+                std::cerr << "Truncated journal " << path << " after " << entries.size() << " entries" << std::endl;
+                return false;
+            }
+            if (structure >= Operation::STRUCTURE_COUNT || type >= Operation::TYPE_COUNT) {
+                std::cerr << "Corrupt journal entry in " << path << std::endl;
+                return false;
+            }
+            entry.op.structure = static_cast<Operation::Structure>(structure);
+            entry.op.type = static_cast<Operation::Type>(type);
+            entry.op.values.clear();
+            entry.op.words.clear();
+            unsigned long long remaining = size - static_cast<unsigned long long>(in.tellg());
+            bool complete = true;
+            if (entry.op.usesWords()) {
+                // Every word takes at least its two-byte length
+                complete = count <= remaining / sizeof(unsigned short);
+                for (unsigned int i = 0; complete && i < count; ++i) {
+                    unsigned short length;
+                    std::string word;
+                    complete = readValue(in, length);
+                    if (complete) word.resize(length);
+                    complete = complete && (length == 0 || in.read(&word[0], length));
+                    if (complete) entry.op.words.push_back(word);
+                }
+            } else {
+                complete = count <= remaining / sizeof(int);
+                if (complete) {
+                    entry.op.values.resize(count);
+                    complete = static_cast<bool>(in.read(reinterpret_cast<char*>(entry.op.values.data()), count * sizeof(int)));
+                }
+            }
+            if (!complete) {
+                std::cerr << "Truncated journal " << path << " after " << entries.size() << " entries" << std::endl;
+                return false;
+            }
+            entries.push_back(entry);
         }
+        return true;
     }
 
-    void reset() {
-        for (auto node : nodes) delete node;
-        nodes.clear();
-        edges.clear();
+private:
+    std::ofstream out;
+    std::chrono::steady_clock::time_point started;
+
+    template <typename T>
+    void writeValue(T value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
     }
 
-    void search(int value) {
-        for (auto& node : nodes) {
-            if (node->value == value) {
-                node->circle.setFillColor(sf::Color::Yellow); // Highlight the found node
-                return;
-            }
-        }
-        std::cout << "Number does not exist." << std::endl;
+    template <typename T>
+    static bool readValue(std::istream& in, T& value) {
+        return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
     }
 };
 
@@ -971,18 +10035,36 @@ public:
 
     std::vector<Button> buttons;
     std::vector<Button> treeButtons;
+    std::vector<Button> sortButtons;   // one per algorithm on the Algorithms page
     Button backButton;
     Button visualizeButton;
     Button resetButton;
     Button addNodeButton;
     Button addEdgeButton;
     Button searchButton; // Add the Search button
+    Button removeButton; // Dequeue on the queue page, pop on the stack page
+    Button simulateButton; // Starts and stops the producer/consumer run on the queue page
+    Button decreaseButton; // Decrease-key on the heap page
+    Button arityButton;    // Switches the heap between binary and 4-ary
+    Button nodeSizeButton; // Cycles the B+tree node size
+    Button compareButton;  // Builds an AVL tree from the B+tree's keys, or compares the balanced trees
+    Button rangeAddButton; // Adds to every value in a range on the range query page
+    Button batchButton;    // Times random range queries on the range query page
+    Button zipfButton;     // Generates a Zipf access trace on the cache page
+    Button capacityButton; // Sets the cache capacity and restarts the trace
+    Button fillButton;     // Fills both membership filters step by step
+    Button bitsButton;     // Sets the Bloom filter's bits per key
     bool showMainPage = true;
     bool showTreePage = false;
     bool showBSTVisualization = false;
     bool showAVLVisualization = false;
+    size_t scrubTarget = 0;                // last version asked for from the timeline
     bool showTrieVisualization = false;
     bool showGraphVisualization = false;
+    bool showHeapVisualization = false;
+    bool showBPlusVisualization = false;
+    bool showRedBlackVisualization = false;
+    bool showTreapVisualization = false;
     std::string currentAlgorithm = "";
 
     BSTVisualizer bstVisualizer;
@@ -991,18 +10073,44 @@ public:
     StackVisualizer stackVisualizer;
     TrieVisualizer trieVisualizer;
     GraphVisualizer graphVisualizer;
+    SortVisualizer sortVisualizer;
+    HeapVisualizer heapVisualizer;
+    HashTableVisualizer hashVisualizer;
+    BPlusTreeVisualizer bplusVisualizer;
+    SkipListVisualizer skipListVisualizer;
+    RangeTreeVisualizer rangeVisualizer;
+    CacheVisualizer cacheVisualizer;
+    FilterVisualizer filterVisualizer;
+    BalancedTreeVisualizer<RedBlackTree> redBlackVisualizer;
+    BalancedTreeVisualizer<Treap> treapVisualizer;
 
     sf::RectangleShape inputBox;
     sf::Text inputText;
     sf::Text instructionsText;
     std::string userInput;
     bool isInputActive = false;
+    bool inputPreviewDirty = false;   // refreshed once per frame, not per keystroke
+    std::vector<int> parsedValues;    // reused across submissions
     bool isScrolling = false;
 
     // Blinking cursor variables
     bool cursorVisible;
     sf::Clock cursorClock;
     sf::Time cursorBlinkInterval;
+    sf::Clock animationClock;   // paces the tree pages' algorithm steps
+
+    // Operation journal: F6 records to journal.bin, --replay plays one back
+    OperationJournal journal;
+    std::vector<OperationJournal::Entry> replayEntries;
+    size_t replayNext = 0;
+    bool replayStepwise = false;
+    sf::Clock replayClock;
+    sf::Text replayText;
+
+    bool showProfiler = false;
+    sf::Clock profilerRefresh;
+    sf::RectangleShape profilerPanel;
+    sf::Text profilerText;
 
     struct DataStructureInfo {
         std::string description, bestComplexity, averageComplexity, advantages, disadvantages;
@@ -1024,8 +10132,25 @@ public:
         addNodeButton("Add Node", font, sf::Vector2f(150, 70), sf::Vector2f(200, 700), sf::Color(120, 120, 120)),
         addEdgeButton("Add Edge", font, sf::Vector2f(150, 70), sf::Vector2f(450, 700), sf::Color(160, 160, 160)),
         searchButton("Search", font, sf::Vector2f(150, 70), sf::Vector2f(1250, 700), sf::Color(160, 160, 160)), // Initialize the Search button
+        removeButton("Remove", font, sf::Vector2f(150, 70), sf::Vector2f(200, 700), sf::Color(120, 120, 120)),
+        simulateButton("Simulate", font, sf::Vector2f(150, 70), sf::Vector2f(450, 700), sf::Color(160, 160, 160)),
+        decreaseButton("Decrease", font, sf::Vector2f(150, 70), sf::Vector2f(450, 700), sf::Color(160, 160, 160)),
+        arityButton("4-ary", font, sf::Vector2f(150, 70), sf::Vector2f(700, 700), sf::Color(120, 120, 120)),
+        nodeSizeButton("256 B", font, sf::Vector2f(150, 70), sf::Vector2f(450, 700), sf::Color(120, 120, 120)),
+        compareButton("vs AVL", font, sf::Vector2f(150, 70), sf::Vector2f(700, 700), sf::Color(160, 160, 160)),
+        rangeAddButton("Add Range", font, sf::Vector2f(150, 70), sf::Vector2f(450, 700), sf::Color(120, 120, 120)),
+        batchButton("Batch", font, sf::Vector2f(150, 70), sf::Vector2f(700, 700), sf::Color(160, 160, 160)),
+        zipfButton("Zipf", font, sf::Vector2f(150, 70), sf::Vector2f(200, 700), sf::Color(120, 120, 120)),
+        capacityButton("Capacity", font, sf::Vector2f(150, 70), sf::Vector2f(700, 700), sf::Color(160, 160, 160)),
+        fillButton("Fill", font, sf::Vector2f(150, 70), sf::Vector2f(450, 700), sf::Color(160, 160, 160)),
+        bitsButton("Bits/Key", font, sf::Vector2f(150, 70), sf::Vector2f(700, 700), sf::Color(120, 120, 120)),
         cursorVisible(true), cursorBlinkInterval(sf::seconds(0.5)) // Initialize cursor variables
     {
+        TRACE_SCOPE("load assets");
+        bstVisualizer.animateSteps = true;
+        avlVisualizer.animateSteps = true;
+        redBlackVisualizer.animateSteps = true;
+        treapVisualizer.animateSteps = true;
         if (!font.loadFromFile("arial.ttf")) {
             std::cerr << "Error loading font!" << std::endl;
             return;
@@ -1078,6 +10203,11 @@ public:
             addNodeButton.shape.getPosition().y + 20    // Move down
         );
 
+        removeButton.text.setPosition(
+            removeButton.shape.getPosition().x + 30,  // Move right
+            removeButton.shape.getPosition().y + 19    // Move down
+        );
+
         visualizeButton.text.setPosition(
             visualizeButton.shape.getPosition().x + 28,  // Move right
             visualizeButton.shape.getPosition().y + 35    // Move down
@@ -1088,18 +10218,23 @@ public:
             addEdgeButton.shape.getPosition().y + 20    // Move down
         );
 
-        std::vector<std::string> algorithms = {"Stacks", "Queues", "Trees", "Graphs", "About"};
-        float y = 300;
-        for (const auto& algo : algorithms) {
-            buttons.push_back(Button(algo, font, sf::Vector2f(350, 70), sf::Vector2f(600, y), sf::Color(150, 150, 150)));
-            y += 100;
+        // Two columns, so the menu has room for more pages
+        std::vector<std::string> algorithms = {"Stacks", "Queues", "Trees", "Graphs", "Algorithms", "Hash Tables", "Skip Lists", "Range Queries", "Caches", "Filters", "About"};
+        for (size_t i = 0; i < algorithms.size(); ++i) {
+            sf::Vector2f position(395 + 410 * (i % 2), 300 + 100 * (i / 2));
+            buttons.push_back(Button(algorithms[i], font, sf::Vector2f(350, 70), position, sf::Color(150, 150, 150)));
+        }
+
+        for (int algorithm = 0; algorithm < SORT_ALGORITHM_COUNT; ++algorithm) {
+            sortButtons.push_back(Button(sortAlgorithmName(algorithm), font, sf::Vector2f(150, 70),
+                                         sf::Vector2f(150 + 165 * algorithm, 700), sf::Color(150, 150, 150)));
         }
 
-        std::vector<std::string> treeTypes = {"BST", "AVL", "Trie"};
-        y = 400;
-        for (const auto& treeType : treeTypes) {
-            treeButtons.push_back(Button(treeType, font, sf::Vector2f(350, 70), sf::Vector2f(600, y), sf::Color(150, 150, 150)));
-            y += 100;
+        // Two columns, like the main menu
+        std::vector<std::string> treeTypes = {"BST", "AVL", "Trie", "Heap", "B+ Tree", "Red-Black", "Treap"};
+        for (size_t i = 0; i < treeTypes.size(); ++i) {
+            sf::Vector2f position(395 + 410 * (i % 2), 400 + 100 * (i / 2));
+            treeButtons.push_back(Button(treeTypes[i], font, sf::Vector2f(350, 70), position, sf::Color(150, 150, 150)));
         }
 
         inputBox.setSize(sf::Vector2f(600, 50));
@@ -1117,21 +10252,287 @@ public:
         instructionsText.setCharacterSize(18);
         instructionsText.setFillColor(sf::Color::White);
         instructionsText.setPosition(500, 820);
-        instructionsText.setString("           Enter node values separated by spaces and click 'Add Node'.\nEnter start and end node values separated by a space and click 'Add Edge'.");
+        instructionsText.setString("           Enter node values separated by spaces and click 'Add Node'.\nEnter start and end node values separated by a space and click 'Add Edge'.\n                     Scroll to zoom, drag with the right mouse button to pan.");
+
+        replayText.setFont(font);
+        replayText.setCharacterSize(16);
+        replayText.setFillColor(sf::Color::Yellow);
+        replayText.setPosition(150, 30);
+
+        // Frame profiler overlay, toggled with F3
+        profilerPanel.setPosition(1180, 10);
+        profilerPanel.setFillColor(sf::Color(0, 0, 0, 180));
+        profilerText.setFont(font);
+        profilerText.setCharacterSize(14);
+        profilerText.setFillColor(sf::Color::Green);
+        profilerText.setPosition(1190, 15);
+    }
+
+    // Every user operation goes through here so the journal sees it
+    void perform(const Operation& op) {
+        if (journal.isRecording()) journal.record(op);
+        applyOperation(*this, op);
+    }
+
+    Operation::Structure currentStructure() const {
+        if (showBSTVisualization) return Operation::Bst;
+        if (showAVLVisualization) return Operation::Avl;
+        if (showTrieVisualization) return Operation::Trie;
+        if (showGraphVisualization) return Operation::Graph;
+        if (showHeapVisualization) return Operation::Heap;
+        if (showBPlusVisualization) return Operation::BPlus;
+        if (showRedBlackVisualization) return Operation::RedBlack;
+        if (showTreapVisualization) return Operation::Treap;
+        if (!showMainPage && currentAlgorithm == "Queues") return Operation::Queue;
+        if (!showMainPage && currentAlgorithm == "Stacks") return Operation::Stack;
+        if (!showMainPage && currentAlgorithm == "Algorithms") return Operation::Sort;
+        if (!showMainPage && currentAlgorithm == "Hash Tables") return Operation::Hash;
+        if (!showMainPage && currentAlgorithm == "Skip Lists") return Operation::SkipList;
+        if (!showMainPage && currentAlgorithm == "Range Queries") return Operation::Range;
+        if (!showMainPage && currentAlgorithm == "Caches") return Operation::Cache;
+        if (!showMainPage && currentAlgorithm == "Filters") return Operation::Filter;
+        return Operation::STRUCTURE_COUNT;
+    }
+
+    // Switches to a structure's page without the reset that clicking through the menus does
+    void showStructure(Operation::Structure structure) {
+        if (currentStructure() == structure) return;
+        showMainPage = showTreePage = false;
+        showBSTVisualization = structure == Operation::Bst;
+        showAVLVisualization = structure == Operation::Avl;
+        showTrieVisualization = structure == Operation::Trie;
+        showGraphVisualization = structure == Operation::Graph;
+        showHeapVisualization = structure == Operation::Heap;
+        showBPlusVisualization = structure == Operation::BPlus;
+        showRedBlackVisualization = structure == Operation::RedBlack;
+        showTreapVisualization = structure == Operation::Treap;
+        const char* pages[] = {"BST", "AVL", "Trie", "Queues", "Stacks", "Graphs", "Algorithms", "Heap", "Hash Tables", "B+ Tree", "Skip Lists", "Range Queries", "Caches", "Filters", "Red-Black", "Treap"};
+        currentAlgorithm = pages[structure];
+        resetInputBox();
+    }
+
+    // Version history of the tree page on screen, or nullptr on other pages
+    std::shared_ptr<const TreeSnapshot> treeSnapshot(TimelineSlider*& timeline) {
+        if (showBSTVisualization) {
+            timeline = &bstVisualizer.timeline;
+            return bstVisualizer.worker.latest();
+        }
+        if (showAVLVisualization) {
+            timeline = &avlVisualizer.timeline;
+            return avlVisualizer.worker.latest();
+        }
+        if (showRedBlackVisualization) {
+            timeline = &redBlackVisualizer.timeline;
+            return redBlackVisualizer.worker.latest();
+        }
+        if (showTreapVisualization) {
+            timeline = &treapVisualizer.timeline;
+            return treapVisualizer.worker.latest();
+        }
+        timeline = nullptr;
+        return nullptr;
+    }
+
+    void scrubTo(size_t version) {
+        if (version == scrubTarget) return;
+        scrubTarget = version;
+        perform({currentStructure(), Operation::Version, {static_cast<int>(version)}});
+    }
+
+    void startReplay(std::vector<OperationJournal::Entry> entries, bool stepwise) {
+        replayEntries = std::move(entries);
+        replayNext = 0;
+        replayStepwise = stepwise;
+        replayClock.restart();
+    }
+
+    void replayOne() {
+        const Operation& op = replayEntries[replayNext++].op;
+        showStructure(op.structure);
+        applyOperation(*this, op);
+    }
+
+    // At recorded speed, every entry whose timestamp has passed; stepwise, nothing until Right
+    void updateReplay() {
+        if (replayNext >= replayEntries.size() || replayStepwise) return;
+        unsigned long long now = static_cast<unsigned long long>(replayClock.getElapsedTime().asMicroseconds());
+        while (replayNext < replayEntries.size() && replayEntries[replayNext].time <= now) replayOne();
+    }
+
+    void drawReplayStatus() {
+        if (replayEntries.empty() && !journal.isRecording()) return;
+        std::string status;
+        if (journal.isRecording()) {
+            status = "Recording journal.bin (F6 to stop)";
+        } else if (replayNext < replayEntries.size()) {
+            const Operation& op = replayEntries[replayNext].op;
+            status = "Replay " + std::to_string(replayNext) + "/" + std::to_string(replayEntries.size()) + "  next: "
+                + Operation::structureName(op.structure) + " " + Operation::typeName(op.type)
+                + (replayStepwise ? "  (Right arrow to step)" : "");
+        } else {
+            status = "Replay finished (" + std::to_string(replayEntries.size()) + " operations)";
+        }
+        replayText.setString(status);
+        window.draw(replayText);
     }
 
     void resetInputBox() {
-        userInput.clear();
-        inputText.setString("");
+        clearInput();
         isInputActive = false;
     }
 
+    int sortButtonAt(sf::Vector2f point) {
+        for (size_t i = 0; i < sortButtons.size(); ++i) {
+            if (sortButtons[i].isClicked(point)) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    // "random 5000" on the sorting, hash and range query pages: that many values in
+    // [0, limit), at most maxCount of them
+    std::vector<int> randomValues(int limit = 10000, int maxCount = 100000000) {
+        int count = 0;
+        parseFirstInt(userInput, count);
+        if (count > maxCount) std::cout << "At most " << maxCount << " random values on this page." << std::endl;
+        std::vector<int> values(static_cast<size_t>(std::max(0, std::min(count, maxCount))));
+        std::mt19937 rng(std::random_device{}());
+        std::uniform_int_distribution<int> range(0, limit - 1);
+        for (int& value : values) value = range(rng);
+        return values;
+    }
+
+    void clearInput() {
+        userInput.clear();
+        inputPreviewDirty = true;
+    }
+
+    const std::vector<int>& inputValues() {
+        parsedValues.clear();
+        parseInts(userInput, parsedValues);
+        return parsedValues;
+    }
+
+    // A pasted input can be megabytes long; only its tail is shown
+    void updateInputPreview() {
+        if (!inputPreviewDirty) return;
+        inputPreviewDirty = false;
+        const size_t PREVIEW_CHARS = 40;
+        const size_t TAIL_CHARS = 24;
+        if (userInput.size() <= PREVIEW_CHARS) {
+            inputText.setString(userInput);
+        } else {
+            inputText.setString("(" + std::to_string(userInput.size()) + " chars) ..." + userInput.substr(userInput.size() - TAIL_CHARS));
+        }
+    }
+
+    // Clipboard text with line breaks, tabs and commas turned into spaces
+    void pasteClipboard() {
+        std::string pasted = sf::Clipboard::getString().toAnsiString();
+        userInput.reserve(userInput.size() + pasted.size());
+        for (char ch : pasted) {
+            unsigned char c = static_cast<unsigned char>(ch);
+            if (std::isalnum(c) || ch == '-') userInput += ch;
+            else if (std::isspace(c) || ch == ',' || ch == ';') userInput += ' ';
+        }
+        inputPreviewDirty = true;
+    }
+
     void run() {
+        FrameProfiler& profiler = FrameProfiler::shared();
         while (window.isOpen()) {
-            handleEvents();
-            update();
-            render();
+            profiler.beginFrame();
+            {
+                ProfileScope phase(FrameProfiler::Events);
+                TRACE_SCOPE("handleEvents");
+                handleEvents();
+            }
+            {
+                ProfileScope phase(FrameProfiler::Update);
+                TRACE_SCOPE("update");
+                update();
+            }
+            {
+                ProfileScope phase(FrameProfiler::Render);
+                TRACE_SCOPE("render");
+                render();
+            }
+            profiler.endFrame();
+        }
+    }
+
+    // Node and edge counts of the page on screen
+    void currentCounts(size_t& nodeCount, size_t& edgeCount) {
+        nodeCount = edgeCount = 0;
+        if (showBSTVisualization) {
+            auto snapshot = bstVisualizer.worker.latest();
+            nodeCount = snapshot->nodes.size();
+            edgeCount = snapshot->edges.size();
+        } else if (showAVLVisualization) {
+            auto snapshot = avlVisualizer.worker.latest();
+            nodeCount = snapshot->nodes.size();
+            edgeCount = snapshot->edges.size();
+        } else if (showTrieVisualization) {
+            nodeCount = trieVisualizer.nodes.size();
+            edgeCount = trieVisualizer.edges.size();
+        } else if (showGraphVisualization) {
+            nodeCount = graphVisualizer.nodes.size();
+            edgeCount = graphVisualizer.edges.size();
+        } else if (currentAlgorithm == "Queues") {
+            nodeCount = queueVisualizer.values.size();
+        } else if (currentAlgorithm == "Stacks") {
+            nodeCount = stackVisualizer.values.size();
+        } else if (showHeapVisualization) {
+            nodeCount = heapVisualizer.count;
+        } else if (currentAlgorithm == "Hash Tables") {
+            nodeCount = hashVisualizer.chained.count;
+        } else if (showBPlusVisualization) {
+            nodeCount = bplusVisualizer.tree.count;
+        } else if (showRedBlackVisualization || showTreapVisualization) {
+            auto snapshot = showRedBlackVisualization ? redBlackVisualizer.worker.latest() : treapVisualizer.worker.latest();
+            nodeCount = snapshot->nodes.size();
+            edgeCount = snapshot->edges.size();
+        } else if (currentAlgorithm == "Skip Lists") {
+            nodeCount = static_cast<size_t>(std::max(0LL, skipListVisualizer.list.size()));
+        } else if (currentAlgorithm == "Range Queries") {
+            nodeCount = rangeVisualizer.segment.count;
+        } else if (currentAlgorithm == "Caches") {
+            nodeCount = cacheVisualizer.simulator.lru.pool.lists[0].size;
+        } else if (currentAlgorithm == "Filters") {
+            nodeCount = filterVisualizer.bloom.count;
+        }
+    }
+
+    // Text is rebuilt a few times a second so the overlay barely shows up in its own numbers
+    void drawProfiler() {
+        if (profilerRefresh.getElapsedTime() >= sf::milliseconds(250)) {
+            profilerRefresh.restart();
+            FrameProfiler& profiler = FrameProfiler::shared();
+            const char* names[] = {"Events", "Update", "Layout", "Render", "Frame"};
+            std::ostringstream out;
+            out.setf(std::ios::fixed);
+            out.precision(2);
+            out << "ms          p50     p95     p99\n";
+            for (int phase = 0; phase < FrameProfiler::PHASE_COUNT; ++phase) {
+                auto p = static_cast<FrameProfiler::Phase>(phase);
+                out << names[phase] << std::string(10 - std::string(names[phase]).size(), ' ')
+                    << profiler.percentile(p, 0.5f) << "   " << profiler.percentile(p, 0.95f) << "   " << profiler.percentile(p, 0.99f) << "\n";
+            }
+            size_t nodeCount, edgeCount;
+            currentCounts(nodeCount, edgeCount);
+            out.precision(0);
+            out << "Batched draw calls " << profiler.getDrawCalls() << "   vertices " << profiler.getVertices() << "\n";
+            out << "Nodes " << nodeCount << "   edges " << edgeCount << "\n";
+            out << "Allocations/frame p50 " << profiler.allocationPercentile(0.5f) << "  p99 " << profiler.allocationPercentile(0.99f);
+            if (showBSTVisualization || showAVLVisualization) {
+                auto snapshot = showBSTVisualization ? bstVisualizer.worker.latest() : avlVisualizer.worker.latest();
+                out.precision(2);
+                out << "\nWorker layout " << snapshot->layoutMs << " ms";
+            }
+            profilerText.setString(out.str());
+            profilerPanel.setSize(sf::Vector2f(profilerText.getLocalBounds().width + 20, profilerText.getLocalBounds().height + 20));
         }
+        window.draw(profilerPanel);
+        window.draw(profilerText);
     }
 
     void handleEvents() {
@@ -1170,6 +10571,13 @@ public:
                     button.text.setPosition(sf::Vector2f(button.text.getPosition().x * scaleX, button.text.getPosition().y * scaleY));
                 }
 
+                for (auto& button : sortButtons) {
+                    button.shape.setSize(sf::Vector2f(button.shape.getSize().x * scaleX, button.shape.getSize().y * scaleY));
+                    button.shape.setPosition(sf::Vector2f(button.shape.getPosition().x * scaleX, button.shape.getPosition().y * scaleY));
+                    button.text.setCharacterSize(static_cast<unsigned int>(18 * std::min(scaleX, scaleY)));
+                    button.text.setPosition(sf::Vector2f(button.text.getPosition().x * scaleX, button.text.getPosition().y * scaleY));
+                }
+
                 backButton.shape.setSize(sf::Vector2f(backButton.shape.getSize().x * scaleX, backButton.shape.getSize().y * scaleY));
                 backButton.shape.setPosition(sf::Vector2f(backButton.shape.getPosition().x * scaleX, backButton.shape.getPosition().y * scaleY));
                 backButton.text.setCharacterSize(static_cast<unsigned int>(18 * std::min(scaleX, scaleY)));
@@ -1200,6 +10608,66 @@ public:
                 searchButton.text.setCharacterSize(static_cast<unsigned int>(18 * std::min(scaleX, scaleY)));
                 searchButton.text.setPosition(sf::Vector2f(searchButton.text.getPosition().x * scaleX, searchButton.text.getPosition().y * scaleY));
 
+                removeButton.shape.setSize(sf::Vector2f(removeButton.shape.getSize().x * scaleX, removeButton.shape.getSize().y * scaleY));
+                removeButton.shape.setPosition(sf::Vector2f(removeButton.shape.getPosition().x * scaleX, removeButton.shape.getPosition().y * scaleY));
+                removeButton.text.setCharacterSize(static_cast<unsigned int>(18 * std::min(scaleX, scaleY)));
+                removeButton.text.setPosition(sf::Vector2f(removeButton.text.getPosition().x * scaleX, removeButton.text.getPosition().y * scaleY));
+
+                simulateButton.shape.setSize(sf::Vector2f(simulateButton.shape.getSize().x * scaleX, simulateButton.shape.getSize().y * scaleY));
+                simulateButton.shape.setPosition(sf::Vector2f(simulateButton.shape.getPosition().x * scaleX, simulateButton.shape.getPosition().y * scaleY));
+                simulateButton.text.setCharacterSize(static_cast<unsigned int>(18 * std::min(scaleX, scaleY)));
+                simulateButton.text.setPosition(sf::Vector2f(simulateButton.text.getPosition().x * scaleX, simulateButton.text.getPosition().y * scaleY));
+
+                decreaseButton.shape.setSize(sf::Vector2f(decreaseButton.shape.getSize().x * scaleX, decreaseButton.shape.getSize().y * scaleY));
+                decreaseButton.shape.setPosition(sf::Vector2f(decreaseButton.shape.getPosition().x * scaleX, decreaseButton.shape.getPosition().y * scaleY));
+                decreaseButton.text.setCharacterSize(static_cast<unsigned int>(18 * std::min(scaleX, scaleY)));
+                decreaseButton.text.setPosition(sf::Vector2f(decreaseButton.text.getPosition().x * scaleX, decreaseButton.text.getPosition().y * scaleY));
+
+                arityButton.shape.setSize(sf::Vector2f(arityButton.shape.getSize().x * scaleX, arityButton.shape.getSize().y * scaleY));
+                arityButton.shape.setPosition(sf::Vector2f(arityButton.shape.getPosition().x * scaleX, arityButton.shape.getPosition().y * scaleY));
+                arityButton.text.setCharacterSize(static_cast<unsigned int>(18 * std::min(scaleX, scaleY)));
+                arityButton.text.setPosition(sf::Vector2f(arityButton.text.getPosition().x * scaleX, arityButton.text.getPosition().y * scaleY));
+
+                nodeSizeButton.shape.setSize(sf::Vector2f(nodeSizeButton.shape.getSize().x * scaleX, nodeSizeButton.shape.getSize().y * scaleY));
+                nodeSizeButton.shape.setPosition(sf::Vector2f(nodeSizeButton.shape.getPosition().x * scaleX, nodeSizeButton.shape.getPosition().y * scaleY));
+                nodeSizeButton.text.setCharacterSize(static_cast<unsigned int>(18 * std::min(scaleX, scaleY)));
+                nodeSizeButton.text.setPosition(sf::Vector2f(nodeSizeButton.text.getPosition().x * scaleX, nodeSizeButton.text.getPosition().y * scaleY));
+
+                compareButton.shape.setSize(sf::Vector2f(compareButton.shape.getSize().x * scaleX, compareButton.shape.getSize().y * scaleY));
+                compareButton.shape.setPosition(sf::Vector2f(compareButton.shape.getPosition().x * scaleX, compareButton.shape.getPosition().y * scaleY));
+                compareButton.text.setCharacterSize(static_cast<unsigned int>(18 * std::min(scaleX, scaleY)));
+                compareButton.text.setPosition(sf::Vector2f(compareButton.text.getPosition().x * scaleX, compareButton.text.getPosition().y * scaleY));
+
+                rangeAddButton.shape.setSize(sf::Vector2f(rangeAddButton.shape.getSize().x * scaleX, rangeAddButton.shape.getSize().y * scaleY));
+                rangeAddButton.shape.setPosition(sf::Vector2f(rangeAddButton.shape.getPosition().x * scaleX, rangeAddButton.shape.getPosition().y * scaleY));
+                rangeAddButton.text.setCharacterSize(static_cast<unsigned int>(18 * std::min(scaleX, scaleY)));
+                rangeAddButton.text.setPosition(sf::Vector2f(rangeAddButton.text.getPosition().x * scaleX, rangeAddButton.text.getPosition().y * scaleY));
+
+                batchButton.shape.setSize(sf::Vector2f(batchButton.shape.getSize().x * scaleX, batchButton.shape.getSize().y * scaleY));
+                batchButton.shape.setPosition(sf::Vector2f(batchButton.shape.getPosition().x * scaleX, batchButton.shape.getPosition().y * scaleY));
+                batchButton.text.setCharacterSize(static_cast<unsigned int>(18 * std::min(scaleX, scaleY)));
+                batchButton.text.setPosition(sf::Vector2f(batchButton.text.getPosition().x * scaleX, batchButton.text.getPosition().y * scaleY));
+
+                zipfButton.shape.setSize(sf::Vector2f(zipfButton.shape.getSize().x * scaleX, zipfButton.shape.getSize().y * scaleY));
+                zipfButton.shape.setPosition(sf::Vector2f(zipfButton.shape.getPosition().x * scaleX, zipfButton.shape.getPosition().y * scaleY));
+                zipfButton.text.setCharacterSize(static_cast<unsigned int>(18 * std::min(scaleX, scaleY)));
+                zipfButton.text.setPosition(sf::Vector2f(zipfButton.text.getPosition().x * scaleX, zipfButton.text.getPosition().y * scaleY));
+
+                capacityButton.shape.setSize(sf::Vector2f(capacityButton.shape.getSize().x * scaleX, capacityButton.shape.getSize().y * scaleY));
+                capacityButton.shape.setPosition(sf::Vector2f(capacityButton.shape.getPosition().x * scaleX, capacityButton.shape.getPosition().y * scaleY));
+                capacityButton.text.setCharacterSize(static_cast<unsigned int>(18 * std::min(scaleX, scaleY)));
+                capacityButton.text.setPosition(sf::Vector2f(capacityButton.text.getPosition().x * scaleX, capacityButton.text.getPosition().y * scaleY));
+
+                fillButton.shape.setSize(sf::Vector2f(fillButton.shape.getSize().x * scaleX, fillButton.shape.getSize().y * scaleY));
+                fillButton.shape.setPosition(sf::Vector2f(fillButton.shape.getPosition().x * scaleX, fillButton.shape.getPosition().y * scaleY));
+                fillButton.text.setCharacterSize(static_cast<unsigned int>(18 * std::min(scaleX, scaleY)));
+                fillButton.text.setPosition(sf::Vector2f(fillButton.text.getPosition().x * scaleX, fillButton.text.getPosition().y * scaleY));
+
+                bitsButton.shape.setSize(sf::Vector2f(bitsButton.shape.getSize().x * scaleX, bitsButton.shape.getSize().y * scaleY));
+                bitsButton.shape.setPosition(sf::Vector2f(bitsButton.shape.getPosition().x * scaleX, bitsButton.shape.getPosition().y * scaleY));
+                bitsButton.text.setCharacterSize(static_cast<unsigned int>(18 * std::min(scaleX, scaleY)));
+                bitsButton.text.setPosition(sf::Vector2f(bitsButton.text.getPosition().x * scaleX, bitsButton.text.getPosition().y * scaleY));
+
                 inputBox.setSize(sf::Vector2f(inputBox.getSize().x * scaleX, inputBox.getSize().y * scaleY));
                 inputBox.setPosition(sf::Vector2f(inputBox.getPosition().x * scaleX, inputBox.getPosition().y * scaleY));
                 inputBox.setOutlineThickness(static_cast<int>(2 * std::min(scaleX, scaleY)));
@@ -1230,14 +10698,32 @@ public:
                                 showMainPage = false;
                             } else if (currentAlgorithm == "Queues") {
                                 showMainPage = false;
-                                queueVisualizer.reset();
+                                perform({Operation::Queue, Operation::Reset});
                             } else if (currentAlgorithm == "Stacks") {
                                 showMainPage = false;
-                                stackVisualizer.reset();
+                                perform({Operation::Stack, Operation::Reset});
                             } else if (currentAlgorithm == "Graphs") {
                                 showGraphVisualization = true;
                                 showMainPage = false;
-                                graphVisualizer.reset();
+                                perform({Operation::Graph, Operation::Reset});
+                            } else if (currentAlgorithm == "Algorithms") {
+                                showMainPage = false;
+                                perform({Operation::Sort, Operation::Reset});
+                            } else if (currentAlgorithm == "Hash Tables") {
+                                showMainPage = false;
+                                perform({Operation::Hash, Operation::Reset});
+                            } else if (currentAlgorithm == "Skip Lists") {
+                                showMainPage = false;
+                                perform({Operation::SkipList, Operation::Reset});
+                            } else if (currentAlgorithm == "Range Queries") {
+                                showMainPage = false;
+                                perform({Operation::Range, Operation::Reset});
+                            } else if (currentAlgorithm == "Caches") {
+                                showMainPage = false;
+                                perform({Operation::Cache, Operation::Reset});
+                            } else if (currentAlgorithm == "Filters") {
+                                showMainPage = false;
+                                perform({Operation::Filter, Operation::Reset});
                             } else if (currentAlgorithm == "About") {
     showMainPage = false;
     showGraphVisualization = false;}
@@ -1261,27 +10747,47 @@ public:
                                 if (currentAlgorithm == "BST") {
                                     showBSTVisualization = true;
                                     showTreePage = false;
-                                    bstVisualizer.reset();
+                                    perform({Operation::Bst, Operation::Reset});
                                 } else if (currentAlgorithm == "AVL") {
                                     showAVLVisualization = true;
                                     showTreePage = false;
-                                    avlVisualizer.reset();
+                                    perform({Operation::Avl, Operation::Reset});
                                 } else if (currentAlgorithm == "Trie") {
                                     showTrieVisualization = true;
                                     showTreePage = false;
-                                    trieVisualizer.reset();
+                                    perform({Operation::Trie, Operation::Reset});
+                                } else if (currentAlgorithm == "Heap") {
+                                    showHeapVisualization = true;
+                                    showTreePage = false;
+                                    perform({Operation::Heap, Operation::Reset});
+                                } else if (currentAlgorithm == "B+ Tree") {
+                                    showBPlusVisualization = true;
+                                    showTreePage = false;
+                                    perform({Operation::BPlus, Operation::Reset});
+                                } else if (currentAlgorithm == "Red-Black") {
+                                    showRedBlackVisualization = true;
+                                    showTreePage = false;
+                                    perform({Operation::RedBlack, Operation::Reset});
+                                } else if (currentAlgorithm == "Treap") {
+                                    showTreapVisualization = true;
+                                    showTreePage = false;
+                                    perform({Operation::Treap, Operation::Reset});
                                 }
                                 resetInputBox(); // Reset input box when transitioning to a new visualization
                                 break;
                             }
                         }
                     }
-                } else if (showBSTVisualization || showAVLVisualization || showTrieVisualization || currentAlgorithm == "Queues" || currentAlgorithm == "Stacks" || currentAlgorithm == "About" || showGraphVisualization) {
+                } else if (showBSTVisualization || showAVLVisualization || showTrieVisualization || showHeapVisualization || showBPlusVisualization || showRedBlackVisualization || showTreapVisualization || currentAlgorithm == "Queues" || currentAlgorithm == "Stacks" || currentAlgorithm == "Algorithms" || currentAlgorithm == "Hash Tables" || currentAlgorithm == "Skip Lists" || currentAlgorithm == "Range Queries" || currentAlgorithm == "Caches" || currentAlgorithm == "Filters" || currentAlgorithm == "About" || showGraphVisualization) {
                     if (backButton.isClicked(mousePos)) {
-                        if (showBSTVisualization || showAVLVisualization || showTrieVisualization) {
+                        if (showBSTVisualization || showAVLVisualization || showTrieVisualization || showHeapVisualization || showBPlusVisualization || showRedBlackVisualization || showTreapVisualization) {
                             showBSTVisualization = false;
                             showAVLVisualization = false;
                             showTrieVisualization = false;
+                            showHeapVisualization = false;
+                            showBPlusVisualization = false;
+                            showRedBlackVisualization = false;
+                            showTreapVisualization = false;
                             showTreePage = true;
                             showMainPage = false;
                             cursorVisible = false;
@@ -1291,6 +10797,10 @@ public:
                             trieVisualizer.reset();
                             queueVisualizer.reset();
                             stackVisualizer.reset();
+                            heapVisualizer.reset();
+                            bplusVisualizer.reset();
+                            redBlackVisualizer.reset();
+                            treapVisualizer.reset();
                         } else {
                             showBSTVisualization = false;
                             showAVLVisualization = false;
@@ -1303,70 +10813,100 @@ public:
                             queueVisualizer.reset();
                             stackVisualizer.reset();
                             graphVisualizer.reset();
+                            sortVisualizer.reset();
+                            hashVisualizer.reset();
+                            skipListVisualizer.reset();
+                            rangeVisualizer.reset();
+                            cacheVisualizer.reset();
+                            filterVisualizer.reset();
                         }
                         resetInputBox(); // Reset input box when going back to the main page
                     } else if (inputBox.getGlobalBounds().contains(mousePos)) {
                         isInputActive = true;
                     } else if (resetButton.isClicked(mousePos)) {
-                        if (showBSTVisualization) bstVisualizer.reset();
-                        if (showAVLVisualization) avlVisualizer.reset();
-                        if (showTrieVisualization) trieVisualizer.reset();
-                        if (currentAlgorithm == "Queues") queueVisualizer.reset();
-                        if (currentAlgorithm == "Stacks") stackVisualizer.reset();
-                        if (showGraphVisualization) graphVisualizer.reset();
+                        if (currentStructure() != Operation::STRUCTURE_COUNT) perform({currentStructure(), Operation::Reset});
                         resetInputBox(); // Reset input box when resetting the visualization
                     } else if (addNodeButton.isClicked(mousePos) && showGraphVisualization) {
-                        std::stringstream ss(userInput);
-                        int value;
-                        while (ss >> value) graphVisualizer.addNode(value);
-                        userInput.clear();
-                        inputText.setString("");
-                    } else if (addEdgeButton.isClicked(mousePos) && showGraphVisualization) {
-                        std::stringstream ss(userInput);
-                        int start, end;
-                        while (ss >> start >> end) graphVisualizer.addEdge(start, end);
-                        userInput.clear();
-                        inputText.setString("");
-                    } else if (searchButton.isClicked(mousePos)) { // Handle Search button click
-                        if (showBSTVisualization) {
-                            int value;
-                            std::stringstream ss(userInput);
-                            if (ss >> value) {
-                                bstVisualizer.search(value);
-                            }
-                        } else if (showAVLVisualization) {
-                            int value;
-                            std::stringstream ss(userInput);
-                            if (ss >> value) {
-                                avlVisualizer.search(value);
-                            }
-                        } else if (showTrieVisualization) {
-                            std::string word;
-                            std::stringstream ss(userInput);
-                            if (ss >> word) {
-                                trieVisualizer.search(word);
-                            }
-                        } else if (currentAlgorithm == "Queues") {
-                            int value;
-                            std::stringstream ss(userInput);
-                            if (ss >> value) {
-                                queueVisualizer.search(value);
-                            }
-                        } else if (currentAlgorithm == "Stacks") {
-                            int value;
-                            std::stringstream ss(userInput);
-                            if (ss >> value) {
-                                stackVisualizer.search(value);
-                            }
-                        } else if (showGraphVisualization) {
-                            int value;
-                            std::stringstream ss(userInput);
-                            if (ss >> value) {
-                                graphVisualizer.search(value);
-                            }
+                        perform({Operation::Graph, Operation::Insert, inputValues()});
+                        clearInput();
+                    } else if (removeButton.isClicked(mousePos) && (currentAlgorithm == "Queues" || currentAlgorithm == "Stacks" || showHeapVisualization)) {
+                        perform({currentStructure(), Operation::Remove});
+                    } else if (removeButton.isClicked(mousePos) && (currentAlgorithm == "Hash Tables" || currentAlgorithm == "Skip Lists" || currentAlgorithm == "Filters")) {
+                        perform({currentStructure(), Operation::Remove, inputValues()});
+                        clearInput();
+                    } else if (decreaseButton.isClicked(mousePos) && showHeapVisualization) {
+                        perform({Operation::Heap, Operation::Update, inputValues()});
+                        clearInput();
+                    } else if (arityButton.isClicked(mousePos) && showHeapVisualization) {
+                        perform({Operation::Heap, Operation::Mode, {heapVisualizer.arity == 2 ? 4 : 2}});
+                    } else if (nodeSizeButton.isClicked(mousePos) && showBPlusVisualization) {
+                        perform({Operation::BPlus, Operation::Mode, {bplusVisualizer.nextNodeBytes()}});
+                    } else if (compareButton.isClicked(mousePos) && showBPlusVisualization) {
+                        perform({Operation::BPlus, Operation::Run});
+                    } else if (compareButton.isClicked(mousePos) && (showRedBlackVisualization || showTreapVisualization)) {
+                        perform({currentStructure(), Operation::Run, inputValues()});
+                        clearInput();
+                    } else if (simulateButton.isClicked(mousePos) && currentAlgorithm == "Queues") {
+                        if (queueVisualizer.simulation.isRunning()) {
+                            queueVisualizer.stopSimulation();
+                        } else {
+                            queueVisualizer.startSimulation(userInput);
+                            clearInput();
+                        }
+                    } else if (simulateButton.isClicked(mousePos) && currentAlgorithm == "Skip Lists") {
+                        if (skipListVisualizer.simulation.isRunning()) {
+                            skipListVisualizer.stopSimulation();
+                        } else {
+                            skipListVisualizer.startSimulation(userInput);
+                            clearInput();
+                        }
+                    } else if (rangeAddButton.isClicked(mousePos) && currentAlgorithm == "Range Queries") {
+                        perform({Operation::Range, Operation::Update, inputValues()});
+                        clearInput();
+                    } else if (batchButton.isClicked(mousePos) && currentAlgorithm == "Range Queries") {
+                        perform({Operation::Range, Operation::Run, inputValues()});
+                        clearInput();
+                    } else if (zipfButton.isClicked(mousePos) && currentAlgorithm == "Caches") {
+                        // An empty input gives the default trace, not the rest of the old one
+                        std::vector<int> values = inputValues();
+                        if (values.empty()) values.push_back(CacheVisualizer::DEFAULT_ZIPF);
+                        perform({Operation::Cache, Operation::Run, values});
+                        clearInput();
+                    } else if (capacityButton.isClicked(mousePos) && currentAlgorithm == "Caches") {
+                        int capacity;
+                        if (parseFirstInt(userInput, capacity)) perform({Operation::Cache, Operation::Mode, {capacity}});
+                        clearInput();
+                    } else if (simulateButton.isClicked(mousePos) && currentAlgorithm == "Caches") {
+                        cacheVisualizer.togglePlaying();
+                    } else if (fillButton.isClicked(mousePos) && currentAlgorithm == "Filters") {
+                        perform({Operation::Filter, Operation::Run, inputValues()});
+                        clearInput();
+                    } else if (bitsButton.isClicked(mousePos) && currentAlgorithm == "Filters") {
+                        int bits;
+                        if (parseFirstInt(userInput, bits)) perform({Operation::Filter, Operation::Mode, {bits}});
+                        clearInput();
+                    } else if (addEdgeButton.isClicked(mousePos) && showGraphVisualization) {
+                        perform({Operation::Graph, Operation::Edge, inputValues()});
+                        clearInput();
+                    } else if (currentAlgorithm == "Algorithms" && sortButtonAt(mousePos) >= 0) {
+                        perform({Operation::Sort, Operation::Run, {sortButtonAt(mousePos)}});
+                    } else if (searchButton.isClicked(mousePos) && currentAlgorithm != "Algorithms") { // Handle Search button click
+                        Operation search{currentStructure(), Operation::Search};
+                        int value;
+                        if (search.structure == Operation::Trie) {
+                            parseWords(userInput, search.words);
+                            if (!search.words.empty()) search.words.resize(1);
+                        } else if (search.structure == Operation::BPlus || search.structure == Operation::Range) {
+                            // Two numbers are a range
+                            parseInts(userInput, search.values);
+                            if (search.values.size() > 2) search.values.resize(2);
+                        } else if (parseFirstInt(userInput, value)) {
+                            search.values.push_back(value);
                         }
-                        userInput.clear();
-                        inputText.setString("");
+                        if (search.structure != Operation::STRUCTURE_COUNT && !(search.values.empty() && search.words.empty())) {
+                            perform(search);
+                        }
+                        clearInput();
                     } else {
                         isInputActive = false;
                     }
@@ -1377,6 +10917,62 @@ public:
                 }
             }
 
+            // Right-drag pans the graph camera
+            if (event.type == sf::Event::MouseButtonPressed && event.mouseButton.button == sf::Mouse::Right && showGraphVisualization) {
+                graphVisualizer.startPan(window.mapPixelToCoords({event.mouseButton.x, event.mouseButton.y}));
+            }
+
+            if (event.type == sf::Event::MouseButtonReleased && event.mouseButton.button == sf::Mouse::Right) {
+                graphVisualizer.stopPan();
+            }
+
+            if (event.type == sf::Event::MouseButtonPressed && event.mouseButton.button == sf::Mouse::Left && currentAlgorithm == "Stacks" && !showMainPage) {
+                stackVisualizer.handleMinimap(window.mapPixelToCoords({event.mouseButton.x, event.mouseButton.y}), true);
+            }
+
+            if (event.type == sf::Event::MouseButtonReleased && event.mouseButton.button == sf::Mouse::Left) {
+                stackVisualizer.stopMinimapDrag();
+            }
+
+            // Pressing or dragging on the timeline shows that version of the tree
+            if (event.type == sf::Event::MouseButtonPressed && event.mouseButton.button == sf::Mouse::Left) {
+                TimelineSlider* timeline;
+                auto snapshot = treeSnapshot(timeline);
+                sf::Vector2f mousePos = window.mapPixelToCoords({event.mouseButton.x, event.mouseButton.y});
+                if (snapshot && snapshot->versionCount > 1 && timeline->contains(mousePos)) {
+                    timeline->isDragging = true;
+                    scrubTarget = snapshot->version;
+                    scrubTo(timeline->versionAt(mousePos.x, *snapshot));
+                }
+            }
+
+            if (event.type == sf::Event::MouseButtonReleased && event.mouseButton.button == sf::Mouse::Left) {
+                bstVisualizer.timeline.isDragging = false;
+                avlVisualizer.timeline.isDragging = false;
+                redBlackVisualizer.timeline.isDragging = false;
+                treapVisualizer.timeline.isDragging = false;
+            }
+
+            if (event.type == sf::Event::MouseMoved) {
+                TimelineSlider* timeline;
+                auto snapshot = treeSnapshot(timeline);
+                if (snapshot && timeline->isDragging) {
+                    scrubTo(timeline->versionAt(window.mapPixelToCoords({event.mouseMove.x, event.mouseMove.y}).x, *snapshot));
+                }
+            }
+
+            // Ctrl+Z and Ctrl+Y step back and forward through the tree's versions
+            if (event.type == sf::Event::KeyPressed && event.key.control
+                && (event.key.code == sf::Keyboard::Z || event.key.code == sf::Keyboard::Y)) {
+                TimelineSlider* timeline;
+                auto snapshot = treeSnapshot(timeline);
+                if (snapshot) {
+                    scrubTarget = snapshot->version;
+                    if (event.key.code == sf::Keyboard::Z && snapshot->version > 0) scrubTo(snapshot->version - 1);
+                    if (event.key.code == sf::Keyboard::Y && snapshot->version + 1 < snapshot->versionCount) scrubTo(snapshot->version + 1);
+                }
+            }
+
             if (event.type == sf::Event::MouseMoved) {
                 sf::Vector2f mousePos = window.mapPixelToCoords({event.mouseMove.x, event.mouseMove.y});
 
@@ -1389,50 +10985,118 @@ public:
                     for (auto& button : treeButtons) {
                         button.isHovered = button.isClicked(mousePos);
                     }
-                } else if (showBSTVisualization || showAVLVisualization || showTrieVisualization || currentAlgorithm == "Queues" || currentAlgorithm == "Stacks" || showGraphVisualization) {
+                } else if (showBSTVisualization || showAVLVisualization || showTrieVisualization || showHeapVisualization || showBPlusVisualization || showRedBlackVisualization || showTreapVisualization || currentAlgorithm == "Queues" || currentAlgorithm == "Stacks" || currentAlgorithm == "Algorithms" || currentAlgorithm == "Hash Tables" || currentAlgorithm == "Skip Lists" || currentAlgorithm == "Range Queries" || currentAlgorithm == "Caches" || currentAlgorithm == "Filters" || showGraphVisualization) {
                     backButton.isHovered = backButton.isClicked(mousePos);
                     resetButton.isHovered = resetButton.isClicked(mousePos);
                     if (showGraphVisualization) {
                         addNodeButton.isHovered = addNodeButton.isClicked(mousePos);
                         addEdgeButton.isHovered = addEdgeButton.isClicked(mousePos);
                     }
+                    if (currentAlgorithm == "Queues" || currentAlgorithm == "Stacks" || currentAlgorithm == "Hash Tables" || currentAlgorithm == "Skip Lists" || currentAlgorithm == "Filters" || showHeapVisualization) {
+                        removeButton.isHovered = removeButton.isClicked(mousePos);
+                    }
+                    if (showHeapVisualization) {
+                        decreaseButton.isHovered = decreaseButton.isClicked(mousePos);
+                        arityButton.isHovered = arityButton.isClicked(mousePos);
+                    }
+                    if (showBPlusVisualization) {
+                        nodeSizeButton.isHovered = nodeSizeButton.isClicked(mousePos);
+                        compareButton.isHovered = compareButton.isClicked(mousePos);
+                    }
+                    if (showRedBlackVisualization || showTreapVisualization) {
+                        compareButton.isHovered = compareButton.isClicked(mousePos);
+                    }
+                    if (currentAlgorithm == "Queues" || currentAlgorithm == "Skip Lists" || currentAlgorithm == "Caches") {
+                        simulateButton.isHovered = simulateButton.isClicked(mousePos);
+                    }
+                    if (currentAlgorithm == "Range Queries") {
+                        rangeAddButton.isHovered = rangeAddButton.isClicked(mousePos);
+                        batchButton.isHovered = batchButton.isClicked(mousePos);
+                    }
+                    if (currentAlgorithm == "Caches") {
+                        zipfButton.isHovered = zipfButton.isClicked(mousePos);
+                        capacityButton.isHovered = capacityButton.isClicked(mousePos);
+                    }
+                    if (currentAlgorithm == "Filters") {
+                        fillButton.isHovered = fillButton.isClicked(mousePos);
+                        bitsButton.isHovered = bitsButton.isClicked(mousePos);
+                    }
+                    if (currentAlgorithm == "Algorithms") {
+                        for (auto& button : sortButtons) button.isHovered = button.isClicked(mousePos);
+                    }
                     searchButton.isHovered = searchButton.isClicked(mousePos);
                 }
+
+                if (showGraphVisualization) {
+                    graphVisualizer.pan(mousePos);
+                }
+
+                if (currentAlgorithm == "Stacks") {
+                    stackVisualizer.handleMinimap(mousePos, false);
+                }
             }
 
             if (event.type == sf::Event::TextEntered && isInputActive) {
                 if (event.text.unicode == '\b' && !userInput.empty()) {
                     userInput.pop_back();
-                } else if (event.text.unicode >= '0' && event.text.unicode <= '9' || event.text.unicode == ' ' ||
+                } else if (event.text.unicode >= '0' && event.text.unicode <= '9' || event.text.unicode == ' ' || event.text.unicode == '-' ||
                            (event.text.unicode >= 'a' && event.text.unicode <= 'z') ||
                            (event.text.unicode >= 'A' && event.text.unicode <= 'Z')) {
                     userInput += static_cast<char>(event.text.unicode);
                 }
-                inputText.setString(userInput);
+                inputPreviewDirty = true;
+            }
+
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F3) {
+                showProfiler = !showProfiler;
+            }
+
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F6) {
+                if (journal.isRecording()) journal.stopRecording();
+                else journal.startRecording("journal.bin");
+            }
+
+            // Ctrl+S and Ctrl+O save and reopen the current structure as <structure>.dsv
+            if (event.type == sf::Event::KeyPressed && event.key.control
+                && (event.key.code == sf::Keyboard::S || event.key.code == sf::Keyboard::O)) {
+                Operation snapshot{currentStructure(), event.key.code == sf::Keyboard::S ? Operation::Save : Operation::Load};
+                if (snapshot.structure != Operation::STRUCTURE_COUNT) {
+                    // The cache page saves and loads its access trace instead
+                    if (snapshot.structure == Operation::Cache) snapshot.words.push_back("cache.trace");
+                    else snapshot.words.push_back(std::string(Operation::structureName(snapshot.structure)) + ".dsv");
+                    perform(snapshot);
+                }
+            }
+
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Right && replayStepwise
+                && replayNext < replayEntries.size() && !isInputActive) {
+                replayOne();
+            }
+
+            // F4 starts a trace; pressing it again writes trace.json
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F4) {
+                Tracer& tracer = Tracer::shared();
+                if (Tracer::enabled()) {
+                    tracer.stop();
+                    tracer.writeChromeTrace("trace.json");
+                } else {
+                    tracer.start();
+                }
             }
 
             if (event.type == sf::Event::KeyPressed && isInputActive) {
-                if (event.key.code == sf::Keyboard::Enter) {
-                    std::stringstream ss(userInput);
-                    std::string word;
-                    if (showBSTVisualization) {
-                        int value;
-                        while (ss >> value) bstVisualizer.insert(value);
-                        bstVisualizer.isAnimating = true;
-                    } else if (showAVLVisualization) {
-                        int value;
-                        while (ss >> value) avlVisualizer.insert(value);
-                    } else if (showTrieVisualization) {
-                        while (ss >> word) trieVisualizer.insert(word);
-                    } else if (currentAlgorithm == "Queues") {
-                        int value;
-                        while (ss >> value) queueVisualizer.enqueue(value);
-                    } else if (currentAlgorithm == "Stacks") {
-                        int value;
-                        while (ss >> value) stackVisualizer.push(value);
-                    }
-                    userInput.clear();
-                    inputText.setString("");
+                if (event.key.code == sf::Keyboard::V && event.key.control) {
+                    pasteClipboard();
+                } else if (event.key.code == sf::Keyboard::Enter) {
+                    Operation insert{currentStructure(), Operation::Insert};
+                    if (insert.structure == Operation::Trie) parseWords(userInput, insert.words);
+                    else if (insert.structure == Operation::Sort && userInput.find("random") != std::string::npos) insert.values = randomValues();
+                    else if (insert.structure == Operation::Hash && userInput.find("random") != std::string::npos) insert.values = randomValues(std::numeric_limits<int>::max(), HashTableVisualizer::MAX_RANDOM);
+                    else if (insert.structure == Operation::Range && userInput.find("random") != std::string::npos) insert.values = randomValues();
+                    else insert.values = inputValues();
+                    // The graph takes nodes through its Add Node button only
+                    if (insert.structure != Operation::STRUCTURE_COUNT && insert.structure != Operation::Graph) perform(insert);
+                    clearInput();
                 }
             }
 
@@ -1446,19 +11110,58 @@ public:
                 }
                 trieVisualizer.updateScrollbar();
             }
+
+            if (event.type == sf::Event::MouseWheelScrolled && currentAlgorithm == "Stacks" && !showMainPage) {
+                stackVisualizer.scroll(event.mouseWheelScroll.delta);
+            }
+
+            if (event.type == sf::Event::MouseWheelScrolled && currentAlgorithm == "Queues" && !showMainPage) {
+                queueVisualizer.scroll(event.mouseWheelScroll.delta);
+            }
+
+            if (event.type == sf::Event::MouseWheelScrolled && showGraphVisualization) {
+                sf::Vector2f mousePos = window.mapPixelToCoords({event.mouseWheelScroll.x, event.mouseWheelScroll.y});
+                graphVisualizer.zoomAt(mousePos, event.mouseWheelScroll.delta > 0 ? 1.25f : 0.8f);
+            }
         }
     }
 
     void update() {
-        if (bstVisualizer.isAnimating) {
-            bstVisualizer.updateAnimation();
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        if (animationClock.getElapsedTime() >= sf::milliseconds(300)) {
+            bstVisualizer.tick();
+            avlVisualizer.tick();
+            redBlackVisualizer.tick();
+            treapVisualizer.tick();
+            animationClock.restart();
         }
 
         if (showTrieVisualization) {
             trieVisualizer.updateScrollbar();
         }
 
+        if (currentAlgorithm == "Algorithms" && !showMainPage) {
+            sortVisualizer.update();
+        }
+
+        if (currentAlgorithm == "Hash Tables" && !showMainPage) {
+            hashVisualizer.update();
+        }
+
+        if (currentAlgorithm == "Skip Lists" && !showMainPage) {
+            skipListVisualizer.update();
+        }
+
+        if (currentAlgorithm == "Caches" && !showMainPage) {
+            cacheVisualizer.update();
+        }
+
+        if (currentAlgorithm == "Filters" && !showMainPage) {
+            filterVisualizer.update();
+        }
+
+        updateInputPreview();
+        updateReplay();
+
         // Update cursor visibility
         if (cursorClock.getElapsedTime() >= cursorBlinkInterval && isInputActive) {
             cursorVisible = !cursorVisible;
@@ -1536,6 +11239,68 @@ public:
             backButton.draw(window);
             resetButton.draw(window);
             searchButton.draw(window); // Draw the Search button
+        } else if (showHeapVisualization) {
+            sf::Text algorithmTitle;
+            algorithmTitle.setFont(font);
+            algorithmTitle.setString("Heap Visualization");
+            algorithmTitle.setCharacterSize(30);
+            algorithmTitle.setFillColor(sf::Color::White);
+            algorithmTitle.setPosition(680, 100);
+            window.draw(algorithmTitle);
+
+            window.draw(inputBox);
+            window.draw(inputText);
+
+            heapVisualizer.draw(window);
+
+            backButton.draw(window);
+            resetButton.draw(window);
+            removeButton.draw(window);
+            decreaseButton.draw(window);
+            arityButton.text.setString(heapVisualizer.arity == 2 ? "4-ary" : "Binary");
+            arityButton.draw(window);
+            searchButton.draw(window); // Draw the Search button
+        } else if (showBPlusVisualization) {
+            sf::Text algorithmTitle;
+            algorithmTitle.setFont(font);
+            algorithmTitle.setString("B+ Tree Visualization");
+            algorithmTitle.setCharacterSize(30);
+            algorithmTitle.setFillColor(sf::Color::White);
+            algorithmTitle.setPosition(680, 100);
+            window.draw(algorithmTitle);
+
+            window.draw(inputBox);
+            window.draw(inputText);
+
+            bplusVisualizer.draw(window);
+
+            backButton.draw(window);
+            resetButton.draw(window);
+            nodeSizeButton.text.setString(std::to_string(bplusVisualizer.nextNodeBytes()) + " B");
+            nodeSizeButton.draw(window);
+            compareButton.text.setString("vs AVL");
+            compareButton.draw(window);
+            searchButton.draw(window); // Draw the Search button
+        } else if (showRedBlackVisualization || showTreapVisualization) {
+            sf::Text algorithmTitle;
+            algorithmTitle.setFont(font);
+            algorithmTitle.setString(showRedBlackVisualization ? "Red-Black Tree Visualization" : "Treap Visualization");
+            algorithmTitle.setCharacterSize(30);
+            algorithmTitle.setFillColor(sf::Color::White);
+            algorithmTitle.setPosition(680, 100);
+            window.draw(algorithmTitle);
+
+            window.draw(inputBox);
+            window.draw(inputText);
+
+            if (showRedBlackVisualization) redBlackVisualizer.draw(window);
+            else treapVisualizer.draw(window);
+
+            backButton.draw(window);
+            resetButton.draw(window);
+            compareButton.text.setString("Compare");
+            compareButton.draw(window);
+            searchButton.draw(window); // Draw the Search button
         } else if (currentAlgorithm == "Queues") {
             sf::Text algorithmTitle;
             algorithmTitle.setFont(font);
@@ -1552,6 +11317,9 @@ public:
 
             backButton.draw(window);
             resetButton.draw(window);
+            removeButton.draw(window);
+            simulateButton.text.setString(queueVisualizer.simulation.isRunning() ? "Stop" : "Simulate");
+            simulateButton.draw(window);
             searchButton.draw(window); // Draw the Search button
         } else if (currentAlgorithm == "Stacks") {
             sf::Text algorithmTitle;
@@ -1569,6 +11337,7 @@ public:
 
             backButton.draw(window);
             resetButton.draw(window);
+            removeButton.draw(window);
             searchButton.draw(window); // Draw the Search button
         } else if (showGraphVisualization) {
             sf::Text algorithmTitle;
@@ -1591,6 +11360,121 @@ public:
 
             backButton.draw(window);
             resetButton.draw(window);
+        } else if (currentAlgorithm == "Algorithms") {
+            sf::Text algorithmTitle;
+            algorithmTitle.setFont(font);
+            algorithmTitle.setString("Sorting Algorithms");
+            algorithmTitle.setCharacterSize(30);
+            algorithmTitle.setFillColor(sf::Color::White);
+            algorithmTitle.setPosition(680, 100);
+            window.draw(algorithmTitle);
+
+            window.draw(inputBox);
+            window.draw(inputText);
+
+            sortVisualizer.draw(window);
+
+            backButton.draw(window);
+            resetButton.draw(window);
+            for (auto& button : sortButtons) button.draw(window);
+        } else if (currentAlgorithm == "Hash Tables") {
+            sf::Text algorithmTitle;
+            algorithmTitle.setFont(font);
+            algorithmTitle.setString("Hash Tables");
+            algorithmTitle.setCharacterSize(30);
+            algorithmTitle.setFillColor(sf::Color::White);
+            algorithmTitle.setPosition(680, 100);
+            window.draw(algorithmTitle);
+
+            window.draw(inputBox);
+            window.draw(inputText);
+
+            hashVisualizer.draw(window);
+
+            backButton.draw(window);
+            resetButton.draw(window);
+            removeButton.draw(window);
+            searchButton.draw(window); // Draw the Search button
+        } else if (currentAlgorithm == "Skip Lists") {
+            sf::Text algorithmTitle;
+            algorithmTitle.setFont(font);
+            algorithmTitle.setString("Concurrent Skip List");
+            algorithmTitle.setCharacterSize(30);
+            algorithmTitle.setFillColor(sf::Color::White);
+            algorithmTitle.setPosition(680, 100);
+            window.draw(algorithmTitle);
+
+            window.draw(inputBox);
+            window.draw(inputText);
+
+            skipListVisualizer.draw(window);
+
+            backButton.draw(window);
+            resetButton.draw(window);
+            removeButton.draw(window);
+            simulateButton.text.setString(skipListVisualizer.simulation.isRunning() ? "Stop" : "Simulate");
+            simulateButton.draw(window);
+            searchButton.draw(window); // Draw the Search button
+        } else if (currentAlgorithm == "Range Queries") {
+            sf::Text algorithmTitle;
+            algorithmTitle.setFont(font);
+            algorithmTitle.setString("Segment and Fenwick Trees");
+            algorithmTitle.setCharacterSize(30);
+            algorithmTitle.setFillColor(sf::Color::White);
+            algorithmTitle.setPosition(680, 100);
+            window.draw(algorithmTitle);
+
+            window.draw(inputBox);
+            window.draw(inputText);
+
+            rangeVisualizer.draw(window);
+
+            backButton.draw(window);
+            resetButton.draw(window);
+            rangeAddButton.draw(window);
+            batchButton.draw(window);
+            searchButton.draw(window); // Draw the Search button
+        } else if (currentAlgorithm == "Caches") {
+            sf::Text algorithmTitle;
+            algorithmTitle.setFont(font);
+            algorithmTitle.setString("Cache Replacement");
+            algorithmTitle.setCharacterSize(30);
+            algorithmTitle.setFillColor(sf::Color::White);
+            algorithmTitle.setPosition(680, 100);
+            window.draw(algorithmTitle);
+
+            window.draw(inputBox);
+            window.draw(inputText);
+
+            cacheVisualizer.draw(window);
+
+            backButton.draw(window);
+            resetButton.draw(window);
+            zipfButton.draw(window);
+            simulateButton.text.setString(cacheVisualizer.playing ? "Pause" : "Play");
+            simulateButton.draw(window);
+            capacityButton.draw(window);
+            searchButton.draw(window); // Draw the Search button
+        } else if (currentAlgorithm == "Filters") {
+            sf::Text algorithmTitle;
+            algorithmTitle.setFont(font);
+            algorithmTitle.setString("Bloom and Cuckoo Filters");
+            algorithmTitle.setCharacterSize(30);
+            algorithmTitle.setFillColor(sf::Color::White);
+            algorithmTitle.setPosition(680, 100);
+            window.draw(algorithmTitle);
+
+            window.draw(inputBox);
+            window.draw(inputText);
+
+            filterVisualizer.draw(window);
+
+            backButton.draw(window);
+            resetButton.draw(window);
+            removeButton.draw(window);
+            fillButton.draw(window);
+            bitsButton.draw(window);
+            searchButton.draw(window); // Draw the Search button
         } else {
             sf::Text algorithmTitle;
             algorithmTitle.setFont(font);
@@ -1637,14 +11521,322 @@ public:
             window.draw(cursor);
         }
 
+        drawReplayStatus();
+
+        if (showProfiler) {
+            drawProfiler();
+        }
+
         window.display();
     }
 };
 
-int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
-    ShowWindow(GetConsoleWindow(), SW_HIDE);
-    Visualizer visualizer;
-    visualizer.run();
-    return 0;
+// Scripted batch mode: runs operations against the visualizers without a window and
+// renders frames into an offscreen texture. One command per line, "#" starts a comment:
+//   bst|avl|trie|queue|stack|graph|sort|heap|hash|bplus|skiplist|range|cache|filter|redblack|treap
+//                                      switch the structure that frames render
+//   insert <values>                    push, enqueue, add graph nodes, insert words
+//   edge <a b>...                      graph only
+//   remove [values]                    dequeue, pop, pop-min on the heap, or erase keys (hash, skiplist, filter)
+//   update <index> <key>               heap decrease-key, or range: update <l> <r> <delta>
+//   mode 2|4                           heap arity, B+tree node bytes (64|256|1024|4096), cache capacity
+//                                      or Bloom filter bits per key
+//   run                                B+tree: compare with an AVL tree on the same keys
+//   run <queries> [threads]            range: time random range sums on both trees
+//   run [count keys [skew%]]           cache: new Zipf trace, or replay the rest of the trace
+//   run [count [bits per key]]         filter: size both filters and fill them, one step per frame
+//   run [count]                        redblack, treap: compare AVL, red-black and treap on count keys
+//   search <value> | reset             range: search <l> <r>
+//   frames <count>                     render the current structure count times
+class HeadlessRunner {
+public:
+    BSTVisualizer bstVisualizer;
+    AVLVisualizer avlVisualizer;
+    TrieVisualizer trieVisualizer;
+    QueueVisualizer queueVisualizer;
+    StackVisualizer stackVisualizer;
+    GraphVisualizer graphVisualizer;
+    SortVisualizer sortVisualizer;
+    HeapVisualizer heapVisualizer;
+    HashTableVisualizer hashVisualizer;
+    BPlusTreeVisualizer bplusVisualizer;
+    SkipListVisualizer skipListVisualizer;
+    RangeTreeVisualizer rangeVisualizer;
+    CacheVisualizer cacheVisualizer;
+    FilterVisualizer filterVisualizer;
+    BalancedTreeVisualizer<RedBlackTree> redBlackVisualizer;
+    BalancedTreeVisualizer<Treap> treapVisualizer;
+
+    sf::RenderTexture target;
+    std::string structure = "bst";
+    std::string frameDirectory;       // PNGs are written here when set
+    int frameNumber = 0;
+    std::vector<double> frameTimes;
+
+    bool create(unsigned int width, unsigned int height) {
+        if (!target.create(width, height)) {
+            std::cerr << "Error creating " << width << "x" << height << " render texture!" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool run(std::istream& script) {
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(script, line)) {
+            ++lineNumber;
+            std::string command = line.substr(0, line.find('#'));
+            std::istringstream words(command);
+            std::string op;
+            if (!(words >> op)) continue;
+            std::string rest;
+            std::getline(words, rest);
+
+            auto start = std::chrono::steady_clock::now();
+            if (!execute(op, rest)) {
+                std::cerr << "Line " << lineNumber << ": unknown command '" << op << "' for " << structure << std::endl;
+                return false;
+            }
+            settle();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (op != "frames" && op != structure) std::cout << structure << " " << op << " " << ms << " ms" << std::endl;
+        }
+        printFrameStats();
+        return true;
+    }
+
+private:
+    bool execute(const std::string& command, const std::string& rest) {
+        int structureIndex = 0;
+        while (structureIndex < Operation::STRUCTURE_COUNT && command != Operation::structureName(static_cast<Operation::Structure>(structureIndex))) ++structureIndex;
+        if (structureIndex < Operation::STRUCTURE_COUNT) {
+            structure = command;
+            return true;
+        }
+        if (command == "frames") {
+            int count = std::max(1, std::atoi(rest.c_str()));
+            for (int i = 0; i < count; ++i) renderFrame();
+            return true;
+        }
+
+        Operation op;
+        structureIndex = 0;
+        while (structure != Operation::structureName(static_cast<Operation::Structure>(structureIndex))) ++structureIndex;
+        op.structure = static_cast<Operation::Structure>(structureIndex);
+        int type = 0;
+        while (type < Operation::TYPE_COUNT && command != Operation::typeName(static_cast<Operation::Type>(type))) ++type;
+        if (type == Operation::TYPE_COUNT) return false;
+        op.type = static_cast<Operation::Type>(type);
+        if (op.type == Operation::Save || op.type == Operation::Load) {
+            size_t first = rest.find_first_not_of(" \t");
+            size_t last = rest.find_last_not_of(" \t\r");
+            if (first == std::string::npos) return false;
+            op.words.push_back(rest.substr(first, last - first + 1));
+        } else if (op.structure == Operation::Trie) {
+            parseWords(rest, op.words);
+        } else if (op.type == Operation::Run) {
+            // "run quick" or "run 0"
+            std::vector<std::string> names;
+            parseWords(rest, names);
+            int algorithm = names.empty() ? -1 : sortAlgorithmIndex(names.front());
+            if (algorithm >= 0) op.values.push_back(algorithm);
+            else parseInts(rest, op.values);
+        } else {
+            parseInts(rest, op.values);
+        }
+        return applyOperation(*this, op);
+    }
+
+    // Frames and timings should see the result of every command before it
+    void settle() {
+        bstVisualizer.worker.waitIdle();
+        avlVisualizer.worker.waitIdle();
+        redBlackVisualizer.worker.waitIdle();
+        treapVisualizer.worker.waitIdle();
+    }
+
+public:
+    // Applies a journal as fast as possible with rendering off and reports throughput and
+    // latency per operation type. Tree operations include the worker's time to finish.
+    void replay(const std::vector<OperationJournal::Entry>& entries) {
+        struct Stats {
+            std::vector<double> latencies;   // microseconds
+            size_t elements = 0;
+        };
+        std::map<std::string, Stats> stats;
+        auto replayStart = std::chrono::steady_clock::now();
+        for (const OperationJournal::Entry& entry : entries) {
+            auto start = std::chrono::steady_clock::now();
+            applyOperation(*this, entry.op);
+            settle();
+            double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            Stats& s = stats[std::string(Operation::structureName(entry.op.structure)) + " " + Operation::typeName(entry.op.type)];
+            s.latencies.push_back(us);
+            s.elements += std::max<size_t>(1, entry.op.values.size() + entry.op.words.size());
+        }
+        double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - replayStart).count();
+
+        std::cout << std::fixed;
+        std::cout.precision(1);
+        std::cout << "operation        count      ops/s   elements/s   p50_us   p99_us   max_us" << std::endl;
+        for (auto& entry : stats) {
+            std::vector<double>& l = entry.second.latencies;
+            std::sort(l.begin(), l.end());
+            double sum = 0;
+            for (double us : l) sum += us;
+            auto at = [&l](double fraction) { return l[std::min(l.size() - 1, static_cast<size_t>(fraction * l.size()))]; };
+            std::cout << std::left << std::setw(15) << entry.first << std::right << std::setw(7) << l.size()
+                      << std::setw(11) << l.size() / (sum / 1e6) << std::setw(13) << entry.second.elements / (sum / 1e6)
+                      << std::setw(9) << at(0.5) << std::setw(9) << at(0.99) << std::setw(9) << l.back() << std::endl;
+        }
+        std::cout << entries.size() << " operations in " << total << " s" << std::endl;
+    }
+
+private:
+    void renderFrame() {
+        FrameProfiler& profiler = FrameProfiler::shared();
+        profiler.beginFrame();
+        auto start = std::chrono::steady_clock::now();
+        target.clear(sf::Color(50, 50, 50));
+        if (structure == "sort") sortVisualizer.update();   // playback moves on once per frame
+        if (structure == "cache") cacheVisualizer.update();
+        if (structure == "filter") filterVisualizer.update();
+        if (structure == "bst") bstVisualizer.draw(target);
+        else if (structure == "avl") avlVisualizer.draw(target);
+        else if (structure == "trie") trieVisualizer.draw(target);
+        else if (structure == "queue") queueVisualizer.draw(target);
+        else if (structure == "stack") stackVisualizer.draw(target);
+        else if (structure == "sort") sortVisualizer.draw(target);
+        else if (structure == "heap") heapVisualizer.draw(target);
+        else if (structure == "bplus") bplusVisualizer.draw(target);
+        else if (structure == "skiplist") skipListVisualizer.draw(target);
+        else if (structure == "range") rangeVisualizer.draw(target);
+        else if (structure == "cache") cacheVisualizer.draw(target);
+        else if (structure == "filter") filterVisualizer.draw(target);
+        else if (structure == "redblack") redBlackVisualizer.draw(target);
+        else if (structure == "treap") treapVisualizer.draw(target);
+        else if (structure == "hash") {
+            hashVisualizer.update();
+            hashVisualizer.draw(target);
+        }
+        else graphVisualizer.draw(target);
+        target.display();
+        frameTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        profiler.endFrame();
+
+        if (!frameDirectory.empty()) {
+            std::ostringstream name;
+            name << frameDirectory << "/frame_" << std::setw(5) << std::setfill('0') << frameNumber << ".png";
+            if (!target.getTexture().copyToImage().saveToFile(name.str())) {
+                std::cerr << "Error writing " << name.str() << std::endl;
+            }
+        }
+        ++frameNumber;
+    }
+
+    void printFrameStats() {
+        if (frameTimes.empty()) return;
+        std::vector<double> sorted = frameTimes;
+        std::sort(sorted.begin(), sorted.end());
+        auto at = [&sorted](double fraction) { return sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))]; };
+        FrameProfiler& profiler = FrameProfiler::shared();
+        std::cout << "frames " << sorted.size() << "  ms p50 " << at(0.5) << "  p95 " << at(0.95) << "  p99 " << at(0.99)
+                  << "  max " << sorted.back() << "  last frame draw calls " << profiler.getDrawCalls()
+                  << "  vertices " << profiler.getVertices() << std::endl;
+    }
+};
+
+// --script <file> [--frames <directory>] [--size <width>x<height>]
+inline int runScript(const std::vector<std::string>& args) {
+    std::string scriptPath;
+    HeadlessRunner runner;
+    unsigned int width = 1600, height = 900;
+    for (size_t i = 0; i + 1 < args.size(); ++i) {
+        if (args[i] == "--script") scriptPath = args[i + 1];
+        else if (args[i] == "--frames") runner.frameDirectory = args[i + 1];
+        else if (args[i] == "--size") std::sscanf(args[i + 1].c_str(), "%ux%u", &width, &height);
+    }
+
+    std::ifstream script(scriptPath);
+    if (!script) {
+        std::cerr << "Error opening script " << scriptPath << std::endl;
+        return 1;
+    }
+    if (!runner.create(width, height)) return 1;
+    return runner.run(script) ? 0 : 1;
+}
+
+// Value following a command-line option, or the fallback when it is absent
+inline std::string optionValue(const std::vector<std::string>& args, const std::string& name, const std::string& fallback = "") {
+    for (size_t i = 0; i + 1 < args.size(); ++i) {
+        if (args[i] == name) return args[i + 1];
+    }
+    return fallback;
+}
+
+// Shared by main and WinMain; the standard forbids calling main itself
+static int runApp(int argc, char** argv) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    bool trace = std::find(args.begin(), args.end(), "--trace") != args.end();
+    if (trace) Tracer::shared().start();   // records from launch, asset loading included
+
+    int result = 0;
+    if (!args.empty() && (args[0] == "--queue-bench" || args[0] == "--sort-bench" || args[0] == "--heap-bench" || args[0] == "--hash-bench" || args[0] == "--bptree-bench" || args[0] == "--skiplist-bench" || args[0] == "--range-bench" || args[0] == "--cache-bench" || args[0] == "--filter-bench" || args[0] == "--tree-bench")) {
+        std::istringstream options;
+        std::string joined;
+        for (size_t i = 1; i < args.size(); ++i) joined += args[i] + " ";
+        options.str(joined);
+        if (args[0] == "--queue-bench") result = runQueueBenchmark(options);
+        else if (args[0] == "--sort-bench") result = runSortBenchmark(options);
+        else if (args[0] == "--heap-bench") result = runHeapBenchmark(options);
+        else if (args[0] == "--hash-bench") result = runHashBenchmark(options);
+        else if (args[0] == "--bptree-bench") result = runBPlusTreeBenchmark(options);
+        else if (args[0] == "--skiplist-bench") result = runSkipListBenchmark(options);
+        else if (args[0] == "--range-bench") result = runRangeBenchmark(options);
+        else if (args[0] == "--cache-bench") result = runCacheBenchmark(options);
+        else if (args[0] == "--filter-bench") result = runFilterBenchmark(options);
+        else result = runTreeBenchmark(options);
+    } else if (std::find(args.begin(), args.end(), "--script") != args.end()) {
+        result = runScript(args);
+    } else {
+        // --replay <journal> [--replay-mode recorded|step|max]; "max" runs headless
+        std::vector<OperationJournal::Entry> replay;
+        std::string replayPath = optionValue(args, "--replay");
+        std::string replayMode = optionValue(args, "--replay-mode", "recorded");
+        if (!replayPath.empty() && !OperationJournal::load(replayPath, replay)) return 1;
+
+        if (!replayPath.empty() && replayMode == "max") {
+            HeadlessRunner runner;
+            runner.replay(replay);
+        } else {
+#ifdef _WIN32
+            ShowWindow(GetConsoleWindow(), SW_HIDE);
+#endif
+            Visualizer visualizer;
+            if (!replay.empty()) visualizer.startReplay(replay, replayMode == "step");
+            std::string recordPath = optionValue(args, "--record");
+            if (!recordPath.empty()) visualizer.journal.startRecording(recordPath);
+            visualizer.run();
+        }
+    }
+
+    if (Tracer::enabled()) Tracer::shared().writeChromeTrace("trace.json");
+    return result;
+}
+
+int main(int argc, char** argv) {
+    return runApp(argc, argv);
 }
 
+#ifdef _WIN32
+// Entry point of the GUI-subsystem build; command-line modes report to the console
+// they were started from
+int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
+    if (__argc > 1 && (AttachConsole(ATTACH_PARENT_PROCESS) || AllocConsole())) {
+        freopen("CONOUT$", "w", stdout);
+        freopen("CONOUT$", "w", stderr);
+    }
+    return runApp(__argc, __argv);
+}
+#endif